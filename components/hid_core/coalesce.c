@@ -0,0 +1,193 @@
+#include "coalesce.h"
+#include <string.h>
+
+void coalesce_init(coalesce_t *c)
+{
+    memset(c, 0, sizeof(*c));
+}
+
+void coalesce_reset(coalesce_t *c)
+{
+    for (uint8_t i = 0; i < c->count; i++)
+    {
+        coalesce_slot_t *slot = &c->slots[i];
+        slot->pending = false;
+        memset(slot->sent, 0, sizeof(slot->sent));
+        memset(slot->delta, 0, sizeof(slot->delta));
+    }
+}
+
+static coalesce_slot_t *coalesce_find(coalesce_t *c, uint8_t report_id)
+{
+    for (uint8_t i = 0; i < c->count; i++)
+    {
+        if (c->slots[i].report_id == report_id)
+            return &c->slots[i];
+    }
+    return NULL;
+}
+
+bool coalesce_add(coalesce_t *c, uint8_t report_id, coalesce_kind_t kind)
+{
+    coalesce_slot_t *slot = coalesce_find(c, report_id);
+    if (slot == NULL)
+    {
+        if (c->count >= COALESCE_MAX_SLOTS)
+            return false;
+        slot = &c->slots[c->count++];
+        memset(slot, 0, sizeof(*slot));
+        slot->report_id = report_id;
+    }
+    slot->kind = kind;
+    return true;
+}
+
+static bool coalesce_has_delta(const coalesce_slot_t *slot)
+{
+    for (uint8_t i = 1; i < slot->len; i++)
+    {
+        if (slot->delta[i])
+            return true;
+    }
+    return false;
+}
+
+static coalesce_result_t coalesce_put_absolute(coalesce_t *c, coalesce_slot_t *slot, const uint8_t *data)
+{
+    if (!slot->pending)
+    {
+        if (memcmp(data, slot->sent, slot->len) == 0)
+        {
+            c->duplicates++;
+            return COALESCE_DUPLICATE;
+        }
+        memcpy(slot->next, data, slot->len);
+        return COALESCE_QUEUED;
+    }
+
+    // A byte that already differs from what the host has and changes again
+    // would swallow a tap or a release, so that report has to go out first
+    for (uint8_t i = 0; i < slot->len; i++)
+    {
+        if (slot->next[i] != slot->sent[i] && data[i] != slot->next[i])
+            return COALESCE_CONFLICT;
+    }
+    if (memcmp(data, slot->next, slot->len) == 0)
+    {
+        c->duplicates++;
+        return COALESCE_DUPLICATE;
+    }
+    memcpy(slot->next, data, slot->len);
+    c->merged++;
+    return COALESCE_MERGED;
+}
+
+static coalesce_result_t coalesce_put_relative(coalesce_t *c, coalesce_slot_t *slot, const uint8_t *data)
+{
+    // Button changes are ordered against motion, so they never merge with pending motion
+    if (slot->pending && data[0] != slot->next[0])
+        return COALESCE_CONFLICT;
+
+    bool moved = false;
+    for (uint8_t i = 1; i < slot->len; i++)
+    {
+        slot->delta[i] += (int8_t)data[i];
+        moved |= data[i] != 0;
+    }
+
+    if (slot->pending)
+    {
+        c->merged++;
+        return COALESCE_MERGED;
+    }
+    if (!moved && data[0] == slot->sent[0])
+    {
+        c->duplicates++;
+        return COALESCE_DUPLICATE;
+    }
+    slot->next[0] = data[0];
+    return COALESCE_QUEUED;
+}
+
+coalesce_result_t coalesce_put(coalesce_t *c, uint8_t report_id, const uint8_t *data, uint8_t len, int64_t now_us)
+{
+    if (len > COALESCE_REPORT_MAX)
+        return COALESCE_NO_SLOT;
+
+    coalesce_slot_t *slot = coalesce_find(c, report_id);
+    if (slot == NULL)
+    {
+        if (!coalesce_add(c, report_id, COALESCE_ABSOLUTE))
+            return COALESCE_NO_SLOT;
+        slot = coalesce_find(c, report_id);
+    }
+    if (slot->len != len)
+    {
+        if (slot->pending)
+            return COALESCE_CONFLICT;
+        slot->len = len;
+        memset(slot->sent, 0, sizeof(slot->sent));
+        memset(slot->delta, 0, sizeof(slot->delta));
+    }
+
+    coalesce_result_t result = slot->kind == COALESCE_RELATIVE
+                                   ? coalesce_put_relative(c, slot, data)
+                                   : coalesce_put_absolute(c, slot, data);
+    if (result == COALESCE_QUEUED)
+    {
+        slot->pending = true;
+        slot->first_us = now_us;
+    }
+    return result;
+}
+
+static int8_t coalesce_saturate(int32_t v)
+{
+    return v > 127 ? 127 : v < -127 ? -127 : (int8_t)v;
+}
+
+int coalesce_flush(coalesce_t *c, coalesce_emit_fn_t emit, void *ctx)
+{
+    int sent = 0;
+    for (uint8_t s = 0; s < c->count; s++)
+    {
+        coalesce_slot_t *slot = &c->slots[s];
+        if (!slot->pending)
+            continue;
+
+        if (slot->kind == COALESCE_ABSOLUTE)
+        {
+            if (!emit(slot->report_id, slot->next, slot->len, slot->first_us, ctx))
+                continue;
+            memcpy(slot->sent, slot->next, slot->len);
+            slot->pending = false;
+            sent++;
+            continue;
+        }
+
+        uint8_t out[COALESCE_REPORT_MAX];
+        out[0] = slot->next[0];
+        for (uint8_t i = 1; i < slot->len; i++)
+            out[i] = (uint8_t)coalesce_saturate(slot->delta[i]);
+        if (!emit(slot->report_id, out, slot->len, slot->first_us, ctx))
+            continue;
+
+        // Whatever did not fit in one report is carried into the next connection event
+        for (uint8_t i = 1; i < slot->len; i++)
+            slot->delta[i] -= (int8_t)out[i];
+        slot->sent[0] = out[0];
+        slot->pending = coalesce_has_delta(slot);
+        sent++;
+    }
+    return sent;
+}
+
+bool coalesce_pending(const coalesce_t *c)
+{
+    for (uint8_t i = 0; i < c->count; i++)
+    {
+        if (c->slots[i].pending)
+            return true;
+    }
+    return false;
+}
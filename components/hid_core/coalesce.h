@@ -0,0 +1,67 @@
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define COALESCE_MAX_SLOTS 4
+#define COALESCE_REPORT_MAX 16
+
+typedef enum
+{
+    COALESCE_ABSOLUTE, // report is a full state (keyboard, consumer), newest wins
+    COALESCE_RELATIVE, // byte 0 is a button state, the other bytes are int8 deltas (mouse)
+} coalesce_kind_t;
+
+typedef enum
+{
+    COALESCE_QUEUED,    // slot was idle, report is now pending
+    COALESCE_MERGED,    // folded into the pending report
+    COALESCE_DUPLICATE, // changes nothing the host has not already seen
+    COALESCE_CONFLICT,  // merging would hide a press or release, flush first
+    COALESCE_NO_SLOT,   // unknown report id and no free slot, send it directly
+} coalesce_result_t;
+
+typedef struct
+{
+    uint8_t report_id;
+    uint8_t len;
+    coalesce_kind_t kind;
+    bool pending;
+    int64_t first_us; // enqueue time of the oldest report folded into this one
+    uint8_t sent[COALESCE_REPORT_MAX];  // what the host last received
+    uint8_t next[COALESCE_REPORT_MAX];  // pending state; button byte only when relative
+    int32_t delta[COALESCE_REPORT_MAX]; // accumulated motion, relative only
+} coalesce_slot_t;
+
+// Keeps the latest state per report ID between connection events. Absolute
+// reports are replaced as long as no byte changes twice before being sent,
+// relative reports sum their deltas and send them saturated to +-127 with
+// the remainder carried over to the next connection event.
+typedef struct
+{
+    coalesce_slot_t slots[COALESCE_MAX_SLOTS];
+    uint8_t count;
+    uint32_t merged;
+    uint32_t duplicates;
+} coalesce_t;
+
+// Sends one report; return false to keep it pending for the next flush
+typedef bool (*coalesce_emit_fn_t)(uint8_t report_id, const uint8_t *data, uint8_t len, int64_t first_us, void *ctx);
+
+void coalesce_init(coalesce_t *c);
+
+// Drops pending reports and forgets what the host has seen, for a new link
+void coalesce_reset(coalesce_t *c);
+
+// Registers a report ID; unregistered IDs get an absolute slot on first use
+bool coalesce_add(coalesce_t *c, uint8_t report_id, coalesce_kind_t kind);
+
+coalesce_result_t coalesce_put(coalesce_t *c, uint8_t report_id, const uint8_t *data, uint8_t len, int64_t now_us);
+
+// Emits every pending report once, in slot order; returns the number sent
+int coalesce_flush(coalesce_t *c, coalesce_emit_fn_t emit, void *ctx);
+
+bool coalesce_pending(const coalesce_t *c);
+
+#endif
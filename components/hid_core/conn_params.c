@@ -0,0 +1,97 @@
+#include "conn_params.h"
+#include <string.h>
+
+const conn_params_t conn_policy_params[CONN_POLICY_COUNT] = {
+    [CONN_POLICY_FAST] = {.itvl_min = 6, .itvl_max = 12, .latency = 0, .supervision_timeout = 400},
+    [CONN_POLICY_IDLE] = {.itvl_min = 24, .itvl_max = 40, .latency = 4, .supervision_timeout = 500},
+};
+
+void conn_params_init(conn_params_mgr_t *m, const hal_ble_t *ble)
+{
+    memset(m, 0, sizeof(*m));
+    m->ble = *ble;
+}
+
+void conn_params_connected(conn_params_mgr_t *m, uint16_t conn_handle, const conn_params_t *granted, int64_t now_us)
+{
+    m->connected = true;
+    m->pending = false;
+    m->conn_handle = conn_handle;
+    m->granted = *granted;
+    m->policy = CONN_POLICY_FAST;
+    m->last_activity_us = now_us;
+    m->next_request_us = now_us + CONN_PARAMS_FIRST_REQUEST_US;
+}
+
+void conn_params_disconnected(conn_params_mgr_t *m)
+{
+    m->connected = false;
+    m->pending = false;
+}
+
+bool conn_params_satisfied(const conn_params_mgr_t *m)
+{
+    const conn_params_t *want = &conn_policy_params[m->policy];
+    return m->granted.itvl_min >= want->itvl_min && m->granted.itvl_min <= want->itvl_max &&
+           m->granted.latency == want->latency;
+}
+
+static void conn_params_maybe_request(conn_params_mgr_t *m, int64_t now_us)
+{
+    if (!m->connected || m->pending || now_us < m->next_request_us || conn_params_satisfied(m))
+        return;
+
+    const conn_params_t *want = &conn_policy_params[m->policy];
+    m->next_request_us = now_us + CONN_PARAMS_MIN_SPACING_US;
+    if (m->ble.update_params(m->ble.ctx, m->conn_handle, want) == 0)
+    {
+        m->pending = true;
+        m->requested = *want;
+        m->requests++;
+    }
+}
+
+void conn_params_updated(conn_params_mgr_t *m, int status, const conn_params_t *granted, int64_t now_us)
+{
+    m->pending = false;
+    m->granted = *granted;
+    if (status != 0 || !conn_params_satisfied(m))
+    {
+        // The host said no or picked something else; do not nag it
+        m->rejections++;
+        m->next_request_us = now_us + CONN_PARAMS_REJECT_BACKOFF_US;
+    }
+}
+
+void conn_params_activity(conn_params_mgr_t *m, int64_t now_us)
+{
+    m->last_activity_us = now_us;
+    if (m->policy != CONN_POLICY_FAST)
+    {
+        m->policy = CONN_POLICY_FAST;
+        // Coming back from idle is latency critical, skip the rejection backoff
+        if (m->next_request_us > now_us + CONN_PARAMS_MIN_SPACING_US)
+            m->next_request_us = now_us;
+    }
+    conn_params_maybe_request(m, now_us);
+}
+
+void conn_params_tick(conn_params_mgr_t *m, int64_t now_us)
+{
+    if (m->policy == CONN_POLICY_FAST && now_us - m->last_activity_us >= CONN_PARAMS_IDLE_TIMEOUT_US)
+        m->policy = CONN_POLICY_IDLE;
+    conn_params_maybe_request(m, now_us);
+}
+
+int64_t conn_params_next_deadline(const conn_params_mgr_t *m)
+{
+    if (!m->connected)
+        return CONN_PARAMS_NO_DEADLINE;
+
+    int64_t deadline = CONN_PARAMS_NO_DEADLINE;
+    if (!m->pending && !conn_params_satisfied(m))
+        deadline = m->next_request_us;
+    if (m->policy == CONN_POLICY_FAST && m->last_activity_us + CONN_PARAMS_IDLE_TIMEOUT_US < deadline)
+        deadline = m->last_activity_us + CONN_PARAMS_IDLE_TIMEOUT_US;
+    return deadline;
+}
@@ -0,0 +1,59 @@
+#ifndef CONN_PARAMS_H
+#define CONN_PARAMS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+
+// All values in BLE units: interval 1.25 ms, supervision timeout 10 ms
+struct conn_params
+{
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint16_t latency;
+    uint16_t supervision_timeout;
+};
+
+typedef enum
+{
+    CONN_POLICY_FAST, // keys active: 7.5-15 ms, no slave latency
+    CONN_POLICY_IDLE, // no input for a while: 30-50 ms with slave latency
+    CONN_POLICY_COUNT,
+} conn_policy_t;
+
+#define CONN_PARAMS_IDLE_TIMEOUT_US (10 * 1000 * 1000)
+#define CONN_PARAMS_FIRST_REQUEST_US (1000 * 1000) // let the host finish discovery first
+#define CONN_PARAMS_MIN_SPACING_US (1000 * 1000)
+#define CONN_PARAMS_REJECT_BACKOFF_US (5 * 1000 * 1000)
+#define CONN_PARAMS_NO_DEADLINE INT64_MAX
+
+extern const conn_params_t conn_policy_params[CONN_POLICY_COUNT];
+
+typedef struct
+{
+    bool connected;
+    bool pending;
+    uint16_t conn_handle;
+    conn_policy_t policy; // policy we want to be in
+    conn_params_t requested;
+    conn_params_t granted;
+    int64_t last_activity_us;
+    int64_t next_request_us; // earliest time another request may go out
+    uint32_t requests;
+    uint32_t rejections;
+    hal_ble_t ble; // requests go out through ble.update_params
+} conn_params_mgr_t;
+
+void conn_params_init(conn_params_mgr_t *m, const hal_ble_t *ble);
+void conn_params_connected(conn_params_mgr_t *m, uint16_t conn_handle, const conn_params_t *granted, int64_t now_us);
+void conn_params_disconnected(conn_params_mgr_t *m);
+// Result of a CONN_UPDATE event; `granted` is what the link uses now
+void conn_params_updated(conn_params_mgr_t *m, int status, const conn_params_t *granted, int64_t now_us);
+void conn_params_activity(conn_params_mgr_t *m, int64_t now_us);
+void conn_params_tick(conn_params_mgr_t *m, int64_t now_us);
+int64_t conn_params_next_deadline(const conn_params_mgr_t *m);
+
+// True if the granted parameters satisfy the policy currently wanted
+bool conn_params_satisfied(const conn_params_mgr_t *m);
+
+#endif
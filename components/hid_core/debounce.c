@@ -0,0 +1,101 @@
+#include "debounce.h"
+#include <string.h>
+
+// === Bit-sliced counter helpers, `m` selects the keys to operate on ===
+static void count_inc(debounce_t *db, scan_mask_t m)
+{
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS && m; b++)
+    {
+        scan_mask_t carry = db->count[b] & m;
+        db->count[b] ^= m;
+        m = carry;
+    }
+}
+
+static void count_dec(debounce_t *db, scan_mask_t m)
+{
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS && m; b++)
+    {
+        scan_mask_t borrow = ~db->count[b] & m;
+        db->count[b] ^= m;
+        m = borrow;
+    }
+}
+
+static void count_clear(debounce_t *db, scan_mask_t m)
+{
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++)
+        db->count[b] &= ~m;
+}
+
+static scan_mask_t count_eq(const debounce_t *db, uint8_t value)
+{
+    scan_mask_t eq = ~(scan_mask_t)0;
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++)
+        eq &= ((value >> b) & 1) ? db->count[b] : ~db->count[b];
+    return eq;
+}
+
+void debounce_init(debounce_t *db, debounce_algo_t algo, uint8_t ticks)
+{
+    memset(db, 0, sizeof(*db));
+    if (ticks == 0)
+        ticks = 1;
+    if (ticks > DEBOUNCE_MAX_TICKS)
+        ticks = DEBOUNCE_MAX_TICKS;
+    db->ticks = ticks;
+    db->algo_mask[algo] = ~(scan_mask_t)0;
+}
+
+void debounce_set_algo(debounce_t *db, uint8_t key, debounce_algo_t algo)
+{
+    scan_mask_t bit = (scan_mask_t)1 << key;
+    for (int a = 0; a < 3; a++)
+        db->algo_mask[a] &= ~bit;
+    db->algo_mask[algo] |= bit;
+    count_clear(db, bit);
+}
+
+scan_mask_t debounce_update(debounce_t *db, scan_mask_t raw)
+{
+    scan_mask_t diff = raw ^ db->state;
+
+    // Eager: a key with a zero counter is idle; any other value is its lockout
+    scan_mask_t eager = db->algo_mask[DEBOUNCE_EAGER];
+    if (eager)
+    {
+        scan_mask_t locked = eager & ~count_eq(db, 0);
+        scan_mask_t unlock = locked & count_eq(db, db->ticks);
+        count_clear(db, unlock);
+        count_inc(db, locked & ~unlock);
+        scan_mask_t fire = eager & ~locked & diff;
+        db->state ^= fire;
+        count_inc(db, fire);
+    }
+
+    // Deferred: count consecutive ticks that disagree with the output
+    scan_mask_t deferred = db->algo_mask[DEBOUNCE_DEFERRED];
+    if (deferred)
+    {
+        count_clear(db, deferred & ~diff);
+        count_inc(db, deferred & diff);
+        scan_mask_t done = deferred & count_eq(db, db->ticks);
+        db->state ^= done;
+        count_clear(db, done);
+    }
+
+    // Integrator: move towards the raw level, switch at the rails
+    scan_mask_t integ = db->algo_mask[DEBOUNCE_INTEGRATOR];
+    if (integ)
+    {
+        scan_mask_t top = count_eq(db, db->ticks);
+        scan_mask_t bottom = count_eq(db, 0);
+        count_inc(db, integ & raw & ~top);
+        count_dec(db, integ & ~raw & ~bottom);
+        top = integ & count_eq(db, db->ticks);
+        bottom = integ & count_eq(db, 0);
+        db->state = (db->state | top) & ~bottom;
+    }
+
+    return db->state;
+}
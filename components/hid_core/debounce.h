@@ -0,0 +1,34 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include "scan.h"
+
+// Per-key counters are stored as bit planes (one scan_mask_t per counter bit),
+// so every key is updated with a handful of word operations per tick.
+#define DEBOUNCE_COUNTER_BITS 5
+#define DEBOUNCE_MAX_TICKS ((1 << DEBOUNCE_COUNTER_BITS) - 1)
+
+typedef enum
+{
+    DEBOUNCE_EAGER,      // report the first edge, then ignore the key for N ticks
+    DEBOUNCE_DEFERRED,   // report an edge once the input has been stable for N ticks
+    DEBOUNCE_INTEGRATOR, // saturating up/down counter, report at 0 and N
+} debounce_algo_t;
+
+typedef struct
+{
+    scan_mask_t state; // debounced key state
+    scan_mask_t algo_mask[3];
+    scan_mask_t count[DEBOUNCE_COUNTER_BITS];
+    uint8_t ticks;
+} debounce_t;
+
+// All keys start with the same algorithm and a window of `ticks` scan ticks
+void debounce_init(debounce_t *db, debounce_algo_t algo, uint8_t ticks);
+void debounce_set_algo(debounce_t *db, uint8_t key, debounce_algo_t algo);
+
+// Feeds one raw scan and returns the debounced state
+scan_mask_t debounce_update(debounce_t *db, scan_mask_t raw);
+
+#endif
@@ -0,0 +1,59 @@
+#include "dlog_ring.h"
+#include <stdio.h>
+
+void dlog_ring_init(dlog_ring_t *r, dlog_slot_t *slots, uint32_t len)
+{
+    r->slots = slots;
+    r->mask = len - 1;
+    for (uint32_t i = 0; i < len; i++)
+        atomic_store_explicit(&slots[i].seq, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->dropped, 0, memory_order_relaxed);
+}
+
+// A position is claimed with a CAS on head while the ring has room, filled,
+// then published through the slot's seq; the reader only takes slots whose
+// seq says they are complete.
+bool dlog_ring_write(dlog_ring_t *r, uint32_t t_us, uint8_t level, const char *tag, const char *fmt,
+                     int nargs, const uint32_t *args)
+{
+    uint32_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    do
+    {
+        if (pos - atomic_load_explicit(&r->tail, memory_order_acquire) > r->mask)
+        {
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed));
+
+    dlog_slot_t *slot = &r->slots[pos & r->mask];
+    slot->e.t_us = t_us;
+    slot->e.tag = tag;
+    slot->e.fmt = fmt;
+    slot->e.level = level;
+    slot->e.nargs = nargs;
+    for (int i = 0; i < nargs; i++)
+        slot->e.args[i] = args[i];
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+bool dlog_ring_pop(dlog_ring_t *r, dlog_entry_t *out)
+{
+    uint32_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    dlog_slot_t *slot = &r->slots[pos & r->mask];
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+        return false;
+    *out = slot->e;
+    atomic_store_explicit(&r->tail, pos + 1, memory_order_release);
+    return true;
+}
+
+int dlog_format(const dlog_entry_t *e, char *buf, size_t len)
+{
+    // Unused words are never read by the format, passing all eight keeps one call site
+    return snprintf(buf, len, e->fmt, e->args[0], e->args[1], e->args[2], e->args[3],
+                    e->args[4], e->args[5], e->args[6], e->args[7]);
+}
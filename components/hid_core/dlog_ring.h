@@ -0,0 +1,55 @@
+#ifndef DLOG_RING_H
+#define DLOG_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Entry ring behind deferred logging (main/dlog.h). A writer stores the
+// format string's address, the tag's address and up to DLOG_MAX_ARGS raw 32
+// bit arguments; formatting waits until the entry is popped.
+#define DLOG_MAX_ARGS 8
+
+typedef struct
+{
+    uint32_t t_us; // low 32 bits of the write time
+    const char *tag;
+    const char *fmt;
+    uint8_t level;
+    uint8_t nargs;
+    uint32_t args[DLOG_MAX_ARGS];
+} dlog_entry_t;
+
+typedef struct
+{
+    _Atomic uint32_t seq; // position + 1 once the entry is complete
+    dlog_entry_t e;
+} dlog_slot_t;
+
+// Any number of writers (tasks or ISRs), one reader. Slots are supplied by
+// the caller, their count must be a power of two.
+typedef struct
+{
+    dlog_slot_t *slots;
+    uint32_t mask;
+    _Atomic uint32_t head; // next position a writer claims
+    _Atomic uint32_t tail; // next position the reader pops
+    _Atomic uint32_t dropped;
+} dlog_ring_t;
+
+void dlog_ring_init(dlog_ring_t *r, dlog_slot_t *slots, uint32_t len);
+
+// Never blocks; false (and counted in dropped) when the ring is full
+bool dlog_ring_write(dlog_ring_t *r, uint32_t t_us, uint8_t level, const char *tag, const char *fmt,
+                     int nargs, const uint32_t *args);
+
+// False when empty or when the oldest entry's writer has not finished yet
+bool dlog_ring_pop(dlog_ring_t *r, dlog_entry_t *out);
+
+// Formats the message of a popped entry like snprintf. Every argument is
+// passed as a 32 bit word, which is what the conversions DLOG allows (%d, %u,
+// %x, %c, and %s where pointers are 32 bits) read.
+int dlog_format(const dlog_entry_t *e, char *buf, size_t len);
+
+#endif
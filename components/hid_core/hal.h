@@ -0,0 +1,55 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "scan.h"
+
+// The core library only reaches the outside world through these. The
+// firmware backs them with GPIO registers, esp_timer, the button ring and
+// the HID transmit task; a host build can back them with anything.
+
+typedef struct button_event button_event_t;
+typedef struct conn_params conn_params_t;
+typedef struct reconnect_stage_params reconnect_stage_params_t;
+typedef struct host_addr host_addr_t;
+
+// Raw key state, bit i set = key i is down (before debouncing)
+typedef struct
+{
+    scan_mask_t (*read)(void *ctx);
+    void *ctx;
+} hal_gpio_t;
+
+// Monotonic time in microseconds
+typedef struct
+{
+    int64_t (*now_us)(void *ctx);
+    void *ctx;
+} hal_clock_t;
+
+// Hands a key event to the consumer; false when it had to be dropped
+typedef struct
+{
+    bool (*push)(void *ctx, const button_event_t *evt);
+    void *ctx;
+} hal_queue_t;
+
+// Takes one input report for the host; false when it could not be queued
+typedef struct
+{
+    bool (*send)(void *ctx, uint8_t report_id, const uint8_t *data, uint8_t len);
+    void *ctx;
+} hal_hid_sink_t;
+
+// Link control, NimBLE's ble_gap_* on the device. Each returns 0 when the
+// stack took the request; the outcome arrives later as a GAP event.
+typedef struct
+{
+    int (*update_params)(void *ctx, uint16_t conn_handle, const conn_params_t *params);
+    // `peer` is the target of directed stages and unused otherwise
+    int (*adv_start)(void *ctx, const reconnect_stage_params_t *stage, const host_addr_t *peer);
+    void *ctx;
+} hal_ble_t;
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef HID_DESC_H
+#define HID_DESC_H
+
+#include <stdint.h>
+
+// Report descriptor builder. A report is defined once as a list macro
+// taking two callbacks:
+//
+//   #define MY_REPORT(I, F)
+//       I(<items>)                                          bare items
+//       F(<main>, <flags>, <member>, <size>, <count>, <items>)  one field
+//
+// I() carries items that do not add report data (collections, report IDs,
+// usage pages). F() is one Input, Output or Feature main item of `count`
+// fields of `size` bits, preceded by its own <items>, and the C member
+// that holds it in the packed report struct. The same list expands into
+// the descriptor bytes (HID_DESC_BYTES), the struct (HID_DESC_STRUCT) and
+// the report size in bits (HID_DESC_BITS), so they cannot drift apart.
+// Every item macro ends with a comma, items are written one after another.
+
+// Main items
+#define HID_DESC_INPUT(flags) 0x81, (flags),
+#define HID_DESC_OUTPUT(flags) 0x91, (flags),
+#define HID_DESC_FEATURE(flags) 0xB1, (flags),
+#define HID_DESC_COLLECTION(type) 0xA1, (type),
+#define HID_DESC_END_COLLECTION 0xC0,
+
+// Global items
+#define HID_DESC_USAGE_PAGE(page) 0x05, (page),
+#define HID_DESC_LOGICAL_MIN(v) 0x15, (uint8_t)(v),
+#define HID_DESC_LOGICAL_MAX(v) 0x25, (uint8_t)(v),
+#define HID_DESC_LOGICAL_MAX16(v) 0x26, (uint8_t)(v), (uint8_t)((v) >> 8),
+#define HID_DESC_PHYSICAL_MIN(v) 0x35, (uint8_t)(v),
+#define HID_DESC_PHYSICAL_MAX(v) 0x45, (uint8_t)(v),
+#define HID_DESC_REPORT_SIZE(bits) 0x75, (bits),
+#define HID_DESC_REPORT_ID(id) 0x85, (id),
+#define HID_DESC_REPORT_COUNT(n) 0x95, (n),
+
+// Local items
+#define HID_DESC_USAGE(u) 0x09, (u),
+#define HID_DESC_USAGE16(u) 0x0A, (uint8_t)(u), (uint8_t)((u) >> 8),
+#define HID_DESC_USAGE_MIN(u) 0x19, (u),
+#define HID_DESC_USAGE_MAX(u) 0x29, (u),
+#define HID_DESC_USAGE_MIN16(u) 0x1A, (uint8_t)(u), (uint8_t)((u) >> 8),
+#define HID_DESC_USAGE_MAX16(u) 0x2A, (uint8_t)(u), (uint8_t)((u) >> 8),
+
+// Main item flags
+#define HID_DESC_DATA 0x00
+#define HID_DESC_CONST 0x01
+#define HID_DESC_ARRAY 0x00
+#define HID_DESC_VAR 0x02
+#define HID_DESC_ABS 0x00
+#define HID_DESC_REL 0x04
+#define HID_DESC_NULL 0x40
+
+// Collection types
+#define HID_DESC_PHYSICAL 0x00
+#define HID_DESC_APPLICATION 0x01
+#define HID_DESC_LOGICAL 0x02
+
+// Usage pages
+#define HID_DESC_PAGE_GENERIC_DESKTOP 0x01
+#define HID_DESC_PAGE_KEYBOARD 0x07
+#define HID_DESC_PAGE_BUTTON 0x09
+#define HID_DESC_PAGE_CONSUMER 0x0C
+
+// Descriptor bytes of a report list
+#define HID_DESC_BYTES(report) report(HID_DESC_BYTES_I_, HID_DESC_BYTES_F_)
+#define HID_DESC_BYTES_I_(items) items
+#define HID_DESC_BYTES_F_(main, flags, member, size, count, items) \
+    items HID_DESC_REPORT_SIZE(size) HID_DESC_REPORT_COUNT(count) HID_DESC_##main(flags)
+
+// Packed struct of the fields of one main item type (INPUT, OUTPUT or
+// FEATURE). Members are laid out from the least significant bit up, as the
+// report itself, so sub-byte fields are bit-fields of uint8_t.
+#define HID_DESC_STRUCT(report, main) \
+    struct __attribute__((packed))    \
+    {                                 \
+        report(HID_DESC_SKIP_, HID_DESC_MEMBER_##main##_)}
+#define HID_DESC_SKIP_(items)
+#define HID_DESC_MEMBER_INPUT_(main, flags, member, size, count, items) HID_DESC_IF_##main##_INPUT_(member;)
+#define HID_DESC_MEMBER_OUTPUT_(main, flags, member, size, count, items) HID_DESC_IF_##main##_OUTPUT_(member;)
+#define HID_DESC_MEMBER_FEATURE_(main, flags, member, size, count, items) HID_DESC_IF_##main##_FEATURE_(member;)
+
+// Report size in bits of the fields of one main item type
+#define HID_DESC_BITS(report, main) (0 report(HID_DESC_SKIP_, HID_DESC_BITS_##main##_))
+#define HID_DESC_BITS_INPUT_(main, flags, member, size, count, items) HID_DESC_IF_##main##_INPUT_(+(size) * (count))
+#define HID_DESC_BITS_OUTPUT_(main, flags, member, size, count, items) HID_DESC_IF_##main##_OUTPUT_(+(size) * (count))
+#define HID_DESC_BITS_FEATURE_(main, flags, member, size, count, items) HID_DESC_IF_##main##_FEATURE_(+(size) * (count))
+
+#define HID_DESC_IF_INPUT_INPUT_(x) x
+#define HID_DESC_IF_INPUT_OUTPUT_(x)
+#define HID_DESC_IF_INPUT_FEATURE_(x)
+#define HID_DESC_IF_OUTPUT_INPUT_(x)
+#define HID_DESC_IF_OUTPUT_OUTPUT_(x) x
+#define HID_DESC_IF_OUTPUT_FEATURE_(x)
+#define HID_DESC_IF_FEATURE_INPUT_(x)
+#define HID_DESC_IF_FEATURE_OUTPUT_(x)
+#define HID_DESC_IF_FEATURE_FEATURE_(x) x
+
+// The struct holds exactly the report's bits: catches missing padding,
+// reports that do not end on a byte and members whose type disagrees with
+// size * count
+#define HID_DESC_CHECK(type, report, main) \
+    _Static_assert(sizeof(type) * 8 == HID_DESC_BITS(report, main), #type " does not match its report descriptor")
+
+#endif
@@ -0,0 +1,217 @@
+#include "hid_report.h"
+#include <string.h>
+#include "keycodes.h"
+#include "macro.h"
+#include "coalesce.h"
+
+// Reports built outside this file must agree with the descriptor
+_Static_assert(TYPING_REPORT_LEN == HID_REPORT_KEYBOARD_LEN, "typing report layout");
+_Static_assert(MACRO_KEYBOARD_REPORT_ID == HID_REPORT_ID_KEYBOARD, "macro keyboard report ID");
+_Static_assert(MACRO_MOUSE_REPORT_ID == HID_REPORT_ID_MOUSE, "macro mouse report ID");
+_Static_assert(MACRO_MOUSE_REPORT_LEN == HID_REPORT_MOUSE_LEN, "macro mouse report layout");
+_Static_assert(HID_REPORT_MAX_LEN >= HID_REPORT_KEYBOARD_LEN && HID_REPORT_MAX_LEN >= HID_REPORT_NKRO_LEN &&
+                   HID_REPORT_MAX_LEN >= HID_REPORT_MOUSE_LEN && HID_REPORT_MAX_LEN >= HID_REPORT_CONSUMER_LEN,
+               "HID_REPORT_MAX_LEN is the longest report");
+_Static_assert(COALESCE_REPORT_MAX >= HID_REPORT_MAX_LEN, "coalesce slots hold every report");
+
+void hid_report_init(hid_report_t *r, const hal_hid_sink_t *sink)
+{
+    memset(r, 0, sizeof(*r));
+    r->sink = *sink;
+}
+
+static bool hid_report_send(hid_report_t *r, uint8_t report_id, const void *data, uint8_t len)
+{
+    return r->sink.send(r->sink.ctx, report_id, data, len);
+}
+
+// A freed last slot takes the lowest held key that had no slot, so a key
+// pressed past the sixth shows up once another one is released
+static void hid_report_refill(hid_report_t *r)
+{
+    for (int usage = 1; usage < HID_REPORT_NKRO_USAGES; usage++)
+    {
+        if ((r->kbd_bits[usage >> 3] & (1 << (usage & 7))) &&
+            !memchr(r->kbd_keys, usage, HID_REPORT_KEYBOARD_KEYS - 1))
+        {
+            r->kbd_keys[HID_REPORT_KEYBOARD_KEYS - 1] = usage;
+            return;
+        }
+    }
+}
+
+// The six key slots of the boot compatible report, in press order
+static void hid_report_slots(hid_report_t *r, uint8_t usage, bool pressed)
+{
+    for (int i = 0; i < HID_REPORT_KEYBOARD_KEYS; i++)
+    {
+        if (pressed && (r->kbd_keys[i] == usage || r->kbd_keys[i] == 0))
+        {
+            r->kbd_keys[i] = usage;
+            break;
+        }
+        if (!pressed && r->kbd_keys[i] == usage)
+        {
+            memmove(&r->kbd_keys[i], &r->kbd_keys[i + 1], HID_REPORT_KEYBOARD_KEYS - 1 - i);
+            r->kbd_keys[HID_REPORT_KEYBOARD_KEYS - 1] = 0;
+            hid_report_refill(r);
+            break;
+        }
+    }
+}
+
+// Sends the held keys on the report of the current format
+static bool hid_report_keyboard(hid_report_t *r)
+{
+    if (r->nkro)
+    {
+        hid_nkro_report_t report = {.mods = r->kbd_mods};
+        memcpy(report.bits, r->kbd_bits, sizeof(report.bits));
+        return hid_report_send(r, HID_REPORT_ID_NKRO, &report, sizeof(report));
+    }
+    hid_keyboard_report_t report = {.mods = r->kbd_mods};
+    memcpy(report.keys, r->kbd_keys, HID_REPORT_KEYBOARD_KEYS);
+    return hid_report_send(r, HID_REPORT_ID_KEYBOARD, &report, sizeof(report));
+}
+
+bool hid_report_key(hid_report_t *r, uint8_t mods, uint8_t usage, bool pressed)
+{
+    if (usage >= HID_REPORT_NKRO_USAGES)
+        return false;
+    if (pressed)
+        r->kbd_mods |= mods;
+    else
+        r->kbd_mods &= ~mods;
+    if (usage)
+    {
+        uint8_t bit = 1 << (usage & 7);
+        if (pressed)
+            r->kbd_bits[usage >> 3] |= bit;
+        else
+            r->kbd_bits[usage >> 3] &= ~bit;
+    }
+    if (usage && !r->nkro)
+        hid_report_slots(r, usage, pressed);
+    return hid_report_keyboard(r);
+}
+
+void hid_report_set_nkro(hid_report_t *r, bool nkro)
+{
+    if (nkro == r->nkro)
+        return;
+    bool held = r->kbd_mods != 0;
+    for (int i = 0; i < (int)sizeof(r->kbd_bits); i++)
+        held |= r->kbd_bits[i] != 0;
+
+    if (held && r->nkro)
+    {
+        const hid_nkro_report_t release = {0};
+        hid_report_send(r, HID_REPORT_ID_NKRO, &release, sizeof(release));
+    }
+    else if (held)
+    {
+        const hid_keyboard_report_t release = {0};
+        hid_report_send(r, HID_REPORT_ID_KEYBOARD, &release, sizeof(release));
+    }
+
+    r->nkro = nkro;
+    if (!nkro)
+    {
+        // Slots were not kept meanwhile: the first six held keys by usage
+        int n = 0;
+        memset(r->kbd_keys, 0, sizeof(r->kbd_keys));
+        for (int usage = 1; usage < HID_REPORT_NKRO_USAGES && n < HID_REPORT_KEYBOARD_KEYS; usage++)
+        {
+            if (r->kbd_bits[usage >> 3] & (1 << (usage & 7)))
+                r->kbd_keys[n++] = usage;
+        }
+    }
+    if (held)
+        hid_report_keyboard(r);
+}
+
+// One key and modifiers alone on the report of the current format
+static bool hid_report_keyboard_only(hid_report_t *r, uint8_t mods, uint8_t usage)
+{
+    if (r->nkro)
+    {
+        hid_nkro_report_t report = {.mods = mods};
+        if (usage)
+            report.bits[usage >> 3] |= 1 << (usage & 7);
+        return hid_report_send(r, HID_REPORT_ID_NKRO, &report, sizeof(report));
+    }
+    hid_keyboard_report_t report = {.mods = mods, .keys = {usage}};
+    return hid_report_send(r, HID_REPORT_ID_KEYBOARD, &report, sizeof(report));
+}
+
+bool hid_report_tap_char(hid_report_t *r, char c)
+{
+    keycode_t code = ascii_to_keycode(c);
+    if (KEYCODE_USAGE(code) >= HID_REPORT_NKRO_USAGES)
+        return false;
+    bool ok = hid_report_keyboard_only(r, KEYCODE_MOD(code), KEYCODE_USAGE(code));
+    /* the transmit task paces the key release */
+    return hid_report_keyboard_only(r, 0, 0) && ok;
+}
+
+bool hid_report_mouse(hid_report_t *r, uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel, int8_t pan)
+{
+    hid_mouse_report_t report = {.buttons = buttons, .x = dx, .y = dy, .wheel = wheel, .pan = pan};
+    return hid_report_send(r, HID_REPORT_ID_MOUSE, &report, sizeof(report));
+}
+
+bool hid_report_mouse_move(hid_report_t *r, int8_t dx, int8_t dy, int8_t wheel, int8_t pan)
+{
+    return hid_report_mouse(r, r->mouse_buttons, dx, dy, wheel, pan);
+}
+
+bool hid_report_consumer(hid_report_t *r, uint16_t usage, bool pressed)
+{
+    if (usage == 0 || usage > HID_REPORT_CONSUMER_MAX_USAGE)
+        return false;
+    int slot = -1;
+    for (int i = 0; i < HID_REPORT_CONSUMER_USAGES; i++)
+    {
+        if (r->cc_usages[i] == usage)
+        {
+            slot = i;
+            break;
+        }
+        if (pressed && slot < 0 && r->cc_usages[i] == 0)
+            slot = i;
+    }
+    if (slot < 0)
+        return false;
+    r->cc_usages[slot] = pressed ? usage : 0;
+
+    hid_consumer_report_t report;
+    memcpy(report.usages, r->cc_usages, sizeof(report.usages));
+    return hid_report_send(r, HID_REPORT_ID_CONSUMER, &report, sizeof(report));
+}
+
+bool hid_report_action(hid_report_t *r, const keystore_action_t *action, bool pressed)
+{
+    switch (action->type)
+    {
+    case KEYSTORE_ACTION_KEY:
+        hid_report_key(r, action->arg0, (uint8_t)action->arg1, pressed);
+        return true;
+    case KEYSTORE_ACTION_CONSUMER:
+        hid_report_consumer(r, action->arg1, pressed);
+        return true;
+    case KEYSTORE_ACTION_MOUSE:
+        if (pressed)
+        {
+            r->mouse_buttons |= action->arg0;
+            hid_report_mouse(r, r->mouse_buttons, (int8_t)(action->arg1 & 0xFF), (int8_t)(action->arg1 >> 8), 0, 0);
+        }
+        else
+        {
+            r->mouse_buttons &= ~action->arg0;
+            hid_report_mouse(r, r->mouse_buttons, 0, 0, 0, 0);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,209 @@
+#ifndef HID_REPORT_H
+#define HID_REPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "keystore.h"
+#include "hid_desc.h"
+
+// Report IDs of the collections in HID_REPORT_DESCRIPTOR
+#define HID_REPORT_ID_KEYBOARD 1
+#define HID_REPORT_ID_MOUSE 2
+#define HID_REPORT_ID_CONSUMER 3
+#define HID_REPORT_ID_NKRO 4
+#define HID_REPORT_KEYBOARD_KEYS 6
+#define HID_REPORT_NKRO_USAGES 120 // keyboard usages 0x00..0x77, in both keyboard reports
+#define HID_REPORT_CONSUMER_USAGES 2
+#define HID_REPORT_CONSUMER_MAX_USAGE 0x0FFF
+#define HID_REPORT_MAX_LEN 16      // longest input report
+#define HID_REPORT_SCROLL_MULTIPLIER 16 // wheel units per detent in high resolution
+
+// Boot keyboard layout: modifier bits, a reserved byte and six key slots.
+// The slots take the same usages as the NKRO bitmap, so a key reaches the
+// host whichever report is in use.
+#define HID_REPORT_KEYBOARD(I, F)                                                                                  \
+    I(HID_DESC_USAGE_PAGE(HID_DESC_PAGE_GENERIC_DESKTOP) HID_DESC_USAGE(0x06) /* Keyboard */                      \
+      HID_DESC_COLLECTION(HID_DESC_APPLICATION) HID_DESC_REPORT_ID(HID_REPORT_ID_KEYBOARD))                       \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_ABS, uint8_t mods, 1, 8,                                      \
+      HID_DESC_USAGE_PAGE(HID_DESC_PAGE_KEYBOARD) HID_DESC_USAGE_MIN(0xE0) HID_DESC_USAGE_MAX(0xE7)                \
+          HID_DESC_LOGICAL_MIN(0) HID_DESC_LOGICAL_MAX(1))                                                         \
+    F(INPUT, HID_DESC_CONST, uint8_t reserved, 8, 1, )                                                             \
+    F(INPUT, HID_DESC_DATA | HID_DESC_ARRAY, uint8_t keys[HID_REPORT_KEYBOARD_KEYS], 8, HID_REPORT_KEYBOARD_KEYS,  \
+      HID_DESC_LOGICAL_MAX(HID_REPORT_NKRO_USAGES - 1) HID_DESC_USAGE_MIN(0x00)                                    \
+          HID_DESC_USAGE_MAX(HID_REPORT_NKRO_USAGES - 1))                                                          \
+    I(HID_DESC_END_COLLECTION)
+
+// N-key rollover: the same modifier bits, then one bit per keyboard usage.
+// Bit n of the bitmap is usage n, so a key state bitset is the report as is.
+#define HID_REPORT_NKRO(I, F)                                                                                      \
+    I(HID_DESC_USAGE_PAGE(HID_DESC_PAGE_GENERIC_DESKTOP) HID_DESC_USAGE(0x06) /* Keyboard */                      \
+      HID_DESC_COLLECTION(HID_DESC_APPLICATION) HID_DESC_REPORT_ID(HID_REPORT_ID_NKRO))                           \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_ABS, uint8_t mods, 1, 8,                                      \
+      HID_DESC_USAGE_PAGE(HID_DESC_PAGE_KEYBOARD) HID_DESC_USAGE_MIN(0xE0) HID_DESC_USAGE_MAX(0xE7)                \
+          HID_DESC_LOGICAL_MIN(0) HID_DESC_LOGICAL_MAX(1))                                                         \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_ABS, uint8_t bits[HID_REPORT_NKRO_USAGES / 8], 1,            \
+      HID_REPORT_NKRO_USAGES, HID_DESC_USAGE_MIN(0x00) HID_DESC_USAGE_MAX(HID_REPORT_NKRO_USAGES - 1))             \
+    I(HID_DESC_END_COLLECTION)
+
+// Three buttons, x, y, a vertical wheel and a horizontal pan (AC Pan). The
+// wheel and pan each sit in a logical collection with a Resolution
+// Multiplier the host sets to 1 (x1) or 16 (x16, high resolution) through
+// the feature report.
+#define HID_REPORT_MOUSE(I, F)                                                                                     \
+    I(HID_DESC_USAGE_PAGE(HID_DESC_PAGE_GENERIC_DESKTOP) HID_DESC_USAGE(0x02) /* Mouse */                         \
+      HID_DESC_COLLECTION(HID_DESC_APPLICATION) HID_DESC_REPORT_ID(HID_REPORT_ID_MOUSE)                           \
+          HID_DESC_USAGE(0x01) /* Pointer */ HID_DESC_COLLECTION(HID_DESC_PHYSICAL))                              \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_ABS, uint8_t buttons : 3, 1, 3,                               \
+      HID_DESC_USAGE_PAGE(HID_DESC_PAGE_BUTTON) HID_DESC_USAGE_MIN(1) HID_DESC_USAGE_MAX(3)                        \
+          HID_DESC_LOGICAL_MIN(0) HID_DESC_LOGICAL_MAX(1))                                                         \
+    F(INPUT, HID_DESC_CONST | HID_DESC_VAR, uint8_t : 5, 5, 1, )                                                   \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_REL, int8_t x, 8, 1,                                          \
+      HID_DESC_USAGE_PAGE(HID_DESC_PAGE_GENERIC_DESKTOP) HID_DESC_USAGE(0x30)                                      \
+          HID_DESC_LOGICAL_MIN(-127) HID_DESC_LOGICAL_MAX(127))                                                    \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_REL, int8_t y, 8, 1, HID_DESC_USAGE(0x31))                    \
+    I(HID_DESC_COLLECTION(HID_DESC_LOGICAL))                                                                       \
+    F(FEATURE, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_ABS, uint8_t wheel_multiplier : 2, 2, 1,                    \
+      HID_DESC_USAGE(0x48) /* Resolution Multiplier */ HID_DESC_LOGICAL_MIN(0) HID_DESC_LOGICAL_MAX(1)            \
+          HID_DESC_PHYSICAL_MIN(1) HID_DESC_PHYSICAL_MAX(HID_REPORT_SCROLL_MULTIPLIER))                            \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_REL, int8_t wheel, 8, 1,                                      \
+      HID_DESC_USAGE(0x38) HID_DESC_PHYSICAL_MIN(0) HID_DESC_PHYSICAL_MAX(0)                                       \
+          HID_DESC_LOGICAL_MIN(-127) HID_DESC_LOGICAL_MAX(127))                                                    \
+    I(HID_DESC_END_COLLECTION HID_DESC_COLLECTION(HID_DESC_LOGICAL))                                               \
+    F(FEATURE, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_ABS, uint8_t pan_multiplier : 2, 2, 1,                      \
+      HID_DESC_USAGE(0x48) HID_DESC_LOGICAL_MIN(0) HID_DESC_LOGICAL_MAX(1)                                         \
+          HID_DESC_PHYSICAL_MIN(1) HID_DESC_PHYSICAL_MAX(HID_REPORT_SCROLL_MULTIPLIER))                            \
+    F(INPUT, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_REL, int8_t pan, 8, 1,                                        \
+      HID_DESC_PHYSICAL_MIN(0) HID_DESC_PHYSICAL_MAX(0) HID_DESC_USAGE_PAGE(HID_DESC_PAGE_CONSUMER)                \
+          HID_DESC_USAGE16(0x0238) /* AC Pan */ HID_DESC_LOGICAL_MIN(-127) HID_DESC_LOGICAL_MAX(127))              \
+    I(HID_DESC_END_COLLECTION)                                                                                     \
+    F(FEATURE, HID_DESC_CONST | HID_DESC_VAR, uint8_t : 4, 4, 1, )                                                 \
+    I(HID_DESC_END_COLLECTION HID_DESC_END_COLLECTION)
+
+// Consumer control as an array of 16-bit usage IDs: every usage of the
+// Consumer page up to HID_REPORT_CONSUMER_MAX_USAGE goes out as is, and up
+// to HID_REPORT_CONSUMER_USAGES of them can be held together. 0 is no usage.
+#define HID_REPORT_CONSUMER(I, F)                                                                                  \
+    I(HID_DESC_USAGE_PAGE(HID_DESC_PAGE_CONSUMER) HID_DESC_USAGE(0x01) /* Consumer Control */                     \
+      HID_DESC_COLLECTION(HID_DESC_APPLICATION) HID_DESC_REPORT_ID(HID_REPORT_ID_CONSUMER))                       \
+    F(INPUT, HID_DESC_DATA | HID_DESC_ARRAY | HID_DESC_ABS, uint16_t usages[HID_REPORT_CONSUMER_USAGES], 16,      \
+      HID_REPORT_CONSUMER_USAGES,                                                                                  \
+      HID_DESC_LOGICAL_MIN(0) HID_DESC_LOGICAL_MAX16(HID_REPORT_CONSUMER_MAX_USAGE) HID_DESC_USAGE_MIN(0)          \
+          HID_DESC_USAGE_MAX16(HID_REPORT_CONSUMER_MAX_USAGE))                                                     \
+    I(HID_DESC_END_COLLECTION)
+
+// The whole report map handed to the HID device profile
+#define HID_REPORT_DESCRIPTOR      \
+    HID_DESC_BYTES(HID_REPORT_KEYBOARD) \
+    HID_DESC_BYTES(HID_REPORT_NKRO)     \
+    HID_DESC_BYTES(HID_REPORT_MOUSE)    \
+    HID_DESC_BYTES(HID_REPORT_CONSUMER)
+
+typedef HID_DESC_STRUCT(HID_REPORT_KEYBOARD, INPUT) hid_keyboard_report_t;
+typedef HID_DESC_STRUCT(HID_REPORT_NKRO, INPUT) hid_nkro_report_t;
+typedef HID_DESC_STRUCT(HID_REPORT_MOUSE, INPUT) hid_mouse_report_t;
+typedef HID_DESC_STRUCT(HID_REPORT_MOUSE, FEATURE) hid_mouse_feature_t;
+typedef HID_DESC_STRUCT(HID_REPORT_CONSUMER, INPUT) hid_consumer_report_t;
+
+HID_DESC_CHECK(hid_keyboard_report_t, HID_REPORT_KEYBOARD, INPUT);
+HID_DESC_CHECK(hid_nkro_report_t, HID_REPORT_NKRO, INPUT);
+HID_DESC_CHECK(hid_mouse_report_t, HID_REPORT_MOUSE, INPUT);
+HID_DESC_CHECK(hid_mouse_feature_t, HID_REPORT_MOUSE, FEATURE);
+HID_DESC_CHECK(hid_consumer_report_t, HID_REPORT_CONSUMER, INPUT);
+
+#define HID_REPORT_KEYBOARD_LEN sizeof(hid_keyboard_report_t)
+#define HID_REPORT_NKRO_LEN sizeof(hid_nkro_report_t)
+#define HID_REPORT_MOUSE_LEN sizeof(hid_mouse_report_t)
+#define HID_REPORT_MOUSE_FEATURE_LEN sizeof(hid_mouse_feature_t)
+#define HID_REPORT_CONSUMER_LEN sizeof(hid_consumer_report_t)
+
+// Wheel units per detent for a Resolution Multiplier field of the feature
+// report (logical 0..1, physical 1..HID_REPORT_SCROLL_MULTIPLIER)
+#define HID_REPORT_MULTIPLIER(field) ((field) ? HID_REPORT_SCROLL_MULTIPLIER : 1)
+
+// HID Consumer Usage IDs (subset of the codes available in the USB HID Usage Tables spec)
+#define HID_CONSUMER_POWER 48 // Power
+#define HID_CONSUMER_RESET 49 // Reset
+#define HID_CONSUMER_SLEEP 50 // Sleep
+
+#define HID_CONSUMER_MENU 64          // Menu
+#define HID_CONSUMER_SELECTION 128    // Selection
+#define HID_CONSUMER_ASSIGN_SEL 129   // Assign Selection
+#define HID_CONSUMER_MODE_STEP 130    // Mode Step
+#define HID_CONSUMER_RECALL_LAST 131  // Recall Last
+#define HID_CONSUMER_QUIT 148         // Quit
+#define HID_CONSUMER_HELP 149         // Help
+#define HID_CONSUMER_CHANNEL_UP 156   // Channel Increment
+#define HID_CONSUMER_CHANNEL_DOWN 157 // Channel Decrement
+
+#define HID_CONSUMER_PLAY 176          // Play
+#define HID_CONSUMER_PAUSE 177         // Pause
+#define HID_CONSUMER_RECORD 178        // Record
+#define HID_CONSUMER_FAST_FORWARD 179  // Fast Forward
+#define HID_CONSUMER_REWIND 180        // Rewind
+#define HID_CONSUMER_SCAN_NEXT_TRK 181 // Scan Next Track
+#define HID_CONSUMER_SCAN_PREV_TRK 182 // Scan Previous Track
+#define HID_CONSUMER_STOP 183          // Stop
+#define HID_CONSUMER_EJECT 184         // Eject
+#define HID_CONSUMER_RANDOM_PLAY 185   // Random Play
+#define HID_CONSUMER_SELECT_DISC 186   // Select Disk
+#define HID_CONSUMER_ENTER_DISC 187    // Enter Disc
+#define HID_CONSUMER_REPEAT 188        // Repeat
+#define HID_CONSUMER_STOP_EJECT 204    // Stop/Eject
+#define HID_CONSUMER_PLAY_PAUSE 205    // Play/Pause
+#define HID_CONSUMER_PLAY_SKIP 206     // Play/Skip
+
+#define HID_CONSUMER_VOLUME 224      // Volume
+#define HID_CONSUMER_BALANCE 225     // Balance
+#define HID_CONSUMER_MUTE 226        // Mute
+#define HID_CONSUMER_BASS 227        // Bass
+#define HID_CONSUMER_VOLUME_UP 233   // Volume Increment
+#define HID_CONSUMER_VOLUME_DOWN 234 // Volume Decrement
+
+// Report building: keeps the keyboard state held through keymap actions and
+// turns key, mouse and consumer actions into reports for the HID sink.
+// Held keys live in a bitset indexed by usage, which is set and cleared in
+// O(1) and copied as is into the NKRO report. The six key slots of the boot
+// compatible report are only kept while NKRO is off; a slot freed by a
+// release is refilled from the bitset with a key still held past the sixth.
+typedef struct
+{
+    hal_hid_sink_t sink;
+    bool nkro; // keyboard state goes out on HID_REPORT_ID_NKRO
+    uint8_t kbd_mods;
+    uint8_t kbd_bits[HID_REPORT_NKRO_USAGES / 8];
+    uint8_t kbd_keys[HID_REPORT_KEYBOARD_KEYS];
+    uint8_t mouse_buttons; // held through MOUSE actions
+    uint16_t cc_usages[HID_REPORT_CONSUMER_USAGES]; // held consumer usages, 0 = free
+} hid_report_t;
+
+void hid_report_init(hid_report_t *r, const hal_hid_sink_t *sink);
+
+// Adds or removes a held key and modifiers, then sends the keyboard report.
+// A usage from HID_REPORT_NKRO_USAGES up fits neither report and is refused
+// with nothing sent.
+bool hid_report_key(hid_report_t *r, uint8_t mods, uint8_t usage, bool pressed);
+
+// Switches the held keys between the NKRO and the 6-key report: the old one
+// is released and the state is sent on the new one. Off while the host
+// speaks boot protocol, which only knows the 6-key report.
+void hid_report_set_nkro(hid_report_t *r, bool nkro);
+
+// Press and release of one ASCII character on the report of the current
+// format, independent of the held keys
+bool hid_report_tap_char(hid_report_t *r, char c);
+
+bool hid_report_mouse(hid_report_t *r, uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel, int8_t pan);
+
+// Pointer and scroll motion with the buttons held through MOUSE actions, so dragging works
+bool hid_report_mouse_move(hid_report_t *r, int8_t dx, int8_t dy, int8_t wheel, int8_t pan);
+
+// Presses or releases a consumer usage and sends the held ones. A press with
+// every slot taken or a usage past HID_REPORT_CONSUMER_MAX_USAGE is dropped.
+bool hid_report_consumer(hid_report_t *r, uint16_t usage, bool pressed);
+
+// Runs KEY, CONSUMER and MOUSE keymap actions; returns false for any other
+// action type, which is left to the caller
+bool hid_report_action(hid_report_t *r, const keystore_action_t *action, bool pressed);
+
+#endif
@@ -0,0 +1,134 @@
+#include "host_slots.h"
+#include <string.h>
+
+void host_slots_init(host_slots_t *hs)
+{
+    memset(hs, 0, sizeof(*hs));
+}
+
+int host_slots_find(const host_slots_t *hs, const host_addr_t *peer)
+{
+    for (int i = 0; i < HOST_SLOTS_MAX; i++)
+    {
+        const host_slot_t *s = &hs->slots[i];
+        if (s->bonded && s->addr.type == peer->type && memcmp(s->addr.val, peer->val, sizeof(peer->val)) == 0)
+            return i;
+    }
+    return -1;
+}
+
+host_action_t host_slots_start(host_slots_t *hs)
+{
+    if (hs->slots[hs->active].bonded)
+    {
+        hs->state = HOST_STATE_ADV_DIRECTED;
+        return HOST_ACTION_ADV_DIRECTED;
+    }
+    hs->state = HOST_STATE_ADV_UNDIRECTED;
+    return HOST_ACTION_ADV_UNDIRECTED;
+}
+
+host_action_t host_slots_adv_timeout(host_slots_t *hs)
+{
+    // Hosts using resolvable private addresses never answer directed
+    // advertising, so they get a chance to find us undirected
+    if (hs->state == HOST_STATE_ADV_DIRECTED)
+    {
+        hs->state = HOST_STATE_ADV_UNDIRECTED;
+        return HOST_ACTION_ADV_UNDIRECTED;
+    }
+    if (hs->state == HOST_STATE_ADV_UNDIRECTED)
+        hs->state = HOST_STATE_IDLE;
+    return HOST_ACTION_NONE;
+}
+
+void host_slots_connected(host_slots_t *hs)
+{
+    if (hs->state == HOST_STATE_ADV_DIRECTED)
+        hs->directed_connects++;
+    hs->state = HOST_STATE_CONNECTED;
+}
+
+void host_slots_disconnected(host_slots_t *hs)
+{
+    hs->state = HOST_STATE_IDLE;
+}
+
+host_action_t host_slots_encrypted(host_slots_t *hs, const host_addr_t *peer, bool bonded, bool *changed)
+{
+    *changed = false;
+    int slot = host_slots_find(hs, peer);
+    if (slot == hs->active)
+        return HOST_ACTION_NONE;
+
+    host_slot_t *active = &hs->slots[hs->active];
+    if (slot < 0 && !active->bonded && bonded)
+    {
+        active->bonded = true;
+        active->addr = *peer;
+        *changed = true;
+        return HOST_ACTION_NONE;
+    }
+
+    hs->rejected++;
+    hs->state = HOST_STATE_SWITCHING;
+    return HOST_ACTION_DISCONNECT;
+}
+
+host_action_t host_slots_select(host_slots_t *hs, uint8_t slot)
+{
+    if (slot >= HOST_SLOTS_MAX)
+        return HOST_ACTION_NONE;
+    if (slot == hs->active && hs->state != HOST_STATE_IDLE)
+        return HOST_ACTION_NONE;
+
+    hs->active = slot;
+    hs->switches++;
+    switch (hs->state)
+    {
+    case HOST_STATE_CONNECTED:
+        // Advertising for the new slot starts from the disconnect event
+        hs->state = HOST_STATE_SWITCHING;
+        return HOST_ACTION_DISCONNECT;
+    case HOST_STATE_ADV_DIRECTED:
+    case HOST_STATE_ADV_UNDIRECTED:
+        return HOST_ACTION_RESTART_ADV;
+    case HOST_STATE_SWITCHING:
+        return HOST_ACTION_NONE;
+    case HOST_STATE_IDLE:
+    default:
+        return host_slots_start(hs);
+    }
+}
+
+bool host_slots_forget(host_slots_t *hs, uint8_t slot, host_addr_t *forgotten, host_action_t *action)
+{
+    *action = HOST_ACTION_NONE;
+    if (slot >= HOST_SLOTS_MAX || !hs->slots[slot].bonded)
+        return false;
+    *forgotten = hs->slots[slot].addr;
+    memset(&hs->slots[slot], 0, sizeof(hs->slots[slot]));
+    // Drop the link if the forgotten host is the one we are talking to
+    if (slot == hs->active && hs->state == HOST_STATE_CONNECTED)
+    {
+        hs->state = HOST_STATE_SWITCHING;
+        *action = HOST_ACTION_DISCONNECT;
+    }
+    return true;
+}
+
+bool host_slots_adopt(host_slots_t *hs, const host_addr_t *peer)
+{
+    if (host_slots_find(hs, peer) >= 0)
+        return false;
+    for (int i = 0; i < HOST_SLOTS_MAX; i++)
+    {
+        if (!hs->slots[i].bonded)
+        {
+            hs->slots[i].bonded = true;
+            hs->slots[i].addr = *peer;
+            return true;
+        }
+    }
+    return false;
+}
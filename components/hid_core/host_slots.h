@@ -0,0 +1,87 @@
+#ifndef HOST_SLOTS_H
+#define HOST_SLOTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+
+#define HOST_SLOTS_MAX 3 // matches CONFIG_BT_NIMBLE_MAX_BONDS
+
+// Same layout as NimBLE's ble_addr_t
+struct host_addr
+{
+    uint8_t type;
+    uint8_t val[6];
+};
+
+typedef struct
+{
+    bool bonded;
+    host_addr_t addr; // peer identity address
+} host_slot_t;
+
+typedef enum
+{
+    HOST_STATE_IDLE,
+    HOST_STATE_ADV_DIRECTED,   // high duty directed advertising to the active slot's host
+    HOST_STATE_ADV_UNDIRECTED, // pairing, or directed advertising went unanswered
+    HOST_STATE_CONNECTED,
+    HOST_STATE_SWITCHING, // dropping the current host before advertising to another
+} host_state_t;
+
+typedef enum
+{
+    HOST_ACTION_NONE,
+    HOST_ACTION_ADV_DIRECTED,
+    HOST_ACTION_ADV_UNDIRECTED,
+    HOST_ACTION_RESTART_ADV, // stop advertising, then start again for the new slot
+    HOST_ACTION_DISCONNECT,
+} host_action_t;
+
+// Keeps one bonded host per slot and decides how to reach the active one.
+// The HID device serves one host at a time; switching drops the current link
+// and advertises directed to the selected host, falling back to undirected
+// advertising when it does not answer or the slot is still empty. Hosts that
+// belong to another slot are turned away once their identity is known.
+typedef struct
+{
+    host_slot_t slots[HOST_SLOTS_MAX];
+    uint8_t active;
+    host_state_t state;
+    uint32_t switches;
+    uint32_t directed_connects;
+    uint32_t rejected;
+} host_slots_t;
+
+void host_slots_init(host_slots_t *hs);
+
+// Advertising action for the active slot; moves to the matching ADV state
+host_action_t host_slots_start(host_slots_t *hs);
+
+// Advertising ended without a connection
+host_action_t host_slots_adv_timeout(host_slots_t *hs);
+
+void host_slots_connected(host_slots_t *hs);
+void host_slots_disconnected(host_slots_t *hs);
+
+// Encryption is up and the peer identity is known. Binds a bonded peer to an
+// empty active slot (sets *changed so the caller can persist the table), or
+// asks to disconnect a peer that belongs elsewhere.
+host_action_t host_slots_encrypted(host_slots_t *hs, const host_addr_t *peer, bool bonded, bool *changed);
+
+// Makes `slot` the output host
+host_action_t host_slots_select(host_slots_t *hs, uint8_t slot);
+
+// Empties `slot` so the next host that pairs while it is active takes it;
+// returns false if it held no bond, otherwise copies the address to forget.
+// *action is HOST_ACTION_DISCONNECT when that host is the one connected.
+bool host_slots_forget(host_slots_t *hs, uint8_t slot, host_addr_t *forgotten, host_action_t *action);
+
+// Binds a bonded peer that no slot knows yet (e.g. a bond made before host
+// slots existed) to the first empty slot; returns true if it was bound
+bool host_slots_adopt(host_slots_t *hs, const host_addr_t *peer);
+
+// Slot bound to `peer`, or -1
+int host_slots_find(const host_slots_t *hs, const host_addr_t *peer);
+
+#endif
@@ -0,0 +1,66 @@
+#include "input.h"
+#include <string.h>
+
+static scan_mask_t input_read(void *ctx)
+{
+    input_t *in = ctx;
+    in->raw = in->cfg.gpio.read(in->cfg.gpio.ctx) & in->scan.key_mask;
+    return debounce_update(&in->debounce, in->raw);
+}
+
+static void input_send(input_t *in, uint8_t key, button_event_kind_t kind, bool long_press, int64_t time_us)
+{
+    button_event_t evt = {
+        .id_char = in->cfg.key_chars ? in->cfg.key_chars[key] : 0,
+        .key = key,
+        .kind = kind,
+        .long_press = long_press,
+        .time_us = time_us};
+    in->cfg.queue.push(in->cfg.queue.ctx, &evt);
+}
+
+// Inputs arrive already debounced
+static void input_scan_event(uint8_t key, bool pressed, int64_t now_us, void *ctx)
+{
+    input_t *in = ctx;
+    scan_mask_t bit = (scan_mask_t)1 << key;
+    if (pressed)
+    {
+        in->press_time_us[key] = now_us;
+        in->hold_pending |= bit;
+        input_send(in, key, BUTTON_EVT_DOWN, false, now_us);
+    }
+    else
+    {
+        bool held = !(in->hold_pending & bit);
+        in->hold_pending &= ~bit;
+        input_send(in, key, BUTTON_EVT_UP, held, now_us);
+    }
+}
+
+void input_init(input_t *in, const input_config_t *cfg)
+{
+    memset(in, 0, sizeof(*in));
+    in->cfg = *cfg;
+    debounce_init(&in->debounce, cfg->debounce_algo, cfg->debounce_ticks);
+    scan_init(&in->scan, cfg->num_keys, input_read, in, input_scan_event, in);
+}
+
+void input_tick(input_t *in)
+{
+    int64_t now = in->cfg.clock.now_us(in->cfg.clock.ctx);
+    scan_tick(&in->scan, now);
+
+    // Hold timer: only keys that are down and have not fired HOLD yet are visited
+    scan_mask_t pending = in->hold_pending;
+    while (pending)
+    {
+        uint8_t key = (uint8_t)__builtin_ctzll(pending);
+        pending &= pending - 1;
+        if (now - in->press_time_us[key] >= in->cfg.long_press_us)
+        {
+            in->hold_pending &= ~((scan_mask_t)1 << key);
+            input_send(in, key, BUTTON_EVT_HOLD, true, now);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "scan.h"
+#include "debounce.h"
+
+typedef enum
+{
+    BUTTON_EVT_DOWN, // debounced press edge
+    BUTTON_EVT_UP,   // debounced release edge
+    BUTTON_EVT_HOLD, // key still held after the long press threshold
+} button_event_kind_t;
+
+struct button_event
+{
+    char id_char;
+    uint8_t key;
+    button_event_kind_t kind;
+    bool long_press; // set on BUTTON_EVT_UP when a HOLD was already sent
+    int64_t time_us; // clock time of the edge that caused the event
+};
+
+typedef struct
+{
+    uint8_t num_keys;
+    debounce_algo_t debounce_algo;
+    uint8_t debounce_ticks; // in scan ticks
+    int64_t long_press_us;
+    const char *key_chars; // id_char of each key, may be NULL
+    hal_gpio_t gpio;
+    hal_clock_t clock;
+    hal_queue_t queue;
+} input_config_t;
+
+// Event generation: raw reads are debounced, edges become DOWN/UP events and
+// keys held past long_press_us get one HOLD. Call input_tick() once per
+// SCAN_PERIOD_US.
+typedef struct
+{
+    input_config_t cfg;
+    scan_t scan;
+    debounce_t debounce;
+    scan_mask_t raw; // last raw read
+    scan_mask_t hold_pending;
+    int64_t press_time_us[SCAN_MAX_KEYS];
+} input_t;
+
+void input_init(input_t *in, const input_config_t *cfg);
+void input_tick(input_t *in);
+
+// Every key is up, raw and debounced
+static inline bool input_idle(const input_t *in)
+{
+    return !in->raw && !in->scan.state;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include "keycodes.h"
+
+// Unshifted and shifted character produced by the same key
+#define KEY_PAIR(lower, upper, usage)   \
+    [lower] = KEYCODE(0, usage),        \
+    [upper] = KEYCODE(USB_HID_MODIFIER_LEFT_SHIFT, usage)
+
+// Entries shared by every layout derived from the US one
+#define LAYOUT_US_ENTRIES \
+    KEY_PAIR('a', 'A', USB_HID_KEY_A + 0), \
+    KEY_PAIR('b', 'B', USB_HID_KEY_A + 1), \
+    KEY_PAIR('c', 'C', USB_HID_KEY_A + 2), \
+    KEY_PAIR('d', 'D', USB_HID_KEY_A + 3), \
+    KEY_PAIR('e', 'E', USB_HID_KEY_A + 4), \
+    KEY_PAIR('f', 'F', USB_HID_KEY_A + 5), \
+    KEY_PAIR('g', 'G', USB_HID_KEY_A + 6), \
+    KEY_PAIR('h', 'H', USB_HID_KEY_A + 7), \
+    KEY_PAIR('i', 'I', USB_HID_KEY_A + 8), \
+    KEY_PAIR('j', 'J', USB_HID_KEY_A + 9), \
+    KEY_PAIR('k', 'K', USB_HID_KEY_A + 10), \
+    KEY_PAIR('l', 'L', USB_HID_KEY_A + 11), \
+    KEY_PAIR('m', 'M', USB_HID_KEY_A + 12), \
+    KEY_PAIR('n', 'N', USB_HID_KEY_A + 13), \
+    KEY_PAIR('o', 'O', USB_HID_KEY_A + 14), \
+    KEY_PAIR('p', 'P', USB_HID_KEY_A + 15), \
+    KEY_PAIR('q', 'Q', USB_HID_KEY_A + 16), \
+    KEY_PAIR('r', 'R', USB_HID_KEY_A + 17), \
+    KEY_PAIR('s', 'S', USB_HID_KEY_A + 18), \
+    KEY_PAIR('t', 'T', USB_HID_KEY_A + 19), \
+    KEY_PAIR('u', 'U', USB_HID_KEY_A + 20), \
+    KEY_PAIR('v', 'V', USB_HID_KEY_A + 21), \
+    KEY_PAIR('w', 'W', USB_HID_KEY_A + 22), \
+    KEY_PAIR('x', 'X', USB_HID_KEY_A + 23), \
+    KEY_PAIR('y', 'Y', USB_HID_KEY_A + 24), \
+    KEY_PAIR('z', 'Z', USB_HID_KEY_A + 25), \
+    KEY_PAIR('1', '!', USB_HID_KEY_1 + 0), \
+    KEY_PAIR('2', '@', USB_HID_KEY_1 + 1), \
+    KEY_PAIR('3', '#', USB_HID_KEY_1 + 2), \
+    KEY_PAIR('4', '$', USB_HID_KEY_1 + 3), \
+    KEY_PAIR('5', '%', USB_HID_KEY_1 + 4), \
+    KEY_PAIR('6', '^', USB_HID_KEY_1 + 5), \
+    KEY_PAIR('7', '&', USB_HID_KEY_1 + 6), \
+    KEY_PAIR('8', '*', USB_HID_KEY_1 + 7), \
+    KEY_PAIR('9', '(', USB_HID_KEY_1 + 8), \
+    KEY_PAIR('0', ')', USB_HID_KEY_0), \
+    KEY_PAIR('-', '_', USB_HID_MINUS), \
+    KEY_PAIR('=', '+', USB_HID_EQUAL), \
+    KEY_PAIR('[', '{', USB_HID_LBRACKET), \
+    KEY_PAIR(']', '}', USB_HID_RBRACKET), \
+    KEY_PAIR('\\', '|', USB_HID_BSLASH), \
+    KEY_PAIR(';', ':', USB_HID_SEMICOLON), \
+    KEY_PAIR('\'', '"', USB_HID_QUOTE), \
+    KEY_PAIR('`', '~', USB_HID_GRAVE), \
+    KEY_PAIR(',', '<', USB_HID_COMMA), \
+    KEY_PAIR('.', '>', USB_HID_DOT), \
+    KEY_PAIR('/', '?', USB_HID_FSLASH), \
+    [' '] = KEYCODE(0, USB_HID_SPACE), \
+    ['\n'] = KEYCODE(0, USB_HID_NEWLINE), \
+    ['\r'] = KEYCODE(0, USB_HID_NEWLINE), \
+    ['\t'] = KEYCODE(0, USB_HID_TAB), \
+    ['\b'] = KEYCODE(0, USB_HID_BACKSPACE), \
+    [0x1B] = KEYCODE(0, USB_HID_ESCAPE), \
+    [0x7F] = KEYCODE(0, USB_HID_DELETE),
+
+const keyboard_layout_t keyboard_layout_us = {
+    .name = "us",
+    .map = {LAYOUT_US_ENTRIES},
+};
+
+// UK differs from US only in a handful of keys; later designators override earlier ones
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+const keyboard_layout_t keyboard_layout_uk = {
+    .name = "uk",
+    .map = {
+        LAYOUT_US_ENTRIES
+        ['"'] = KEYCODE(USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_KEY_1 + 1),
+        ['@'] = KEYCODE(USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_QUOTE),
+        KEY_PAIR('#', '~', USB_HID_NON_US_HASH),
+        KEY_PAIR('\\', '|', USB_HID_NON_US_BSLASH),
+    },
+};
+#pragma GCC diagnostic pop
+
+const keyboard_layout_t *keyboard_layout = &keyboard_layout_us;
+
+void keycodes_set_layout(const keyboard_layout_t *layout)
+{
+    keyboard_layout = layout ? layout : &keyboard_layout_us;
+}
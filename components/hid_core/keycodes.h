@@ -0,0 +1,66 @@
+#ifndef KEYCODES_H
+#define KEYCODES_H
+
+#include <stdint.h>
+
+// USB keyboard modifier bits
+#define USB_HID_MODIFIER_LEFT_CTRL 0x01
+#define USB_HID_MODIFIER_LEFT_SHIFT 0x02
+#define USB_HID_MODIFIER_LEFT_ALT 0x04
+#define USB_HID_MODIFIER_LEFT_GUI 0x08
+#define USB_HID_MODIFIER_RIGHT_CTRL 0x10
+#define USB_HID_MODIFIER_RIGHT_SHIFT 0x20
+#define USB_HID_MODIFIER_RIGHT_ALT 0x40
+#define USB_HID_MODIFIER_RIGHT_GUI 0x80
+
+// USB keyboard usage IDs (Keyboard/Keypad page)
+#define USB_HID_KEY_A 0x04
+#define USB_HID_KEY_1 0x1E
+#define USB_HID_KEY_0 0x27
+#define USB_HID_NEWLINE 0x28
+#define USB_HID_ESCAPE 0x29
+#define USB_HID_BACKSPACE 0x2A
+#define USB_HID_TAB 0x2B
+#define USB_HID_SPACE 0x2C
+#define USB_HID_MINUS 0x2D
+#define USB_HID_EQUAL 0x2E
+#define USB_HID_LBRACKET 0x2F
+#define USB_HID_RBRACKET 0x30
+#define USB_HID_BSLASH 0x31
+#define USB_HID_NON_US_HASH 0x32
+#define USB_HID_SEMICOLON 0x33
+#define USB_HID_QUOTE 0x34
+#define USB_HID_GRAVE 0x35
+#define USB_HID_COMMA 0x36
+#define USB_HID_DOT 0x37
+#define USB_HID_FSLASH 0x38
+#define USB_HID_DELETE 0x4C
+#define USB_HID_NON_US_BSLASH 0x64
+
+// A keycode packs the modifier byte and the usage byte: (modifier << 8) | usage
+typedef uint16_t keycode_t;
+
+#define KEYCODE(mod, usage) ((keycode_t)(((mod) << 8) | (usage)))
+#define KEYCODE_MOD(k) ((uint8_t)((k) >> 8))
+#define KEYCODE_USAGE(k) ((uint8_t)((k) & 0xFF))
+
+typedef struct
+{
+    const char *name;
+    keycode_t map[128]; // indexed by 7-bit ASCII, 0 = no key
+} keyboard_layout_t;
+
+extern const keyboard_layout_t keyboard_layout_us;
+extern const keyboard_layout_t keyboard_layout_uk;
+
+extern const keyboard_layout_t *keyboard_layout;
+
+void keycodes_set_layout(const keyboard_layout_t *layout);
+
+static inline keycode_t ascii_to_keycode(char ch)
+{
+    unsigned char c = (unsigned char)ch;
+    return c < 128 ? keyboard_layout->map[c] : 0;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "keystore.h"
+#include <string.h>
+
+static uint32_t keystore_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+esp_err_t keystore_open(keystore_t *ks, const void *image, size_t size)
+{
+    memset(ks, 0, sizeof(*ks));
+    const uint8_t *base = image;
+    const keystore_header_t *hdr = image;
+
+    if (size < sizeof(*hdr) || hdr->magic != KEYSTORE_MAGIC)
+        return ESP_ERR_NOT_FOUND;
+    if (hdr->version != KEYSTORE_VERSION || hdr->header_size < sizeof(*hdr))
+        return ESP_ERR_INVALID_VERSION;
+    if (hdr->total_size > size || hdr->header_size > hdr->total_size)
+        return ESP_ERR_INVALID_SIZE;
+
+    size_t keymap_size = (size_t)hdr->num_layers * hdr->num_keys * sizeof(keystore_action_t);
+    size_t macros_size = (size_t)hdr->num_macros * sizeof(keystore_macro_t);
+    if (hdr->keymap_offset % 4 || hdr->macros_offset % 4 ||
+        hdr->keymap_offset < hdr->header_size || hdr->keymap_offset + keymap_size > hdr->total_size ||
+        hdr->macros_offset < hdr->header_size || hdr->macros_offset + macros_size > hdr->total_size)
+        return ESP_ERR_INVALID_SIZE;
+
+    const keystore_macro_t *macros = (const keystore_macro_t *)(base + hdr->macros_offset);
+    for (int i = 0; i < hdr->num_macros; i++)
+    {
+        if (macros[i].offset < hdr->header_size || (size_t)macros[i].offset + macros[i].len > hdr->total_size)
+            return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (keystore_crc32(base + hdr->header_size, hdr->total_size - hdr->header_size) != hdr->crc32)
+        return ESP_ERR_INVALID_CRC;
+
+    ks->base = base;
+    ks->header = hdr;
+    ks->keymap = (const keystore_action_t *)(base + hdr->keymap_offset);
+    ks->macros = macros;
+    return ESP_OK;
+}
+
+const uint8_t *keystore_macro(const keystore_t *ks, uint16_t index, uint16_t *len)
+{
+    if (ks->base == NULL || index >= ks->header->num_macros)
+    {
+        *len = 0;
+        return NULL;
+    }
+    *len = ks->macros[index].len;
+    return ks->base + ks->macros[index].offset;
+}
@@ -0,0 +1,96 @@
+#ifndef KEYSTORE_H
+#define KEYSTORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Keymap/macro image, little endian, built by tools/keystore.py:
+//
+//   keystore_header_t
+//   keystore_action_t keymap[num_layers][num_keys]
+//   keystore_macro_t  macros[num_macros]
+//   macro bytecode blobs
+//
+// The image is used in place (memory-mapped flash on target), so every
+// lookup is a pointer offset with no copy or allocation.
+#define KEYSTORE_MAGIC 0x534B504D // "MPKS"
+#define KEYSTORE_VERSION 1
+
+#define KEYSTORE_PARTITION_LABEL "keymap"
+#define KEYSTORE_PARTITION_SUBTYPE 0x40
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint8_t num_layers;
+    uint8_t num_keys;
+    uint16_t num_macros;
+    uint32_t keymap_offset;
+    uint32_t macros_offset;
+    uint32_t total_size;
+    uint32_t crc32; // over bytes [header_size, total_size)
+} keystore_header_t;
+
+typedef enum
+{
+    KEYSTORE_ACTION_NONE = 0,
+    KEYSTORE_ACTION_KEY = 1,      // arg0 = modifiers, arg1 = usage
+    KEYSTORE_ACTION_CONSUMER = 2, // arg1 = consumer usage
+    KEYSTORE_ACTION_MACRO = 3,    // arg1 = macro index
+    KEYSTORE_ACTION_MOUSE = 4,    // arg0 = buttons, arg1 = dx | dy << 8 (signed bytes)
+    KEYSTORE_ACTION_TRANSPARENT = 5,     // use the action of the next active layer below
+    KEYSTORE_ACTION_LAYER_MOMENTARY = 6, // arg1 = layer, active while held
+    KEYSTORE_ACTION_LAYER_TOGGLE = 7,    // arg1 = layer, flips on each press
+    KEYSTORE_ACTION_TAP_HOLD = 8,        // arg0 = modifiers when held, arg1 = usage when tapped
+    KEYSTORE_ACTION_HOST = 9,            // arg0 = 1 to forget the bond, arg1 = host slot
+    KEYSTORE_ACTION_MOUSE_MOVE = 10,     // arg1 = MOUSE_KEYS_* direction bits, accelerates while held
+    KEYSTORE_ACTION_SCROLL = 11,         // arg1 = SCROLL_* direction bits, glides on after release
+} keystore_action_type_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t arg0;
+    uint16_t arg1;
+} keystore_action_t;
+
+typedef struct
+{
+    uint32_t offset; // from the start of the image
+    uint16_t len;
+    uint16_t reserved;
+} keystore_macro_t;
+
+_Static_assert(sizeof(keystore_header_t) == 28, "keystore header layout");
+_Static_assert(sizeof(keystore_action_t) == 4, "keystore action layout");
+_Static_assert(sizeof(keystore_macro_t) == 8, "keystore macro layout");
+
+typedef struct
+{
+    const uint8_t *base;
+    const keystore_header_t *header;
+    const keystore_action_t *keymap;
+    const keystore_macro_t *macros;
+} keystore_t;
+
+// Validates an image that is already in memory and points `ks` into it
+esp_err_t keystore_open(keystore_t *ks, const void *image, size_t size);
+
+// Maps the keymap partition and opens the image found there
+esp_err_t keystore_mount(keystore_t *ks);
+
+static inline const keystore_action_t *keystore_action(const keystore_t *ks, uint8_t layer, uint8_t key)
+{
+    static const keystore_action_t none = {0};
+    if (ks->base == NULL || layer >= ks->header->num_layers || key >= ks->header->num_keys)
+        return &none;
+    return &ks->keymap[layer * ks->header->num_keys + key];
+}
+
+const uint8_t *keystore_macro(const keystore_t *ks, uint16_t index, uint16_t *len);
+
+#endif
@@ -0,0 +1,141 @@
+#include "layer.h"
+#include <string.h>
+
+void layer_init(layer_engine_t *le, const keystore_t *ks, layer_emit_fn_t emit, void *ctx)
+{
+    memset(le, 0, sizeof(*le));
+    le->ks = ks;
+    le->emit = emit;
+    le->ctx = ctx;
+    le->active = 1;
+    le->th_key = -1;
+    if (ks->base == NULL)
+        return;
+
+    uint8_t layers = ks->header->num_layers;
+    if (layers > LAYER_MAX_LAYERS)
+        layers = LAYER_MAX_LAYERS;
+    le->num_keys = ks->header->num_keys < LAYER_MAX_KEYS ? ks->header->num_keys : LAYER_MAX_KEYS;
+
+    for (uint8_t key = 0; key < le->num_keys; key++)
+    {
+        for (uint8_t layer = 0; layer < layers; layer++)
+        {
+            if (keystore_action(ks, layer, key)->type != KEYSTORE_ACTION_TRANSPARENT)
+                le->opaque[key] |= 1u << layer;
+        }
+    }
+}
+
+static void layer_update(layer_engine_t *le)
+{
+    le->active = 1 | le->toggled | le->momentary;
+}
+
+static uint8_t layer_resolve(const layer_engine_t *le, uint8_t key)
+{
+    uint32_t mask = le->opaque[key] & le->active;
+    return mask ? (uint8_t)(31 - __builtin_clz(mask)) : 0;
+}
+
+static void layer_emit_key(layer_engine_t *le, uint8_t mods, uint8_t usage, bool pressed)
+{
+    keystore_action_t action = {.type = KEYSTORE_ACTION_KEY, .arg0 = mods, .arg1 = usage};
+    le->emit(&action, pressed, le->ctx);
+}
+
+// Settles the pending tap-hold key as a hold: its modifiers go down now
+static void layer_th_hold(layer_engine_t *le)
+{
+    uint8_t key = (uint8_t)le->th_key;
+    const keystore_action_t *action = keystore_action(le->ks, le->pressed_layer[key], key);
+    le->th_key = -1;
+    le->th_holding |= 1ULL << key;
+    layer_emit_key(le, action->arg0, 0, true);
+}
+
+static void layer_run(layer_engine_t *le, uint8_t key, const keystore_action_t *action, bool pressed)
+{
+    uint8_t target = (uint8_t)(action->arg1 % LAYER_MAX_LAYERS);
+    switch (action->type)
+    {
+    case KEYSTORE_ACTION_LAYER_MOMENTARY:
+        if (pressed)
+        {
+            le->momentary_count[target]++;
+            le->momentary |= 1u << target;
+        }
+        else if (le->momentary_count[target] && --le->momentary_count[target] == 0)
+        {
+            le->momentary &= ~(1u << target);
+        }
+        layer_update(le);
+        break;
+
+    case KEYSTORE_ACTION_LAYER_TOGGLE:
+        if (pressed)
+        {
+            le->toggled ^= 1u << target;
+            layer_update(le);
+        }
+        break;
+
+    case KEYSTORE_ACTION_TAP_HOLD:
+        if (pressed)
+            break; // handled in layer_key
+        if (le->th_holding & (1ULL << key))
+        {
+            le->th_holding &= ~(1ULL << key);
+            layer_emit_key(le, action->arg0, 0, false);
+        }
+        else if (le->th_key == key)
+        {
+            // Released within the tapping term: a plain tap
+            le->th_key = -1;
+            layer_emit_key(le, 0, (uint8_t)action->arg1, true);
+            layer_emit_key(le, 0, (uint8_t)action->arg1, false);
+        }
+        break;
+
+    default:
+        le->emit(action, pressed, le->ctx);
+        break;
+    }
+}
+
+void layer_key(layer_engine_t *le, uint8_t key, bool pressed, int64_t now_us)
+{
+    if (key >= le->num_keys)
+        return;
+
+    layer_tick(le, now_us);
+
+    if (!pressed)
+    {
+        const keystore_action_t *action = keystore_action(le->ks, le->pressed_layer[key], key);
+        layer_run(le, key, action, false);
+        return;
+    }
+
+    // Any other key going down decides a pending tap-hold as hold, so the
+    // modifier is in place before that key is sent
+    if (le->th_key >= 0 && le->th_key != key)
+        layer_th_hold(le);
+
+    uint8_t layer = layer_resolve(le, key);
+    le->pressed_layer[key] = layer;
+    const keystore_action_t *action = keystore_action(le->ks, layer, key);
+    if (action->type == KEYSTORE_ACTION_TAP_HOLD)
+    {
+        le->th_key = key;
+        le->th_deadline = now_us + LAYER_TAPPING_TERM_US;
+        return;
+    }
+    layer_run(le, key, action, true);
+}
+
+void layer_tick(layer_engine_t *le, int64_t now_us)
+{
+    if (le->th_key >= 0 && now_us >= le->th_deadline)
+        layer_th_hold(le);
+}
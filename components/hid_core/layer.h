@@ -0,0 +1,52 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keystore.h"
+
+#define LAYER_MAX_LAYERS 32
+#define LAYER_MAX_KEYS 64
+#define LAYER_TAPPING_TERM_US (200 * 1000)
+#define LAYER_NO_DEADLINE INT64_MAX
+
+// Receives the resolved action for every press and release; tap-hold keys
+// are turned into plain KEYSTORE_ACTION_KEY actions before they get here
+typedef void (*layer_emit_fn_t)(const keystore_action_t *action, bool pressed, void *ctx);
+
+// Layer engine over a keystore image. Each key keeps a bitmask of the layers
+// where it is not transparent; ANDed with the active-layer mask, the highest
+// set bit is the layer that owns the key, so lookups never walk the stack.
+typedef struct
+{
+    const keystore_t *ks;
+    uint8_t num_keys;
+    uint32_t opaque[LAYER_MAX_KEYS];
+    uint32_t active;
+    uint32_t toggled;
+    uint32_t momentary;
+    uint8_t momentary_count[LAYER_MAX_LAYERS];
+    uint8_t pressed_layer[LAYER_MAX_KEYS]; // layer resolved at press, reused at release
+
+    // Tap-hold: at most one key is undecided at a time
+    int16_t th_key;
+    int64_t th_deadline;
+    uint64_t th_holding; // tap-hold keys resolved as hold and still down
+
+    layer_emit_fn_t emit;
+    void *ctx;
+} layer_engine_t;
+
+void layer_init(layer_engine_t *le, const keystore_t *ks, layer_emit_fn_t emit, void *ctx);
+void layer_key(layer_engine_t *le, uint8_t key, bool pressed, int64_t now_us);
+
+// Resolves a pending tap-hold once its tapping term has passed
+void layer_tick(layer_engine_t *le, int64_t now_us);
+
+// Time at which layer_tick() has work to do, LAYER_NO_DEADLINE if none
+static inline int64_t layer_next_deadline(const layer_engine_t *le)
+{
+    return le->th_key >= 0 ? le->th_deadline : LAYER_NO_DEADLINE;
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include "macro.h"
+#include <string.h>
+
+enum
+{
+    PENDING_NONE,
+    PENDING_KEY_UP,
+    PENDING_CONSUMER_UP,
+};
+
+void macro_init(macro_vm_t *vm, const uint8_t *code, uint32_t len)
+{
+    memset(vm, 0, sizeof(*vm));
+    vm->pc = code;
+    vm->end = code + len;
+}
+
+static void macro_keyboard_report(const macro_vm_t *vm, macro_step_t *step)
+{
+    step->kind = MACRO_STEP_REPORT;
+    step->report_id = MACRO_KEYBOARD_REPORT_ID;
+    step->len = 8;
+    memset(step->data, 0, sizeof(step->data));
+    step->data[0] = vm->mods;
+    memcpy(&step->data[2], vm->keys, vm->nkeys);
+}
+
+static void macro_key_down(macro_vm_t *vm, uint8_t usage)
+{
+    if (memchr(vm->keys, usage, vm->nkeys) || vm->nkeys == sizeof(vm->keys))
+        return;
+    vm->keys[vm->nkeys++] = usage;
+}
+
+static void macro_key_up(macro_vm_t *vm, uint8_t usage)
+{
+    for (int i = 0; i < vm->nkeys; i++)
+    {
+        if (vm->keys[i] == usage)
+        {
+            memmove(&vm->keys[i], &vm->keys[i + 1], vm->nkeys - i - 1);
+            vm->nkeys--;
+            return;
+        }
+    }
+}
+
+// Operand bytes still available at pc
+#define MACRO_HAS(vm, n) ((vm)->end - (vm)->pc >= (n))
+
+void macro_step(macro_vm_t *vm, macro_step_t *step)
+{
+    memset(step, 0, sizeof(*step));
+
+    if (vm->pending == PENDING_KEY_UP)
+    {
+        vm->pending = PENDING_NONE;
+        macro_key_up(vm, (uint8_t)vm->pending_usage);
+        macro_keyboard_report(vm, step);
+        return;
+    }
+    if (vm->pending == PENDING_CONSUMER_UP)
+    {
+        vm->pending = PENDING_NONE;
+        step->kind = MACRO_STEP_CONSUMER;
+        step->usage = vm->pending_usage;
+        step->pressed = false;
+        return;
+    }
+
+    if (vm->typing_active)
+    {
+        step->report_id = MACRO_KEYBOARD_REPORT_ID;
+        step->len = 8;
+        if (typing_next_report(&vm->typing, step->data))
+        {
+            step->kind = MACRO_STEP_REPORT;
+            return;
+        }
+        vm->typing_active = false;
+        // The typed run released everything; restore what the macro holds
+        if (vm->mods || vm->nkeys)
+        {
+            macro_keyboard_report(vm, step);
+            return;
+        }
+    }
+
+    while (1)
+    {
+        if (!MACRO_HAS(vm, 1))
+        {
+            step->kind = MACRO_STEP_DONE;
+            return;
+        }
+
+        uint8_t op = *vm->pc++;
+        switch (op)
+        {
+        case MACRO_OP_END:
+            vm->pc = vm->end;
+            step->kind = MACRO_STEP_DONE;
+            return;
+
+        case MACRO_OP_KEY_DOWN:
+        case MACRO_OP_KEY_UP:
+        case MACRO_OP_TAP:
+            if (!MACRO_HAS(vm, 1))
+                goto fail;
+            if (op == MACRO_OP_KEY_UP)
+            {
+                macro_key_up(vm, *vm->pc);
+            }
+            else
+            {
+                macro_key_down(vm, *vm->pc);
+            }
+            if (op == MACRO_OP_TAP)
+            {
+                vm->pending = PENDING_KEY_UP;
+                vm->pending_usage = *vm->pc;
+            }
+            vm->pc++;
+            macro_keyboard_report(vm, step);
+            return;
+
+        case MACRO_OP_MODS:
+            if (!MACRO_HAS(vm, 1))
+                goto fail;
+            vm->mods = *vm->pc++;
+            macro_keyboard_report(vm, step);
+            return;
+
+        case MACRO_OP_DELAY:
+            if (!MACRO_HAS(vm, 2))
+                goto fail;
+            step->kind = MACRO_STEP_DELAY;
+            step->delay_ms = vm->pc[0] | (vm->pc[1] << 8);
+            vm->pc += 2;
+            return;
+
+        case MACRO_OP_CONSUMER:
+            if (!MACRO_HAS(vm, 2))
+                goto fail;
+            step->kind = MACRO_STEP_CONSUMER;
+            step->usage = vm->pc[0] | (vm->pc[1] << 8);
+            step->pressed = true;
+            vm->pending = PENDING_CONSUMER_UP;
+            vm->pending_usage = step->usage;
+            vm->pc += 2;
+            return;
+
+        case MACRO_OP_MOUSE:
+            if (!MACRO_HAS(vm, 4))
+                goto fail;
+            step->kind = MACRO_STEP_REPORT;
+            step->report_id = MACRO_MOUSE_REPORT_ID;
+            step->len = MACRO_MOUSE_REPORT_LEN;
+            memcpy(step->data, vm->pc, 4);
+            step->data[4] = 0;
+            vm->pc += 4;
+            return;
+
+        case MACRO_OP_REPEAT:
+            if (!MACRO_HAS(vm, 1) || vm->depth == MACRO_MAX_DEPTH)
+                goto fail;
+            vm->loops[vm->depth].remaining = *vm->pc++;
+            vm->loops[vm->depth].body = vm->pc;
+            vm->depth++;
+            break;
+
+        case MACRO_OP_LOOP:
+            if (vm->depth == 0)
+                goto fail;
+            if (vm->loops[vm->depth - 1].remaining > 1)
+            {
+                vm->loops[vm->depth - 1].remaining--;
+                vm->pc = vm->loops[vm->depth - 1].body;
+            }
+            else
+            {
+                vm->depth--;
+            }
+            break;
+
+        case MACRO_OP_STRING:
+        {
+            if (!MACRO_HAS(vm, 1))
+                goto fail;
+            uint8_t len = *vm->pc;
+            if (!MACRO_HAS(vm, len + 2) || vm->pc[1 + len] != 0)
+                goto fail;
+            typing_init(&vm->typing, (const char *)vm->pc + 1);
+            vm->typing_active = true;
+            vm->pc += len + 2;
+            // Release everything so the run types as written; the held keys
+            // and mods stay in vm and are pressed again after the run
+            if (vm->mods || vm->nkeys)
+            {
+                step->kind = MACRO_STEP_REPORT;
+                step->report_id = MACRO_KEYBOARD_REPORT_ID;
+                step->len = 8;
+                return;
+            }
+            macro_step(vm, step);
+            return;
+        }
+
+        default:
+            goto fail;
+        }
+    }
+
+fail:
+    // Malformed bytecode stops the macro instead of reading past its end
+    vm->pc = vm->end;
+    step->kind = MACRO_STEP_ERROR;
+}
+
+int macro_cancel(macro_vm_t *vm, macro_step_t steps[MACRO_CANCEL_STEPS])
+{
+    int n = 0;
+    memset(steps, 0, MACRO_CANCEL_STEPS * sizeof(*steps));
+
+    steps[n].kind = MACRO_STEP_REPORT;
+    steps[n].report_id = MACRO_KEYBOARD_REPORT_ID;
+    steps[n++].len = 8;
+    steps[n].kind = MACRO_STEP_REPORT;
+    steps[n].report_id = MACRO_MOUSE_REPORT_ID;
+    steps[n++].len = MACRO_MOUSE_REPORT_LEN;
+    if (vm->pending == PENDING_CONSUMER_UP)
+    {
+        steps[n].kind = MACRO_STEP_CONSUMER;
+        steps[n++].usage = vm->pending_usage;
+    }
+
+    vm->pc = vm->end;
+    vm->pending = PENDING_NONE;
+    vm->typing_active = false;
+    vm->depth = 0;
+    vm->mods = 0;
+    vm->nkeys = 0;
+    return n;
+}
@@ -0,0 +1,78 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "typing.h"
+
+// Macro bytecode. Every instruction is an opcode byte followed by fixed
+// operands, except MACRO_OP_STRING which carries a length-prefixed,
+// NUL-terminated ASCII run so it can be typed straight from flash.
+// Multi-byte operands are little endian. Programs end with MACRO_OP_END.
+#define MACRO_OP_END 0x00
+#define MACRO_OP_KEY_DOWN 0x01 // usage
+#define MACRO_OP_KEY_UP 0x02   // usage
+#define MACRO_OP_TAP 0x03      // usage: down then up
+#define MACRO_OP_MODS 0x04     // modifier mask held from now on
+#define MACRO_OP_DELAY 0x05    // ms lo, ms hi
+#define MACRO_OP_CONSUMER 0x06 // usage lo, usage hi: tap a consumer usage
+#define MACRO_OP_MOUSE 0x07    // buttons, dx, dy, wheel (signed)
+#define MACRO_OP_REPEAT 0x08   // count: run the body up to the matching LOOP count times
+#define MACRO_OP_LOOP 0x09
+#define MACRO_OP_STRING 0x0A // len, bytes..., 0: type with all keys up, then press the held ones again
+
+#define MACRO_MAX_DEPTH 4
+#define MACRO_KEYBOARD_REPORT_ID 1
+#define MACRO_MOUSE_REPORT_ID 2
+#define MACRO_MOUSE_REPORT_LEN 5 // MACRO_OP_MOUSE operands plus a zero pan byte
+#define MACRO_CANCEL_STEPS 3
+
+typedef enum
+{
+    MACRO_STEP_REPORT,   // send report_id/data/len
+    MACRO_STEP_CONSUMER, // press or release consumer usage
+    MACRO_STEP_DELAY,    // wait delay_ms before the next step
+    MACRO_STEP_DONE,
+    MACRO_STEP_ERROR, // malformed bytecode, execution stopped
+} macro_step_kind_t;
+
+typedef struct
+{
+    macro_step_kind_t kind;
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t data[8];
+    uint16_t usage;
+    bool pressed;
+    uint16_t delay_ms;
+} macro_step_t;
+
+// Interpreter state. Bytecode is read in place (it can live in flash) and
+// nothing is allocated; one step produces at most one report.
+typedef struct
+{
+    const uint8_t *pc;
+    const uint8_t *end;
+    uint8_t mods;
+    uint8_t nkeys;
+    uint8_t keys[6];
+    uint8_t depth;
+    struct
+    {
+        const uint8_t *body;
+        uint8_t remaining;
+    } loops[MACRO_MAX_DEPTH];
+    uint8_t pending; // second half of a TAP or CONSUMER tap
+    uint16_t pending_usage;
+    bool typing_active;
+    typing_t typing;
+} macro_vm_t;
+
+void macro_init(macro_vm_t *vm, const uint8_t *code, uint32_t len);
+void macro_step(macro_vm_t *vm, macro_step_t *step);
+// Stops the macro and fills steps with what leaves the host with nothing held:
+// an empty keyboard report, an empty mouse report and the release of a consumer
+// usage still pressed. Returns the number of steps (at most MACRO_CANCEL_STEPS).
+int macro_cancel(macro_vm_t *vm, macro_step_t steps[MACRO_CANCEL_STEPS]);
+
+#endif
@@ -0,0 +1,83 @@
+#include "mouse_keys.h"
+#include <string.h>
+
+#define ONE_PIXEL ((int64_t)1 << MOUSE_KEYS_FRAC_BITS)
+#define INV_SQRT2 46341 // 1/sqrt(2) in Q16
+
+void mouse_keys_init(mouse_keys_t *mk, const mouse_keys_config_t *cfg)
+{
+    memset(mk, 0, sizeof(*mk));
+    mk->cfg = *cfg;
+}
+
+// Speed in Q16 pixels per second, `held_us` after the motion started
+static int64_t mouse_keys_speed(const mouse_keys_config_t *cfg, int64_t held_us)
+{
+    int64_t t = held_us - (int64_t)cfg->delay_ms * 1000;
+    int64_t frac = ONE_PIXEL;
+    if (t <= 0)
+        frac = 0;
+    else if (t < (int64_t)cfg->accel_ms * 1000)
+        frac = (t << MOUSE_KEYS_FRAC_BITS) / ((int64_t)cfg->accel_ms * 1000);
+    if (cfg->curve == MOUSE_KEYS_CURVE_QUADRATIC)
+        frac = (frac * frac) >> MOUSE_KEYS_FRAC_BITS;
+    return ((int64_t)cfg->start_speed << MOUSE_KEYS_FRAC_BITS) + ((int64_t)cfg->max_speed - cfg->start_speed) * frac;
+}
+
+// Integrates the held directions from last_us to now_us
+static void mouse_keys_advance(mouse_keys_t *mk, int64_t now_us)
+{
+    int64_t dt = now_us - mk->last_us;
+    if (dt <= 0)
+        return;
+    mk->last_us = now_us;
+    if (!mk->held)
+        return;
+    if (dt > MOUSE_KEYS_MAX_STEP_US)
+        dt = MOUSE_KEYS_MAX_STEP_US;
+
+    int vx = !!(mk->held & MOUSE_KEYS_RIGHT) - !!(mk->held & MOUSE_KEYS_LEFT);
+    int vy = !!(mk->held & MOUSE_KEYS_DOWN) - !!(mk->held & MOUSE_KEYS_UP);
+    // Speed at the middle of the step, so the result does not depend on the tick rate
+    int64_t dist = mouse_keys_speed(&mk->cfg, now_us - dt / 2 - mk->start_us) * dt / 1000000;
+    if (vx && vy)
+        dist = (dist * INV_SQRT2) >> 16;
+    mk->pos_x += vx * dist;
+    mk->pos_y += vy * dist;
+}
+
+void mouse_keys_press(mouse_keys_t *mk, uint8_t dirs, bool pressed, int64_t now_us)
+{
+    mouse_keys_advance(mk, now_us);
+    if (pressed && !mk->held)
+    {
+        // New motion: starts slow again and forgets the sub-pixel rest of the last one
+        mk->start_us = now_us;
+        mk->pos_x -= mk->pos_x % ONE_PIXEL;
+        mk->pos_y -= mk->pos_y % ONE_PIXEL;
+    }
+    if (pressed)
+        mk->held |= dirs;
+    else
+        mk->held &= ~dirs;
+}
+
+// Whole pixels of `pos` that fit one report; the rest stays for the next tick
+static int8_t mouse_keys_take(int64_t *pos)
+{
+    int64_t px = *pos / ONE_PIXEL;
+    if (px > 127)
+        px = 127;
+    else if (px < -127)
+        px = -127;
+    *pos -= px * ONE_PIXEL;
+    return (int8_t)px;
+}
+
+bool mouse_keys_tick(mouse_keys_t *mk, int64_t now_us, int8_t *dx, int8_t *dy)
+{
+    mouse_keys_advance(mk, now_us);
+    *dx = mouse_keys_take(&mk->pos_x);
+    *dy = mouse_keys_take(&mk->pos_y);
+    return *dx || *dy;
+}
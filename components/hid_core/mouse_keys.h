@@ -0,0 +1,72 @@
+#ifndef MOUSE_KEYS_H
+#define MOUSE_KEYS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Direction bits, also the arg1 of KEYSTORE_ACTION_MOUSE_MOVE
+#define MOUSE_KEYS_UP 0x01
+#define MOUSE_KEYS_DOWN 0x02
+#define MOUSE_KEYS_LEFT 0x04
+#define MOUSE_KEYS_RIGHT 0x08
+
+#define MOUSE_KEYS_FRAC_BITS 16 // sub-pixel precision of the position
+#define MOUSE_KEYS_MAX_STEP_US (250 * 1000) // longer gaps between ticks are not integrated
+
+typedef enum
+{
+    MOUSE_KEYS_CURVE_LINEAR,    // speed grows evenly over accel_ms
+    MOUSE_KEYS_CURVE_QUADRATIC, // slow start for fine positioning, then fast
+} mouse_keys_curve_t;
+
+typedef struct
+{
+    uint16_t start_speed; // pixels per second as soon as a key goes down
+    uint16_t max_speed;   // pixels per second after delay_ms + accel_ms
+    uint16_t delay_ms;    // held this long before accelerating
+    uint16_t accel_ms;
+    mouse_keys_curve_t curve;
+} mouse_keys_config_t;
+
+#define MOUSE_KEYS_DEFAULT_CONFIG    \
+    {                                \
+        .start_speed = 150,          \
+        .max_speed = 1500,           \
+        .delay_ms = 150,             \
+        .accel_ms = 1000,            \
+        .curve = MOUSE_KEYS_CURVE_QUADRATIC}
+
+// Mouse keys motion: held direction keys move the pointer at a speed that
+// follows the acceleration curve, integrated in fixed point over the time
+// between ticks. Opposite keys cancel and orthogonal ones combine into a
+// diagonal at the same speed. Sub-pixel remainders and motion past the
+// +-127 of one report carry over to the next tick, so the pointer covers
+// the same distance whatever the tick rate.
+typedef struct
+{
+    mouse_keys_config_t cfg;
+    uint8_t held;     // direction bits of the keys down
+    int64_t start_us; // first key of the current motion went down
+    int64_t last_us;  // position integrated up to here
+    int64_t pos_x;    // not yet reported, in 1 / 2^MOUSE_KEYS_FRAC_BITS pixels
+    int64_t pos_y;
+} mouse_keys_t;
+
+void mouse_keys_init(mouse_keys_t *mk, const mouse_keys_config_t *cfg);
+
+// Presses or releases the keys in `dirs`
+void mouse_keys_press(mouse_keys_t *mk, uint8_t dirs, bool pressed, int64_t now_us);
+
+// Advances the motion to now_us and takes the next report's deltas; returns
+// false when there is nothing to send
+bool mouse_keys_tick(mouse_keys_t *mk, int64_t now_us, int8_t *dx, int8_t *dy);
+
+// A key is down or whole pixels are still waiting to be reported; tick
+// about once per connection interval while this holds
+static inline bool mouse_keys_active(const mouse_keys_t *mk)
+{
+    const int64_t one = (int64_t)1 << MOUSE_KEYS_FRAC_BITS;
+    return mk->held || mk->pos_x >= one || mk->pos_x <= -one || mk->pos_y >= one || mk->pos_y <= -one;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#include "reconnect.h"
+#include <string.h>
+
+const reconnect_stage_params_t reconnect_stage_params[RECONNECT_STAGE_COUNT] = {
+    [RECONNECT_DIRECTED_HIGH] = {.directed = true, .high_duty = true, .duration_ms = 1280},
+    [RECONNECT_DIRECTED_LOW] = {.directed = true, .itvl_min_ms = 20, .itvl_max_ms = 30, .duration_ms = 10000},
+    [RECONNECT_UNDIRECTED] = {.itvl_min_ms = 30, .itvl_max_ms = 50, .duration_ms = 180000},
+};
+
+void reconnect_init(reconnect_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->stage = RECONNECT_IDLE;
+}
+
+reconnect_stage_t reconnect_begin(reconnect_t *r, bool bonded_peer, int64_t now_us)
+{
+    r->stage = bonded_peer ? RECONNECT_DIRECTED_HIGH : RECONNECT_UNDIRECTED;
+    r->started_us = now_us;
+    r->stats.attempts++;
+    return r->stage;
+}
+
+reconnect_stage_t reconnect_next(reconnect_t *r)
+{
+    if (r->stage >= RECONNECT_IDLE)
+        return RECONNECT_IDLE;
+    r->stage++;
+    if (r->stage == RECONNECT_IDLE)
+        r->stats.exhausted++;
+    return r->stage;
+}
+
+reconnect_stage_t reconnect_advance(reconnect_t *r, host_slots_t *hs)
+{
+    reconnect_stage_t stage = reconnect_next(r);
+    if (stage == RECONNECT_UNDIRECTED || stage == RECONNECT_IDLE)
+        host_slots_adv_timeout(hs);
+    return stage;
+}
+
+reconnect_stage_t reconnect_run(reconnect_t *r, host_slots_t *hs, const hal_ble_t *ble, const host_addr_t *peer)
+{
+    while (r->stage != RECONNECT_IDLE)
+    {
+        if (ble->adv_start(ble->ctx, &reconnect_stage_params[r->stage], peer) == 0)
+            break;
+        reconnect_advance(r, hs);
+    }
+    return r->stage;
+}
+
+void reconnect_connected(reconnect_t *r, int64_t now_us)
+{
+    if (r->stage >= RECONNECT_IDLE)
+        return;
+
+    reconnect_stats_t *s = &r->stats;
+    int64_t elapsed = now_us - r->started_us;
+    s->connects[r->stage]++;
+    s->last_us = elapsed;
+    s->total_us += elapsed;
+    if (s->min_us == 0 || elapsed < s->min_us)
+        s->min_us = elapsed;
+    if (elapsed > s->max_us)
+        s->max_us = elapsed;
+    r->stage = RECONNECT_IDLE;
+}
+
+void reconnect_cancel(reconnect_t *r)
+{
+    r->stage = RECONNECT_IDLE;
+}
@@ -0,0 +1,72 @@
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "host_slots.h"
+
+typedef enum
+{
+    RECONNECT_DIRECTED_HIGH, // high duty directed to the last host, controller caps it at 1.28 s
+    RECONNECT_DIRECTED_LOW,  // low duty directed, for hosts that scan slowly after waking
+    RECONNECT_UNDIRECTED,    // general discoverable, any host can find us or pair
+    RECONNECT_STAGE_COUNT,
+    RECONNECT_IDLE = RECONNECT_STAGE_COUNT, // every stage timed out
+} reconnect_stage_t;
+
+struct reconnect_stage_params
+{
+    bool directed;
+    bool high_duty;
+    uint16_t itvl_min_ms;
+    uint16_t itvl_max_ms;
+    int32_t duration_ms;
+};
+
+extern const reconnect_stage_params_t reconnect_stage_params[RECONNECT_STAGE_COUNT];
+
+typedef struct
+{
+    uint32_t attempts;
+    uint32_t connects[RECONNECT_STAGE_COUNT]; // which stage the host came back in
+    uint32_t exhausted;                       // all stages ran out without a connection
+    int64_t last_us;                          // advertising start to connection
+    int64_t min_us;
+    int64_t max_us;
+    int64_t total_us;
+} reconnect_stats_t;
+
+// Walks the advertising stages after a disconnect, from the most aggressive
+// towards plain discoverable mode, and measures how long hosts take to return
+typedef struct
+{
+    reconnect_stage_t stage;
+    int64_t started_us;
+    reconnect_stats_t stats;
+} reconnect_t;
+
+void reconnect_init(reconnect_t *r);
+
+// Starts a new attempt; directed stages are skipped without a bonded peer
+reconnect_stage_t reconnect_begin(reconnect_t *r, bool bonded_peer, int64_t now_us);
+
+// The current stage timed out or could not start; returns the next one
+reconnect_stage_t reconnect_next(reconnect_t *r);
+
+// reconnect_next(), with the host slots following from directed to
+// undirected to idle
+reconnect_stage_t reconnect_advance(reconnect_t *r, host_slots_t *hs);
+
+// Starts advertising for the current stage through ble->adv_start, stepping
+// past any stage the controller refuses; returns the stage advertising now,
+// RECONNECT_IDLE if none could start
+reconnect_stage_t reconnect_run(reconnect_t *r, host_slots_t *hs, const hal_ble_t *ble, const host_addr_t *peer);
+
+// A host connected while advertising; records the reconnect time
+void reconnect_connected(reconnect_t *r, int64_t now_us);
+
+// Advertising stopped on purpose (e.g. host switch), no metrics recorded
+void reconnect_cancel(reconnect_t *r);
+
+#endif
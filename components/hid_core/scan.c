@@ -0,0 +1,37 @@
+#include "scan.h"
+#include <string.h>
+
+void scan_init(scan_t *scan, uint8_t num_keys,
+               scan_read_fn_t read, void *read_ctx,
+               scan_event_fn_t on_event, void *event_ctx)
+{
+    memset(scan, 0, sizeof(*scan));
+    if (num_keys > SCAN_MAX_KEYS)
+    {
+        num_keys = SCAN_MAX_KEYS;
+    }
+    scan->num_keys = num_keys;
+    scan->key_mask = (num_keys == SCAN_MAX_KEYS) ? ~(scan_mask_t)0 : (((scan_mask_t)1 << num_keys) - 1);
+    scan->read = read;
+    scan->read_ctx = read_ctx;
+    scan->on_event = on_event;
+    scan->event_ctx = event_ctx;
+}
+
+void scan_tick(scan_t *scan, int64_t now_us)
+{
+    scan_mask_t raw = scan->read(scan->read_ctx) & scan->key_mask;
+    scan_mask_t changed = raw ^ scan->state;
+    scan->state = raw;
+
+    // Walk only the keys that changed, lowest index first
+    while (changed)
+    {
+        uint8_t key = (uint8_t)__builtin_ctzll(changed);
+        changed &= changed - 1;
+        if (scan->on_event)
+        {
+            scan->on_event(key, (raw >> key) & 1, now_us, scan->event_ctx);
+        }
+    }
+}
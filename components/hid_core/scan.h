@@ -0,0 +1,43 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCAN_MAX_KEYS 64
+#define SCAN_PERIOD_US 1000 // 1 ms scan tick
+
+// One bit per key, bit i set = key i is down
+typedef uint64_t scan_mask_t;
+
+// Reads the raw state of every key in a single pass
+typedef scan_mask_t (*scan_read_fn_t)(void *ctx);
+
+// Called once for every key whose state changed in a scan pass
+typedef void (*scan_event_fn_t)(uint8_t key, bool pressed, int64_t now_us, void *ctx);
+
+typedef struct
+{
+    uint8_t num_keys;
+    scan_mask_t key_mask;
+    scan_mask_t state;
+    scan_read_fn_t read;
+    void *read_ctx;
+    scan_event_fn_t on_event;
+    void *event_ctx;
+} scan_t;
+
+void scan_init(scan_t *scan, uint8_t num_keys,
+               scan_read_fn_t read, void *read_ctx,
+               scan_event_fn_t on_event, void *event_ctx);
+
+// Reads all keys once and reports every edge since the previous tick.
+// Cost is one backend read plus one callback per changed key.
+void scan_tick(scan_t *scan, int64_t now_us);
+
+static inline bool scan_is_down(const scan_t *scan, uint8_t key)
+{
+    return (scan->state >> key) & 1;
+}
+
+#endif
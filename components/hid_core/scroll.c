@@ -0,0 +1,104 @@
+#include "scroll.h"
+#include <string.h>
+
+#define ONE_DETENT ((int64_t)1 << SCROLL_FRAC_BITS)
+
+void scroll_init(scroll_t *s, const scroll_config_t *cfg)
+{
+    memset(s, 0, sizeof(*s));
+    s->cfg = *cfg;
+    s->mult_v = 1;
+    s->mult_h = 1;
+}
+
+void scroll_set_resolution(scroll_t *s, uint8_t mult_v, uint8_t mult_h)
+{
+    s->mult_v = mult_v ? mult_v : 1;
+    s->mult_h = mult_h ? mult_h : 1;
+}
+
+// Speed in Q16 detents per second, `held_us` after the first key went down
+static int64_t scroll_speed(const scroll_config_t *cfg, int64_t held_us)
+{
+    int64_t frac = ONE_DETENT;
+    if (held_us <= 0)
+        frac = 0;
+    else if (held_us < (int64_t)cfg->accel_ms * 1000)
+        frac = (held_us << SCROLL_FRAC_BITS) / ((int64_t)cfg->accel_ms * 1000);
+    return ((int64_t)cfg->start_speed << SCROLL_FRAC_BITS) + ((int64_t)cfg->max_speed - cfg->start_speed) * frac;
+}
+
+// Exponential decay over one step, tau / (tau + dt) stays stable for long steps
+static int64_t scroll_glide(int64_t vel, int64_t tau_us, int64_t dt)
+{
+    vel = tau_us ? vel * tau_us / (tau_us + dt) : 0;
+    return vel > -SCROLL_STOP_SPEED && vel < SCROLL_STOP_SPEED ? 0 : vel;
+}
+
+static void scroll_advance(scroll_t *s, int64_t now_us)
+{
+    int64_t dt = now_us - s->last_us;
+    if (dt <= 0)
+        return;
+    s->last_us = now_us;
+    if (dt > SCROLL_MAX_STEP_US)
+        dt = SCROLL_MAX_STEP_US;
+
+    int64_t vel_v = s->vel_v;
+    int64_t vel_h = s->vel_h;
+    if (s->held)
+    {
+        int64_t speed = scroll_speed(&s->cfg, now_us - s->start_us);
+        s->vel_v = (!!(s->held & SCROLL_UP) - !!(s->held & SCROLL_DOWN)) * speed;
+        s->vel_h = (!!(s->held & SCROLL_RIGHT) - !!(s->held & SCROLL_LEFT)) * speed;
+    }
+    else
+    {
+        int64_t tau_us = (int64_t)s->cfg.glide_ms * 1000;
+        s->vel_v = scroll_glide(s->vel_v, tau_us, dt);
+        s->vel_h = scroll_glide(s->vel_h, tau_us, dt);
+    }
+    // Trapezoid over the step
+    s->pos_v += (vel_v + s->vel_v) / 2 * dt / 1000000;
+    s->pos_h += (vel_h + s->vel_h) / 2 * dt / 1000000;
+}
+
+void scroll_press(scroll_t *s, uint8_t dirs, bool pressed, int64_t now_us)
+{
+    scroll_advance(s, now_us);
+    if (pressed && !s->held)
+        s->start_us = now_us;
+    if (pressed)
+        s->held |= dirs;
+    else
+        s->held &= ~dirs;
+}
+
+// Whole wheel units of `pos` that fit one report; the rest stays for the next tick
+static int8_t scroll_take(int64_t *pos, uint8_t mult)
+{
+    int64_t units = *pos * mult / ONE_DETENT;
+    if (units > 127)
+        units = 127;
+    else if (units < -127)
+        units = -127;
+    *pos -= units * ONE_DETENT / mult;
+    return (int8_t)units;
+}
+
+bool scroll_tick(scroll_t *s, int64_t now_us, int8_t *wheel, int8_t *pan)
+{
+    scroll_advance(s, now_us);
+    *wheel = scroll_take(&s->pos_v, s->mult_v);
+    *pan = scroll_take(&s->pos_h, s->mult_h);
+    return *wheel || *pan;
+}
+
+bool scroll_active(const scroll_t *s)
+{
+    if (s->held || s->vel_v || s->vel_h)
+        return true;
+    int64_t v = s->pos_v * s->mult_v;
+    int64_t h = s->pos_h * s->mult_h;
+    return v >= ONE_DETENT || v <= -ONE_DETENT || h >= ONE_DETENT || h <= -ONE_DETENT;
+}
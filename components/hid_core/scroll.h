@@ -0,0 +1,66 @@
+#ifndef SCROLL_H
+#define SCROLL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Direction bits, also the arg1 of KEYSTORE_ACTION_SCROLL
+#define SCROLL_UP 0x01
+#define SCROLL_DOWN 0x02
+#define SCROLL_LEFT 0x04
+#define SCROLL_RIGHT 0x08
+
+#define SCROLL_FRAC_BITS 16
+#define SCROLL_MAX_STEP_US (250 * 1000) // longer gaps between ticks are not integrated
+#define SCROLL_STOP_SPEED 8192          // momentum below 1/8 detent per second stops, Q16
+
+typedef struct
+{
+    uint16_t start_speed; // detents per second as soon as a key goes down
+    uint16_t max_speed;   // detents per second after accel_ms
+    uint16_t accel_ms;
+    uint16_t glide_ms; // time constant of the momentum after release, 0 stops at once
+} scroll_config_t;
+
+#define SCROLL_DEFAULT_CONFIG \
+    {                         \
+        .start_speed = 4,     \
+        .max_speed = 30,      \
+        .accel_ms = 800,      \
+        .glide_ms = 250}
+
+// Scroll keys with momentum. Held keys scroll at a speed ramping from
+// start_speed to max_speed; once released the speed decays exponentially
+// over glide_ms. Position is kept in fixed-point detents and reported in
+// wheel units of detent / multiplier, so with the host's Resolution
+// Multiplier enabled the same motion goes out as many small steps instead
+// of whole notches. Whatever does not fit one report carries over.
+typedef struct
+{
+    scroll_config_t cfg;
+    uint8_t held;
+    uint8_t mult_v; // wheel units per detent, 1 until the host enables high resolution
+    uint8_t mult_h;
+    int64_t start_us;
+    int64_t last_us;
+    int64_t vel_v; // Q16 detents per second, positive scrolls up
+    int64_t vel_h; // positive pans right
+    int64_t pos_v; // Q16 detents not yet reported
+    int64_t pos_h;
+} scroll_t;
+
+void scroll_init(scroll_t *s, const scroll_config_t *cfg);
+
+// Multipliers from the host's Resolution Multiplier feature report
+void scroll_set_resolution(scroll_t *s, uint8_t mult_v, uint8_t mult_h);
+
+void scroll_press(scroll_t *s, uint8_t dirs, bool pressed, int64_t now_us);
+
+// Advances to now_us and takes the next report's wheel and pan; returns
+// false when there is nothing to send
+bool scroll_tick(scroll_t *s, int64_t now_us, int8_t *wheel, int8_t *pan);
+
+// Keys are down, momentum is left or whole units wait to be reported
+bool scroll_active(const scroll_t *s);
+
+#endif
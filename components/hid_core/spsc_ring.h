@@ -0,0 +1,81 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Lock-free single-producer/single-consumer ring.
+//
+// SPSC_RING_DEFINE(name, type, capacity) declares `name_t` and the inline
+// functions name_init/push/pop/pop_batch/size/dropped. Capacity must be a
+// power of two. Head and tail live on separate cache lines so the producer
+// and consumer never write to the same line. Push never blocks and is safe
+// from ISR context as long as there is only one producer.
+
+#ifndef SPSC_CACHE_LINE
+#define SPSC_CACHE_LINE 64
+#endif
+
+#define SPSC_RING_DEFINE(name, type, capacity)                                                         \
+    _Static_assert((capacity) >= 2 && ((capacity) & ((capacity) - 1)) == 0,                            \
+                   #name " capacity must be a power of two");                                          \
+    typedef struct                                                                                     \
+    {                                                                                                  \
+        _Alignas(SPSC_CACHE_LINE) _Atomic uint32_t head; /* written by producer */                     \
+        uint32_t dropped;                                                                              \
+        _Alignas(SPSC_CACHE_LINE) _Atomic uint32_t tail; /* written by consumer */                     \
+        _Alignas(SPSC_CACHE_LINE) type slots[(capacity)];                                              \
+    } name##_t;                                                                                        \
+                                                                                                       \
+    static inline void name##_init(name##_t *r)                                                        \
+    {                                                                                                  \
+        atomic_store_explicit(&r->head, 0, memory_order_relaxed);                                      \
+        atomic_store_explicit(&r->tail, 0, memory_order_relaxed);                                      \
+        r->dropped = 0;                                                                                \
+    }                                                                                                  \
+                                                                                                       \
+    static inline bool name##_push(name##_t *r, const type *item)                                      \
+    {                                                                                                  \
+        uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);                          \
+        uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);                          \
+        if (head - tail >= (capacity))                                                                 \
+        {                                                                                              \
+            r->dropped++;                                                                              \
+            return false;                                                                              \
+        }                                                                                              \
+        r->slots[head & ((capacity) - 1)] = *item;                                                     \
+        atomic_store_explicit(&r->head, head + 1, memory_order_release);                               \
+        return true;                                                                                   \
+    }                                                                                                  \
+                                                                                                       \
+    static inline uint32_t name##_pop_batch(name##_t *r, type *out, uint32_t max)                      \
+    {                                                                                                  \
+        uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);                          \
+        uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);                          \
+        uint32_t n = head - tail;                                                                      \
+        if (n > max)                                                                                   \
+            n = max;                                                                                   \
+        for (uint32_t i = 0; i < n; i++)                                                               \
+            out[i] = r->slots[(tail + i) & ((capacity) - 1)];                                          \
+        atomic_store_explicit(&r->tail, tail + n, memory_order_release);                               \
+        return n;                                                                                      \
+    }                                                                                                  \
+                                                                                                       \
+    static inline bool name##_pop(name##_t *r, type *out)                                              \
+    {                                                                                                  \
+        return name##_pop_batch(r, out, 1) == 1;                                                       \
+    }                                                                                                  \
+                                                                                                       \
+    static inline uint32_t name##_size(name##_t *r)                                                    \
+    {                                                                                                  \
+        return atomic_load_explicit(&r->head, memory_order_acquire) -                                  \
+               atomic_load_explicit(&r->tail, memory_order_acquire);                                   \
+    }                                                                                                  \
+                                                                                                       \
+    static inline uint32_t name##_dropped(const name##_t *r)                                           \
+    {                                                                                                  \
+        return r->dropped;                                                                             \
+    }
+
+#endif
@@ -0,0 +1,129 @@
+#include "tx_flow.h"
+#include <string.h>
+
+void tx_flow_init(tx_flow_t *f)
+{
+    memset(f, 0, sizeof(*f));
+}
+
+static tx_flow_conn_t *tx_flow_find(tx_flow_t *f, uint16_t conn_handle)
+{
+    for (int i = 0; i < TX_FLOW_MAX_CONNS; i++)
+    {
+        if (f->conns[i].in_use && f->conns[i].conn_handle == conn_handle)
+            return &f->conns[i];
+    }
+    return NULL;
+}
+
+const tx_flow_conn_t *tx_flow_get(const tx_flow_t *f, uint16_t conn_handle)
+{
+    return tx_flow_find((tx_flow_t *)f, conn_handle);
+}
+
+void tx_flow_connected(tx_flow_t *f, uint16_t conn_handle, uint8_t limit)
+{
+    tx_flow_conn_t *c = tx_flow_find(f, conn_handle);
+    for (int i = 0; c == NULL && i < TX_FLOW_MAX_CONNS; i++)
+    {
+        if (!f->conns[i].in_use)
+            c = &f->conns[i];
+    }
+    if (c == NULL)
+        return;
+
+    memset(c, 0, sizeof(*c));
+    c->in_use = true;
+    c->conn_handle = conn_handle;
+    c->limit = limit ? limit : 1;
+}
+
+void tx_flow_disconnected(tx_flow_t *f, uint16_t conn_handle)
+{
+    tx_flow_conn_t *c = tx_flow_find(f, conn_handle);
+    if (c)
+        c->in_use = false;
+}
+
+bool tx_flow_due(tx_flow_t *f, uint16_t conn_handle, int64_t now_us, uint32_t interval_us)
+{
+    tx_flow_conn_t *c = tx_flow_find(f, conn_handle);
+    if (c == NULL)
+        return true;
+    if (now_us < c->next_us)
+        return false;
+    c->used = 0;
+    c->next_us = now_us + interval_us;
+    return true;
+}
+
+int64_t tx_flow_next_us(const tx_flow_t *f, uint16_t conn_handle)
+{
+    const tx_flow_conn_t *c = tx_flow_get(f, conn_handle);
+    return c ? c->next_us : 0;
+}
+
+bool tx_flow_acquire(tx_flow_t *f, uint16_t conn_handle)
+{
+    tx_flow_conn_t *c = tx_flow_find(f, conn_handle);
+    if (c == NULL)
+        return true;
+    if (c->used >= c->limit)
+    {
+        c->stalls++;
+        return false;
+    }
+    c->used++;
+    c->sent++;
+    return true;
+}
+
+void tx_flow_cancel(tx_flow_t *f, uint16_t conn_handle)
+{
+    tx_flow_conn_t *c = tx_flow_find(f, conn_handle);
+    if (c && c->used)
+    {
+        c->used--;
+        c->sent--;
+    }
+}
+
+bool tx_flow_add_handle(tx_flow_t *f, uint16_t attr_handle)
+{
+    for (int i = 0; i < f->num_handles; i++)
+    {
+        if (f->handles[i] == attr_handle)
+            return true;
+    }
+    if (f->num_handles == TX_FLOW_MAX_HANDLES)
+        return false;
+    f->handles[f->num_handles++] = attr_handle;
+    return true;
+}
+
+static bool tx_flow_ours(const tx_flow_t *f, uint16_t attr_handle)
+{
+    for (int i = 0; i < f->num_handles; i++)
+    {
+        if (f->handles[i] == attr_handle)
+            return true;
+    }
+    return f->num_handles == 0;
+}
+
+bool tx_flow_complete(tx_flow_t *f, uint16_t conn_handle, uint16_t attr_handle, int status)
+{
+    if (!tx_flow_ours(f, attr_handle))
+    {
+        f->foreign++;
+        return false;
+    }
+    tx_flow_conn_t *c = tx_flow_find(f, conn_handle);
+    if (c == NULL)
+        return false;
+    if (status == 0)
+        c->completed++;
+    else
+        c->failed++;
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef TX_FLOW_H
+#define TX_FLOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Set from CONFIG_BT_NIMBLE_MAX_CONNECTIONS by the component build
+#ifndef TX_FLOW_MAX_CONNS
+#define TX_FLOW_MAX_CONNS 3
+#endif
+#define TX_FLOW_DEFAULT_CREDITS 4 // notifications per connection interval, kept below the mbuf pool
+#define TX_FLOW_MAX_HANDLES 8     // characteristics whose notifications take credits
+
+typedef struct
+{
+    bool in_use;
+    uint16_t conn_handle;
+    uint8_t limit;
+    uint8_t used;    // credits taken in the current connection interval
+    int64_t next_us; // start of the next interval, see tx_flow_due
+    uint32_t sent;
+    uint32_t completed;
+    uint32_t failed;  // NOTIFY_TX with a non-zero status
+    uint32_t stalls;  // acquire found no credit left
+} tx_flow_conn_t;
+
+// Rate pacing for HID notifications. NimBLE reports BLE_GAP_EVENT_NOTIFY_TX
+// from inside the notify call, as soon as the notification is queued in the
+// host, so completions say nothing about controller buffers and only feed the
+// counters. Instead each connection gets `limit` credits per connection
+// interval: the sender flushes once tx_flow_due() opens a new interval, and
+// whatever the credits do not cover waits for the next one, coalescing
+// meanwhile. A full mbuf pool shows up as a failed send, which the caller
+// retries. Not thread safe, callers serialize access.
+typedef struct
+{
+    tx_flow_conn_t conns[TX_FLOW_MAX_CONNS];
+    uint16_t handles[TX_FLOW_MAX_HANDLES];
+    uint8_t num_handles;
+    uint32_t foreign; // completions for other characteristics, ignored
+} tx_flow_t;
+
+void tx_flow_init(tx_flow_t *f);
+void tx_flow_connected(tx_flow_t *f, uint16_t conn_handle, uint8_t limit);
+void tx_flow_disconnected(tx_flow_t *f, uint16_t conn_handle);
+
+// True when a new connection interval has begun at `now_us`: the credits are
+// refilled and the next interval starts `interval_us` later. Connections that
+// were never registered are always due.
+bool tx_flow_due(tx_flow_t *f, uint16_t conn_handle, int64_t now_us, uint32_t interval_us);
+
+// When tx_flow_due() opens the next interval; 0 for unregistered connections
+int64_t tx_flow_next_us(const tx_flow_t *f, uint16_t conn_handle);
+
+// Takes a credit; false when the link already sent `limit` notifications this
+// interval. Connections that were never registered are not limited.
+bool tx_flow_acquire(tx_flow_t *f, uint16_t conn_handle);
+
+// Returns a credit whose notification was rejected before reaching the stack
+void tx_flow_cancel(tx_flow_t *f, uint16_t conn_handle);
+
+// Registers the value handle of a characteristic whose notifications go
+// through tx_flow_acquire (the HID input reports); false when full. Until the
+// first one is registered every completion counts.
+bool tx_flow_add_handle(tx_flow_t *f, uint16_t attr_handle);
+
+// NOTIFY_TX for a notification; returns true if it was one of ours and was
+// counted. Completions for other characteristics (e.g. battery level) are not.
+bool tx_flow_complete(tx_flow_t *f, uint16_t conn_handle, uint16_t attr_handle, int status);
+
+const tx_flow_conn_t *tx_flow_get(const tx_flow_t *f, uint16_t conn_handle);
+
+#endif
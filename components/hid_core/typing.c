@@ -0,0 +1,77 @@
+#include "typing.h"
+#include "keycodes.h"
+#include <string.h>
+
+void typing_init(typing_t *t, const char *text)
+{
+    memset(t, 0, sizeof(*t));
+    t->text = text;
+}
+
+static bool typing_is_held(const typing_t *t, uint8_t usage)
+{
+    for (int i = 0; i < t->nkeys; i++)
+    {
+        if (t->keys[i] == usage)
+            return true;
+    }
+    return false;
+}
+
+// Returns the next mappable keycode, skipping characters with no key
+static keycode_t typing_peek(typing_t *t)
+{
+    while (*t->text)
+    {
+        keycode_t code = ascii_to_keycode(*t->text);
+        if (code)
+            return code;
+        t->text++;
+    }
+    return 0;
+}
+
+bool typing_next_report(typing_t *t, uint8_t report[TYPING_REPORT_LEN])
+{
+    memset(report, 0, TYPING_REPORT_LEN);
+
+    keycode_t code = typing_peek(t);
+    if (!code)
+    {
+        // Text finished: one final all-up report if anything is still held
+        if (t->nkeys == 0 && t->mod == 0)
+            return false;
+        t->nkeys = 0;
+        t->mod = 0;
+        return true;
+    }
+
+    uint8_t mod = KEYCODE_MOD(code);
+    if (mod != t->mod || typing_is_held(t, KEYCODE_USAGE(code)))
+    {
+        // Release the held keys and press the new modifier on its own, so it
+        // is down before any key that depends on it
+        t->nkeys = 0;
+        t->mod = mod;
+        report[0] = mod;
+        return true;
+    }
+
+    uint8_t held[TYPING_MAX_KEYS_PER_REPORT];
+    uint8_t nheld = t->nkeys;
+    memcpy(held, t->keys, nheld);
+
+    report[0] = mod;
+    t->nkeys = 0;
+    while (t->nkeys < TYPING_MAX_KEYS_PER_REPORT && (code = typing_peek(t)) != 0)
+    {
+        uint8_t usage = KEYCODE_USAGE(code);
+        if (KEYCODE_MOD(code) != mod || typing_is_held(t, usage) || memchr(held, usage, nheld))
+            break;
+        t->keys[t->nkeys] = usage;
+        report[2 + t->nkeys] = usage;
+        t->nkeys++;
+        t->text++;
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef TYPING_H
+#define TYPING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TYPING_REPORT_LEN 8
+#define TYPING_MAX_KEYS_PER_REPORT 6 // lower to 1 for hosts that reorder keys within a report
+
+// Turns a string into a minimal sequence of 8-byte boot keyboard reports.
+// Consecutive characters sharing a modifier are pressed together, up to
+// TYPING_MAX_KEYS_PER_REPORT at a time. A release report is only inserted
+// when a key would repeat or the modifier changes.
+typedef struct
+{
+    const char *text;
+    uint8_t mod;
+    uint8_t nkeys;
+    uint8_t keys[TYPING_MAX_KEYS_PER_REPORT];
+} typing_t;
+
+void typing_init(typing_t *t, const char *text);
+
+// Fills `report` with the next report to send; returns false when done
+bool typing_next_report(typing_t *t, uint8_t report[TYPING_REPORT_LEN]);
+
+#endif
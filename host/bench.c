@@ -0,0 +1,450 @@
+// Micro-benchmarks of the core input pipeline, run natively:
+//
+//   cmake -S host -B build_host && cmake --build build_host && build_host/hid_core_bench
+//
+// Each line is the mean cost of one call over many iterations. Host numbers
+// only rank changes against each other; they do not predict target timing.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "input.h"
+#include "debounce.h"
+#include "keystore.h"
+#include "layer.h"
+#include "typing.h"
+#include "keycodes.h"
+#include "coalesce.h"
+#include "hid_report.h"
+#include "mouse_keys.h"
+#include "spsc_ring.h"
+#include "dlog_ring.h"
+
+#define BENCH_NUM_KEYS 64
+#define BENCH_QUEUE_LEN 64
+#define BENCH_QUEUE_ITEMS 4000000
+#define BENCH_DLOG_LEN 128
+
+static volatile uint32_t s_sink; // keeps results alive
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start_ns, long iters)
+{
+    printf("%-36s %8.1f ns\n", name, (now_ns() - start_ns) / iters);
+}
+
+// Pseudo-random key chatter: a few keys toggle, the rest stay put
+static uint32_t s_rng = 12345;
+
+static uint32_t rng(void)
+{
+    s_rng = s_rng * 1664525 + 1013904223;
+    return s_rng;
+}
+
+// === HAL backends over plain variables ===
+static scan_mask_t s_keys;
+static int64_t s_now_us;
+
+static scan_mask_t bench_gpio_read(void *ctx)
+{
+    return s_keys;
+}
+
+static int64_t bench_clock(void *ctx)
+{
+    return s_now_us;
+}
+
+static bool bench_push(void *ctx, const button_event_t *evt)
+{
+    s_sink += evt->key;
+    return true;
+}
+
+static bool bench_send(void *ctx, uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    s_sink += data[0] + len;
+    return true;
+}
+
+static void bench_debounce(debounce_algo_t algo, const char *name)
+{
+    debounce_t db;
+    debounce_init(&db, algo, 5);
+    long iters = 2000000;
+    scan_mask_t raw = 0;
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        if ((i & 15) == 0)
+            raw ^= (scan_mask_t)1 << (rng() % BENCH_NUM_KEYS);
+        s_sink += (uint32_t)debounce_update(&db, raw);
+    }
+    report(name, start, iters);
+}
+
+static void bench_input(void)
+{
+    input_t in;
+    const input_config_t cfg = {
+        .num_keys = BENCH_NUM_KEYS,
+        .debounce_algo = DEBOUNCE_EAGER,
+        .debounce_ticks = 5,
+        .long_press_us = 500 * 1000,
+        .gpio = {.read = bench_gpio_read},
+        .clock = {.now_us = bench_clock},
+        .queue = {.push = bench_push}};
+    input_init(&in, &cfg);
+
+    long iters = 2000000;
+    s_keys = 0;
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        if ((i & 63) == 0)
+            s_keys ^= (scan_mask_t)1 << (rng() % BENCH_NUM_KEYS);
+        s_now_us += SCAN_PERIOD_US;
+        input_tick(&in);
+    }
+    report("input_tick (64 keys, 1 edge/64 ticks)", start, iters);
+
+    input_init(&in, &cfg);
+    s_keys = 0;
+    start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        s_now_us += SCAN_PERIOD_US;
+        input_tick(&in);
+    }
+    report("input_tick (idle)", start, iters);
+}
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static void layer_emit(const keystore_action_t *action, bool pressed, void *ctx)
+{
+    s_sink += action->arg1 + pressed;
+}
+
+// Four layers of plain keys with every other key transparent above layer 0
+static void bench_layer(void)
+{
+    enum
+    {
+        LAYERS = 4,
+        KEYS = BENCH_NUM_KEYS
+    };
+    static uint8_t image[sizeof(keystore_header_t) + LAYERS * KEYS * sizeof(keystore_action_t)];
+    keystore_header_t *hdr = (keystore_header_t *)image;
+    keystore_action_t *map = (keystore_action_t *)(image + sizeof(*hdr));
+    for (int l = 0; l < LAYERS; l++)
+    {
+        for (int k = 0; k < KEYS; k++)
+        {
+            keystore_action_t a = {.type = KEYSTORE_ACTION_KEY, .arg1 = 4 + k % 26};
+            if (l > 0 && (k & 1))
+                a.type = KEYSTORE_ACTION_TRANSPARENT;
+            if (l == 0 && k < LAYERS - 1)
+                a = (keystore_action_t){.type = KEYSTORE_ACTION_LAYER_TOGGLE, .arg1 = k + 1};
+            map[l * KEYS + k] = a;
+        }
+    }
+    *hdr = (keystore_header_t){
+        .magic = KEYSTORE_MAGIC,
+        .version = KEYSTORE_VERSION,
+        .header_size = sizeof(*hdr),
+        .num_layers = LAYERS,
+        .num_keys = KEYS,
+        .keymap_offset = sizeof(*hdr),
+        .macros_offset = sizeof(image),
+        .total_size = sizeof(image)};
+    hdr->crc32 = crc32(image + sizeof(*hdr), sizeof(image) - sizeof(*hdr));
+
+    keystore_t ks;
+    if (keystore_open(&ks, image, sizeof(image)) != ESP_OK)
+    {
+        printf("layer: keystore image rejected\n");
+        return;
+    }
+    layer_engine_t le;
+    layer_init(&le, &ks, layer_emit, NULL);
+    // Toggle every layer on so lookups fall through transparent keys
+    for (int k = 0; k < LAYERS - 1; k++)
+    {
+        layer_key(&le, k, true, 0);
+        layer_key(&le, k, false, 0);
+    }
+
+    long iters = 2000000;
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        uint8_t key = LAYERS + (i >> 1) % (KEYS - LAYERS);
+        layer_key(&le, key, !(i & 1), i);
+    }
+    report("layer_key (4 layers active)", start, iters);
+}
+
+static void bench_keycodes(void)
+{
+    static const char text[] = "The quick brown fox jumps over the lazy dog 0123456789!{}[]:;'\"~";
+    long iters = 20000000;
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+        s_sink += ascii_to_keycode(text[i % (sizeof(text) - 1)]);
+    report("ascii_to_keycode", start, iters);
+}
+
+static void bench_typing(void)
+{
+    static const char text[] = "The quick brown fox jumps over the lazy dog 0123456789!";
+    long iters = 200000;
+    uint8_t out[TYPING_REPORT_LEN];
+    long reports = 0;
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        typing_t t;
+        typing_init(&t, text);
+        while (typing_next_report(&t, out))
+            reports++;
+    }
+    double per_char = (now_ns() - start) / (iters * (double)(sizeof(text) - 1));
+    printf("%-36s %8.1f ns (%.2f reports/char)\n", "typing per character", per_char,
+           (double)reports / (iters * (double)(sizeof(text) - 1)));
+}
+
+static void bench_reports(void)
+{
+    hid_report_t r;
+    const hal_hid_sink_t sink = {.send = bench_send};
+    hid_report_init(&r, &sink);
+
+    long iters = 2000000;
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+        hid_report_key(&r, 0, 4 + (i >> 1) % 6, !(i & 1));
+    report("hid_report_key (6KRO)", start, iters);
+
+    // Rolling over 10 held keys: each step presses one and releases the oldest
+    hid_report_set_nkro(&r, true);
+    start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        long step = i >> 1;
+        if (i & 1)
+            hid_report_key(&r, 0, 4 + (step + 10) % 20, false);
+        else
+            hid_report_key(&r, 0, 4 + step % 20, true);
+    }
+    report("hid_report_key (NKRO)", start, iters);
+    hid_report_set_nkro(&r, false);
+
+    start = now_ns();
+    for (long i = 0; i < iters; i++)
+        hid_report_consumer(&r, HID_CONSUMER_VOLUME_UP, !(i & 1));
+    report("hid_report_consumer", start, iters);
+
+    coalesce_t c;
+    coalesce_init(&c);
+    coalesce_add(&c, HID_REPORT_ID_MOUSE, COALESCE_RELATIVE);
+    coalesce_add(&c, HID_REPORT_ID_KEYBOARD, COALESCE_ABSOLUTE);
+    uint8_t mouse[HID_REPORT_MOUSE_LEN] = {0, 3, (uint8_t)-2, 0, 0};
+    start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        coalesce_put(&c, HID_REPORT_ID_MOUSE, mouse, sizeof(mouse), i);
+        if ((i & 7) == 7)
+            coalesce_reset(&c);
+    }
+    report("coalesce_put (relative)", start, iters);
+}
+
+static void bench_mouse_keys(void)
+{
+    mouse_keys_t mk;
+    const mouse_keys_config_t cfg = MOUSE_KEYS_DEFAULT_CONFIG;
+    mouse_keys_init(&mk, &cfg);
+    mouse_keys_press(&mk, MOUSE_KEYS_UP | MOUSE_KEYS_RIGHT, true, 0);
+
+    long iters = 2000000;
+    int8_t dx, dy;
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+    {
+        mouse_keys_tick(&mk, (i + 1) * 7500, &dx, &dy);
+        s_sink += dx + dy;
+    }
+    report("mouse_keys_tick (diagonal)", start, iters);
+}
+
+// === Deferred logging against formatting in the caller ===
+// ESP_LOGI formats and writes the whole line in the calling task; DLOGI only
+// stores the arguments and the drain task does the same work later. Lines go
+// to /dev/null here, so the UART time ESP_LOGI also waits for on the target
+// is not counted.
+static void bench_dlog(void)
+{
+    static const char tag[] = "GAP";
+    static dlog_slot_t slots[BENCH_DLOG_LEN];
+    dlog_ring_t ring;
+    dlog_ring_init(&ring, slots, BENCH_DLOG_LEN);
+    FILE *out = fopen("/dev/null", "w");
+    if (out == NULL)
+        return;
+
+    long batches = 20000;
+    double write_ns = 0, drain_ns = 0;
+    char line[192];
+    dlog_entry_t e;
+    for (long b = 0; b < batches; b++)
+    {
+        double start = now_ns();
+        for (int i = 0; i < BENCH_DLOG_LEN; i++)
+        {
+            const uint32_t args[] = {i, 1, 0};
+            dlog_ring_write(&ring, i, 3, tag, "bench %d; conn_handle=%d status=%d", 3, args);
+        }
+        double mid = now_ns();
+        while (dlog_ring_pop(&ring, &e))
+        {
+            dlog_format(&e, line, sizeof(line));
+            fprintf(out, "%c (%u) %s: %s\n", 'I', (unsigned)(e.t_us / 1000), e.tag, line);
+        }
+        drain_ns += now_ns() - mid;
+        write_ns += mid - start;
+    }
+    long iters = batches * BENCH_DLOG_LEN;
+    printf("%-36s %8.1f ns\n", "DLOGI (caller)", write_ns / iters);
+    printf("%-36s %8.1f ns\n", "DLOGI (drain: format + write)", drain_ns / iters);
+
+    double start = now_ns();
+    for (long i = 0; i < iters; i++)
+        fprintf(out, "%c (%u) %s: bench %d; conn_handle=%d status=%d\n", 'I', (unsigned)(i / 1000), tag,
+                (int)(i & (BENCH_DLOG_LEN - 1)), 1, 0);
+    report("ESP_LOGI (caller: format + write)", start, iters);
+    fclose(out);
+}
+
+// === Event queue between two threads: SPSC ring against a mutex queue ===
+// A side that finds the queue full or empty yields, as the firmware's
+// consumer blocks; on a single core the numbers are mostly context switches.
+SPSC_RING_DEFINE(bench_ring, button_event_t, BENCH_QUEUE_LEN)
+
+static bench_ring_t s_ring;
+
+static void *bench_ring_producer(void *arg)
+{
+    button_event_t evt = {0};
+    for (uint32_t i = 0; i < BENCH_QUEUE_ITEMS; i++)
+    {
+        evt.time_us = i;
+        while (!bench_ring_push(&s_ring, &evt))
+            sched_yield();
+    }
+    return NULL;
+}
+
+// The same ring guarded by one mutex, as a FreeRTOS queue is by a critical section
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint32_t head;
+    uint32_t tail;
+    button_event_t slots[BENCH_QUEUE_LEN];
+} bench_mutex_queue_t;
+
+static bench_mutex_queue_t s_mq = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static bool bench_mq_push(bench_mutex_queue_t *q, const button_event_t *evt)
+{
+    pthread_mutex_lock(&q->lock);
+    bool ok = q->head - q->tail < BENCH_QUEUE_LEN;
+    if (ok)
+        q->slots[q->head++ % BENCH_QUEUE_LEN] = *evt;
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+static uint32_t bench_mq_pop_batch(bench_mutex_queue_t *q, button_event_t *out, uint32_t max)
+{
+    pthread_mutex_lock(&q->lock);
+    uint32_t n = 0;
+    while (n < max && q->tail != q->head)
+        out[n++] = q->slots[q->tail++ % BENCH_QUEUE_LEN];
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+static void *bench_mq_producer(void *arg)
+{
+    button_event_t evt = {0};
+    for (uint32_t i = 0; i < BENCH_QUEUE_ITEMS; i++)
+    {
+        evt.time_us = i;
+        while (!bench_mq_push(&s_mq, &evt))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void bench_queues(void)
+{
+    button_event_t out[8];
+    pthread_t producer;
+
+    bench_ring_init(&s_ring);
+    double start = now_ns();
+    pthread_create(&producer, NULL, bench_ring_producer, NULL);
+    for (uint32_t got = 0, n; got < BENCH_QUEUE_ITEMS; got += n)
+    {
+        if ((n = bench_ring_pop_batch(&s_ring, out, 8)) == 0)
+            sched_yield();
+    }
+    pthread_join(producer, NULL);
+    report("spsc ring, 2 threads (per event)", start, BENCH_QUEUE_ITEMS);
+
+    start = now_ns();
+    pthread_create(&producer, NULL, bench_mq_producer, NULL);
+    for (uint32_t got = 0, n; got < BENCH_QUEUE_ITEMS; got += n)
+    {
+        if ((n = bench_mq_pop_batch(&s_mq, out, 8)) == 0)
+            sched_yield();
+    }
+    pthread_join(producer, NULL);
+    report("mutex queue, 2 threads (per event)", start, BENCH_QUEUE_ITEMS);
+}
+
+int main(void)
+{
+    bench_debounce(DEBOUNCE_EAGER, "debounce_update (eager)");
+    bench_debounce(DEBOUNCE_DEFERRED, "debounce_update (deferred)");
+    bench_debounce(DEBOUNCE_INTEGRATOR, "debounce_update (integrator)");
+    bench_input();
+    bench_layer();
+    bench_keycodes();
+    bench_typing();
+    bench_reports();
+    bench_mouse_keys();
+    bench_dlog();
+    bench_queues();
+    return 0;
+}
@@ -0,0 +1,295 @@
+// Contact bounce replay through every debounce algorithm:
+//
+//   build_host/hid_bounce bounce.txt [-d MS]
+//   build_host/hid_bounce -n 500 -b 4000 -S 7
+//
+// A trace is the raw level of one contact, one transition per line with the
+// time in microseconds first ('#' starts a comment), as a logic analyzer
+// export reduces to:
+//
+//   0 1
+//   180 0
+//   420 1
+//
+// Without a file, presses with random bounce of up to -b microseconds on
+// both edges are generated. The level is sampled once per SCAN_PERIOD_US
+// tick, as scan.c does. A real edge is the first transition of a burst that
+// settles (holds for -s ms) at a new level; every algorithm is scored on the
+// latency it adds to real edges, the edges it reports that are not real
+// (false triggers) and the real edges it never reports (misses).
+// -c exits with an error if any algorithm has a false trigger or a miss.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include "debounce.h"
+
+typedef struct
+{
+    int64_t t_us;
+    bool level;
+} bounce_edge_t;
+
+typedef struct
+{
+    bounce_edge_t *v;
+    size_t n;
+    size_t cap;
+} bounce_edges_t;
+
+static struct
+{
+    uint32_t debounce_ms;
+    uint32_t settle_ms;
+    uint32_t presses;
+    uint32_t bounce_us;
+    uint32_t seed;
+    bool check;
+} s_cfg = {
+    .debounce_ms = 5,
+    .settle_ms = 10,
+    .presses = 200,
+    .bounce_us = 3000,
+    .seed = 1,
+};
+
+static uint32_t s_rng;
+
+static uint32_t rng(void)
+{
+    s_rng = s_rng * 1664525 + 1013904223;
+    return s_rng >> 8;
+}
+
+static void edges_add(bounce_edges_t *e, int64_t t_us, bool level)
+{
+    if (e->n && e->v[e->n - 1].level == level)
+        return;
+    if (e->n == e->cap)
+    {
+        e->cap = e->cap ? e->cap * 2 : 256;
+        e->v = realloc(e->v, e->cap * sizeof(*e->v));
+        if (e->v == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    e->v[e->n++] = (bounce_edge_t){.t_us = t_us, .level = level};
+}
+
+static bool trace_load(bounce_edges_t *raw, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    char line[128];
+    int lineno = 0;
+    int64_t last = INT64_MIN;
+    while (fgets(line, sizeof(line), f))
+    {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = 0;
+        long long t;
+        int level;
+        char extra;
+        int n = sscanf(line, "%lld %d %c", &t, &level, &extra);
+        if (n <= 0)
+            continue;
+        if (n != 2 || (level != 0 && level != 1) || t < last)
+        {
+            fprintf(stderr, "%s:%d: expected '<time_us> <0|1>' in time order\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+        last = t;
+        edges_add(raw, t, level);
+    }
+    fclose(f);
+    return true;
+}
+
+// Presses held 30-150 ms with 30-200 ms between them; each edge chatters for
+// up to bounce_us before settling
+static void trace_generate(bounce_edges_t *raw)
+{
+    int64_t t = 10000;
+    for (uint32_t p = 0; p < s_cfg.presses * 2; p++)
+    {
+        bool level = !(p & 1);
+        int toggles = s_cfg.bounce_us ? 2 * (rng() % 4) : 0;
+        int64_t bt = t;
+        edges_add(raw, bt, level);
+        for (int i = 0; i < toggles; i++)
+        {
+            bt += 1 + rng() % (s_cfg.bounce_us / (toggles + 1) + 1);
+            edges_add(raw, bt, (i & 1) ? level : !level);
+        }
+        t += (level ? 30000 + rng() % 120000 : 30000 + rng() % 170000);
+    }
+}
+
+// Real edges: the start of each burst that settles at a new level
+static void trace_real_edges(const bounce_edges_t *raw, bounce_edges_t *real)
+{
+    int64_t settle_us = (int64_t)s_cfg.settle_ms * 1000;
+    bool settled = false;
+    size_t burst = 0;
+    for (size_t i = 0; i < raw->n; i++)
+    {
+        bool last = i + 1 == raw->n;
+        if (!last && raw->v[i + 1].t_us - raw->v[i].t_us < settle_us)
+            continue;
+        if (raw->v[i].level != settled)
+        {
+            settled = raw->v[i].level;
+            edges_add(real, raw->v[burst].t_us, settled);
+        }
+        burst = i + 1;
+    }
+}
+
+typedef struct
+{
+    uint32_t reported;
+    uint32_t false_triggers;
+    uint32_t misses;
+    int64_t latency_sum;
+    int64_t latency_max;
+} bounce_score_t;
+
+static bounce_score_t replay(const bounce_edges_t *raw, const bounce_edges_t *real, debounce_algo_t algo)
+{
+    bounce_score_t score = {0};
+    debounce_t db;
+    debounce_init(&db, algo, s_cfg.debounce_ms * 1000 / SCAN_PERIOD_US);
+
+    int64_t end = (raw->n ? raw->v[raw->n - 1].t_us : 0) + (int64_t)(s_cfg.settle_ms + s_cfg.debounce_ms + 50) * 1000;
+    size_t r = 0;  // next raw transition
+    size_t e = 0;  // next real edge that can still be matched
+    bool out = false;
+    bool matched = false; // the current real edge was reported
+    for (int64_t t = 0; t <= end; t += SCAN_PERIOD_US)
+    {
+        while (r < raw->n && raw->v[r].t_us <= t)
+            r++;
+        bool level = r && raw->v[r - 1].level;
+        bool now = debounce_update(&db, level) & 1;
+        if (now == out)
+            continue;
+        out = now;
+        score.reported++;
+
+        // Move to the real edge this output belongs to
+        while (e < real->n && real->v[e].t_us <= t)
+        {
+            if (e && !matched)
+                score.misses++;
+            matched = false;
+            e++;
+        }
+        if (e && !matched && real->v[e - 1].level == now)
+        {
+            int64_t lat = t - real->v[e - 1].t_us;
+            score.latency_sum += lat;
+            if (lat > score.latency_max)
+                score.latency_max = lat;
+            matched = true;
+        }
+        else
+        {
+            score.false_triggers++;
+        }
+    }
+    // Real edges after the last output, or the last one itself, never showed
+    score.misses += (uint32_t)(real->n - e) + (e && !matched);
+    return score;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [trace.txt] [options]\n"
+            "  -d MS   debounce time (%" PRIu32 ")\n"
+            "  -s MS   a level held this long has settled (%" PRIu32 ")\n"
+            "  -n N    generated presses without a trace (%" PRIu32 ")\n"
+            "  -b US   generated bounce window (%" PRIu32 ")\n"
+            "  -S N    random seed (%" PRIu32 ")\n"
+            "  -c      fail on any false trigger or miss\n",
+            prog, s_cfg.debounce_ms, s_cfg.settle_ms, s_cfg.presses, s_cfg.bounce_us, s_cfg.seed);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:n:b:S:ch")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            s_cfg.debounce_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            s_cfg.settle_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            s_cfg.presses = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            s_cfg.bounce_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            s_cfg.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            s_cfg.check = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    bounce_edges_t raw = {0}, real = {0};
+    s_rng = s_cfg.seed;
+    if (optind < argc)
+    {
+        if (!trace_load(&raw, argv[optind]))
+            return 1;
+    }
+    else
+    {
+        trace_generate(&raw);
+    }
+    trace_real_edges(&raw, &real);
+
+    static const struct
+    {
+        debounce_algo_t algo;
+        const char *name;
+    } algos[] = {
+        {DEBOUNCE_EAGER, "eager"},
+        {DEBOUNCE_DEFERRED, "deferred"},
+        {DEBOUNCE_INTEGRATOR, "integrator"},
+    };
+    printf("# %zu raw transitions, %zu real edges, debounce %" PRIu32 " ms\n", raw.n, real.n, s_cfg.debounce_ms);
+    printf("%-12s %8s %8s %8s %10s %10s\n", "algorithm", "reported", "false", "missed", "mean us", "max us");
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(algos) / sizeof(algos[0]); i++)
+    {
+        bounce_score_t s = replay(&raw, &real, algos[i].algo);
+        uint32_t matched = s.reported - s.false_triggers;
+        printf("%-12s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %10.0f %10" PRId64 "\n", algos[i].name, s.reported,
+               s.false_triggers, s.misses, matched ? (double)s.latency_sum / matched : 0.0, s.latency_max);
+        failed |= s.false_triggers || s.misses;
+    }
+    free(raw.v);
+    free(real.v);
+    return s_cfg.check && failed;
+}
@@ -0,0 +1,394 @@
+// Notifications saved by coalesce.c under a typing trace:
+//
+//   build_host/hid_coalesce "The quick brown fox" [-w WPM] [-m HZ]
+//   build_host/hid_coalesce -w 120 -m 500 -i 30000 < text.txt
+//
+// Each string (an argument, or each line of stdin) is typed by a simulated
+// person at -w words per minute with random hold times, so fast typing rolls
+// over into overlapping keys; -m adds pointer motion reports at HZ the whole
+// time, as a mouse moved while typing. The reports come from hid_report.c and
+// reach the air two ways:
+//
+//   direct     every report is a notification, as before coalescing
+//   coalesced  hid_tx.c: reports fold into coalesce.c and are flushed at each
+//              connection event, or early when a merge would lose an edge
+//
+// Both go through the same stack model: at most -c notifications held by the
+// stack, -n of them leaving per connection event
+// of -i microseconds. The host side replays what arrives and counts key
+// presses and pointer distance, so a coalesced stream that lost a tap shows
+// up; -C exits with an error if the two streams differ in either.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include "hid_report.h"
+#include "coalesce.h"
+#include "keycodes.h"
+#include "tx_flow.h"
+
+#define SIM_MAX_REPORTS (1 << 20)
+
+typedef struct
+{
+    int64_t t_us;
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t data[HID_REPORT_MAX_LEN];
+} sim_report_t;
+
+typedef struct
+{
+    sim_report_t *v;
+    size_t n;
+} sim_trace_t;
+
+static struct
+{
+    uint32_t wpm;
+    uint32_t mouse_hz;
+    uint32_t conn_interval_us;
+    uint32_t per_event;
+    uint32_t credits;
+    uint32_t seed;
+    bool check;
+} s_cfg = {
+    .wpm = 90,
+    .conn_interval_us = 15000,
+    .per_event = TX_FLOW_DEFAULT_CREDITS,
+    .credits = TX_FLOW_DEFAULT_CREDITS,
+    .seed = 1,
+};
+
+static uint32_t s_rng;
+
+static uint32_t rng(void)
+{
+    s_rng = s_rng * 1664525 + 1013904223;
+    return s_rng >> 8;
+}
+
+// === Trace: what hid_report.c sends while the text is typed ===
+static int64_t s_now;
+
+static bool trace_send(void *ctx, uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    sim_trace_t *tr = ctx;
+    if (tr->n == SIM_MAX_REPORTS || len > HID_REPORT_MAX_LEN)
+        return false;
+    sim_report_t *r = &tr->v[tr->n++];
+    r->t_us = s_now;
+    r->report_id = report_id;
+    r->len = len;
+    memcpy(r->data, data, len);
+    return true;
+}
+
+typedef struct
+{
+    int64_t t_us;
+    keycode_t key;
+    bool pressed;
+} sim_edge_t;
+
+static int edge_cmp(const void *a, const void *b)
+{
+    const sim_edge_t *x = a, *y = b;
+    if (x->t_us != y->t_us)
+        return x->t_us < y->t_us ? -1 : 1;
+    return x->pressed - y->pressed; // releases first at the same time
+}
+
+// One press per character, a new one every 60 / (wpm * 5) s on average
+// (+-50 %), each held 50-130 ms; returns the number of characters typed
+static uint32_t trace_build(sim_trace_t *tr, const char *text)
+{
+    size_t len = strlen(text);
+    sim_edge_t *edges = malloc((2 * len + 1) * sizeof(*edges));
+    if (edges == NULL)
+        return 0;
+    int64_t gap = 60 * 1000000LL / ((int64_t)s_cfg.wpm * 5);
+    int64_t t = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        keycode_t k = ascii_to_keycode(text[i]);
+        if (k == 0)
+            continue;
+        int64_t hold = 50000 + rng() % 80000;
+        edges[n++] = (sim_edge_t){.t_us = t, .key = k, .pressed = true};
+        edges[n++] = (sim_edge_t){.t_us = t + hold, .key = k, .pressed = false};
+        t += gap / 2 + rng() % (gap + 1);
+    }
+    qsort(edges, n, sizeof(*edges), edge_cmp);
+    int64_t end = n ? edges[n - 1].t_us : 0;
+
+    hid_report_t r;
+    const hal_hid_sink_t sink = {.send = trace_send, .ctx = tr};
+    hid_report_init(&r, &sink);
+    int64_t mouse_period = s_cfg.mouse_hz ? 1000000 / s_cfg.mouse_hz : 0;
+    int64_t next_mouse = s_cfg.mouse_hz ? 0 : INT64_MAX;
+    size_t e = 0;
+    while (e < n || next_mouse <= end)
+    {
+        if (e < n && edges[e].t_us <= next_mouse)
+        {
+            s_now = edges[e].t_us;
+            hid_report_key(&r, KEYCODE_MOD(edges[e].key), KEYCODE_USAGE(edges[e].key), edges[e].pressed);
+            e++;
+        }
+        else
+        {
+            // A slow drift to the right with some jitter, as a hand on a mouse
+            s_now = next_mouse;
+            hid_report_mouse_move(&r, (int8_t)(1 + rng() % 4), (int8_t)(rng() % 5) - 2, 0, 0);
+            next_mouse += mouse_period;
+        }
+    }
+    free(edges);
+    return (uint32_t)(n / 2);
+}
+
+// Types `text` half a second after the end of the trace so far
+static uint32_t trace_append(sim_trace_t *tr, const char *text)
+{
+    int64_t offset = tr->n ? tr->v[tr->n - 1].t_us + 500000 : 0;
+    sim_trace_t line = {.v = tr->v + tr->n};
+    uint32_t chars = trace_build(&line, text);
+    for (size_t i = 0; i < line.n; i++)
+        line.v[i].t_us += offset;
+    tr->n += line.n;
+    return chars;
+}
+
+// === Stack and host ===
+typedef struct
+{
+    uint32_t notifications;
+    uint32_t presses;     // key usages the host saw go down
+    int64_t mouse_dx;     // pointer distance the host moved
+    int64_t latency_sum;  // report to connection event
+    int64_t latency_max;
+    uint32_t conn_events; // carrying at least one notification
+    hid_keyboard_report_t kbd;
+} sim_host_t;
+
+typedef struct
+{
+    sim_report_t q[64];
+    uint32_t count;
+    sim_host_t host;
+} sim_stack_t;
+
+static bool stack_push(sim_stack_t *s, uint8_t report_id, const uint8_t *data, uint8_t len, int64_t origin_us)
+{
+    if (s->count == s_cfg.credits)
+        return false;
+    sim_report_t *r = &s->q[s->count++];
+    r->t_us = origin_us;
+    r->report_id = report_id;
+    r->len = len;
+    memcpy(r->data, data, len);
+    return true;
+}
+
+static void host_receive(sim_host_t *h, const sim_report_t *r, int64_t now)
+{
+    h->notifications++;
+    int64_t lat = now - r->t_us;
+    h->latency_sum += lat;
+    if (lat > h->latency_max)
+        h->latency_max = lat;
+    if (r->report_id == HID_REPORT_ID_MOUSE)
+    {
+        hid_mouse_report_t m;
+        memcpy(&m, r->data, sizeof(m));
+        h->mouse_dx += m.x;
+    }
+    else if (r->report_id == HID_REPORT_ID_KEYBOARD)
+    {
+        // A usage in the key array that was not there before went down
+        hid_keyboard_report_t k;
+        memcpy(&k, r->data, sizeof(k));
+        for (int i = 0; i < HID_REPORT_KEYBOARD_KEYS; i++)
+        {
+            bool held = k.keys[i] == 0;
+            for (int j = 0; j < HID_REPORT_KEYBOARD_KEYS && !held; j++)
+                held = h->kbd.keys[j] == k.keys[i];
+            h->presses += !held;
+        }
+        h->kbd = k;
+    }
+}
+
+// A connection event: up to per_event notifications reach the host
+static void stack_event(sim_stack_t *s, int64_t now)
+{
+    uint32_t n = s->count < s_cfg.per_event ? s->count : s_cfg.per_event;
+    for (uint32_t i = 0; i < n; i++)
+        host_receive(&s->host, &s->q[i], now);
+    memmove(s->q, s->q + n, (s->count - n) * sizeof(s->q[0]));
+    s->count -= n;
+    s->host.conn_events += n > 0;
+}
+
+// Every report handed to the stack as soon as it has room
+static sim_host_t replay_direct(const sim_trace_t *tr)
+{
+    sim_stack_t s = {0};
+    int64_t conn = s_cfg.conn_interval_us;
+    size_t i = 0;
+    while (i < tr->n || s.count)
+    {
+        while (i < tr->n && tr->v[i].t_us < conn &&
+               stack_push(&s, tr->v[i].report_id, tr->v[i].data, tr->v[i].len, tr->v[i].t_us))
+            i++;
+        stack_event(&s, conn);
+        conn += s_cfg.conn_interval_us;
+    }
+    return s.host;
+}
+
+static bool coalesced_emit(uint8_t report_id, const uint8_t *data, uint8_t len, int64_t first_us, void *ctx)
+{
+    return stack_push(ctx, report_id, data, len, first_us);
+}
+
+// hid_tx.c: fold into coalesce.c, flush before each connection event, flush
+// early on a conflict and wait for the next event if the stack is full
+static sim_host_t replay_coalesced(const sim_trace_t *tr, coalesce_t *c)
+{
+    sim_stack_t s = {0};
+    coalesce_init(c);
+    coalesce_add(c, HID_REPORT_ID_MOUSE, COALESCE_RELATIVE);
+    coalesce_add(c, HID_REPORT_ID_KEYBOARD, COALESCE_ABSOLUTE);
+    int64_t conn = s_cfg.conn_interval_us;
+    size_t i = 0;
+    while (i < tr->n || s.count || coalesce_pending(c))
+    {
+        while (i < tr->n && tr->v[i].t_us < conn)
+        {
+            const sim_report_t *r = &tr->v[i];
+            coalesce_result_t res = coalesce_put(c, r->report_id, r->data, r->len, r->t_us);
+            if (res == COALESCE_CONFLICT)
+            {
+                coalesce_flush(c, coalesced_emit, &s);
+                res = coalesce_put(c, r->report_id, r->data, r->len, r->t_us);
+                if (res == COALESCE_CONFLICT)
+                    break; // blocked on a credit until the next event
+            }
+            i++;
+        }
+        coalesce_flush(c, coalesced_emit, &s);
+        stack_event(&s, conn);
+        conn += s_cfg.conn_interval_us;
+    }
+    return s.host;
+}
+
+static void print_row(const char *name, const sim_host_t *h, uint32_t reports)
+{
+    printf("%-10s %8" PRIu32 " %8" PRIu32 " %7.1f%% %8" PRIu32 " %9" PRIu32 " %9.0f %9" PRId64 " %8" PRId64 "\n", name,
+           reports, h->notifications, reports ? 100.0 * (1.0 - (double)h->notifications / reports) : 0.0,
+           h->conn_events, h->presses, h->notifications ? (double)h->latency_sum / h->notifications : 0.0,
+           h->latency_max, h->mouse_dx);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: hid_coalesce [options] [text ...]   (lines of stdin without text)\n"
+            "  -w WPM  typing speed, 5 characters a word (%" PRIu32 ")\n"
+            "  -m HZ   pointer motion reports per second while typing (off)\n"
+            "  -i US   connection interval (%" PRIu32 ")\n"
+            "  -n N    notifications per connection event (%" PRIu32 ")\n"
+            "  -c N    notifications the stack holds (%" PRIu32 ")\n"
+            "  -S N    random seed (%" PRIu32 ")\n"
+            "  -C      fail if coalescing changed the presses or pointer distance the host sees\n",
+            s_cfg.wpm, s_cfg.conn_interval_us, s_cfg.per_event, s_cfg.credits, s_cfg.seed);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "w:m:i:n:c:S:Ch")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            s_cfg.wpm = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            s_cfg.mouse_hz = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            s_cfg.conn_interval_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            s_cfg.per_event = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            s_cfg.credits = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            s_cfg.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'C':
+            s_cfg.check = true;
+            break;
+        default:
+            usage();
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (!s_cfg.wpm || s_cfg.mouse_hz > 1000000 || !s_cfg.conn_interval_us || !s_cfg.per_event || !s_cfg.credits ||
+        s_cfg.credits > 64)
+    {
+        usage();
+        return 2;
+    }
+
+    sim_trace_t tr = {.v = malloc(SIM_MAX_REPORTS * sizeof(sim_report_t))};
+    if (tr.v == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    s_rng = s_cfg.seed;
+    uint32_t chars = 0;
+    if (optind < argc)
+    {
+        for (int i = optind; i < argc; i++)
+            chars += trace_append(&tr, argv[i]);
+    }
+    else
+    {
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin))
+        {
+            line[strcspn(line, "\r\n")] = 0;
+            chars += trace_append(&tr, line);
+        }
+    }
+
+    coalesce_t c;
+    sim_host_t direct = replay_direct(&tr);
+    sim_host_t merged = replay_coalesced(&tr, &c);
+
+    printf("# %" PRIu32 " chars at %" PRIu32 " wpm, pointer %" PRIu32 " Hz, interval %" PRIu32 " us, %" PRIu32
+           " per event, %" PRIu32 " credits\n",
+           chars, s_cfg.wpm, s_cfg.mouse_hz, s_cfg.conn_interval_us, s_cfg.per_event, s_cfg.credits);
+    printf("%-10s %8s %8s %8s %8s %9s %9s %9s %8s\n", "path", "reports", "notifs", "saved", "events", "presses",
+           "mean us", "max us", "dx");
+    print_row("direct", &direct, (uint32_t)tr.n);
+    print_row("coalesced", &merged, (uint32_t)tr.n);
+    printf("# coalesce: %" PRIu32 " merged, %" PRIu32 " duplicates\n", c.merged, c.duplicates);
+    free(tr.v);
+
+    bool differ = direct.presses != merged.presses || direct.mouse_dx != merged.mouse_dx;
+    if (differ)
+        fprintf(stderr, "host saw different input: presses %" PRIu32 " vs %" PRIu32 ", dx %" PRId64 " vs %" PRId64 "\n",
+                direct.presses, merged.presses, direct.mouse_dx, merged.mouse_dx);
+    return s_cfg.check && differ;
+}
@@ -0,0 +1,50 @@
+#include "keystore_file.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static void *s_map;
+static size_t s_map_size;
+
+esp_err_t keystore_mount_file(keystore_t *ks, const char *path)
+{
+    memset(ks, 0, sizeof(*ks));
+    if (s_map)
+    {
+        munmap(s_map, s_map_size);
+        s_map = NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return ESP_ERR_NOT_FOUND;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return ESP_FAIL;
+
+    esp_err_t ret = keystore_open(ks, map, st.st_size);
+    if (ret != ESP_OK)
+    {
+        munmap(map, st.st_size);
+        return ret;
+    }
+    s_map = map;
+    s_map_size = st.st_size;
+    return ESP_OK;
+}
+
+esp_err_t keystore_mount(keystore_t *ks)
+{
+    const char *path = getenv(KEYSTORE_FILE_ENV);
+    return keystore_mount_file(ks, path ? path : KEYSTORE_FILE_DEFAULT);
+}
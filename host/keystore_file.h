@@ -0,0 +1,16 @@
+#ifndef KEYSTORE_FILE_H
+#define KEYSTORE_FILE_H
+
+#include "keystore.h"
+
+// Linux backend of the keymap partition: the image file is mapped read-only
+// with mmap and opened in place, as keystore_mount() does with flash on
+// target. Mounting another file unmaps the previous one, which invalidates
+// the keystore_t that pointed into it.
+esp_err_t keystore_mount_file(keystore_t *ks, const char *path);
+
+// Image used by keystore_mount() on the host
+#define KEYSTORE_FILE_ENV "KEYMAP_IMAGE"
+#define KEYSTORE_FILE_DEFAULT "keymap.bin"
+
+#endif
@@ -0,0 +1,1075 @@
+// Discrete-event replay of key traces through the core input pipeline:
+//
+//   build_host/hid_sim trace.txt [options]
+//   build_host/hid_sim -s 200 -b 800 -q
+//
+// The trace uses the format of tools/energy_model.py, one edge per line with
+// the time in milliseconds first ('#' starts a comment):
+//
+//   0 down u
+//   85 up u
+//
+// Keys are the characters of button_chars[] in main/button.c or key indexes.
+// Time is virtual: the 1 ms scan, the button event task, the transmit task
+// and BLE connection events run as events on one clock, so a run is
+// reproducible to the microsecond. input.c, the SPSC ring, the layer engine,
+// hid_report.c, the macro VM, coalescing and credit flow control are the
+// firmware's own code; the two FreeRTOS tasks are modeled after
+// button_event_handler_task() and hid_tx_task(), including tick rounding.
+//
+// Output is the report stream as the host receives it (time at the connection
+// event, report ID, bytes), drop counters and latency percentiles per stage.
+// With -C the exit status fails the run if a keystroke was lost or dropped on
+// the way, or the host is left with a key or button held.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <getopt.h>
+#include "input.h"
+#include "spsc_ring.h"
+#include "keystore.h"
+#include "keystore_file.h"
+#include "layer.h"
+#include "hid_report.h"
+#include "macro.h"
+#include "typing.h"
+#include "coalesce.h"
+#include "tx_flow.h"
+#include "mouse_keys.h"
+#include "scroll.h"
+#include "macros.h"
+
+// Firmware constants (main/button.c, main/global.h, main/hid_tx.h)
+#define SIM_NUM_BUTTONS 5
+#define SIM_LONG_PRESS_MS 500
+#define SIM_DEBOUNCE_MS 5
+#define SIM_QUEUE_LEN 64
+#define SIM_EVT_BATCH 8
+#define SIM_TX_QUEUE_LEN 32
+#define SIM_CONSUMER_QUEUE_LEN 16 // CONSUMER_STEP_QUEUE_LEN
+#define SIM_TX_PRIO_HIGH 0
+#define SIM_TX_PRIO_NORMAL 1
+#define SIM_CONN_HANDLE 1
+#define SIM_REPORT_HANDLE 0x20 // value handle of the input reports
+#define SIM_TAIL_US (3 * 1000 * 1000) // keeps running after the last edge
+#define SIM_NONE INT64_MAX
+#define SIM_REPORT_IDS 8
+
+static const char sim_button_chars[SIM_NUM_BUTTONS] = {'u', 'r', 'd', 'l', 'c'};
+
+SPSC_RING_DEFINE(sim_ring, button_event_t, SIM_QUEUE_LEN)
+
+// Macro consumer steps posted by the transmit task to the event task
+typedef struct
+{
+    uint16_t usage;
+    bool pressed;
+    int64_t origin_us;
+} sim_consumer_step_t;
+
+SPSC_RING_DEFINE(sim_consumer_ring, sim_consumer_step_t, SIM_CONSUMER_QUEUE_LEN)
+
+typedef struct
+{
+    int64_t t_us;
+    uint8_t key;
+    bool down;
+    bool bounce; // chatter added around a real edge, not a keystroke
+} sim_edge_t;
+
+typedef enum
+{
+    SIM_JOB_REPORT,
+    SIM_JOB_MACRO,
+} sim_job_kind_t;
+
+typedef struct
+{
+    sim_job_kind_t kind;
+    int64_t origin_us; // raw edge of the key that caused it
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t data[HID_REPORT_MAX_LEN];
+    const uint8_t *code;
+    uint16_t code_len;
+} sim_job_t;
+
+typedef struct
+{
+    sim_job_t jobs[SIM_TX_QUEUE_LEN];
+    uint32_t head;
+    uint32_t count;
+} sim_job_queue_t;
+
+// Notifications handed to the stack, sent at the next connection events
+typedef struct
+{
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t data[HID_REPORT_MAX_LEN];
+    int64_t origin_us;
+    int64_t handed_us;
+} sim_notify_t;
+
+typedef struct
+{
+    int64_t *v;
+    size_t n;
+    size_t cap;
+} sim_samples_t;
+
+// === Settings ===
+static struct
+{
+    uint8_t num_keys;
+    debounce_algo_t debounce_algo;
+    uint32_t debounce_ms;
+    uint32_t long_press_ms;
+    uint32_t tick_hz;
+    uint32_t task_latency_us;
+    uint32_t conn_interval_us;
+    uint32_t conn_phase_us;
+    uint32_t per_event;
+    uint32_t credits;
+    uint32_t bounce_us;
+    uint32_t seed;
+    bool hires_scroll; // the host enabled both Resolution Multipliers
+    bool boot_protocol; // 6-key keyboard reports only (CONFIG_HID_NKRO off or a boot host)
+    bool quiet;
+    bool check;
+} s_cfg = {
+    .num_keys = SIM_NUM_BUTTONS,
+    .debounce_algo = DEBOUNCE_EAGER,
+    .debounce_ms = SIM_DEBOUNCE_MS,
+    .long_press_ms = SIM_LONG_PRESS_MS,
+    .tick_hz = 100, // CONFIG_FREERTOS_HZ
+    .task_latency_us = 20,
+    .conn_interval_us = 15000,
+    .per_event = TX_FLOW_DEFAULT_CREDITS,
+    .credits = TX_FLOW_DEFAULT_CREDITS,
+    .seed = 1,
+};
+
+// === Simulation state ===
+static int64_t s_now;
+static sim_edge_t *s_edges;
+static size_t s_num_edges;
+static size_t s_next_edge;
+static scan_mask_t s_keys;
+static int64_t s_edge_us[SCAN_MAX_KEYS]; // last real edge of each key
+
+static input_t s_input;
+static sim_ring_t s_queue;
+static uint32_t s_queue_max;
+static int64_t s_handler_wake = SIM_NONE;
+static keystore_t s_keystore;
+static layer_engine_t s_layers;
+static hid_report_t s_report;
+static int64_t s_origin_us; // raw edge behind the event being handled
+static sim_consumer_ring_t s_consumer_steps;
+static mouse_keys_t s_mouse_keys;
+static scroll_t s_scroll;
+static uint32_t s_pointer_period_us;
+static int64_t s_pointer_timer = SIM_NONE;
+
+static sim_job_queue_t s_tx_queues[2];
+static coalesce_t s_coalesce;
+static tx_flow_t s_flow;
+static macro_vm_t s_vm;
+static sim_job_t s_active_job;
+static bool s_active;
+static int64_t s_resume_us;
+static bool s_blocked; // transmit task waiting for a credit with this report
+static sim_job_t s_blocked_report;
+static bool s_tx_running;
+static bool s_tx_again;
+static int64_t s_tx_wake = SIM_NONE;
+
+static sim_notify_t s_stack[TX_FLOW_DEFAULT_CREDITS * 16];
+static uint32_t s_stack_head;
+static uint32_t s_stack_count;
+static sim_notify_t s_host[SIM_REPORT_IDS]; // last report the host got per ID
+
+static struct
+{
+    uint32_t edges;
+    uint32_t bounces;
+    uint32_t downs;
+    uint32_t ups;
+    uint32_t holds;
+    uint32_t tx_dropped;
+    uint32_t consumer_failed; // macro consumer presses not queued or refused
+    uint32_t sent;
+    uint32_t conn_events;
+    uint32_t busy_events; // connection events that carried a report
+    int64_t last_report_us;
+} s_stats;
+
+static sim_samples_t s_debounce_lat;
+static sim_samples_t s_queue_lat;
+static sim_samples_t s_stack_lat;
+static sim_samples_t s_total_lat;
+
+static void samples_add(sim_samples_t *s, int64_t v)
+{
+    if (s->n == s->cap)
+    {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->v = realloc(s->v, s->cap * sizeof(*s->v));
+    }
+    s->v[s->n++] = v;
+}
+
+// === Trace loading ===
+static uint32_t s_rng;
+
+static uint32_t rng(void)
+{
+    s_rng = s_rng * 1664525 + 1013904223;
+    return s_rng >> 8;
+}
+
+static void edge_add(int64_t t_us, uint8_t key, bool down, bool bounce)
+{
+    static size_t cap;
+    if (s_num_edges == cap)
+    {
+        cap = cap ? cap * 2 : 256;
+        s_edges = realloc(s_edges, cap * sizeof(*s_edges));
+    }
+    s_edges[s_num_edges++] = (sim_edge_t){.t_us = t_us, .key = key, .down = down, .bounce = bounce};
+}
+
+static int key_index(const char *name)
+{
+    char *end;
+    long n = strtol(name, &end, 10);
+    if (*end == '\0')
+        return n >= 0 && n < s_cfg.num_keys ? (int)n : -1;
+    for (int i = 0; name[1] == '\0' && i < SIM_NUM_BUTTONS && i < s_cfg.num_keys; i++)
+    {
+        if (sim_button_chars[i] == name[0])
+            return i;
+    }
+    return -1;
+}
+
+static bool trace_load(const char *path)
+{
+    FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    int n = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        n++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        double ms;
+        char kind[16], key[16];
+        int fields = sscanf(line, "%lf %15s %15s", &ms, kind, key);
+        if (fields <= 0)
+            continue;
+        int k = fields == 3 ? key_index(key) : -1;
+        if (fields != 3 || k < 0 || (strcmp(kind, "down") && strcmp(kind, "up")))
+        {
+            fprintf(stderr, "%s:%d: expected '<ms> down|up <key>'\n", path, n);
+            return false;
+        }
+        edge_add((int64_t)(ms * 1000), (uint8_t)k, kind[0] == 'd', false);
+    }
+    if (f != stdin)
+        fclose(f);
+    return true;
+}
+
+// Typing-like bursts: Poisson key presses at `rate` per second, mostly short
+// taps with one in ten held past the long press threshold
+static void trace_synthesize(uint32_t strokes, uint32_t rate)
+{
+    int64_t t = 100 * 1000;
+    int64_t free_at[SCAN_MAX_KEYS] = {0};
+    for (uint32_t i = 0; i < strokes; i++)
+    {
+        // Exponential gaps from a uniform draw, in microseconds
+        double u = (rng() + 1.0) / (1 << 24);
+        t += (int64_t)(-1e6 / rate * log(u));
+        uint8_t key = rng() % s_cfg.num_keys;
+        if (t < free_at[key])
+            t = free_at[key];
+        int64_t hold = rng() % 10 == 0 ? (int64_t)s_cfg.long_press_ms * 1000 + rng() % 300000 : 40000 + rng() % 100000;
+        edge_add(t, key, true, false);
+        edge_add(t + hold, key, false, false);
+        free_at[key] = t + hold + 20000;
+    }
+}
+
+static int edge_cmp(const void *a, const void *b)
+{
+    const sim_edge_t *x = a, *y = b;
+    if (x->t_us != y->t_us)
+        return x->t_us < y->t_us ? -1 : 1;
+    return x->bounce - y->bounce;
+}
+
+// Contact chatter: each real edge gets up to four extra transitions spread
+// over the bounce window, ending in the real level
+static void trace_add_bounce(void)
+{
+    size_t n = s_num_edges;
+    for (size_t i = 0; s_cfg.bounce_us && i < n; i++)
+    {
+        sim_edge_t e = s_edges[i];
+        uint32_t toggles = (rng() % 3) * 2; // even, so the final level is unchanged
+        int64_t t = e.t_us;
+        bool level = e.down;
+        for (uint32_t j = 0; j < toggles; j++)
+        {
+            t += 1 + rng() % (s_cfg.bounce_us / (toggles + 1) + 1);
+            level = !level;
+            edge_add(t, e.key, level, true);
+        }
+    }
+    qsort(s_edges, s_num_edges, sizeof(*s_edges), edge_cmp);
+}
+
+// === Input HAL backends ===
+static scan_mask_t sim_gpio_read(void *ctx)
+{
+    return s_keys;
+}
+
+static int64_t sim_clock(void *ctx)
+{
+    return s_now;
+}
+
+static bool sim_push(void *ctx, const button_event_t *evt)
+{
+    if (evt->kind == BUTTON_EVT_DOWN)
+        s_stats.downs++;
+    else if (evt->kind == BUTTON_EVT_UP)
+        s_stats.ups++;
+    else
+        s_stats.holds++;
+    if (evt->kind != BUTTON_EVT_HOLD)
+        samples_add(&s_debounce_lat, evt->time_us - s_edge_us[evt->key]);
+
+    if (!sim_ring_push(&s_queue, evt))
+        return false;
+    if (sim_ring_size(&s_queue) > s_queue_max)
+        s_queue_max = sim_ring_size(&s_queue);
+    // xTaskNotifyGive: the event task runs after a context switch
+    int64_t wake = s_now + s_cfg.task_latency_us;
+    if (wake < s_handler_wake)
+        s_handler_wake = wake;
+    return true;
+}
+
+// === Transmit task model (main/hid_tx.c) ===
+static int64_t min64(int64_t a, int64_t b)
+{
+    return a < b ? a : b;
+}
+
+static int64_t tick_us(void)
+{
+    return 1000000 / s_cfg.tick_hz;
+}
+
+static int64_t ms_to_ticks(int64_t ms)
+{
+    return ms * s_cfg.tick_hz / 1000;
+}
+
+static void tx_run(void);
+
+static bool tx_enqueue(const sim_job_t *job, int prio)
+{
+    sim_job_queue_t *q = &s_tx_queues[prio];
+    if (q->count == SIM_TX_QUEUE_LEN)
+    {
+        s_stats.tx_dropped++;
+        return false;
+    }
+    q->jobs[(q->head + q->count++) % SIM_TX_QUEUE_LEN] = *job;
+    // The transmit task has the higher priority, it preempts the caller
+    tx_run();
+    return true;
+}
+
+static bool tx_dequeue(int prio, sim_job_t *job)
+{
+    sim_job_queue_t *q = &s_tx_queues[prio];
+    if (q->count == 0)
+        return false;
+    *job = q->jobs[q->head];
+    q->head = (q->head + 1) % SIM_TX_QUEUE_LEN;
+    q->count--;
+    return true;
+}
+
+static bool sim_sink_send(void *ctx, uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    sim_job_t job = {.kind = SIM_JOB_REPORT, .origin_us = s_origin_us, .report_id = report_id, .len = len};
+    memcpy(job.data, data, len);
+    bool keyboard = report_id == HID_REPORT_ID_KEYBOARD || report_id == HID_REPORT_ID_NKRO;
+    return tx_enqueue(&job, keyboard ? SIM_TX_PRIO_NORMAL : SIM_TX_PRIO_HIGH);
+}
+
+// hid_tx_emit(): takes a credit of this interval and hands the report to the
+// stack, which reports NOTIFY_TX before the call returns
+static bool tx_emit(uint8_t report_id, const uint8_t *data, uint8_t len, int64_t origin_us, void *ctx)
+{
+    if (s_stack_count == sizeof(s_stack) / sizeof(s_stack[0]) || !tx_flow_acquire(&s_flow, SIM_CONN_HANDLE))
+        return false;
+    tx_flow_complete(&s_flow, SIM_CONN_HANDLE, SIM_REPORT_HANDLE, 0);
+    sim_notify_t *n = &s_stack[(s_stack_head + s_stack_count++) % (sizeof(s_stack) / sizeof(s_stack[0]))];
+    n->report_id = report_id;
+    n->len = len;
+    memcpy(n->data, data, len);
+    n->origin_us = origin_us;
+    n->handed_us = s_now;
+    return true;
+}
+
+// hid_tx_wait_interval(): whole ticks until the next connection interval
+static void tx_wait_interval(void)
+{
+    int64_t wait_us = tx_flow_next_us(&s_flow, SIM_CONN_HANDLE) - s_now;
+    int64_t ticks = wait_us > 0 ? (wait_us + tick_us() - 1) / tick_us() : 1;
+    s_tx_wake = min64(s_tx_wake, (s_now / tick_us() + ticks) * tick_us());
+}
+
+// hid_tx_flush(): once per connection interval; sleeps while reports stay pending
+static bool tx_flush(void)
+{
+    if (tx_flow_due(&s_flow, SIM_CONN_HANDLE, s_now, s_cfg.conn_interval_us))
+        coalesce_flush(&s_coalesce, tx_emit, NULL);
+    if (!coalesce_pending(&s_coalesce))
+        return false;
+    tx_wait_interval();
+    return true;
+}
+
+// hid_tx_output(); returns false when the task would block for a credit
+static bool tx_output(const sim_job_t *r)
+{
+    coalesce_result_t result;
+    while ((result = coalesce_put(&s_coalesce, r->report_id, r->data, r->len, r->origin_us)) == COALESCE_CONFLICT)
+    {
+        if (tx_flush())
+        {
+            s_blocked_report = *r;
+            s_blocked = true;
+            return false;
+        }
+    }
+    if (result == COALESCE_NO_SLOT && !tx_emit(r->report_id, r->data, r->len, r->origin_us, NULL))
+    {
+        // Retried after the next interval refills the credits
+        tx_flush();
+        if (!tx_emit(r->report_id, r->data, r->len, r->origin_us, NULL))
+        {
+            tx_wait_interval();
+            s_blocked_report = *r;
+            s_blocked = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+// One hid_tx_macro_step(); false once the macro has finished
+static bool tx_macro_step(void)
+{
+    macro_step_t step;
+    macro_step(&s_vm, &step);
+    switch (step.kind)
+    {
+    case MACRO_STEP_REPORT:
+    {
+        sim_job_t r = {.origin_us = s_active_job.origin_us, .report_id = step.report_id, .len = step.len};
+        memcpy(r.data, step.data, step.len);
+        tx_output(&r);
+        return true;
+    }
+    case MACRO_STEP_CONSUMER:
+    {
+        // esp_hidd_send_consumer_value(): the event task owns the consumer usages
+        const sim_consumer_step_t cc = {.usage = step.usage, .pressed = step.pressed,
+                                        .origin_us = s_active_job.origin_us};
+        if (!sim_consumer_ring_push(&s_consumer_steps, &cc))
+            s_stats.consumer_failed++;
+        s_handler_wake = min64(s_handler_wake, s_now + s_cfg.task_latency_us);
+        return true;
+    }
+    case MACRO_STEP_DELAY:
+        s_resume_us = (s_now / tick_us() + ms_to_ticks(step.delay_ms)) * tick_us();
+        return true;
+    case MACRO_STEP_ERROR:
+        fprintf(stderr, "macro: malformed bytecode\n");
+        return false;
+    case MACRO_STEP_DONE:
+    default:
+        return false;
+    }
+}
+
+// Runs the transmit task loop until it would sleep
+static void tx_run(void)
+{
+    if (s_tx_running)
+    {
+        s_tx_again = true;
+        return;
+    }
+    s_tx_running = true;
+    s_tx_wake = SIM_NONE;
+    sim_job_t job;
+    do
+    {
+        s_tx_again = false;
+        if (s_blocked)
+        {
+            s_blocked = false;
+            if (!tx_output(&s_blocked_report))
+                break;
+        }
+        while (!s_blocked && tx_dequeue(SIM_TX_PRIO_HIGH, &job))
+            tx_output(&job);
+        if (s_blocked)
+            break;
+
+        if (s_active && s_resume_us <= s_now)
+        {
+            s_active = tx_macro_step();
+            if (s_blocked)
+                break;
+        }
+
+        while (!s_active && !s_blocked && tx_dequeue(SIM_TX_PRIO_NORMAL, &job))
+        {
+            if (job.kind == SIM_JOB_REPORT)
+            {
+                tx_output(&job);
+                continue;
+            }
+            s_active_job = job;
+            s_active = true;
+            s_resume_us = s_now / tick_us() * tick_us();
+            macro_init(&s_vm, job.code, job.code_len);
+        }
+        if (s_blocked)
+            break;
+
+        // Sleeps until the next interval, or a connection event frees stack room
+        if (coalesce_pending(&s_coalesce) && tx_flush())
+            break;
+
+        if (s_active)
+        {
+            if (s_resume_us > s_now)
+            {
+                s_tx_wake = s_resume_us;
+                break;
+            }
+            s_tx_again = true;
+        }
+    } while (s_tx_again);
+    s_tx_running = false;
+}
+
+static void tx_run_macro(const uint8_t *code, uint16_t len)
+{
+    sim_job_t job = {.kind = SIM_JOB_MACRO, .origin_us = s_origin_us, .code = code, .code_len = len};
+    tx_enqueue(&job, SIM_TX_PRIO_NORMAL);
+}
+
+static void print_report(const sim_notify_t *n)
+{
+    printf("%10" PRId64 " %u", s_now, n->report_id);
+    for (int i = 0; i < n->len; i++)
+        printf(" %02x", n->data[i]);
+    printf("\n");
+}
+
+// The link sends what the stack holds
+static void conn_event(void)
+{
+    s_stats.conn_events++;
+    uint32_t released = 0;
+    while (s_stack_count && released < s_cfg.per_event)
+    {
+        const sim_notify_t *n = &s_stack[s_stack_head];
+        if (!s_cfg.quiet)
+            print_report(n);
+        if (n->report_id < SIM_REPORT_IDS)
+            s_host[n->report_id] = *n;
+        samples_add(&s_stack_lat, s_now - n->handed_us);
+        samples_add(&s_total_lat, s_now - n->origin_us);
+        s_stats.sent++;
+        s_stats.last_report_us = s_now;
+        s_stack_head = (s_stack_head + 1) % (sizeof(s_stack) / sizeof(s_stack[0]));
+        s_stack_count--;
+        released++;
+    }
+    if (released)
+    {
+        s_stats.busy_events++;
+        tx_run();
+    }
+}
+
+// === Button event task model (main/esp_hid_device.c) ===
+static bool pointer_active(void)
+{
+    return mouse_keys_active(&s_mouse_keys) || scroll_active(&s_scroll);
+}
+
+static void pointer_service(void)
+{
+    int8_t dx, dy, wheel, pan;
+    bool moved = mouse_keys_tick(&s_mouse_keys, s_now, &dx, &dy);
+    bool scrolled = scroll_tick(&s_scroll, s_now, &wheel, &pan);
+    if (moved || scrolled)
+        hid_report_mouse_move(&s_report, dx, dy, wheel, pan);
+
+    uint32_t period = pointer_active() ? s_cfg.conn_interval_us : 0;
+    if (period == s_pointer_period_us)
+        return;
+    s_pointer_timer = period ? s_now + period : SIM_NONE;
+    s_pointer_period_us = period;
+}
+
+static void run_action(const keystore_action_t *action, bool pressed, void *ctx)
+{
+    if (hid_report_action(&s_report, action, pressed))
+        return;
+    if (action->type == KEYSTORE_ACTION_MACRO && pressed)
+    {
+        uint16_t len;
+        const uint8_t *code = keystore_macro(&s_keystore, action->arg1, &len);
+        if (code)
+            tx_run_macro(code, len);
+    }
+    else if (action->type == KEYSTORE_ACTION_MOUSE_MOVE)
+    {
+        mouse_keys_press(&s_mouse_keys, (uint8_t)action->arg1, pressed, s_now);
+    }
+    else if (action->type == KEYSTORE_ACTION_SCROLL)
+    {
+        scroll_press(&s_scroll, (uint8_t)action->arg1, pressed, s_now);
+    }
+}
+
+static uint8_t builtin_direction(char id)
+{
+    switch (id)
+    {
+    case 'u':
+        return MOUSE_KEYS_UP;
+    case 'r':
+        return MOUSE_KEYS_RIGHT;
+    case 'd':
+        return MOUSE_KEYS_DOWN;
+    case 'l':
+        return MOUSE_KEYS_LEFT;
+    default:
+        return 0;
+    }
+}
+
+static uint64_t s_builtin_held; // built-in map keys whose long press has run
+
+static void handle_button_event(const button_event_t *evt)
+{
+    s_origin_us = s_edge_us[evt->key];
+    if (evt->kind == BUTTON_EVT_HOLD)
+        s_origin_us = evt->time_us;
+    hid_report_set_nkro(&s_report, !s_cfg.boot_protocol);
+    if (s_keystore.base)
+    {
+        if (evt->kind != BUTTON_EVT_HOLD)
+            layer_key(&s_layers, evt->key, evt->kind == BUTTON_EVT_DOWN, evt->time_us);
+        return;
+    }
+
+    // Built-in actions when no keymap image is given
+    uint8_t dir = builtin_direction(evt->id_char);
+    uint64_t bit = 1ULL << evt->key;
+    switch (evt->kind)
+    {
+    case BUTTON_EVT_DOWN:
+        if (dir)
+            mouse_keys_press(&s_mouse_keys, dir, true, s_now);
+        s_builtin_held &= ~bit;
+        break;
+    case BUTTON_EVT_HOLD:
+        if (!dir)
+        {
+            s_builtin_held |= bit;
+            tx_run_macro(macro_long_press, sizeof(macro_long_press));
+        }
+        break;
+    case BUTTON_EVT_UP:
+        if (dir)
+        {
+            mouse_keys_press(&s_mouse_keys, dir, false, s_now);
+        }
+        else if (!(s_builtin_held & bit))
+        {
+            hid_report_mouse(&s_report, 1, 0, 0, 0, 0);
+            hid_report_mouse(&s_report, 0, 0, 0, 0, 0);
+        }
+        s_builtin_held &= ~bit;
+        break;
+    }
+}
+
+static void handler_run(void)
+{
+    button_event_t evts[SIM_EVT_BATCH];
+    uint32_t n;
+    while ((n = sim_ring_pop_batch(&s_queue, evts, SIM_EVT_BATCH)) > 0)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (evts[i].kind != BUTTON_EVT_HOLD)
+                samples_add(&s_queue_lat, s_now - evts[i].time_us);
+            handle_button_event(&evts[i]);
+        }
+    }
+    sim_consumer_step_t cc;
+    while (sim_consumer_ring_pop(&s_consumer_steps, &cc))
+    {
+        s_origin_us = cc.origin_us;
+        if (!hid_report_consumer(&s_report, cc.usage, cc.pressed) && cc.pressed)
+            s_stats.consumer_failed++;
+    }
+    s_origin_us = s_now;
+    layer_tick(&s_layers, s_now);
+    if (s_pointer_period_us || pointer_active())
+        pointer_service();
+
+    // ulTaskNotifyTake() with the tick-rounded wait of the firmware
+    s_handler_wake = SIM_NONE;
+    int64_t deadline = layer_next_deadline(&s_layers);
+    if (deadline != LAYER_NO_DEADLINE)
+    {
+        int64_t remaining_us = deadline - s_now;
+        int64_t wait = remaining_us > 0 ? ms_to_ticks(remaining_us / 1000) + 1 : 0;
+        s_handler_wake = wait ? (s_now / tick_us() + wait) * tick_us() : s_now + 1;
+    }
+}
+
+// === Event loop ===
+static void simulate(void)
+{
+    int64_t end = (s_num_edges ? s_edges[s_num_edges - 1].t_us : 0) + SIM_TAIL_US;
+    int64_t next_scan = 0;
+    int64_t next_conn = s_cfg.conn_phase_us;
+
+    while (s_now <= end)
+    {
+        int64_t next_edge = s_next_edge < s_num_edges ? s_edges[s_next_edge].t_us : SIM_NONE;
+        s_now = min64(min64(next_edge, next_scan), min64(min64(s_handler_wake, s_tx_wake), next_conn));
+        s_now = min64(s_now, s_pointer_timer);
+
+        while (s_next_edge < s_num_edges && s_edges[s_next_edge].t_us <= s_now)
+        {
+            const sim_edge_t *e = &s_edges[s_next_edge++];
+            scan_mask_t bit = (scan_mask_t)1 << e->key;
+            if (!e->bounce && e->down != !!(s_keys & bit))
+                s_edge_us[e->key] = e->t_us;
+            s_keys = e->down ? s_keys | bit : s_keys & ~bit;
+            if (e->bounce)
+                s_stats.bounces++;
+            else
+                s_stats.edges++;
+        }
+        if (next_scan == s_now)
+        {
+            input_tick(&s_input);
+            next_scan += SCAN_PERIOD_US;
+        }
+        if (s_pointer_timer == s_now)
+        {
+            // esp_timer callback notifying the event task
+            s_pointer_timer += s_pointer_period_us;
+            s_handler_wake = min64(s_handler_wake, s_now + s_cfg.task_latency_us);
+        }
+        if (s_handler_wake <= s_now)
+            handler_run();
+        if (s_tx_wake <= s_now)
+            tx_run();
+        if (next_conn == s_now)
+        {
+            conn_event();
+            next_conn += s_cfg.conn_interval_us;
+        }
+    }
+}
+
+// === Report ===
+static int cmp64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t percentile(const sim_samples_t *s, int p)
+{
+    size_t i = (s->n * p + 99) / 100;
+    return s->v[i ? i - 1 : 0];
+}
+
+static void print_latency(const char *name, sim_samples_t *s)
+{
+    if (s->n == 0)
+    {
+        printf("  %-16s %7d\n", name, 0);
+        return;
+    }
+    qsort(s->v, s->n, sizeof(*s->v), cmp64);
+    printf("  %-16s %7zu %8" PRId64 " %8" PRId64 " %8" PRId64 " %8" PRId64 " %8" PRId64 "\n", name, s->n,
+           s->v[0], percentile(s, 50), percentile(s, 90), percentile(s, 99), s->v[s->n - 1]);
+}
+
+static void print_summary(void)
+{
+    const tx_flow_conn_t *flow = tx_flow_get(&s_flow, SIM_CONN_HANDLE);
+    double active_s = s_stats.last_report_us / 1e6;
+    printf("# edges %" PRIu32 " (+%" PRIu32 " bounce), events down %" PRIu32 " up %" PRIu32 " hold %" PRIu32 "\n",
+           s_stats.edges, s_stats.bounces, s_stats.downs, s_stats.ups, s_stats.holds);
+    printf("# button queue: dropped %" PRIu32 ", max depth %" PRIu32 "/%d\n",
+           sim_ring_dropped(&s_queue), s_queue_max, SIM_QUEUE_LEN);
+    printf("# macro consumer steps failed %" PRIu32 "\n", s_stats.consumer_failed);
+    printf("# hid_tx: dropped %" PRIu32 ", coalesced %" PRIu32 ", duplicates %" PRIu32 ", credit stalls %" PRIu32 "\n",
+           s_stats.tx_dropped, s_coalesce.merged, s_coalesce.duplicates, flow ? flow->stalls : 0);
+    printf("# reports sent %" PRIu32 " (%.1f/s), connection events %" PRIu32 " (%" PRIu32 " carrying reports)\n",
+           s_stats.sent, active_s > 0 ? s_stats.sent / active_s : 0.0, s_stats.conn_events, s_stats.busy_events);
+    printf("# latency us         count      min      p50      p90      p99      max\n");
+    print_latency("edge->event", &s_debounce_lat);
+    print_latency("event->task", &s_queue_lat);
+    print_latency("stack->air", &s_stack_lat);
+    print_latency("edge->air", &s_total_lat);
+}
+
+// Every real edge became one event, nothing was dropped or left in the
+// stack, and the last report of each kind releases everything
+static bool check_run(void)
+{
+    bool ok = true;
+    if (s_stats.downs + s_stats.ups != s_stats.edges)
+    {
+        fprintf(stderr, "check: %" PRIu32 " edges gave %" PRIu32 " down and %" PRIu32 " up events\n",
+                s_stats.edges, s_stats.downs, s_stats.ups);
+        ok = false;
+    }
+    if (sim_ring_dropped(&s_queue) || s_stats.tx_dropped || s_stats.consumer_failed)
+    {
+        fprintf(stderr,
+                "check: dropped %" PRIu32 " button events, %" PRIu32 " reports and %" PRIu32 " consumer steps\n",
+                sim_ring_dropped(&s_queue), s_stats.tx_dropped, s_stats.consumer_failed);
+        ok = false;
+    }
+    if (s_stack_count || coalesce_pending(&s_coalesce) || s_blocked || s_active)
+    {
+        fprintf(stderr, "check: reports still waiting at the end of the run\n");
+        ok = false;
+    }
+    for (int id = 0; id < SIM_REPORT_IDS; id++)
+    {
+        const sim_notify_t *n = &s_host[id];
+        // Pointer motion is relative, only the mouse buttons are state
+        uint8_t len = id == HID_REPORT_ID_MOUSE && n->len ? 1 : n->len;
+        for (int i = 0; i < len; i++)
+        {
+            if (n->data[i])
+            {
+                fprintf(stderr, "check: host left with report %d held\n", id);
+                ok = false;
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
+// === Setup ===
+static bool keymap_load(const char *path)
+{
+    esp_err_t err = keystore_mount_file(&s_keystore, path);
+    if (err != ESP_OK)
+    {
+        fprintf(stderr, "%s: not a valid keymap image (error 0x%x)\n", path, err);
+        return false;
+    }
+    s_cfg.num_keys = s_keystore.header->num_keys < SCAN_MAX_KEYS ? s_keystore.header->num_keys : SCAN_MAX_KEYS;
+    return true;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: hid_sim [options] [trace.txt | -]\n"
+            "  -s N        synthesize N keystrokes instead of reading a trace\n"
+            "  -r RATE     keystrokes per second of the synthetic trace (8)\n"
+            "  -b US       contact bounce window added to every edge (0)\n"
+            "  -S SEED     random seed (1)\n"
+            "  -k FILE     keymap image from tools/keystore.py (built-in actions)\n"
+            "  -a ALGO     debounce: eager, deferred or integrator (eager)\n"
+            "  -d MS       debounce time (%d)\n"
+            "  -l MS       long press threshold (%d)\n"
+            "  -i US       connection interval (15000)\n"
+            "  -p US       first connection event (0)\n"
+            "  -n N        notifications per connection event (%d)\n"
+            "  -c N        notification credits per connection interval (%d)\n"
+            "  -t HZ       FreeRTOS tick rate (100)\n"
+            "  -w US       task wakeup latency (20)\n"
+            "  -R          host enables high-resolution scrolling\n"
+            "  -6          host uses boot protocol: 6-key keyboard reports, no NKRO\n"
+            "  -q          summary only, no report stream\n"
+            "  -C          exit with an error if a keystroke was lost or a key is left held\n",
+            SIM_DEBOUNCE_MS, SIM_LONG_PRESS_MS, TX_FLOW_DEFAULT_CREDITS, TX_FLOW_DEFAULT_CREDITS);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t strokes = 0, rate = 8;
+    const char *keymap = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:b:S:k:a:d:l:i:p:n:c:t:w:R6qCh")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            strokes = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            rate = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            s_cfg.bounce_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            s_cfg.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            keymap = optarg;
+            break;
+        case 'a':
+            if (!strcmp(optarg, "eager"))
+                s_cfg.debounce_algo = DEBOUNCE_EAGER;
+            else if (!strcmp(optarg, "deferred"))
+                s_cfg.debounce_algo = DEBOUNCE_DEFERRED;
+            else if (!strcmp(optarg, "integrator"))
+                s_cfg.debounce_algo = DEBOUNCE_INTEGRATOR;
+            else
+            {
+                usage();
+                return 2;
+            }
+            break;
+        case 'd':
+            s_cfg.debounce_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            s_cfg.long_press_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            s_cfg.conn_interval_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            s_cfg.conn_phase_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            s_cfg.per_event = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            s_cfg.credits = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            s_cfg.tick_hz = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            s_cfg.task_latency_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            s_cfg.hires_scroll = true;
+            break;
+        case '6':
+            s_cfg.boot_protocol = true;
+            break;
+        case 'q':
+            s_cfg.quiet = true;
+            break;
+        case 'C':
+            s_cfg.check = true;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if ((strokes == 0) == (optind >= argc) || !rate || !s_cfg.conn_interval_us || !s_cfg.per_event ||
+        !s_cfg.tick_hz || s_cfg.tick_hz > 1000 || !s_cfg.credits || s_cfg.credits > sizeof(s_stack) / sizeof(s_stack[0]))
+    {
+        usage();
+        return 2;
+    }
+
+    s_rng = s_cfg.seed;
+    if (keymap && !keymap_load(keymap))
+        return 1;
+    if (strokes)
+        trace_synthesize(strokes, rate);
+    else if (!trace_load(argv[optind]))
+        return 1;
+    trace_add_bounce();
+
+    const input_config_t input_cfg = {
+        .num_keys = s_cfg.num_keys,
+        .debounce_algo = s_cfg.debounce_algo,
+        .debounce_ticks = s_cfg.debounce_ms * 1000 / SCAN_PERIOD_US,
+        .long_press_us = (int64_t)s_cfg.long_press_ms * 1000,
+        .key_chars = s_cfg.num_keys <= SIM_NUM_BUTTONS ? sim_button_chars : NULL,
+        .gpio = {.read = sim_gpio_read},
+        .clock = {.now_us = sim_clock},
+        .queue = {.push = sim_push}};
+    input_init(&s_input, &input_cfg);
+    sim_ring_init(&s_queue);
+    sim_consumer_ring_init(&s_consumer_steps);
+    layer_init(&s_layers, &s_keystore, run_action, NULL);
+    const hal_hid_sink_t sink = {.send = sim_sink_send};
+    hid_report_init(&s_report, &sink);
+    const mouse_keys_config_t mouse_cfg = MOUSE_KEYS_DEFAULT_CONFIG;
+    mouse_keys_init(&s_mouse_keys, &mouse_cfg);
+    const scroll_config_t scroll_cfg = SCROLL_DEFAULT_CONFIG;
+    scroll_init(&s_scroll, &scroll_cfg);
+    if (s_cfg.hires_scroll)
+        scroll_set_resolution(&s_scroll, HID_REPORT_SCROLL_MULTIPLIER, HID_REPORT_SCROLL_MULTIPLIER);
+
+    coalesce_init(&s_coalesce);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_MOUSE, COALESCE_RELATIVE);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_KEYBOARD, COALESCE_ABSOLUTE);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_NKRO, COALESCE_ABSOLUTE);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_CONSUMER, COALESCE_ABSOLUTE);
+    tx_flow_init(&s_flow);
+    tx_flow_add_handle(&s_flow, SIM_REPORT_HANDLE);
+    tx_flow_connected(&s_flow, SIM_CONN_HANDLE, s_cfg.credits);
+
+    if (!s_cfg.quiet)
+        printf("# time_us report_id data\n");
+    simulate();
+    print_summary();
+    return s_cfg.check && !check_run();
+}
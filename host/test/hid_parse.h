@@ -0,0 +1,314 @@
+#ifndef HID_PARSE_H
+#define HID_PARSE_H
+
+// Report descriptor parser for the host tests, reading the bytes the way a
+// host's HID driver does: short items only, global state per Report ID,
+// usages extended with the usage page current when they are declared. Every
+// Input, Output and Feature main item becomes a field with its bit offset
+// in the report (Report ID byte excluded), so tests can decode what the
+// send functions produce against the descriptor instead of the C structs.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HID_PARSE_MAX_FIELDS 48
+#define HID_PARSE_MAX_USAGES 8
+#define HID_PARSE_MAX_COLLECTIONS 16
+#define HID_PARSE_MAX_DEPTH 8
+#define HID_PARSE_USAGE(page, id) (((uint32_t)(page) << 16) | (id))
+
+typedef enum
+{
+    HID_PARSE_INPUT,
+    HID_PARSE_OUTPUT,
+    HID_PARSE_FEATURE,
+    HID_PARSE_MAIN_COUNT,
+} hid_parse_main_t;
+
+typedef struct
+{
+    hid_parse_main_t main;
+    uint8_t flags; // HID_DESC_CONST, HID_DESC_VAR, HID_DESC_REL, ...
+    uint8_t report_id;
+    uint16_t offset; // first bit in the report
+    uint8_t size;
+    uint8_t count;
+    uint32_t usages[HID_PARSE_MAX_USAGES]; // extended usages, page in the high half
+    uint8_t num_usages;
+    uint32_t usage_min; // extended usage range, when usage_max is not 0
+    uint32_t usage_max;
+    int32_t logical_min;
+    int32_t logical_max;
+    int32_t physical_min;
+    int32_t physical_max;
+    int collection; // innermost enclosing collection, -1 at top level
+} hid_parse_field_t;
+
+typedef struct
+{
+    uint8_t type; // HID_DESC_PHYSICAL, HID_DESC_APPLICATION, HID_DESC_LOGICAL
+    uint32_t usage;
+    int parent;
+} hid_parse_collection_t;
+
+typedef struct
+{
+    hid_parse_field_t fields[HID_PARSE_MAX_FIELDS];
+    int num_fields;
+    hid_parse_collection_t collections[HID_PARSE_MAX_COLLECTIONS];
+    int num_collections;
+    uint16_t bits[256][HID_PARSE_MAIN_COUNT]; // report length in bits per Report ID
+    const char *error;                        // set when hid_parse() fails
+    size_t error_at;
+} hid_parse_t;
+
+static inline int32_t hid_parse_signed(uint32_t v, int bytes)
+{
+    if (bytes == 1)
+        return (int8_t)v;
+    if (bytes == 2)
+        return (int16_t)v;
+    return (int32_t)v;
+}
+
+static inline bool hid_parse_fail(hid_parse_t *p, const char *error, size_t at)
+{
+    p->error = error;
+    p->error_at = at;
+    return false;
+}
+
+static inline bool hid_parse(hid_parse_t *p, const uint8_t *desc, size_t len)
+{
+    memset(p, 0, sizeof(*p));
+    struct
+    {
+        uint16_t page;
+        int32_t logical_min, logical_max, physical_min, physical_max;
+        uint8_t size, count, report_id;
+    } global = {0};
+    hid_parse_field_t local = {0};
+    int stack[HID_PARSE_MAX_DEPTH];
+    int depth = 0;
+
+    size_t i = 0;
+    while (i < len)
+    {
+        uint8_t prefix = desc[i];
+        if (prefix == 0xFE)
+            return hid_parse_fail(p, "long item", i);
+        int bytes = (prefix & 3) == 3 ? 4 : prefix & 3;
+        if (i + 1 + bytes > len)
+            return hid_parse_fail(p, "item runs past the end", i);
+        uint32_t data = 0;
+        for (int b = 0; b < bytes; b++)
+            data |= (uint32_t)desc[i + 1 + b] << (8 * b);
+        uint8_t type = (prefix >> 2) & 3, tag = prefix >> 4;
+        int32_t sdata = hid_parse_signed(data, bytes);
+        // A 4 byte usage carries its own page
+        uint32_t usage = bytes == 4 ? data : HID_PARSE_USAGE(global.page, data);
+
+        if (type == 0) // main
+        {
+            if (tag == 0x8 || tag == 0x9 || tag == 0xB)
+            {
+                if (p->num_fields == HID_PARSE_MAX_FIELDS)
+                    return hid_parse_fail(p, "too many fields", i);
+                if (global.size == 0 || global.count == 0)
+                    return hid_parse_fail(p, "main item without report size or count", i);
+                hid_parse_main_t main = tag == 0x8 ? HID_PARSE_INPUT : tag == 0x9 ? HID_PARSE_OUTPUT : HID_PARSE_FEATURE;
+                hid_parse_field_t *f = &p->fields[p->num_fields++];
+                *f = local;
+                f->main = main;
+                f->flags = (uint8_t)data;
+                f->report_id = global.report_id;
+                f->offset = p->bits[global.report_id][main];
+                f->size = global.size;
+                f->count = global.count;
+                f->logical_min = global.logical_min;
+                f->logical_max = global.logical_max;
+                f->physical_min = global.physical_min;
+                f->physical_max = global.physical_max;
+                f->collection = depth ? stack[depth - 1] : -1;
+                p->bits[global.report_id][main] += global.size * global.count;
+            }
+            else if (tag == 0xA)
+            {
+                if (depth == HID_PARSE_MAX_DEPTH || p->num_collections == HID_PARSE_MAX_COLLECTIONS)
+                    return hid_parse_fail(p, "collections nested too deep", i);
+                hid_parse_collection_t *c = &p->collections[p->num_collections];
+                c->type = (uint8_t)data;
+                c->usage = local.num_usages ? local.usages[0] : 0;
+                c->parent = depth ? stack[depth - 1] : -1;
+                stack[depth++] = p->num_collections++;
+            }
+            else if (tag == 0xC)
+            {
+                if (depth == 0)
+                    return hid_parse_fail(p, "end collection without collection", i);
+                depth--;
+            }
+            else
+            {
+                return hid_parse_fail(p, "unknown main item", i);
+            }
+            memset(&local, 0, sizeof(local));
+        }
+        else if (type == 1) // global
+        {
+            switch (tag)
+            {
+            case 0x0:
+                global.page = (uint16_t)data;
+                break;
+            case 0x1:
+                global.logical_min = sdata;
+                break;
+            case 0x2:
+                global.logical_max = sdata;
+                break;
+            case 0x3:
+                global.physical_min = sdata;
+                break;
+            case 0x4:
+                global.physical_max = sdata;
+                break;
+            case 0x7:
+                global.size = (uint8_t)data;
+                break;
+            case 0x8:
+                if (data == 0 || data > 255)
+                    return hid_parse_fail(p, "report ID out of range", i);
+                global.report_id = (uint8_t)data;
+                break;
+            case 0x9:
+                global.count = (uint8_t)data;
+                break;
+            case 0x5: // unit exponent
+            case 0x6: // unit
+                break;
+            default:
+                return hid_parse_fail(p, "unsupported global item", i);
+            }
+        }
+        else if (type == 2) // local
+        {
+            if (tag == 0x0)
+            {
+                if (local.num_usages == HID_PARSE_MAX_USAGES)
+                    return hid_parse_fail(p, "too many usages", i);
+                local.usages[local.num_usages++] = usage;
+            }
+            else if (tag == 0x1)
+            {
+                local.usage_min = usage;
+            }
+            else if (tag == 0x2)
+            {
+                local.usage_max = usage;
+            }
+            else
+            {
+                return hid_parse_fail(p, "unsupported local item", i);
+            }
+        }
+        else
+        {
+            return hid_parse_fail(p, "reserved item type", i);
+        }
+        i += 1 + bytes;
+    }
+    if (depth)
+        return hid_parse_fail(p, "unclosed collection", len);
+    return true;
+}
+
+static inline uint16_t hid_parse_report_len(const hid_parse_t *p, uint8_t report_id, hid_parse_main_t main)
+{
+    return (p->bits[report_id][main] + 7) / 8;
+}
+
+// Usage of element `index` of a variable field: the listed usages in order,
+// the last one repeating, or the usage range
+static inline uint32_t hid_parse_var_usage(const hid_parse_field_t *f, int index)
+{
+    if (f->num_usages)
+        return f->usages[index < f->num_usages ? index : f->num_usages - 1];
+    return f->usage_max ? f->usage_min + index : 0;
+}
+
+// Field of report `report_id` that reports `usage`: the element of a
+// variable field (index in *index), or an array field whose range holds it
+static inline const hid_parse_field_t *hid_parse_find(const hid_parse_t *p, uint8_t report_id, hid_parse_main_t main,
+                                                      uint32_t usage, int *index)
+{
+    for (int i = 0; i < p->num_fields; i++)
+    {
+        const hid_parse_field_t *f = &p->fields[i];
+        if (f->report_id != report_id || f->main != main || (f->flags & 0x01))
+            continue;
+        if (!(f->flags & 0x02))
+        {
+            if (f->usage_max && usage >= f->usage_min && usage <= f->usage_max)
+            {
+                if (index)
+                    *index = 0;
+                return f;
+            }
+            continue;
+        }
+        for (int e = 0; e < f->count; e++)
+        {
+            if (hid_parse_var_usage(f, e) == usage)
+            {
+                if (index)
+                    *index = e;
+                return f;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Element `index` of field `f` in `report`, sign extended when the logical
+// minimum is negative
+static inline int32_t hid_parse_get(const hid_parse_field_t *f, int index, const uint8_t *report)
+{
+    uint32_t bit = f->offset + (uint32_t)index * f->size;
+    uint32_t v = 0;
+    for (int b = 0; b < f->size; b++, bit++)
+        v |= (uint32_t)((report[bit / 8] >> (bit % 8)) & 1) << b;
+    if (f->logical_min < 0 && f->size < 32 && (v >> (f->size - 1)) & 1)
+        v |= ~0u << f->size;
+    return (int32_t)v;
+}
+
+static inline void hid_parse_put(const hid_parse_field_t *f, int index, uint8_t *report, int32_t value)
+{
+    uint32_t bit = f->offset + (uint32_t)index * f->size;
+    for (int b = 0; b < f->size; b++, bit++)
+    {
+        report[bit / 8] &= ~(1u << (bit % 8));
+        report[bit / 8] |= (((uint32_t)value >> b) & 1) << (bit % 8);
+    }
+}
+
+// Usages an array field reports as held: value v is usage_min + v - logical_min,
+// values outside the logical range mean nothing is held in that slot
+static inline int hid_parse_array_usages(const hid_parse_field_t *f, const uint8_t *report, uint32_t *out, int max)
+{
+    int n = 0;
+    for (int e = 0; e < f->count && n < max; e++)
+    {
+        int32_t v = hid_parse_get(f, e, report);
+        if (v < f->logical_min || v > f->logical_max)
+            continue;
+        uint32_t usage = f->usage_min + (uint32_t)(v - f->logical_min);
+        if ((usage & 0xFFFF) != 0) // usage 0 is "no event"
+            out[n++] = usage;
+    }
+    return n;
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef TEST_H
+#define TEST_H
+
+// Minimal assertion helpers for the host unit tests. Each test program is a
+// list of void functions run by TEST_RUN(); a failed CHECK prints its
+// location and the run carries on, main() returns TEST_EXIT() so ctest sees
+// the failure count.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hal.h"
+#include "keystore.h"
+
+static int s_test_failures;
+static int s_test_checks;
+
+#define CHECK(cond)                                                     \
+    do                                                                  \
+    {                                                                   \
+        s_test_checks++;                                                \
+        if (!(cond))                                                    \
+        {                                                               \
+            s_test_failures++;                                          \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        }                                                               \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                               \
+    do                                                                               \
+    {                                                                                \
+        long long a_ = (long long)(a), b_ = (long long)(b);                          \
+        s_test_checks++;                                                             \
+        if (a_ != b_)                                                                \
+        {                                                                            \
+            s_test_failures++;                                                       \
+            printf("%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, \
+                   a_, b_);                                                          \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_MEM(a, b, n)                                                                 \
+    do                                                                                     \
+    {                                                                                      \
+        s_test_checks++;                                                                   \
+        if (memcmp((a), (b), (n)) != 0)                                                    \
+        {                                                                                  \
+            s_test_failures++;                                                             \
+            printf("%s:%d: %s and %s differ\n", __FILE__, __LINE__, #a, #b);               \
+            test_dump("  got ", (const uint8_t *)(a), (n));                                \
+            test_dump("  want", (const uint8_t *)(b), (n));                                \
+        }                                                                                  \
+    } while (0)
+
+#define TEST_RUN(fn)                                                         \
+    do                                                                       \
+    {                                                                        \
+        int before_ = s_test_failures;                                       \
+        fn();                                                                \
+        printf("%s %s\n", s_test_failures == before_ ? "ok  " : "FAIL", #fn); \
+    } while (0)
+
+#define TEST_EXIT() (printf("%d checks, %d failed\n", s_test_checks, s_test_failures), s_test_failures != 0)
+
+static inline void test_dump(const char *label, const uint8_t *data, size_t n)
+{
+    printf("%s", label);
+    for (size_t i = 0; i < n; i++)
+        printf(" %02x", data[i]);
+    printf("\n");
+}
+
+// === Report recorder, a hal_hid_sink_t that keeps everything it is sent ===
+#define TEST_MAX_REPORTS 256
+#define TEST_REPORT_MAX 16
+
+typedef struct
+{
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t data[TEST_REPORT_MAX];
+} test_report_t;
+
+typedef struct
+{
+    test_report_t reports[TEST_MAX_REPORTS];
+    int count;
+    bool refuse; // send() fails, as a full transmit queue does
+} test_sink_t;
+
+static inline bool test_sink_send(void *ctx, uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    test_sink_t *s = ctx;
+    if (s->refuse || s->count == TEST_MAX_REPORTS || len > TEST_REPORT_MAX)
+        return false;
+    test_report_t *r = &s->reports[s->count++];
+    r->report_id = report_id;
+    r->len = len;
+    memcpy(r->data, data, len);
+    return true;
+}
+
+static inline hal_hid_sink_t test_sink(test_sink_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    return (hal_hid_sink_t){.send = test_sink_send, .ctx = s};
+}
+
+static inline const test_report_t *test_last(const test_sink_t *s)
+{
+    static const test_report_t none = {0};
+    return s->count ? &s->reports[s->count - 1] : &none;
+}
+
+// === Keystore images, laid out as tools/keystore.py writes them ===
+static inline uint32_t test_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+// Builds an image of `layers` x `keys` actions followed by the macros
+// (bytecode and length per macro) into `buf`; returns its size, 0 if too big
+static inline size_t test_keystore_image(uint8_t *buf, size_t size, uint8_t layers, uint8_t keys,
+                                         const keystore_action_t *keymap, uint16_t num_macros,
+                                         const uint8_t *const *macros, const uint16_t *macro_lens)
+{
+    size_t map_size = (size_t)layers * keys * sizeof(keystore_action_t);
+    size_t offset = sizeof(keystore_header_t) + map_size + num_macros * sizeof(keystore_macro_t);
+    size_t total = offset;
+    for (uint16_t m = 0; m < num_macros; m++)
+        total += macro_lens[m];
+    if (total > size)
+        return 0;
+
+    keystore_header_t *hdr = (keystore_header_t *)buf;
+    *hdr = (keystore_header_t){
+        .magic = KEYSTORE_MAGIC,
+        .version = KEYSTORE_VERSION,
+        .header_size = sizeof(*hdr),
+        .num_layers = layers,
+        .num_keys = keys,
+        .num_macros = num_macros,
+        .keymap_offset = sizeof(*hdr),
+        .macros_offset = sizeof(*hdr) + map_size,
+        .total_size = total};
+    memcpy(buf + hdr->keymap_offset, keymap, map_size);
+    keystore_macro_t *table = (keystore_macro_t *)(buf + hdr->macros_offset);
+    for (uint16_t m = 0; m < num_macros; m++)
+    {
+        table[m] = (keystore_macro_t){.offset = offset, .len = macro_lens[m]};
+        memcpy(buf + offset, macros[m], macro_lens[m]);
+        offset += macro_lens[m];
+    }
+    hdr->crc32 = test_crc32(buf + hdr->header_size, total - hdr->header_size);
+    return total;
+}
+
+#endif
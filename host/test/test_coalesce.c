@@ -0,0 +1,136 @@
+// Report coalescing between connection events
+#include "test.h"
+#include "coalesce.h"
+
+#define KBD 1
+#define MOUSE 2
+
+typedef struct
+{
+    test_sink_t sink;
+    bool refuse;
+} flushed_t;
+
+static bool emit(uint8_t report_id, const uint8_t *data, uint8_t len, int64_t first_us, void *ctx)
+{
+    flushed_t *f = ctx;
+    return !f->refuse && test_sink_send(&f->sink, report_id, data, len);
+}
+
+static void test_absolute_newest_wins(void)
+{
+    coalesce_t c;
+    flushed_t f = {0};
+    coalesce_init(&c);
+    const uint8_t a[4] = {0, 0, 4, 0};
+    const uint8_t ab[4] = {0, 0, 4, 5};
+    CHECK_EQ(coalesce_put(&c, KBD, a, 4, 10), COALESCE_QUEUED);
+    CHECK_EQ(coalesce_put(&c, KBD, ab, 4, 20), COALESCE_MERGED);
+    CHECK_EQ(coalesce_put(&c, KBD, ab, 4, 30), COALESCE_DUPLICATE);
+    CHECK_EQ(coalesce_flush(&c, emit, &f), 1);
+    CHECK_EQ(f.sink.count, 1);
+    CHECK_MEM(f.sink.reports[0].data, ab, 4);
+
+    // The host already has this state
+    CHECK_EQ(coalesce_put(&c, KBD, ab, 4, 40), COALESCE_DUPLICATE);
+    CHECK(!coalesce_pending(&c));
+    CHECK_EQ(c.merged, 1);
+    CHECK_EQ(c.duplicates, 2);
+}
+
+static void test_absolute_keeps_taps(void)
+{
+    coalesce_t c;
+    flushed_t f = {0};
+    coalesce_init(&c);
+    const uint8_t down[4] = {0, 0, 4, 0};
+    const uint8_t up[4] = {0};
+    CHECK_EQ(coalesce_put(&c, KBD, down, 4, 0), COALESCE_QUEUED);
+    // Releasing before the press went out would lose the tap
+    CHECK_EQ(coalesce_put(&c, KBD, up, 4, 0), COALESCE_CONFLICT);
+    coalesce_flush(&c, emit, &f);
+    CHECK_EQ(coalesce_put(&c, KBD, up, 4, 0), COALESCE_QUEUED);
+    coalesce_flush(&c, emit, &f);
+    CHECK_EQ(f.sink.count, 2);
+    CHECK_MEM(f.sink.reports[1].data, up, 4);
+}
+
+static void test_relative_sums_and_carries(void)
+{
+    coalesce_t c;
+    flushed_t f = {0};
+    coalesce_init(&c);
+    coalesce_add(&c, MOUSE, COALESCE_RELATIVE);
+    const uint8_t move[3] = {0, 100, (uint8_t)-60};
+    CHECK_EQ(coalesce_put(&c, MOUSE, move, 3, 0), COALESCE_QUEUED);
+    CHECK_EQ(coalesce_put(&c, MOUSE, move, 3, 0), COALESCE_MERGED);
+
+    // 200 does not fit one report: 127 now, 73 on the next flush
+    CHECK_EQ(coalesce_flush(&c, emit, &f), 1);
+    CHECK(coalesce_pending(&c));
+    CHECK_EQ(coalesce_flush(&c, emit, &f), 1);
+    CHECK(!coalesce_pending(&c));
+    CHECK_EQ((int8_t)f.sink.reports[0].data[1], 127);
+    CHECK_EQ((int8_t)f.sink.reports[0].data[2], -120);
+    CHECK_EQ((int8_t)f.sink.reports[1].data[1], 73);
+    CHECK_EQ((int8_t)f.sink.reports[1].data[2], 0);
+}
+
+static void test_relative_buttons_are_ordered(void)
+{
+    coalesce_t c;
+    flushed_t f = {0};
+    coalesce_init(&c);
+    coalesce_add(&c, MOUSE, COALESCE_RELATIVE);
+    const uint8_t move[3] = {0, 1, 1};
+    const uint8_t click[3] = {1, 0, 0};
+    const uint8_t still[3] = {0, 0, 0};
+    CHECK_EQ(coalesce_put(&c, MOUSE, still, 3, 0), COALESCE_DUPLICATE);
+    CHECK_EQ(coalesce_put(&c, MOUSE, move, 3, 0), COALESCE_QUEUED);
+    CHECK_EQ(coalesce_put(&c, MOUSE, click, 3, 0), COALESCE_CONFLICT);
+    coalesce_flush(&c, emit, &f);
+    CHECK_EQ(coalesce_put(&c, MOUSE, click, 3, 0), COALESCE_QUEUED);
+    coalesce_flush(&c, emit, &f);
+    CHECK_EQ(f.sink.count, 2);
+    CHECK_MEM(f.sink.reports[1].data, click, 3);
+}
+
+static void test_refused_emit_stays_pending(void)
+{
+    coalesce_t c;
+    flushed_t f = {.refuse = true};
+    coalesce_init(&c);
+    const uint8_t a[2] = {1, 2};
+    coalesce_put(&c, KBD, a, 2, 5);
+    CHECK_EQ(coalesce_flush(&c, emit, &f), 0);
+    CHECK(coalesce_pending(&c));
+    f.refuse = false;
+    CHECK_EQ(coalesce_flush(&c, emit, &f), 1);
+
+    // A new link has seen nothing
+    coalesce_reset(&c);
+    CHECK_EQ(coalesce_put(&c, KBD, a, 2, 6), COALESCE_QUEUED);
+}
+
+static void test_slot_limit(void)
+{
+    coalesce_t c;
+    coalesce_init(&c);
+    const uint8_t a[1] = {1};
+    for (int id = 1; id <= COALESCE_MAX_SLOTS; id++)
+        CHECK_EQ(coalesce_put(&c, id, a, 1, 0), COALESCE_QUEUED);
+    CHECK_EQ(coalesce_put(&c, COALESCE_MAX_SLOTS + 1, a, 1, 0), COALESCE_NO_SLOT);
+    uint8_t big[COALESCE_REPORT_MAX + 1] = {0};
+    CHECK_EQ(coalesce_put(&c, 1, big, sizeof(big), 0), COALESCE_NO_SLOT);
+}
+
+int main(void)
+{
+    TEST_RUN(test_absolute_newest_wins);
+    TEST_RUN(test_absolute_keeps_taps);
+    TEST_RUN(test_relative_sums_and_carries);
+    TEST_RUN(test_relative_buttons_are_ordered);
+    TEST_RUN(test_refused_emit_stays_pending);
+    TEST_RUN(test_slot_limit);
+    return TEST_EXIT();
+}
@@ -0,0 +1,215 @@
+// Connection parameter policy against a mock ble_gap_update_params: when
+// requests go out, what they ask for, and how rejections are backed off
+#include "test.h"
+#include "conn_params.h"
+
+#define S (1000 * 1000LL)
+#define HANDLE 7
+
+// Stands in for NimBLE: records each request and answers with `rc`
+typedef struct
+{
+    conn_params_t requests[32];
+    int64_t at[32];
+    int count;
+    int rc;
+    uint16_t bad_handles; // requests on any other connection handle
+} mock_stack_t;
+
+static int64_t s_now;
+
+static int mock_update_params(void *ctx, uint16_t conn_handle, const conn_params_t *params)
+{
+    mock_stack_t *m = ctx;
+    if (conn_handle != HANDLE)
+        m->bad_handles++;
+    if (m->count < 32)
+    {
+        m->requests[m->count] = *params;
+        m->at[m->count] = s_now;
+        m->count++;
+    }
+    return m->rc;
+}
+
+static const conn_params_t s_slow = {.itvl_min = 36, .itvl_max = 36, .latency = 0, .supervision_timeout = 500};
+
+static void setup(conn_params_mgr_t *cp, mock_stack_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    hal_ble_t ble = {.update_params = mock_update_params, .ctx = m};
+    conn_params_init(cp, &ble);
+    s_now = 5 * S;
+}
+
+// Runs the manager the way the button task does: sleep until the next
+// deadline, tick, repeat
+static void run_until(conn_params_mgr_t *cp, int64_t t)
+{
+    for (int64_t d; (d = conn_params_next_deadline(cp)) <= t;)
+    {
+        s_now = d > s_now ? d : s_now;
+        conn_params_tick(cp, s_now);
+        if (conn_params_next_deadline(cp) == d)
+            break; // waiting on the stack
+    }
+    s_now = t;
+    conn_params_tick(cp, s_now);
+}
+
+// The stack's CONN_UPDATE event, granting `itvl` and `latency`
+static void granted(conn_params_mgr_t *cp, int status, uint16_t itvl, uint16_t latency)
+{
+    conn_params_t p = {.itvl_min = itvl, .itvl_max = itvl, .latency = latency, .supervision_timeout = 400};
+    conn_params_updated(cp, status, &p, s_now);
+}
+
+static void test_first_request_after_discovery(void)
+{
+    conn_params_mgr_t cp;
+    mock_stack_t m;
+    setup(&cp, &m);
+    CHECK_EQ(conn_params_next_deadline(&cp), CONN_PARAMS_NO_DEADLINE);
+
+    int64_t t0 = s_now;
+    conn_params_connected(&cp, HANDLE, &s_slow, t0);
+    conn_params_activity(&cp, t0 + 1000);
+    CHECK_EQ(m.count, 0); // the host is still discovering
+    CHECK_EQ(conn_params_next_deadline(&cp), t0 + CONN_PARAMS_FIRST_REQUEST_US);
+
+    run_until(&cp, t0 + CONN_PARAMS_FIRST_REQUEST_US);
+    CHECK_EQ(m.count, 1);
+    CHECK_EQ(m.at[0], t0 + CONN_PARAMS_FIRST_REQUEST_US);
+    CHECK_MEM(&m.requests[0], &conn_policy_params[CONN_POLICY_FAST], sizeof(conn_params_t));
+    CHECK_EQ(m.bad_handles, 0);
+    CHECK(cp.pending);
+
+    // Nothing more while the request is outstanding
+    run_until(&cp, t0 + 3 * S);
+    CHECK_EQ(m.count, 1);
+
+    granted(&cp, 0, 12, 0);
+    CHECK(conn_params_satisfied(&cp));
+    CHECK(!cp.pending);
+    CHECK_EQ(cp.requests, 1);
+    CHECK_EQ(cp.rejections, 0);
+}
+
+static void test_already_fast_sends_nothing(void)
+{
+    conn_params_mgr_t cp;
+    mock_stack_t m;
+    setup(&cp, &m);
+    conn_params_t fast = {.itvl_min = 6, .itvl_max = 6, .latency = 0, .supervision_timeout = 400};
+    conn_params_connected(&cp, HANDLE, &fast, s_now);
+    for (int i = 0; i < 9; i++)
+        conn_params_activity(&cp, s_now + i * S);
+    run_until(&cp, s_now + 9 * S);
+    CHECK_EQ(m.count, 0);
+}
+
+static void test_idle_and_back(void)
+{
+    conn_params_mgr_t cp;
+    mock_stack_t m;
+    setup(&cp, &m);
+    conn_params_t fast = {.itvl_min = 12, .itvl_max = 12, .latency = 0, .supervision_timeout = 400};
+    int64_t t0 = s_now;
+    conn_params_connected(&cp, HANDLE, &fast, t0);
+
+    // No input for the idle timeout: ask for the slow, latency-tolerant set
+    CHECK_EQ(conn_params_next_deadline(&cp), t0 + CONN_PARAMS_IDLE_TIMEOUT_US);
+    run_until(&cp, t0 + CONN_PARAMS_IDLE_TIMEOUT_US);
+    CHECK_EQ(cp.policy, CONN_POLICY_IDLE);
+    CHECK_EQ(m.count, 1);
+    CHECK_EQ(m.at[0], t0 + CONN_PARAMS_IDLE_TIMEOUT_US);
+    CHECK_MEM(&m.requests[0], &conn_policy_params[CONN_POLICY_IDLE], sizeof(conn_params_t));
+    granted(&cp, 0, 40, 4);
+    CHECK(conn_params_satisfied(&cp));
+    CHECK_EQ(conn_params_next_deadline(&cp), CONN_PARAMS_NO_DEADLINE);
+
+    // A key press asks for fast right away
+    s_now += 30 * S;
+    conn_params_activity(&cp, s_now);
+    CHECK_EQ(cp.policy, CONN_POLICY_FAST);
+    CHECK_EQ(m.count, 2);
+    CHECK_EQ(m.at[1], s_now);
+    CHECK_MEM(&m.requests[1], &conn_policy_params[CONN_POLICY_FAST], sizeof(conn_params_t));
+}
+
+static void test_rejection_backoff(void)
+{
+    conn_params_mgr_t cp;
+    mock_stack_t m;
+    setup(&cp, &m);
+    int64_t t0 = s_now;
+    conn_params_connected(&cp, HANDLE, &s_slow, t0);
+    run_until(&cp, t0 + CONN_PARAMS_FIRST_REQUEST_US);
+    CHECK_EQ(m.count, 1);
+
+    // The host refuses: no new request until the backoff has passed, even
+    // with keys going down
+    int64_t t1 = s_now + 100000;
+    s_now = t1;
+    granted(&cp, 0x1E, 36, 0);
+    CHECK_EQ(cp.rejections, 1);
+    CHECK_EQ(conn_params_next_deadline(&cp), t1 + CONN_PARAMS_REJECT_BACKOFF_US);
+    conn_params_activity(&cp, t1 + S);
+    run_until(&cp, t1 + CONN_PARAMS_REJECT_BACKOFF_US - 1);
+    CHECK_EQ(m.count, 1);
+    run_until(&cp, t1 + CONN_PARAMS_REJECT_BACKOFF_US);
+    CHECK_EQ(m.count, 2);
+
+    // Accepted but not what we asked for counts as a rejection too
+    granted(&cp, 0, 24, 0);
+    CHECK_EQ(cp.rejections, 2);
+    CHECK(!conn_params_satisfied(&cp));
+}
+
+static void test_stack_busy_retries(void)
+{
+    conn_params_mgr_t cp;
+    mock_stack_t m;
+    setup(&cp, &m);
+    int64_t t0 = s_now;
+    m.rc = 15; // BLE_HS_EALREADY: a procedure is already running
+    conn_params_connected(&cp, HANDLE, &s_slow, t0);
+    run_until(&cp, t0 + CONN_PARAMS_FIRST_REQUEST_US);
+    CHECK_EQ(m.count, 1);
+    CHECK(!cp.pending);
+    CHECK_EQ(cp.requests, 0);
+
+    // Retried after the minimum spacing, not on every tick
+    run_until(&cp, t0 + CONN_PARAMS_FIRST_REQUEST_US + CONN_PARAMS_MIN_SPACING_US - 1);
+    CHECK_EQ(m.count, 1);
+    m.rc = 0;
+    run_until(&cp, t0 + CONN_PARAMS_FIRST_REQUEST_US + CONN_PARAMS_MIN_SPACING_US);
+    CHECK_EQ(m.count, 2);
+    CHECK(cp.pending);
+    CHECK_EQ(cp.requests, 1);
+}
+
+static void test_disconnected_is_quiet(void)
+{
+    conn_params_mgr_t cp;
+    mock_stack_t m;
+    setup(&cp, &m);
+    int64_t t0 = s_now;
+    conn_params_connected(&cp, HANDLE, &s_slow, t0);
+    conn_params_disconnected(&cp);
+    CHECK_EQ(conn_params_next_deadline(&cp), CONN_PARAMS_NO_DEADLINE);
+    conn_params_activity(&cp, t0 + 2 * S);
+    run_until(&cp, t0 + 60 * S);
+    CHECK_EQ(m.count, 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_first_request_after_discovery);
+    TEST_RUN(test_already_fast_sends_nothing);
+    TEST_RUN(test_idle_and_back);
+    TEST_RUN(test_rejection_backoff);
+    TEST_RUN(test_stack_busy_retries);
+    TEST_RUN(test_disconnected_is_quiet);
+    return TEST_EXIT();
+}
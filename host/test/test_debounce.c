@@ -0,0 +1,89 @@
+// Debouncer behaviour per algorithm, one key driven tick by tick
+#include "test.h"
+#include "debounce.h"
+
+#define TICKS 5
+
+// Feeds `raw` for `n` ticks and returns the debounced state of key 0
+static bool feed(debounce_t *db, bool raw, int n)
+{
+    scan_mask_t state = 0;
+    while (n--)
+        state = debounce_update(db, raw);
+    return state & 1;
+}
+
+static void test_eager_reports_first_edge(void)
+{
+    debounce_t db;
+    debounce_init(&db, DEBOUNCE_EAGER, TICKS);
+    CHECK_EQ(feed(&db, true, 1), true);
+
+    // Contact bounce inside the lockout window is ignored
+    for (int i = 0; i < TICKS; i++)
+        CHECK_EQ(feed(&db, i & 1, 1), true);
+    CHECK_EQ(feed(&db, true, 3), true);
+
+    // The release is reported on its first tick too
+    CHECK_EQ(feed(&db, false, 1), false);
+}
+
+static void test_deferred_waits_for_stable_input(void)
+{
+    debounce_t db;
+    debounce_init(&db, DEBOUNCE_DEFERRED, TICKS);
+    CHECK_EQ(feed(&db, true, TICKS - 1), false);
+    CHECK_EQ(feed(&db, true, 1), true);
+
+    // A glitch shorter than the window restarts the count and never shows
+    CHECK_EQ(feed(&db, false, TICKS - 1), true);
+    CHECK_EQ(feed(&db, true, 1), true);
+    CHECK_EQ(feed(&db, false, TICKS - 1), true);
+    CHECK_EQ(feed(&db, false, 1), false);
+}
+
+static void test_integrator_rails(void)
+{
+    debounce_t db;
+    debounce_init(&db, DEBOUNCE_INTEGRATOR, TICKS);
+    CHECK_EQ(feed(&db, true, TICKS - 1), false);
+    CHECK_EQ(feed(&db, true, 1), true);
+
+    // Alternating noise does not move the output off a rail
+    for (int i = 0; i < 20; i++)
+        CHECK_EQ(feed(&db, i & 1, 1), true);
+    CHECK_EQ(feed(&db, false, TICKS + 1), false);
+}
+
+static void test_per_key_algorithm(void)
+{
+    debounce_t db;
+    debounce_init(&db, DEBOUNCE_DEFERRED, TICKS);
+    debounce_set_algo(&db, 1, DEBOUNCE_EAGER);
+    scan_mask_t state = debounce_update(&db, 0x3);
+    CHECK_EQ(state, 0x2);
+    for (int i = 1; i < TICKS; i++)
+        state = debounce_update(&db, 0x3);
+    CHECK_EQ(state, 0x3);
+}
+
+static void test_window_is_clamped(void)
+{
+    debounce_t db;
+    debounce_init(&db, DEBOUNCE_DEFERRED, 0);
+    CHECK_EQ(db.ticks, 1);
+    debounce_init(&db, DEBOUNCE_DEFERRED, 255);
+    CHECK_EQ(db.ticks, DEBOUNCE_MAX_TICKS);
+    CHECK_EQ(feed(&db, true, DEBOUNCE_MAX_TICKS - 1), false);
+    CHECK_EQ(feed(&db, true, 1), true);
+}
+
+int main(void)
+{
+    TEST_RUN(test_eager_reports_first_edge);
+    TEST_RUN(test_deferred_waits_for_stable_input);
+    TEST_RUN(test_integrator_rails);
+    TEST_RUN(test_per_key_algorithm);
+    TEST_RUN(test_window_is_clamped);
+    return TEST_EXIT();
+}
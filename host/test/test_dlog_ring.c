@@ -0,0 +1,139 @@
+// Deferred log ring: ordering, drops, formatting and concurrent writers
+#include <pthread.h>
+#include <sched.h>
+#include "test.h"
+#include "dlog_ring.h"
+
+#define RING_LEN 8
+#define STRESS_WRITERS 2
+#define STRESS_ITEMS 200000
+
+static const char s_tag[] = "TEST";
+
+static void test_fifo_and_full(void)
+{
+    dlog_slot_t slots[RING_LEN];
+    dlog_ring_t r;
+    dlog_ring_init(&r, slots, RING_LEN);
+    dlog_entry_t e;
+    CHECK(!dlog_ring_pop(&r, &e));
+
+    for (uint32_t i = 0; i < RING_LEN; i++)
+        CHECK(dlog_ring_write(&r, 100 + i, 3, s_tag, "n=%u", 1, &i));
+    uint32_t extra = 99;
+    CHECK(!dlog_ring_write(&r, 0, 3, s_tag, "n=%u", 1, &extra));
+    CHECK_EQ(atomic_load(&r.dropped), 1);
+
+    for (uint32_t i = 0; i < RING_LEN; i++)
+    {
+        CHECK(dlog_ring_pop(&r, &e));
+        CHECK_EQ(e.t_us, 100 + i);
+        CHECK_EQ(e.args[0], i);
+        CHECK_EQ(e.nargs, 1);
+        CHECK(e.tag == s_tag);
+    }
+    CHECK(!dlog_ring_pop(&r, &e));
+    // Room again once drained
+    CHECK(dlog_ring_write(&r, 0, 3, s_tag, "n=%u", 1, &extra));
+}
+
+// A claimed slot that is not published yet holds back the reader, even
+// when later writers have finished
+static void test_unpublished_slot(void)
+{
+    dlog_slot_t slots[RING_LEN];
+    dlog_ring_t r;
+    dlog_ring_init(&r, slots, RING_LEN);
+    atomic_store(&r.head, 1); // a writer claimed position 0 and was preempted
+    uint32_t v = 7;
+    CHECK(dlog_ring_write(&r, 0, 3, s_tag, "n=%u", 1, &v));
+
+    dlog_entry_t e;
+    CHECK(!dlog_ring_pop(&r, &e));
+    atomic_store(&slots[0].seq, 1);
+    CHECK(dlog_ring_pop(&r, &e));
+    CHECK(dlog_ring_pop(&r, &e));
+    CHECK_EQ(e.args[0], 7);
+}
+
+static void test_format(void)
+{
+    dlog_slot_t slots[RING_LEN];
+    dlog_ring_t r;
+    dlog_ring_init(&r, slots, RING_LEN);
+    const uint32_t args[] = {12, (uint32_t)-3, 0xbeef, 'k'};
+    dlog_ring_write(&r, 0, 3, s_tag, "conn_handle=%u status=%d attr=%x key=%c", 4, args);
+    dlog_ring_write(&r, 0, 3, s_tag, "no arguments", 0, NULL);
+
+    dlog_entry_t e;
+    char line[64];
+    CHECK(dlog_ring_pop(&r, &e));
+    CHECK_EQ(dlog_format(&e, line, sizeof(line)), 40);
+    CHECK(strcmp(line, "conn_handle=12 status=-3 attr=beef key=k") == 0);
+    CHECK(dlog_ring_pop(&r, &e));
+    dlog_format(&e, line, sizeof(line));
+    CHECK(strcmp(line, "no arguments") == 0);
+    // Truncated like snprintf
+    dlog_ring_write(&r, 0, 3, s_tag, "conn_handle=%u status=%d attr=%x key=%c", 4, args);
+    CHECK(dlog_ring_pop(&r, &e));
+    CHECK_EQ(dlog_format(&e, line, 8), 40);
+    CHECK(strcmp(line, "conn_ha") == 0);
+}
+
+// Writers on their own threads against one reader: every entry arrives
+// exactly once and each writer's entries stay in order
+static dlog_slot_t s_stress_slots[64];
+static dlog_ring_t s_stress;
+
+static void *stress_writer(void *arg)
+{
+    uint32_t args[2] = {(uint32_t)(uintptr_t)arg, 0};
+    for (uint32_t i = 0; i < STRESS_ITEMS; i++)
+    {
+        args[1] = i;
+        while (!dlog_ring_write(&s_stress, i, 3, s_tag, "%u %u", 2, args))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void test_threaded_writers(void)
+{
+    dlog_ring_init(&s_stress, s_stress_slots, 64);
+    pthread_t writers[STRESS_WRITERS];
+    for (int w = 0; w < STRESS_WRITERS; w++)
+        CHECK(pthread_create(&writers[w], NULL, stress_writer, (void *)(uintptr_t)w) == 0);
+
+    uint32_t next[STRESS_WRITERS] = {0};
+    uint32_t got = 0;
+    bool in_order = true;
+    dlog_entry_t e;
+    while (got < STRESS_WRITERS * STRESS_ITEMS)
+    {
+        if (!dlog_ring_pop(&s_stress, &e))
+        {
+            sched_yield();
+            continue;
+        }
+        uint32_t w = e.args[0];
+        in_order &= w < STRESS_WRITERS && e.args[1] == next[w] && e.t_us == e.args[1];
+        if (w < STRESS_WRITERS)
+            next[w]++;
+        got++;
+    }
+    for (int w = 0; w < STRESS_WRITERS; w++)
+        pthread_join(writers[w], NULL);
+    CHECK(in_order);
+    for (int w = 0; w < STRESS_WRITERS; w++)
+        CHECK_EQ(next[w], STRESS_ITEMS);
+    CHECK(!dlog_ring_pop(&s_stress, &e));
+}
+
+int main(void)
+{
+    TEST_RUN(test_fifo_and_full);
+    TEST_RUN(test_unpublished_slot);
+    TEST_RUN(test_format);
+    TEST_RUN(test_threaded_writers);
+    return TEST_EXIT();
+}
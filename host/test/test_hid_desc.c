@@ -0,0 +1,411 @@
+// Every report the firmware sends, decoded through the generated report
+// descriptor as a host parses it: IDs, lengths and field values must match
+// what the sender meant, independent of the packed structs
+#include "test.h"
+#include "hid_parse.h"
+#include "hid_report.h"
+#include "keycodes.h"
+#include "typing.h"
+#include "macro.h"
+
+#define A 0x04
+#define KEY(u) HID_PARSE_USAGE(HID_DESC_PAGE_KEYBOARD, (u))
+#define GD(u) HID_PARSE_USAGE(HID_DESC_PAGE_GENERIC_DESKTOP, (u))
+#define CONSUMER(u) HID_PARSE_USAGE(HID_DESC_PAGE_CONSUMER, (u))
+
+static const uint8_t s_desc[] = {HID_REPORT_DESCRIPTOR};
+static hid_parse_t s_parse;
+
+// What a host makes of one input report
+typedef struct
+{
+    uint8_t mods;
+    uint8_t keys[32]; // held keyboard usages, bit per usage
+    int nkeys;
+    uint8_t buttons;
+    int x, y, wheel, pan;
+    uint32_t consumer[4];
+    int nconsumer;
+} host_view_t;
+
+static void view_key(host_view_t *v, uint32_t usage)
+{
+    uint8_t id = (uint8_t)usage;
+    if (id >= 0xE0 && id <= 0xE7)
+    {
+        v->mods |= 1 << (id - 0xE0);
+    }
+    else if (!(v->keys[id / 8] & (1 << (id % 8))))
+    {
+        v->keys[id / 8] |= 1 << (id % 8);
+        v->nkeys++;
+    }
+}
+
+// False when the length disagrees with the descriptor
+static bool decode(uint8_t report_id, const uint8_t *data, uint8_t len, host_view_t *v)
+{
+    memset(v, 0, sizeof(*v));
+    if (len != hid_parse_report_len(&s_parse, report_id, HID_PARSE_INPUT) || len == 0)
+        return false;
+    for (int i = 0; i < s_parse.num_fields; i++)
+    {
+        const hid_parse_field_t *f = &s_parse.fields[i];
+        if (f->report_id != report_id || f->main != HID_PARSE_INPUT || (f->flags & HID_DESC_CONST))
+            continue;
+        if (!(f->flags & HID_DESC_VAR))
+        {
+            uint32_t usages[8];
+            int n = hid_parse_array_usages(f, data, usages, 8);
+            for (int u = 0; u < n; u++)
+            {
+                if (usages[u] >> 16 == HID_DESC_PAGE_KEYBOARD)
+                    view_key(v, usages[u]);
+                else if (usages[u] >> 16 == HID_DESC_PAGE_CONSUMER && v->nconsumer < 4)
+                    v->consumer[v->nconsumer++] = usages[u];
+            }
+            continue;
+        }
+        for (int e = 0; e < f->count; e++)
+        {
+            uint32_t usage = hid_parse_var_usage(f, e);
+            int32_t value = hid_parse_get(f, e, data);
+            if (usage >> 16 == HID_DESC_PAGE_KEYBOARD && value)
+                view_key(v, usage);
+            else if (usage >> 16 == HID_DESC_PAGE_BUTTON && value)
+                v->buttons |= 1 << ((usage & 0xFFFF) - 1);
+            else if (usage == GD(0x30))
+                v->x = value;
+            else if (usage == GD(0x31))
+                v->y = value;
+            else if (usage == GD(0x38))
+                v->wheel = value;
+            else if (usage == CONSUMER(0x238))
+                v->pan = value;
+        }
+    }
+    return true;
+}
+
+static bool holds(const host_view_t *v, uint8_t usage)
+{
+    return v->keys[usage / 8] & (1 << (usage % 8));
+}
+
+static bool decode_last(const test_sink_t *s, uint8_t report_id, host_view_t *v)
+{
+    const test_report_t *r = test_last(s);
+    CHECK_EQ(r->report_id, report_id);
+    return decode(r->report_id, r->data, r->len, v);
+}
+
+static void test_descriptor_layout(void)
+{
+    CHECK(hid_parse(&s_parse, s_desc, sizeof(s_desc)));
+    if (s_parse.error)
+        printf("  %s at byte %zu\n", s_parse.error, s_parse.error_at);
+
+    // Every field sits in a report with an ID: mixing reports with and
+    // without one is what the old hand-written map got wrong
+    for (int i = 0; i < s_parse.num_fields; i++)
+        CHECK(s_parse.fields[i].report_id != 0);
+    // One ID per application collection
+    for (int c = 0; c < s_parse.num_collections; c++)
+    {
+        if (s_parse.collections[c].type != HID_DESC_APPLICATION)
+            continue;
+        int id = -1;
+        for (int i = 0; i < s_parse.num_fields; i++)
+        {
+            const hid_parse_field_t *f = &s_parse.fields[i];
+            int top = f->collection;
+            while (top >= 0 && s_parse.collections[top].parent >= 0)
+                top = s_parse.collections[top].parent;
+            if (top != c)
+                continue;
+            CHECK(id < 0 || id == f->report_id);
+            id = f->report_id;
+        }
+        CHECK(id > 0);
+    }
+
+    const struct
+    {
+        uint8_t id;
+        hid_parse_main_t main;
+        size_t len;
+        uint32_t usage; // of the application collection
+    } reports[] = {
+        {HID_REPORT_ID_KEYBOARD, HID_PARSE_INPUT, HID_REPORT_KEYBOARD_LEN, GD(0x06)},
+        {HID_REPORT_ID_NKRO, HID_PARSE_INPUT, HID_REPORT_NKRO_LEN, GD(0x06)},
+        {HID_REPORT_ID_MOUSE, HID_PARSE_INPUT, HID_REPORT_MOUSE_LEN, GD(0x02)},
+        {HID_REPORT_ID_MOUSE, HID_PARSE_FEATURE, HID_REPORT_MOUSE_FEATURE_LEN, GD(0x02)},
+        {HID_REPORT_ID_CONSUMER, HID_PARSE_INPUT, HID_REPORT_CONSUMER_LEN, CONSUMER(0x01)},
+    };
+    for (size_t i = 0; i < sizeof(reports) / sizeof(reports[0]); i++)
+    {
+        CHECK_EQ(s_parse.bits[reports[i].id][reports[i].main] % 8, 0);
+        CHECK_EQ(hid_parse_report_len(&s_parse, reports[i].id, reports[i].main), reports[i].len);
+        CHECK(reports[i].len <= HID_REPORT_MAX_LEN);
+        const hid_parse_field_t *f = NULL;
+        for (int k = 0; k < s_parse.num_fields && f == NULL; k++)
+            f = s_parse.fields[k].report_id == reports[i].id ? &s_parse.fields[k] : NULL;
+        int top = f ? f->collection : -1;
+        while (top >= 0 && s_parse.collections[top].parent >= 0)
+            top = s_parse.collections[top].parent;
+        CHECK(top >= 0 && s_parse.collections[top].usage == reports[i].usage);
+    }
+    // No output reports: nothing in the firmware handles them
+    for (int id = 0; id < 256; id++)
+        CHECK_EQ(s_parse.bits[id][HID_PARSE_OUTPUT], 0);
+}
+
+// Report IDs and lengths the typing engine and macro VM hard-code
+static void test_core_constants(void)
+{
+    CHECK_EQ(TYPING_REPORT_LEN, hid_parse_report_len(&s_parse, HID_REPORT_ID_KEYBOARD, HID_PARSE_INPUT));
+    CHECK_EQ(MACRO_KEYBOARD_REPORT_ID, HID_REPORT_ID_KEYBOARD);
+    CHECK_EQ(MACRO_MOUSE_REPORT_ID, HID_REPORT_ID_MOUSE);
+    CHECK_EQ(MACRO_MOUSE_REPORT_LEN, hid_parse_report_len(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_INPUT));
+    CHECK(hid_parse_find(&s_parse, HID_REPORT_ID_KEYBOARD, HID_PARSE_INPUT, KEY(USB_HID_KEY_A), NULL) != NULL);
+}
+
+static void test_keyboard_report(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+    host_view_t v;
+
+    hid_report_key(&r, USB_HID_MODIFIER_LEFT_SHIFT | USB_HID_MODIFIER_RIGHT_ALT, A, true);
+    hid_report_key(&r, 0, USB_HID_SPACE, true);
+    hid_report_key(&r, 0, USB_HID_NON_US_BSLASH, true);
+    CHECK(decode_last(&s, HID_REPORT_ID_KEYBOARD, &v));
+    CHECK_EQ(v.mods, USB_HID_MODIFIER_LEFT_SHIFT | USB_HID_MODIFIER_RIGHT_ALT);
+    CHECK_EQ(v.nkeys, 3);
+    CHECK(holds(&v, A) && holds(&v, USB_HID_SPACE) && holds(&v, USB_HID_NON_US_BSLASH));
+
+    hid_report_key(&r, USB_HID_MODIFIER_LEFT_SHIFT | USB_HID_MODIFIER_RIGHT_ALT, A, false);
+    CHECK(decode_last(&s, HID_REPORT_ID_KEYBOARD, &v));
+    CHECK_EQ(v.mods, 0);
+    CHECK_EQ(v.nkeys, 2);
+    CHECK(!holds(&v, A));
+}
+
+static void test_nkro_report(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+    hid_report_set_nkro(&r, true);
+    host_view_t v;
+
+    // Every usage the bitmap declares, all held at once
+    const hid_parse_field_t *bitmap = hid_parse_find(&s_parse, HID_REPORT_ID_NKRO, HID_PARSE_INPUT, KEY(A), NULL);
+    CHECK(bitmap != NULL && (bitmap->flags & HID_DESC_VAR));
+    int declared = 0;
+    for (int u = 1; u < 0xE0; u++)
+    {
+        if (!hid_parse_find(&s_parse, HID_REPORT_ID_NKRO, HID_PARSE_INPUT, KEY(u), NULL))
+            continue;
+        declared++;
+        hid_report_key(&r, 0, u, true);
+    }
+    hid_report_key(&r, USB_HID_MODIFIER_RIGHT_GUI, 0, true);
+    CHECK(decode_last(&s, HID_REPORT_ID_NKRO, &v));
+    CHECK_EQ(v.nkeys, declared);
+    CHECK_EQ(v.mods, USB_HID_MODIFIER_RIGHT_GUI);
+
+    for (int u = 1; u < 0xE0; u++)
+        hid_report_key(&r, 0, u, false);
+    CHECK(decode_last(&s, HID_REPORT_ID_NKRO, &v));
+    CHECK_EQ(v.nkeys, 0);
+}
+
+// Press report of every printable character carries its layout keycode, on
+// either keyboard report
+static void test_tap_char(void)
+{
+    hid_report_t r;
+    test_sink_t s;
+    host_view_t v;
+    for (int i = 0; i < 2 * (0x7F - 0x20); i++)
+    {
+        bool nkro = i >= 0x7F - 0x20;
+        char c = 0x20 + i % (0x7F - 0x20);
+        hal_hid_sink_t sink = test_sink(&s);
+        hid_report_init(&r, &sink);
+        hid_report_set_nkro(&r, nkro);
+        keycode_t kc = ascii_to_keycode(c);
+        CHECK(hid_report_tap_char(&r, c));
+        CHECK_EQ(s.count, 2);
+        CHECK(decode(s.reports[0].report_id, s.reports[0].data, s.reports[0].len, &v));
+        CHECK_EQ(s.reports[0].report_id, nkro ? HID_REPORT_ID_NKRO : HID_REPORT_ID_KEYBOARD);
+        CHECK_EQ(v.mods, KEYCODE_MOD(kc));
+        CHECK_EQ(v.nkeys, 1);
+        CHECK(holds(&v, KEYCODE_USAGE(kc)));
+        CHECK(decode(s.reports[1].report_id, s.reports[1].data, s.reports[1].len, &v));
+        CHECK_EQ(v.mods | v.nkeys, 0);
+    }
+}
+
+static void test_mouse_report(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+    host_view_t v;
+
+    hid_report_mouse(&r, 0x05, -127, 127, -3, 2);
+    CHECK(decode_last(&s, HID_REPORT_ID_MOUSE, &v));
+    CHECK_EQ(v.buttons, 0x05);
+    CHECK_EQ(v.x, -127);
+    CHECK_EQ(v.y, 127);
+    CHECK_EQ(v.wheel, -3);
+    CHECK_EQ(v.pan, 2);
+
+    const keystore_action_t right = {.type = KEYSTORE_ACTION_MOUSE, .arg0 = 0x02};
+    hid_report_action(&r, &right, true);
+    hid_report_mouse_move(&r, 9, -8, 1, -1);
+    CHECK(decode_last(&s, HID_REPORT_ID_MOUSE, &v));
+    CHECK_EQ(v.buttons, 0x02);
+    CHECK_EQ(v.x, 9);
+    CHECK_EQ(v.y, -8);
+    CHECK_EQ(v.wheel, 1);
+    CHECK_EQ(v.pan, -1);
+}
+
+static void test_consumer_report(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+    host_view_t v;
+
+    hid_report_consumer(&r, HID_CONSUMER_VOLUME_UP, true);
+    hid_report_consumer(&r, HID_REPORT_CONSUMER_MAX_USAGE, true);
+    CHECK(decode_last(&s, HID_REPORT_ID_CONSUMER, &v));
+    CHECK_EQ(v.nconsumer, 2);
+    CHECK_EQ(v.consumer[0], CONSUMER(HID_CONSUMER_VOLUME_UP));
+    CHECK_EQ(v.consumer[1], CONSUMER(HID_REPORT_CONSUMER_MAX_USAGE));
+    hid_report_consumer(&r, HID_CONSUMER_VOLUME_UP, false);
+    hid_report_consumer(&r, HID_REPORT_CONSUMER_MAX_USAGE, false);
+    CHECK(decode_last(&s, HID_REPORT_ID_CONSUMER, &v));
+    CHECK_EQ(v.nconsumer, 0);
+}
+
+// Typed text and macro reports bypass hid_report.c and are sent as is
+// Every named usage fits the 16-bit array and reads back as itself, alone
+// and held together with the previous one
+static void test_consumer_usages(void)
+{
+    static const uint16_t usages[] = {
+        HID_CONSUMER_POWER,         HID_CONSUMER_RESET,         HID_CONSUMER_SLEEP,         HID_CONSUMER_MENU,
+        HID_CONSUMER_SELECTION,     HID_CONSUMER_ASSIGN_SEL,    HID_CONSUMER_MODE_STEP,     HID_CONSUMER_RECALL_LAST,
+        HID_CONSUMER_QUIT,          HID_CONSUMER_HELP,          HID_CONSUMER_CHANNEL_UP,    HID_CONSUMER_CHANNEL_DOWN,
+        HID_CONSUMER_PLAY,          HID_CONSUMER_PAUSE,         HID_CONSUMER_RECORD,        HID_CONSUMER_FAST_FORWARD,
+        HID_CONSUMER_REWIND,        HID_CONSUMER_SCAN_NEXT_TRK, HID_CONSUMER_SCAN_PREV_TRK, HID_CONSUMER_STOP,
+        HID_CONSUMER_EJECT,         HID_CONSUMER_RANDOM_PLAY,   HID_CONSUMER_SELECT_DISC,   HID_CONSUMER_ENTER_DISC,
+        HID_CONSUMER_REPEAT,        HID_CONSUMER_STOP_EJECT,    HID_CONSUMER_PLAY_PAUSE,    HID_CONSUMER_PLAY_SKIP,
+        HID_CONSUMER_VOLUME,        HID_CONSUMER_BALANCE,       HID_CONSUMER_MUTE,          HID_CONSUMER_BASS,
+        HID_CONSUMER_VOLUME_UP,     HID_CONSUMER_VOLUME_DOWN,
+    };
+    const hid_parse_field_t *array =
+        hid_parse_find(&s_parse, HID_REPORT_ID_CONSUMER, HID_PARSE_INPUT, CONSUMER(HID_CONSUMER_MUTE), NULL);
+    CHECK(array != NULL);
+    if (array == NULL)
+        return;
+    CHECK_EQ(array->flags & (HID_DESC_CONST | HID_DESC_VAR), 0);
+    CHECK_EQ(array->size, 16);
+    CHECK_EQ(array->count, HID_REPORT_CONSUMER_USAGES);
+    CHECK_EQ(array->logical_min, 0);
+    CHECK_EQ(array->logical_max, HID_REPORT_CONSUMER_MAX_USAGE);
+    CHECK_EQ(array->usage_min, CONSUMER(0));
+
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+    host_view_t v;
+    for (size_t i = 0; i < sizeof(usages) / sizeof(usages[0]); i++)
+    {
+        CHECK(hid_parse_find(&s_parse, HID_REPORT_ID_CONSUMER, HID_PARSE_INPUT, CONSUMER(usages[i]), NULL) == array);
+        CHECK(hid_report_consumer(&r, usages[i], true));
+        CHECK(decode_last(&s, HID_REPORT_ID_CONSUMER, &v));
+        CHECK_EQ(v.nconsumer, 1);
+        CHECK_EQ(v.consumer[0], CONSUMER(usages[i]));
+        if (i > 0)
+        {
+            CHECK(hid_report_consumer(&r, usages[i - 1], true));
+            CHECK(decode_last(&s, HID_REPORT_ID_CONSUMER, &v));
+            CHECK_EQ(v.nconsumer, 2);
+            CHECK(v.consumer[0] == CONSUMER(usages[i - 1]) || v.consumer[1] == CONSUMER(usages[i - 1]));
+            CHECK(hid_report_consumer(&r, usages[i - 1], false));
+        }
+        CHECK(hid_report_consumer(&r, usages[i], false));
+        CHECK(decode_last(&s, HID_REPORT_ID_CONSUMER, &v));
+        CHECK_EQ(v.nconsumer, 0);
+    }
+}
+
+static void test_typing_and_macro_reports(void)
+{
+    typing_t t;
+    uint8_t report[TYPING_REPORT_LEN];
+    host_view_t v;
+    bool shifted_h = false;
+    typing_init(&t, "Hi");
+    while (typing_next_report(&t, report))
+    {
+        CHECK(decode(HID_REPORT_ID_KEYBOARD, report, TYPING_REPORT_LEN, &v));
+        if (holds(&v, KEYCODE_USAGE(ascii_to_keycode('H'))))
+            shifted_h = v.mods == USB_HID_MODIFIER_LEFT_SHIFT;
+    }
+    CHECK(shifted_h);
+
+    const uint8_t code[] = {MACRO_OP_MODS, USB_HID_MODIFIER_LEFT_CTRL, MACRO_OP_KEY_DOWN, A,
+                            MACRO_OP_MOUSE, 0x01, (uint8_t)-5, 7, (uint8_t)-1, MACRO_OP_END};
+    macro_vm_t vm;
+    macro_step_t step;
+    macro_init(&vm, code, sizeof(code));
+    int reports = 0;
+    for (macro_step(&vm, &step); step.kind != MACRO_STEP_DONE && step.kind != MACRO_STEP_ERROR; macro_step(&vm, &step))
+    {
+        if (step.kind != MACRO_STEP_REPORT)
+            continue;
+        reports++;
+        CHECK(decode(step.report_id, step.data, step.len, &v));
+        if (step.report_id == HID_REPORT_ID_MOUSE)
+        {
+            CHECK_EQ(v.buttons, 1);
+            CHECK_EQ(v.x, -5);
+            CHECK_EQ(v.y, 7);
+            CHECK_EQ(v.wheel, -1);
+            CHECK_EQ(v.pan, 0);
+        }
+        else if (holds(&v, A))
+        {
+            CHECK_EQ(v.mods, USB_HID_MODIFIER_LEFT_CTRL);
+        }
+    }
+    CHECK_EQ(step.kind, MACRO_STEP_DONE);
+    CHECK(reports >= 2);
+}
+
+int main(void)
+{
+    TEST_RUN(test_descriptor_layout);
+    TEST_RUN(test_core_constants);
+    TEST_RUN(test_keyboard_report);
+    TEST_RUN(test_nkro_report);
+    TEST_RUN(test_tap_char);
+    TEST_RUN(test_mouse_report);
+    TEST_RUN(test_consumer_report);
+    TEST_RUN(test_consumer_usages);
+    TEST_RUN(test_typing_and_macro_reports);
+    return TEST_EXIT();
+}
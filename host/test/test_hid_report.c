@@ -0,0 +1,272 @@
+// Report builder: key slots, mouse and consumer reports, keymap actions
+#include "test.h"
+#include "hid_report.h"
+
+#define A 0x04
+
+static void check_keyboard(const test_sink_t *s, uint8_t mods, const uint8_t keys[HID_REPORT_KEYBOARD_KEYS])
+{
+    const test_report_t *r = test_last(s);
+    hid_keyboard_report_t want = {.mods = mods};
+    memcpy(want.keys, keys, HID_REPORT_KEYBOARD_KEYS);
+    CHECK_EQ(r->report_id, HID_REPORT_ID_KEYBOARD);
+    CHECK_EQ(r->len, HID_REPORT_KEYBOARD_LEN);
+    CHECK_MEM(r->data, &want, sizeof(want));
+}
+
+static void test_key_slots_keep_press_order(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+
+    hid_report_key(&r, 0, A + 2, true);
+    hid_report_key(&r, 0, A, true);
+    hid_report_key(&r, 0, A + 1, true);
+    check_keyboard(&s, 0, (const uint8_t[6]){A + 2, A, A + 1});
+
+    hid_report_key(&r, 0, A, false);
+    check_keyboard(&s, 0, (const uint8_t[6]){A + 2, A + 1});
+    hid_report_key(&r, 0, A + 1, true);
+    check_keyboard(&s, 0, (const uint8_t[6]){A + 2, A + 1});
+    CHECK_EQ(s.count, 5);
+}
+
+static void test_modifiers(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+
+    hid_report_key(&r, 0x02, 0, true);
+    hid_report_key(&r, 0x01, A, true);
+    check_keyboard(&s, 0x03, (const uint8_t[6]){A});
+    hid_report_key(&r, 0x02, 0, false);
+    check_keyboard(&s, 0x01, (const uint8_t[6]){A});
+    hid_report_key(&r, 0x01, A, false);
+    check_keyboard(&s, 0, (const uint8_t[6]){0});
+}
+
+// A seventh key waits for a free slot and takes it while still held
+static void test_seventh_key_refills_slot(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+
+    for (int i = 0; i < 7; i++)
+        hid_report_key(&r, 0, A + i, true);
+    check_keyboard(&s, 0, (const uint8_t[6]){A, A + 1, A + 2, A + 3, A + 4, A + 5});
+    hid_report_key(&r, 0, A + 6, false);
+    check_keyboard(&s, 0, (const uint8_t[6]){A, A + 1, A + 2, A + 3, A + 4, A + 5});
+
+    hid_report_key(&r, 0, A + 6, true);
+    hid_report_key(&r, 0, A + 2, false);
+    check_keyboard(&s, 0, (const uint8_t[6]){A, A + 1, A + 3, A + 4, A + 5, A + 6});
+    hid_report_key(&r, 0, A + 6, false);
+    check_keyboard(&s, 0, (const uint8_t[6]){A, A + 1, A + 3, A + 4, A + 5});
+}
+
+static void check_nkro(const test_sink_t *s, uint8_t mods, uint8_t first, uint8_t last)
+{
+    const test_report_t *r = test_last(s);
+    hid_nkro_report_t want = {.mods = mods};
+    for (int u = first; u && u <= last; u++)
+        want.bits[u / 8] |= 1 << (u % 8);
+    CHECK_EQ(r->report_id, HID_REPORT_ID_NKRO);
+    CHECK_EQ(r->len, HID_REPORT_NKRO_LEN);
+    CHECK_MEM(r->data, &want, sizeof(want));
+}
+
+// Every usage the reports carry can be held at once on NKRO, six of them on
+// the 6-key report; past the last one nothing changes and nothing is sent
+static void test_rollover(void)
+{
+    const uint8_t last = HID_REPORT_NKRO_USAGES - 1;
+    for (int nkro = 0; nkro <= 1; nkro++)
+    {
+        test_sink_t s;
+        hid_report_t r;
+        hal_hid_sink_t sink = test_sink(&s);
+        hid_report_init(&r, &sink);
+        hid_report_set_nkro(&r, nkro);
+
+        for (int u = A; u <= last; u++)
+            CHECK(hid_report_key(&r, 0, u, true));
+        if (nkro)
+            check_nkro(&s, 0, A, last);
+        else
+            check_keyboard(&s, 0, (const uint8_t[6]){A, A + 1, A + 2, A + 3, A + 4, A + 5});
+        int before = s.count;
+        CHECK(!hid_report_key(&r, 0x01, HID_REPORT_NKRO_USAGES, true));
+        CHECK(!hid_report_key(&r, 0, 0xE0, true));
+        CHECK_EQ(s.count, before);
+        CHECK_EQ(r.kbd_mods, 0);
+
+        // The top usage is reported like any other; on the 6-key report it
+        // moves into a slot once the keys before it are released
+        for (int u = A; u < last; u++)
+            hid_report_key(&r, 0, u, false);
+        if (nkro)
+            check_nkro(&s, 0, last, last);
+        else
+            check_keyboard(&s, 0, (const uint8_t[6]){last});
+        hid_report_key(&r, 0, last, false);
+        hid_report_key(&r, 0, last, true);
+        if (nkro)
+            check_nkro(&s, 0, last, last);
+        else
+            check_keyboard(&s, 0, (const uint8_t[6]){last});
+    }
+}
+
+// Switching formats with keys held releases them on the old report and
+// carries every held key and modifier to the new one
+static void test_format_switch_while_held(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+    hid_report_set_nkro(&r, true);
+    CHECK_EQ(s.count, 0);
+
+    hid_report_key(&r, 0x02, 0, true);
+    for (int u = A; u < A + 8; u++)
+        hid_report_key(&r, 0, u, true);
+    int before = s.count;
+    hid_report_set_nkro(&r, false);
+    CHECK_EQ(s.count, before + 2);
+    const hid_nkro_report_t release = {0};
+    CHECK_EQ(s.reports[before].report_id, HID_REPORT_ID_NKRO);
+    CHECK_MEM(s.reports[before].data, &release, sizeof(release));
+    check_keyboard(&s, 0x02, (const uint8_t[6]){A, A + 1, A + 2, A + 3, A + 4, A + 5});
+
+    // Keys past the six stay held while in boot mode, fill freed slots and
+    // all come back on NKRO
+    hid_report_key(&r, 0, A + 1, false);
+    check_keyboard(&s, 0x02, (const uint8_t[6]){A, A + 2, A + 3, A + 4, A + 5, A + 6});
+    hid_report_key(&r, 0, A + 8, true);
+    check_keyboard(&s, 0x02, (const uint8_t[6]){A, A + 2, A + 3, A + 4, A + 5, A + 6});
+    before = s.count;
+    hid_report_set_nkro(&r, true);
+    CHECK_EQ(s.count, before + 2);
+    const hid_keyboard_report_t boot_release = {0};
+    CHECK_EQ(s.reports[before].report_id, HID_REPORT_ID_KEYBOARD);
+    CHECK_MEM(s.reports[before].data, &boot_release, sizeof(boot_release));
+    hid_nkro_report_t want = {.mods = 0x02};
+    for (int u = A; u <= A + 8; u++)
+        want.bits[u / 8] |= u == A + 1 ? 0 : 1 << (u % 8);
+    CHECK_MEM(test_last(&s)->data, &want, sizeof(want));
+
+    // Released on NKRO, back to boot: only what is still held
+    for (int u = A; u <= A + 8; u++)
+        hid_report_key(&r, 0, u, false);
+    hid_report_key(&r, 0, A + 3, true);
+    hid_report_set_nkro(&r, false);
+    check_keyboard(&s, 0x02, (const uint8_t[6]){A + 3});
+    hid_report_key(&r, 0x02, A + 3, false);
+    check_keyboard(&s, 0, (const uint8_t[6]){0});
+
+    // Nothing held: no reports on a switch
+    before = s.count;
+    hid_report_set_nkro(&r, true);
+    hid_report_set_nkro(&r, false);
+    CHECK_EQ(s.count, before);
+}
+
+static void test_tap_char(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+
+    CHECK(hid_report_tap_char(&r, 'B'));
+    CHECK_EQ(s.count, 2);
+    const hid_keyboard_report_t down = {.mods = 0x02, .keys = {A + 1}};
+    CHECK_MEM(s.reports[0].data, &down, sizeof(down));
+    check_keyboard(&s, 0, (const uint8_t[6]){0});
+
+    // On NKRO the character goes out on the NKRO report
+    hid_report_set_nkro(&r, true);
+    CHECK(hid_report_tap_char(&r, 'B'));
+    CHECK_EQ(s.count, 4);
+    hid_nkro_report_t nkro_down = {.mods = 0x02};
+    nkro_down.bits[(A + 1) / 8] |= 1 << ((A + 1) % 8);
+    CHECK_EQ(s.reports[2].report_id, HID_REPORT_ID_NKRO);
+    CHECK_MEM(s.reports[2].data, &nkro_down, sizeof(nkro_down));
+    check_nkro(&s, 0, 0, 0);
+
+    s.refuse = true;
+    CHECK(!hid_report_tap_char(&r, 'a'));
+}
+
+static void test_mouse_actions(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+
+    const keystore_action_t click = {.type = KEYSTORE_ACTION_MOUSE, .arg0 = 1, .arg1 = (uint8_t)-4 | 6 << 8};
+    CHECK(hid_report_action(&r, &click, true));
+    hid_mouse_report_t want = {.buttons = 1, .x = -4, .y = 6};
+    CHECK_EQ(test_last(&s)->report_id, HID_REPORT_ID_MOUSE);
+    CHECK_EQ(test_last(&s)->len, HID_REPORT_MOUSE_LEN);
+    CHECK_MEM(test_last(&s)->data, &want, sizeof(want));
+
+    // Motion keeps the held button
+    hid_report_mouse_move(&r, 1, 2, -1, 1);
+    want = (hid_mouse_report_t){.buttons = 1, .x = 1, .y = 2, .wheel = -1, .pan = 1};
+    CHECK_MEM(test_last(&s)->data, &want, sizeof(want));
+
+    CHECK(hid_report_action(&r, &click, false));
+    want = (hid_mouse_report_t){0};
+    CHECK_MEM(test_last(&s)->data, &want, sizeof(want));
+
+    const keystore_action_t layer = {.type = KEYSTORE_ACTION_LAYER_TOGGLE};
+    int before = s.count;
+    CHECK(!hid_report_action(&r, &layer, true));
+    CHECK_EQ(s.count, before);
+}
+
+static void test_consumer_slots(void)
+{
+    test_sink_t s;
+    hid_report_t r;
+    hal_hid_sink_t sink = test_sink(&s);
+    hid_report_init(&r, &sink);
+
+    CHECK(hid_report_consumer(&r, HID_CONSUMER_VOLUME_UP, true));
+    CHECK(hid_report_consumer(&r, HID_CONSUMER_MUTE, true));
+    CHECK(!hid_report_consumer(&r, HID_CONSUMER_PLAY_PAUSE, true));
+    hid_consumer_report_t want = {.usages = {HID_CONSUMER_VOLUME_UP, HID_CONSUMER_MUTE}};
+    CHECK_EQ(test_last(&s)->report_id, HID_REPORT_ID_CONSUMER);
+    CHECK_MEM(test_last(&s)->data, &want, sizeof(want));
+
+    CHECK(hid_report_consumer(&r, HID_CONSUMER_VOLUME_UP, false));
+    want = (hid_consumer_report_t){.usages = {0, HID_CONSUMER_MUTE}};
+    CHECK_MEM(test_last(&s)->data, &want, sizeof(want));
+
+    CHECK(!hid_report_consumer(&r, 0, true));
+    CHECK(!hid_report_consumer(&r, HID_REPORT_CONSUMER_MAX_USAGE + 1, true));
+    CHECK(!hid_report_consumer(&r, HID_CONSUMER_PLAY_PAUSE, false));
+    CHECK_EQ(s.count, 3);
+}
+
+int main(void)
+{
+    TEST_RUN(test_key_slots_keep_press_order);
+    TEST_RUN(test_modifiers);
+    TEST_RUN(test_seventh_key_refills_slot);
+    TEST_RUN(test_rollover);
+    TEST_RUN(test_format_switch_while_held);
+    TEST_RUN(test_tap_char);
+    TEST_RUN(test_mouse_actions);
+    TEST_RUN(test_consumer_slots);
+    return TEST_EXIT();
+}
@@ -0,0 +1,271 @@
+// Host slot state machine driven through a mock stack that carries out the
+// actions it returns, as esp_hid_gap.c does with NimBLE
+#include "test.h"
+#include "host_slots.h"
+
+static const host_addr_t s_mac = {.type = 0, .val = {1, 2, 3, 4, 5, 6}};
+static const host_addr_t s_phone = {.type = 1, .val = {0xA, 0xB, 0xC, 0xD, 0xE, 0xF}};
+static const host_addr_t s_tablet = {.type = 0, .val = {9, 9, 9, 9, 9, 9}};
+
+typedef enum
+{
+    ADV_OFF,
+    ADV_DIRECTED,
+    ADV_UNDIRECTED,
+} adv_t;
+
+typedef struct
+{
+    host_slots_t hs;
+    adv_t adv;
+    host_addr_t adv_peer; // target of directed advertising
+    bool connected;
+    int adv_starts;
+    int disconnects;
+    int saves;
+} mock_stack_t;
+
+static void adv_start(mock_stack_t *m)
+{
+    host_action_t a = host_slots_start(&m->hs);
+    m->adv = a == HOST_ACTION_ADV_DIRECTED ? ADV_DIRECTED : ADV_UNDIRECTED;
+    m->adv_peer = m->hs.slots[m->hs.active].addr;
+    m->adv_starts++;
+}
+
+static void apply(mock_stack_t *m, host_action_t action)
+{
+    switch (action)
+    {
+    case HOST_ACTION_DISCONNECT:
+        CHECK(m->connected);
+        m->disconnects++;
+        break;
+    case HOST_ACTION_RESTART_ADV:
+        CHECK(m->adv != ADV_OFF);
+        m->adv = ADV_OFF;
+        adv_start(m);
+        break;
+    case HOST_ACTION_ADV_DIRECTED:
+    case HOST_ACTION_ADV_UNDIRECTED:
+        m->adv = action == HOST_ACTION_ADV_DIRECTED ? ADV_DIRECTED : ADV_UNDIRECTED;
+        m->adv_peer = m->hs.slots[m->hs.active].addr;
+        m->adv_starts++;
+        break;
+    case HOST_ACTION_NONE:
+    default:
+        break;
+    }
+}
+
+static void setup(mock_stack_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    host_slots_init(&m->hs);
+}
+
+// The advertising in progress timed out
+static void adv_timeout(mock_stack_t *m)
+{
+    m->adv = ADV_OFF;
+    apply(m, host_slots_adv_timeout(&m->hs));
+}
+
+// `peer` connects and encrypts; false if it was turned away
+static bool connect(mock_stack_t *m, const host_addr_t *peer, bool bonded)
+{
+    CHECK(m->adv != ADV_OFF);
+    if (m->adv == ADV_DIRECTED)
+        CHECK_MEM(&m->adv_peer, peer, sizeof(*peer));
+    m->adv = ADV_OFF;
+    m->connected = true;
+    host_slots_connected(&m->hs);
+
+    bool changed;
+    int disconnects = m->disconnects;
+    apply(m, host_slots_encrypted(&m->hs, peer, bonded, &changed));
+    m->saves += changed;
+    return m->disconnects == disconnects;
+}
+
+// The link went down; esp_hidd restarts advertising from here
+static void disconnected(mock_stack_t *m)
+{
+    m->connected = false;
+    host_slots_disconnected(&m->hs);
+    adv_start(m);
+}
+
+static void test_pairing_fills_the_active_slot(void)
+{
+    mock_stack_t m;
+    setup(&m);
+    adv_start(&m);
+    CHECK_EQ(m.adv, ADV_UNDIRECTED);
+    CHECK_EQ(m.hs.state, HOST_STATE_ADV_UNDIRECTED);
+
+    CHECK(connect(&m, &s_mac, true));
+    CHECK_EQ(m.hs.state, HOST_STATE_CONNECTED);
+    CHECK_EQ(m.saves, 1);
+    CHECK(m.hs.slots[0].bonded);
+    CHECK_EQ(host_slots_find(&m.hs, &s_mac), 0);
+
+    // Reconnecting later is directed at it
+    disconnected(&m);
+    CHECK_EQ(m.adv, ADV_DIRECTED);
+    CHECK(connect(&m, &s_mac, true));
+    CHECK_EQ(m.hs.directed_connects, 1);
+    CHECK_EQ(m.saves, 1);
+
+    // A host that does not bond neither takes the slot nor stays
+    setup(&m);
+    adv_start(&m);
+    CHECK(!connect(&m, &s_mac, false));
+    CHECK(!m.hs.slots[0].bonded);
+    CHECK_EQ(m.saves, 0);
+}
+
+static void test_switch_while_connected(void)
+{
+    mock_stack_t m;
+    setup(&m);
+    adv_start(&m);
+    CHECK(connect(&m, &s_mac, true));
+
+    // Slot 1 is empty: drop the Mac, then advertise undirected for pairing
+    apply(&m, host_slots_select(&m.hs, 1));
+    CHECK_EQ(m.disconnects, 1);
+    CHECK_EQ(m.hs.state, HOST_STATE_SWITCHING);
+    CHECK_EQ(m.hs.active, 1);
+    disconnected(&m);
+    CHECK_EQ(m.adv, ADV_UNDIRECTED);
+    CHECK(connect(&m, &s_phone, true));
+    CHECK_EQ(host_slots_find(&m.hs, &s_phone), 1);
+
+    // Back to slot 0: directed at the Mac
+    apply(&m, host_slots_select(&m.hs, 0));
+    disconnected(&m);
+    CHECK_EQ(m.adv, ADV_DIRECTED);
+    CHECK_MEM(&m.adv_peer, &s_mac, sizeof(s_mac));
+    CHECK(connect(&m, &s_mac, true));
+    CHECK_EQ(m.hs.switches, 2);
+
+    // Selecting the slot in use, or one that does not exist, does nothing
+    CHECK_EQ(host_slots_select(&m.hs, 0), HOST_ACTION_NONE);
+    CHECK_EQ(host_slots_select(&m.hs, HOST_SLOTS_MAX), HOST_ACTION_NONE);
+    CHECK_EQ(m.hs.switches, 2);
+}
+
+static void test_switch_while_advertising(void)
+{
+    mock_stack_t m;
+    setup(&m);
+    m.hs.slots[0] = (host_slot_t){.bonded = true, .addr = s_mac};
+    m.hs.slots[2] = (host_slot_t){.bonded = true, .addr = s_tablet};
+    adv_start(&m);
+    CHECK_EQ(m.adv, ADV_DIRECTED);
+
+    // Advertising restarts aimed at the new slot's host
+    apply(&m, host_slots_select(&m.hs, 2));
+    CHECK_EQ(m.adv_starts, 2);
+    CHECK_EQ(m.adv, ADV_DIRECTED);
+    CHECK_MEM(&m.adv_peer, &s_tablet, sizeof(s_tablet));
+
+    // Idle after both advertising phases ran out: selecting starts again
+    adv_timeout(&m);
+    CHECK_EQ(m.adv, ADV_UNDIRECTED);
+    adv_timeout(&m);
+    CHECK_EQ(m.adv, ADV_OFF);
+    CHECK_EQ(m.hs.state, HOST_STATE_IDLE);
+    apply(&m, host_slots_select(&m.hs, 2));
+    CHECK_EQ(m.adv, ADV_DIRECTED);
+    CHECK_EQ(m.hs.switches, 2);
+}
+
+static void test_wrong_host_is_turned_away(void)
+{
+    mock_stack_t m;
+    setup(&m);
+    m.hs.slots[0] = (host_slot_t){.bonded = true, .addr = s_mac};
+    m.hs.slots[1] = (host_slot_t){.bonded = true, .addr = s_phone};
+    adv_start(&m);
+
+    // Directed advertising went unanswered, the phone (slot 1) answers the
+    // undirected phase while slot 0 is active
+    adv_timeout(&m);
+    CHECK_EQ(m.adv, ADV_UNDIRECTED);
+    CHECK(!connect(&m, &s_phone, true));
+    CHECK_EQ(m.hs.rejected, 1);
+    CHECK_EQ(m.hs.state, HOST_STATE_SWITCHING);
+
+    // A stranger cannot take a slot that is already bonded
+    disconnected(&m);
+    adv_timeout(&m);
+    CHECK(!connect(&m, &s_tablet, true));
+    CHECK_EQ(m.hs.rejected, 2);
+    CHECK_EQ(host_slots_find(&m.hs, &s_tablet), -1);
+    CHECK_EQ(m.saves, 0);
+}
+
+static void test_forget(void)
+{
+    mock_stack_t m;
+    setup(&m);
+    adv_start(&m);
+    CHECK(connect(&m, &s_mac, true));
+
+    // Forgetting the connected host drops it and reopens the slot
+    host_addr_t gone;
+    host_action_t action;
+    CHECK(host_slots_forget(&m.hs, 0, &gone, &action));
+    CHECK_EQ(action, HOST_ACTION_DISCONNECT);
+    CHECK_MEM(&gone, &s_mac, sizeof(s_mac));
+    apply(&m, action);
+    disconnected(&m);
+    CHECK_EQ(m.adv, ADV_UNDIRECTED);
+    CHECK(connect(&m, &s_phone, true));
+    CHECK_EQ(host_slots_find(&m.hs, &s_phone), 0);
+
+    // Another slot: no disconnect; an empty one: nothing to forget
+    m.hs.slots[1] = (host_slot_t){.bonded = true, .addr = s_tablet};
+    CHECK(host_slots_forget(&m.hs, 1, &gone, &action));
+    CHECK_EQ(action, HOST_ACTION_NONE);
+    CHECK(!host_slots_forget(&m.hs, 1, &gone, &action));
+    CHECK(!host_slots_forget(&m.hs, HOST_SLOTS_MAX, &gone, &action));
+    CHECK_EQ(action, HOST_ACTION_NONE);
+    CHECK_EQ(m.hs.state, HOST_STATE_CONNECTED);
+}
+
+static void test_adopt_existing_bonds(void)
+{
+    host_slots_t hs;
+    host_slots_init(&hs);
+    hs.slots[1] = (host_slot_t){.bonded = true, .addr = s_phone};
+    CHECK(host_slots_adopt(&hs, &s_mac));
+    CHECK(!host_slots_adopt(&hs, &s_mac));
+    CHECK(!host_slots_adopt(&hs, &s_phone));
+    CHECK(host_slots_adopt(&hs, &s_tablet));
+    CHECK_EQ(host_slots_find(&hs, &s_mac), 0);
+    CHECK_EQ(host_slots_find(&hs, &s_tablet), 2);
+
+    // Full
+    host_addr_t other = s_tablet;
+    other.val[0] = 0;
+    CHECK(!host_slots_adopt(&hs, &other));
+
+    // The address type is part of the identity
+    other = s_mac;
+    other.type = 1;
+    CHECK_EQ(host_slots_find(&hs, &other), -1);
+}
+
+int main(void)
+{
+    TEST_RUN(test_pairing_fills_the_active_slot);
+    TEST_RUN(test_switch_while_connected);
+    TEST_RUN(test_switch_while_advertising);
+    TEST_RUN(test_wrong_host_is_turned_away);
+    TEST_RUN(test_forget);
+    TEST_RUN(test_adopt_existing_bonds);
+    return TEST_EXIT();
+}
@@ -0,0 +1,161 @@
+// Edge-to-queue timing of input.c on a simulated clock: DOWN on key-down,
+// HOLD while still held, UP on release
+#include "test.h"
+#include "input.h"
+
+#define LONG_PRESS_US (500 * 1000)
+#define MAX_EVENTS 32
+
+typedef struct
+{
+    scan_mask_t pins;
+    int64_t now_us;
+    button_event_t events[MAX_EVENTS];
+    int count;
+    bool full; // the queue refuses events
+} sim_t;
+
+static scan_mask_t sim_read(void *ctx)
+{
+    return ((sim_t *)ctx)->pins;
+}
+
+static int64_t sim_clock(void *ctx)
+{
+    return ((sim_t *)ctx)->now_us;
+}
+
+static bool sim_push(void *ctx, const button_event_t *evt)
+{
+    sim_t *s = ctx;
+    if (s->full || s->count == MAX_EVENTS)
+        return false;
+    s->events[s->count++] = *evt;
+    return true;
+}
+
+static void setup(input_t *in, sim_t *s, debounce_algo_t algo)
+{
+    memset(s, 0, sizeof(*s));
+    const input_config_t cfg = {
+        .num_keys = 4,
+        .debounce_algo = algo,
+        .debounce_ticks = 5,
+        .long_press_us = LONG_PRESS_US,
+        .key_chars = "urdl",
+        .gpio = {.read = sim_read, .ctx = s},
+        .clock = {.now_us = sim_clock, .ctx = s},
+        .queue = {.push = sim_push, .ctx = s}};
+    input_init(in, &cfg);
+}
+
+// Runs scan ticks until `until_us`, the raw edge happens at `edge_us`
+static void run(input_t *in, sim_t *s, int64_t edge_us, scan_mask_t pins, int64_t until_us)
+{
+    while (s->now_us < until_us)
+    {
+        s->now_us += SCAN_PERIOD_US;
+        if (s->now_us >= edge_us)
+            s->pins = pins;
+        input_tick(in);
+    }
+}
+
+// Time from the raw edge to its event, in scan ticks
+static int64_t latency_ticks(const button_event_t *evt, int64_t edge_us)
+{
+    return (evt->time_us - edge_us) / SCAN_PERIOD_US;
+}
+
+static void test_down_is_queued_on_press(void)
+{
+    input_t in;
+    sim_t s;
+    setup(&in, &s, DEBOUNCE_EAGER);
+    int64_t edge = 10 * SCAN_PERIOD_US + 400; // between two ticks
+    run(&in, &s, edge, 0x2, 100 * 1000);
+    CHECK_EQ(s.count, 1);
+    CHECK_EQ(s.events[0].kind, BUTTON_EVT_DOWN);
+    CHECK_EQ(s.events[0].key, 1);
+    CHECK_EQ(s.events[0].id_char, 'r');
+    // Eager debouncing costs nothing beyond waiting for the next tick
+    CHECK(s.events[0].time_us >= edge);
+    CHECK(s.events[0].time_us - edge < SCAN_PERIOD_US);
+
+    int64_t release = 200 * 1000;
+    run(&in, &s, release, 0, 300 * 1000);
+    CHECK_EQ(s.count, 2);
+    CHECK_EQ(s.events[1].kind, BUTTON_EVT_UP);
+    CHECK_EQ(s.events[1].long_press, false);
+    CHECK_EQ(latency_ticks(&s.events[1], release), 0);
+}
+
+static void test_deferred_adds_the_window(void)
+{
+    input_t in;
+    sim_t s;
+    setup(&in, &s, DEBOUNCE_DEFERRED);
+    int64_t edge = 20 * SCAN_PERIOD_US;
+    run(&in, &s, edge, 0x1, 100 * 1000);
+    CHECK_EQ(s.count, 1);
+    CHECK_EQ(latency_ticks(&s.events[0], edge), 4);
+}
+
+static void test_hold_fires_while_held(void)
+{
+    input_t in;
+    sim_t s;
+    setup(&in, &s, DEBOUNCE_EAGER);
+    int64_t edge = 5 * SCAN_PERIOD_US;
+    run(&in, &s, edge, 0x4, edge + LONG_PRESS_US - SCAN_PERIOD_US);
+    CHECK_EQ(s.count, 1);
+    run(&in, &s, edge, 0x4, edge + 2 * LONG_PRESS_US);
+    CHECK_EQ(s.count, 2);
+    CHECK_EQ(s.events[1].kind, BUTTON_EVT_HOLD);
+    CHECK_EQ(s.events[1].time_us - s.events[0].time_us, LONG_PRESS_US);
+
+    // Only one HOLD however long the key stays down; UP says it was long
+    int64_t release = edge + 2 * LONG_PRESS_US + 500;
+    run(&in, &s, release, 0, release + 10 * 1000);
+    CHECK_EQ(s.count, 3);
+    CHECK_EQ(s.events[2].kind, BUTTON_EVT_UP);
+    CHECK_EQ(s.events[2].long_press, true);
+    CHECK(input_idle(&in));
+}
+
+static void test_simultaneous_keys(void)
+{
+    input_t in;
+    sim_t s;
+    setup(&in, &s, DEBOUNCE_EAGER);
+    run(&in, &s, 3 * SCAN_PERIOD_US, 0xF, 10 * 1000);
+    CHECK_EQ(s.count, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK_EQ(s.events[i].key, i);
+        CHECK_EQ(s.events[i].time_us, 3 * SCAN_PERIOD_US);
+    }
+}
+
+static void test_full_queue_does_not_stall(void)
+{
+    input_t in;
+    sim_t s;
+    setup(&in, &s, DEBOUNCE_EAGER);
+    s.full = true;
+    run(&in, &s, 0, 0x1, 10 * 1000);
+    s.full = false;
+    run(&in, &s, 20 * 1000, 0, 30 * 1000);
+    CHECK_EQ(s.count, 1);
+    CHECK_EQ(s.events[0].kind, BUTTON_EVT_UP);
+}
+
+int main(void)
+{
+    TEST_RUN(test_down_is_queued_on_press);
+    TEST_RUN(test_deferred_adds_the_window);
+    TEST_RUN(test_hold_fires_while_held);
+    TEST_RUN(test_simultaneous_keys);
+    TEST_RUN(test_full_queue_does_not_stall);
+    return TEST_EXIT();
+}
@@ -0,0 +1,98 @@
+// ASCII to keycode tables: every printable character against the US and UK
+// keyboard legends
+#include "test.h"
+#include "keycodes.h"
+
+#define SHIFT USB_HID_MODIFIER_LEFT_SHIFT
+
+// Each key's unshifted and shifted legend in usage order, US layout
+static const struct
+{
+    char lower;
+    char upper;
+    uint8_t usage;
+} s_us_keys[] = {
+    {'1', '!', 0x1E}, {'2', '@', 0x1F}, {'3', '#', 0x20}, {'4', '$', 0x21}, {'5', '%', 0x22},
+    {'6', '^', 0x23}, {'7', '&', 0x24}, {'8', '*', 0x25}, {'9', '(', 0x26}, {'0', ')', 0x27},
+    {'-', '_', 0x2D}, {'=', '+', 0x2E}, {'[', '{', 0x2F}, {']', '}', 0x30}, {'\\', '|', 0x31},
+    {';', ':', 0x33}, {'\'', '"', 0x34}, {'`', '~', 0x35}, {',', '<', 0x36}, {'.', '>', 0x37},
+    {'/', '?', 0x38},
+};
+
+static keycode_t us_reference(char c)
+{
+    if (c >= 'a' && c <= 'z')
+        return KEYCODE(0, USB_HID_KEY_A + (c - 'a'));
+    if (c >= 'A' && c <= 'Z')
+        return KEYCODE(SHIFT, USB_HID_KEY_A + (c - 'A'));
+    if (c == ' ')
+        return KEYCODE(0, USB_HID_SPACE);
+    for (size_t i = 0; i < sizeof(s_us_keys) / sizeof(s_us_keys[0]); i++)
+    {
+        if (s_us_keys[i].lower == c)
+            return KEYCODE(0, s_us_keys[i].usage);
+        if (s_us_keys[i].upper == c)
+            return KEYCODE(SHIFT, s_us_keys[i].usage);
+    }
+    return 0;
+}
+
+static void test_us_printable(void)
+{
+    keycodes_set_layout(&keyboard_layout_us);
+    int mismatches = 0;
+    for (int c = 0x20; c < 0x7F; c++)
+    {
+        keycode_t want = us_reference((char)c);
+        CHECK(want != 0);
+        if (ascii_to_keycode((char)c) != want)
+        {
+            printf("  '%c': got %04x, want %04x\n", c, ascii_to_keycode((char)c), want);
+            mismatches++;
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+static void test_control_characters(void)
+{
+    keycodes_set_layout(&keyboard_layout_us);
+    CHECK_EQ(ascii_to_keycode('\n'), KEYCODE(0, USB_HID_NEWLINE));
+    CHECK_EQ(ascii_to_keycode('\t'), KEYCODE(0, USB_HID_TAB));
+    CHECK_EQ(ascii_to_keycode('\b'), KEYCODE(0, USB_HID_BACKSPACE));
+    CHECK_EQ(ascii_to_keycode(0x1B), KEYCODE(0, USB_HID_ESCAPE));
+    CHECK_EQ(ascii_to_keycode(0), 0);
+    CHECK_EQ(ascii_to_keycode(0x01), 0);
+    for (int c = 0x80; c < 0x100; c++)
+        CHECK_EQ(ascii_to_keycode((char)c), 0);
+}
+
+static void test_uk_differences(void)
+{
+    keycodes_set_layout(&keyboard_layout_uk);
+    CHECK_EQ(ascii_to_keycode('"'), KEYCODE(SHIFT, 0x1F));
+    CHECK_EQ(ascii_to_keycode('@'), KEYCODE(SHIFT, USB_HID_QUOTE));
+    CHECK_EQ(ascii_to_keycode('#'), KEYCODE(0, USB_HID_NON_US_HASH));
+    CHECK_EQ(ascii_to_keycode('~'), KEYCODE(SHIFT, USB_HID_NON_US_HASH));
+    CHECK_EQ(ascii_to_keycode('\\'), KEYCODE(0, USB_HID_NON_US_BSLASH));
+    CHECK_EQ(ascii_to_keycode('|'), KEYCODE(SHIFT, USB_HID_NON_US_BSLASH));
+
+    // Everything else matches US
+    static const char changed[] = "\"@#~\\|";
+    for (int c = 0x20; c < 0x7F; c++)
+    {
+        if (!strchr(changed, c))
+            CHECK_EQ(ascii_to_keycode((char)c), us_reference((char)c));
+    }
+
+    keycodes_set_layout(NULL);
+    CHECK(keyboard_layout == &keyboard_layout_us);
+}
+
+int main(void)
+{
+    TEST_RUN(test_us_printable);
+    TEST_RUN(test_control_characters);
+    TEST_RUN(test_uk_differences);
+    return TEST_EXIT();
+}
@@ -0,0 +1,151 @@
+// Keystore images opened in place, through the mmap backend
+//
+//   test_keystore [image.bin]   also mounts an image from tools/keystore.py
+#include <stdlib.h>
+#include <unistd.h>
+#include "test.h"
+#include "keystore.h"
+#include "keystore_file.h"
+
+#define KEYS 3
+
+static const keystore_action_t s_keymap[2 * KEYS] = {
+    {.type = KEYSTORE_ACTION_KEY, .arg0 = 0x02, .arg1 = 0x04},
+    {.type = KEYSTORE_ACTION_MACRO, .arg1 = 1},
+    {.type = KEYSTORE_ACTION_LAYER_MOMENTARY, .arg1 = 1},
+    {.type = KEYSTORE_ACTION_CONSUMER, .arg1 = 0xE9},
+    {.type = KEYSTORE_ACTION_TRANSPARENT},
+    {.type = KEYSTORE_ACTION_TRANSPARENT},
+};
+
+static const uint8_t s_macro0[] = {0x03, 0x04, 0x00};
+static const uint8_t s_macro1[] = {0x0A, 2, 'h', 'i', 0, 0x00};
+
+static uint8_t s_image[512];
+static char s_path[64];
+
+static size_t build(void)
+{
+    const uint8_t *const macros[] = {s_macro0, s_macro1};
+    const uint16_t lens[] = {sizeof(s_macro0), sizeof(s_macro1)};
+    return test_keystore_image(s_image, sizeof(s_image), 2, KEYS, s_keymap, 2, macros, lens);
+}
+
+static void write_file(const void *data, size_t size)
+{
+    FILE *f = fopen(s_path, "wb");
+    CHECK(f != NULL);
+    if (f)
+    {
+        CHECK_EQ(fwrite(data, 1, size, f), size);
+        fclose(f);
+    }
+}
+
+static void test_mount_reads_in_place(void)
+{
+    size_t size = build();
+    write_file(s_image, size);
+
+    keystore_t ks;
+    CHECK_EQ(keystore_mount_file(&ks, s_path), ESP_OK);
+    CHECK(ks.base != NULL && ks.base != s_image);
+    CHECK_EQ(ks.header->num_layers, 2);
+    CHECK_EQ(ks.header->num_keys, KEYS);
+
+    // Lookups are pointers into the mapping, nothing is copied
+    const keystore_action_t *a = keystore_action(&ks, 1, 0);
+    CHECK((const uint8_t *)a >= ks.base && (const uint8_t *)a < ks.base + size);
+    CHECK_EQ(a->type, KEYSTORE_ACTION_CONSUMER);
+    CHECK_EQ(a->arg1, 0xE9);
+    CHECK_EQ(keystore_action(&ks, 0, 0)->arg0, 0x02);
+
+    uint16_t len;
+    const uint8_t *code = keystore_macro(&ks, 1, &len);
+    CHECK_EQ(len, sizeof(s_macro1));
+    CHECK(code != NULL && code >= ks.base && code < ks.base + size);
+    if (code)
+        CHECK_MEM(code, s_macro1, sizeof(s_macro1));
+
+    // Out of range is harmless
+    CHECK_EQ(keystore_action(&ks, 2, 0)->type, KEYSTORE_ACTION_NONE);
+    CHECK_EQ(keystore_action(&ks, 0, KEYS)->type, KEYSTORE_ACTION_NONE);
+    CHECK(keystore_macro(&ks, 2, &len) == NULL);
+    CHECK_EQ(len, 0);
+}
+
+static void test_bad_images_are_rejected(void)
+{
+    keystore_t ks;
+    size_t size = build();
+    CHECK_EQ(keystore_mount_file(&ks, "/nonexistent/keymap.bin"), ESP_ERR_NOT_FOUND);
+
+    // One flipped bit in a macro
+    s_image[size - 2] ^= 0x10;
+    write_file(s_image, size);
+    CHECK_EQ(keystore_mount_file(&ks, s_path), ESP_ERR_INVALID_CRC);
+    CHECK(ks.base == NULL);
+
+    build();
+    write_file(s_image, size - 1);
+    CHECK_EQ(keystore_mount_file(&ks, s_path), ESP_ERR_INVALID_SIZE);
+
+    keystore_header_t *hdr = (keystore_header_t *)s_image;
+    hdr->version++;
+    write_file(s_image, size);
+    CHECK_EQ(keystore_mount_file(&ks, s_path), ESP_ERR_INVALID_VERSION);
+
+    build();
+    hdr->macros_offset = size;
+    write_file(s_image, size);
+    CHECK_EQ(keystore_mount_file(&ks, s_path), ESP_ERR_INVALID_SIZE);
+
+    // Erased flash
+    memset(s_image, 0xFF, sizeof(s_image));
+    write_file(s_image, sizeof(s_image));
+    CHECK_EQ(keystore_mount_file(&ks, s_path), ESP_ERR_NOT_FOUND);
+    write_file(s_image, 0);
+    CHECK_EQ(keystore_mount_file(&ks, s_path), ESP_ERR_INVALID_SIZE);
+}
+
+static void test_mount_from_environment(void)
+{
+    size_t size = build();
+    write_file(s_image, size);
+    setenv(KEYSTORE_FILE_ENV, s_path, 1);
+    keystore_t ks;
+    CHECK_EQ(keystore_mount(&ks), ESP_OK);
+    CHECK_EQ(ks.header->num_macros, 2);
+}
+
+// An image built by tools/keystore.py
+static void check_tool_image(const char *path)
+{
+    keystore_t ks;
+    CHECK_EQ(keystore_mount_file(&ks, path), ESP_OK);
+    if (ks.base == NULL)
+        return;
+    CHECK(ks.header->num_layers > 0 && ks.header->num_keys > 0);
+    for (uint16_t m = 0; m < ks.header->num_macros; m++)
+    {
+        uint16_t len;
+        const uint8_t *code = keystore_macro(&ks, m, &len);
+        CHECK(code != NULL && len > 0);
+        if (code && len)
+            CHECK_EQ(code[len - 1], 0x00); // MACRO_OP_END
+    }
+    printf("%s: %u layers x %u keys, %u macros\n", path, ks.header->num_layers, ks.header->num_keys,
+           ks.header->num_macros);
+}
+
+int main(int argc, char **argv)
+{
+    snprintf(s_path, sizeof(s_path), "/tmp/test_keystore_%d.bin", (int)getpid());
+    TEST_RUN(test_mount_reads_in_place);
+    TEST_RUN(test_bad_images_are_rejected);
+    TEST_RUN(test_mount_from_environment);
+    if (argc > 1)
+        check_tool_image(argv[1]);
+    unlink(s_path);
+    return TEST_EXIT();
+}
@@ -0,0 +1,352 @@
+// Layer resolution: momentary and toggled layers, transparency, the layer a
+// key was pressed on being reused for its release, and tap-hold decisions on
+// a simulated clock
+#include "test.h"
+#include "layer.h"
+
+#define KEYS 4
+#define A 0x04
+#define B 0x05
+#define C 0x06
+
+enum
+{
+    K_MO = 0, // layer 1 while held
+    K_TG = 1, // toggles layer 2
+    K_X = 2,  // a on layer 0, c on layer 1
+    K_Y = 3,  // b on layer 0, transparent above
+};
+
+#define KEY_ACTION(u) {.type = KEYSTORE_ACTION_KEY, .arg1 = (u)}
+#define TRANS {.type = KEYSTORE_ACTION_TRANSPARENT}
+
+static const keystore_action_t s_keymap[3 * KEYS] = {
+    {.type = KEYSTORE_ACTION_LAYER_MOMENTARY, .arg1 = 1},
+    {.type = KEYSTORE_ACTION_LAYER_TOGGLE, .arg1 = 2},
+    KEY_ACTION(A),
+    KEY_ACTION(B),
+    // layer 1
+    TRANS,
+    TRANS,
+    KEY_ACTION(C),
+    TRANS,
+    // layer 2
+    TRANS,
+    TRANS,
+    TRANS,
+    KEY_ACTION(C),
+};
+
+typedef struct
+{
+    uint16_t usage[32];
+    uint8_t mods[32];
+    bool pressed[32];
+    int64_t at[32]; // s_now when emitted
+    int count;
+} emitted_t;
+
+static int64_t s_now;
+
+static void record(const keystore_action_t *action, bool pressed, void *ctx)
+{
+    emitted_t *e = ctx;
+    if (action->type != KEYSTORE_ACTION_KEY || e->count == 32)
+        return;
+    e->usage[e->count] = action->arg1;
+    e->mods[e->count] = action->arg0;
+    e->at[e->count] = s_now;
+    e->pressed[e->count] = pressed;
+    e->count++;
+}
+
+static uint8_t s_image[512];
+static keystore_t s_ks;
+
+static void setup(layer_engine_t *le, emitted_t *e)
+{
+    size_t size = test_keystore_image(s_image, sizeof(s_image), 3, KEYS, s_keymap, 0, NULL, NULL);
+    CHECK(keystore_open(&s_ks, s_image, size) == ESP_OK);
+    memset(e, 0, sizeof(*e));
+    layer_init(le, &s_ks, record, e);
+}
+
+static void tap(layer_engine_t *le, uint8_t key)
+{
+    layer_key(le, key, true, 0);
+    layer_key(le, key, false, 0);
+}
+
+static void test_base_layer(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    setup(&le, &e);
+    tap(&le, K_X);
+    tap(&le, K_Y);
+    CHECK_EQ(e.count, 4);
+    CHECK_EQ(e.usage[0], A);
+    CHECK_EQ(e.pressed[0], true);
+    CHECK_EQ(e.usage[1], A);
+    CHECK_EQ(e.pressed[1], false);
+    CHECK_EQ(e.usage[2], B);
+}
+
+static void test_momentary_falls_through_transparent(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    setup(&le, &e);
+    layer_key(&le, K_MO, true, 0);
+    tap(&le, K_X);
+    tap(&le, K_Y);
+    layer_key(&le, K_MO, false, 0);
+    tap(&le, K_X);
+    CHECK_EQ(e.count, 6);
+    CHECK_EQ(e.usage[0], C);
+    CHECK_EQ(e.usage[2], B);
+    CHECK_EQ(e.usage[4], A);
+    CHECK_EQ(le.active, 1);
+}
+
+static void test_release_uses_press_layer(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    setup(&le, &e);
+    layer_key(&le, K_MO, true, 0);
+    layer_key(&le, K_X, true, 0);
+    layer_key(&le, K_MO, false, 0);
+    layer_key(&le, K_X, false, 0);
+    CHECK_EQ(e.count, 2);
+    CHECK_EQ(e.usage[1], C);
+    CHECK_EQ(e.pressed[1], false);
+}
+
+static void test_toggle_and_priority(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    setup(&le, &e);
+    tap(&le, K_TG);
+    CHECK_EQ(le.active, 0x5);
+    tap(&le, K_Y);
+    tap(&le, K_X);
+
+    // Layer 1 on top of the toggled layer 2 still reaches layer 2 for K_Y
+    layer_key(&le, K_MO, true, 0);
+    tap(&le, K_Y);
+    tap(&le, K_X);
+    layer_key(&le, K_MO, false, 0);
+
+    tap(&le, K_TG);
+    CHECK_EQ(le.active, 1);
+    tap(&le, K_Y);
+    CHECK_EQ(e.count, 10);
+    CHECK_EQ(e.usage[0], C);
+    CHECK_EQ(e.usage[2], A);
+    CHECK_EQ(e.usage[4], C);
+    CHECK_EQ(e.usage[6], C);
+    CHECK_EQ(e.usage[8], B);
+}
+
+static void test_no_image(void)
+{
+    keystore_t ks = {0};
+    layer_engine_t le;
+    emitted_t e = {0};
+    layer_init(&le, &ks, record, &e);
+    tap(&le, 0);
+    CHECK_EQ(e.count, 0);
+    CHECK_EQ(layer_next_deadline(&le), LAYER_NO_DEADLINE);
+}
+
+// === Tap-hold ===
+#define TH_KEYS 3
+#define LCTRL 0x01
+#define LSHIFT 0x02
+#define ESC 0x29
+#define Z 0x1D
+#define TERM LAYER_TAPPING_TERM_US
+
+enum
+{
+    K_TH_CTRL = 0, // escape tapped, left control held
+    K_A = 1,
+    K_TH_SHIFT = 2, // z tapped, left shift held
+};
+
+static const keystore_action_t s_th_keymap[TH_KEYS] = {
+    {.type = KEYSTORE_ACTION_TAP_HOLD, .arg0 = LCTRL, .arg1 = ESC},
+    KEY_ACTION(A),
+    {.type = KEYSTORE_ACTION_TAP_HOLD, .arg0 = LSHIFT, .arg1 = Z},
+};
+
+static void th_setup(layer_engine_t *le, emitted_t *e)
+{
+    size_t size = test_keystore_image(s_image, sizeof(s_image), 1, TH_KEYS, s_th_keymap, 0, NULL, NULL);
+    CHECK(keystore_open(&s_ks, s_image, size) == ESP_OK);
+    memset(e, 0, sizeof(*e));
+    layer_init(le, &s_ks, record, e);
+    s_now = 1000;
+}
+
+// Advances the clock to `t` the way the button task does: it sleeps until
+// the next deadline and calls layer_tick() when it wakes
+static void run_until(layer_engine_t *le, int64_t t)
+{
+    while (layer_next_deadline(le) <= t)
+    {
+        s_now = layer_next_deadline(le);
+        layer_tick(le, s_now);
+    }
+    s_now = t;
+}
+
+static void key_at(layer_engine_t *le, uint8_t key, bool pressed, int64_t t)
+{
+    run_until(le, t);
+    layer_key(le, key, pressed, s_now);
+}
+
+static void test_tap_hold_tap(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    th_setup(&le, &e);
+    int64_t t0 = s_now;
+    key_at(&le, K_TH_CTRL, true, t0);
+    CHECK_EQ(layer_next_deadline(&le), t0 + TERM);
+    CHECK_EQ(e.count, 0); // undecided, nothing sent yet
+
+    key_at(&le, K_TH_CTRL, false, t0 + TERM / 2);
+    CHECK_EQ(layer_next_deadline(&le), LAYER_NO_DEADLINE);
+    CHECK_EQ(e.count, 2);
+    CHECK_EQ(e.usage[0], ESC);
+    CHECK_EQ(e.mods[0], 0);
+    CHECK(e.pressed[0] && !e.pressed[1]);
+    CHECK_EQ(e.usage[1], ESC);
+    CHECK_EQ(e.at[0], t0 + TERM / 2); // the tap is sent at release
+
+    // Nothing is left for the clock to do
+    run_until(&le, t0 + 10 * TERM);
+    CHECK_EQ(e.count, 2);
+}
+
+static void test_tap_hold_hold_at_deadline(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    th_setup(&le, &e);
+    int64_t t0 = s_now;
+    key_at(&le, K_TH_CTRL, true, t0);
+
+    run_until(&le, t0 + TERM - 1);
+    CHECK_EQ(e.count, 0);
+    run_until(&le, t0 + TERM);
+    CHECK_EQ(e.count, 1);
+    CHECK_EQ(e.mods[0], LCTRL);
+    CHECK_EQ(e.usage[0], 0);
+    CHECK(e.pressed[0]);
+    CHECK_EQ(e.at[0], t0 + TERM); // layer_tick at the deadline, not later
+    CHECK_EQ(layer_next_deadline(&le), LAYER_NO_DEADLINE);
+
+    // Held keys go out with the modifier already down
+    key_at(&le, K_A, true, t0 + TERM + 50000);
+    key_at(&le, K_A, false, t0 + TERM + 60000);
+    key_at(&le, K_TH_CTRL, false, t0 + TERM + 70000);
+    CHECK_EQ(e.count, 4);
+    CHECK_EQ(e.usage[1], A);
+    CHECK_EQ(e.mods[3], LCTRL);
+    CHECK(!e.pressed[3]);
+    CHECK_EQ(e.at[3], t0 + TERM + 70000);
+}
+
+static void test_tap_hold_release_on_deadline(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    th_setup(&le, &e);
+    int64_t t0 = s_now;
+
+    // One microsecond short of the term is still a tap
+    key_at(&le, K_TH_CTRL, true, t0);
+    layer_key(&le, K_TH_CTRL, false, t0 + TERM - 1);
+    CHECK_EQ(e.count, 2);
+    CHECK_EQ(e.usage[0], ESC);
+
+    // Released exactly on the deadline, even if layer_tick never ran: a hold
+    memset(&e, 0, sizeof(e));
+    layer_key(&le, K_TH_CTRL, true, t0 + TERM);
+    layer_key(&le, K_TH_CTRL, false, t0 + 2 * TERM);
+    CHECK_EQ(e.count, 2);
+    CHECK_EQ(e.mods[0], LCTRL);
+    CHECK_EQ(e.usage[0], 0);
+    CHECK(e.pressed[0] && !e.pressed[1]);
+    CHECK_EQ(e.mods[1], LCTRL);
+}
+
+static void test_tap_hold_interrupted(void)
+{
+    layer_engine_t le;
+    emitted_t e;
+    th_setup(&le, &e);
+    int64_t t0 = s_now;
+
+    // Another key down within the term decides hold, before that key is sent
+    key_at(&le, K_TH_CTRL, true, t0);
+    key_at(&le, K_A, true, t0 + 30000);
+    CHECK_EQ(layer_next_deadline(&le), LAYER_NO_DEADLINE);
+    CHECK_EQ(e.count, 2);
+    CHECK_EQ(e.mods[0], LCTRL);
+    CHECK(e.pressed[0]);
+    CHECK_EQ(e.usage[1], A);
+    CHECK_EQ(e.at[0], t0 + 30000);
+    key_at(&le, K_A, false, t0 + 40000);
+    key_at(&le, K_TH_CTRL, false, t0 + 50000); // within the term, still a hold
+    CHECK_EQ(e.count, 4);
+    CHECK_EQ(e.mods[3], LCTRL);
+    CHECK(!e.pressed[3]);
+
+    // A second tap-hold key interrupts the first and becomes the pending one
+    memset(&e, 0, sizeof(e));
+    int64_t t1 = t0 + 1000000;
+    key_at(&le, K_TH_CTRL, true, t1);
+    key_at(&le, K_TH_SHIFT, true, t1 + 10000);
+    CHECK_EQ(e.count, 1);
+    CHECK_EQ(e.mods[0], LCTRL);
+    CHECK_EQ(layer_next_deadline(&le), t1 + 10000 + TERM);
+    key_at(&le, K_TH_SHIFT, false, t1 + 20000);
+    key_at(&le, K_TH_CTRL, false, t1 + 30000);
+    CHECK_EQ(e.count, 4);
+    CHECK_EQ(e.usage[1], Z); // shift released in its term: a tap
+    CHECK_EQ(e.mods[1], 0);
+    CHECK_EQ(e.usage[2], Z);
+    CHECK_EQ(e.mods[3], LCTRL);
+    CHECK(!e.pressed[3]);
+
+    // Releasing a plain key does not decide a pending tap-hold
+    memset(&e, 0, sizeof(e));
+    int64_t t2 = t1 + 1000000;
+    key_at(&le, K_A, true, t2);
+    key_at(&le, K_TH_CTRL, true, t2 + 10000);
+    key_at(&le, K_A, false, t2 + 20000);
+    CHECK_EQ(layer_next_deadline(&le), t2 + 10000 + TERM);
+    key_at(&le, K_TH_CTRL, false, t2 + 30000);
+    CHECK_EQ(e.count, 4);
+    CHECK_EQ(e.usage[2], ESC);
+}
+
+int main(void)
+{
+    TEST_RUN(test_base_layer);
+    TEST_RUN(test_momentary_falls_through_transparent);
+    TEST_RUN(test_release_uses_press_layer);
+    TEST_RUN(test_toggle_and_priority);
+    TEST_RUN(test_no_image);
+    TEST_RUN(test_tap_hold_tap);
+    TEST_RUN(test_tap_hold_hold_at_deadline);
+    TEST_RUN(test_tap_hold_release_on_deadline);
+    TEST_RUN(test_tap_hold_interrupted);
+    return TEST_EXIT();
+}
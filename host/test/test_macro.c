@@ -0,0 +1,275 @@
+// Macro VM: the step sequence each opcode produces
+#include "test.h"
+#include "macro.h"
+#include "keycodes.h"
+
+#define A 0x04
+#define B 0x05
+#define SHIFT USB_HID_MODIFIER_LEFT_SHIFT
+#define MAX_STEPS 64
+
+typedef struct
+{
+    macro_step_t steps[MAX_STEPS];
+    int count; // including the final DONE or ERROR
+} trace_t;
+
+static void run(trace_t *t, const uint8_t *code, uint32_t len)
+{
+    macro_vm_t vm;
+    macro_init(&vm, code, len);
+    memset(t, 0, sizeof(*t));
+    do
+        macro_step(&vm, &t->steps[t->count++]);
+    while (t->count < MAX_STEPS && t->steps[t->count - 1].kind != MACRO_STEP_DONE &&
+           t->steps[t->count - 1].kind != MACRO_STEP_ERROR);
+}
+
+// Plays a macro into a mock sink the way hid_tx.c does: reports go to the
+// host, consumer steps are counted, delays are skipped
+typedef struct
+{
+    test_sink_t sink;
+    int consumer_steps;
+    macro_step_kind_t last;
+} played_t;
+
+static void play(played_t *p, const uint8_t *code, uint32_t len)
+{
+    macro_vm_t vm;
+    macro_step_t step;
+    test_sink(&p->sink);
+    p->consumer_steps = 0;
+    macro_init(&vm, code, len);
+    for (int i = 0; i < MAX_STEPS; i++)
+    {
+        macro_step(&vm, &step);
+        p->last = step.kind;
+        if (step.kind == MACRO_STEP_REPORT)
+            test_sink_send(&p->sink, step.report_id, step.data, step.len);
+        else if (step.kind == MACRO_STEP_CONSUMER)
+            p->consumer_steps++;
+        else if (step.kind != MACRO_STEP_DELAY)
+            return;
+    }
+}
+
+static void check_report(const test_report_t *r, uint8_t mods, uint8_t k0, uint8_t k1)
+{
+    const uint8_t want[8] = {mods, 0, k0, k1};
+    CHECK_EQ(r->report_id, MACRO_KEYBOARD_REPORT_ID);
+    CHECK_EQ(r->len, 8);
+    CHECK_MEM(r->data, want, 8);
+}
+
+static void check_keyboard(const macro_step_t *s, uint8_t mods, uint8_t k0, uint8_t k1)
+{
+    const uint8_t want[8] = {mods, 0, k0, k1};
+    CHECK_EQ(s->kind, MACRO_STEP_REPORT);
+    CHECK_EQ(s->report_id, MACRO_KEYBOARD_REPORT_ID);
+    CHECK_EQ(s->len, 8);
+    CHECK_MEM(s->data, want, 8);
+}
+
+static void test_tap_and_hold(void)
+{
+    static const uint8_t code[] = {
+        MACRO_OP_MODS, SHIFT,
+        MACRO_OP_KEY_DOWN, A,
+        MACRO_OP_TAP, B,
+        MACRO_OP_KEY_UP, A,
+        MACRO_OP_MODS, 0,
+        MACRO_OP_END};
+    trace_t t;
+    run(&t, code, sizeof(code));
+    CHECK_EQ(t.count, 7);
+    check_keyboard(&t.steps[0], SHIFT, 0, 0);
+    check_keyboard(&t.steps[1], SHIFT, A, 0);
+    check_keyboard(&t.steps[2], SHIFT, A, B);
+    check_keyboard(&t.steps[3], SHIFT, A, 0);
+    check_keyboard(&t.steps[4], SHIFT, 0, 0);
+    check_keyboard(&t.steps[5], 0, 0, 0);
+    CHECK_EQ(t.steps[6].kind, MACRO_STEP_DONE);
+}
+
+static void test_delay_consumer_mouse(void)
+{
+    static const uint8_t code[] = {
+        MACRO_OP_DELAY, 0x2C, 0x01,
+        MACRO_OP_CONSUMER, 0xE9, 0x00,
+        MACRO_OP_MOUSE, 1, 5, (uint8_t)-3, 1};
+    trace_t t;
+    run(&t, code, sizeof(code));
+    CHECK_EQ(t.count, 5);
+    CHECK_EQ(t.steps[0].kind, MACRO_STEP_DELAY);
+    CHECK_EQ(t.steps[0].delay_ms, 300);
+    CHECK_EQ(t.steps[1].kind, MACRO_STEP_CONSUMER);
+    CHECK_EQ(t.steps[1].usage, 0xE9);
+    CHECK_EQ(t.steps[1].pressed, true);
+    CHECK_EQ(t.steps[2].kind, MACRO_STEP_CONSUMER);
+    CHECK_EQ(t.steps[2].pressed, false);
+
+    const uint8_t mouse[MACRO_MOUSE_REPORT_LEN] = {1, 5, (uint8_t)-3, 1, 0};
+    CHECK_EQ(t.steps[3].report_id, MACRO_MOUSE_REPORT_ID);
+    CHECK_EQ(t.steps[3].len, MACRO_MOUSE_REPORT_LEN);
+    CHECK_MEM(t.steps[3].data, mouse, MACRO_MOUSE_REPORT_LEN);
+    // Running off the end without MACRO_OP_END is a normal finish
+    CHECK_EQ(t.steps[4].kind, MACRO_STEP_DONE);
+}
+
+static void test_nested_repeat(void)
+{
+    static const uint8_t code[] = {
+        MACRO_OP_REPEAT, 3,
+        MACRO_OP_REPEAT, 2,
+        MACRO_OP_TAP, A,
+        MACRO_OP_LOOP,
+        MACRO_OP_TAP, B,
+        MACRO_OP_LOOP,
+        MACRO_OP_END};
+    trace_t t;
+    run(&t, code, sizeof(code));
+    CHECK_EQ(t.count, 3 * 3 * 2 + 1);
+    int a = 0, b = 0;
+    for (int i = 0; i < t.count - 1; i += 2)
+    {
+        a += t.steps[i].data[2] == A;
+        b += t.steps[i].data[2] == B;
+        check_keyboard(&t.steps[i + 1], 0, 0, 0);
+    }
+    CHECK_EQ(a, 6);
+    CHECK_EQ(b, 3);
+}
+
+static void test_string(void)
+{
+    static const uint8_t code[] = {MACRO_OP_STRING, 2, 'a', 'B', 0, MACRO_OP_TAP, A};
+    trace_t t;
+    run(&t, code, sizeof(code));
+    CHECK_EQ(t.count, 7);
+    check_keyboard(&t.steps[0], 0, A, 0);
+    check_keyboard(&t.steps[1], SHIFT, 0, 0);
+    check_keyboard(&t.steps[2], SHIFT, B, 0);
+    check_keyboard(&t.steps[3], 0, 0, 0);
+    check_keyboard(&t.steps[4], 0, A, 0);
+    check_keyboard(&t.steps[5], 0, 0, 0);
+}
+
+// Keys and mods held across a typed string are released for the string and
+// pressed again after it, so the rest of the macro sees them still down
+static void test_string_restores_held_state(void)
+{
+    static const uint8_t code[] = {
+        MACRO_OP_MODS, SHIFT,
+        MACRO_OP_KEY_DOWN, A,
+        MACRO_OP_STRING, 1, 'b', 0,
+        MACRO_OP_KEY_UP, A,
+        MACRO_OP_MODS, 0,
+        MACRO_OP_END};
+    played_t p;
+    play(&p, code, sizeof(code));
+    CHECK_EQ(p.last, MACRO_STEP_DONE);
+    CHECK_EQ(p.sink.count, 8);
+    check_report(&p.sink.reports[0], SHIFT, 0, 0);
+    check_report(&p.sink.reports[1], SHIFT, A, 0);
+    check_report(&p.sink.reports[2], 0, 0, 0);
+    check_report(&p.sink.reports[3], 0, B, 0);
+    check_report(&p.sink.reports[4], 0, 0, 0);
+    check_report(&p.sink.reports[5], SHIFT, A, 0);
+    check_report(&p.sink.reports[6], SHIFT, 0, 0);
+    check_report(&p.sink.reports[7], 0, 0, 0);
+}
+
+// Every press a macro sends is matched by a release before it ends
+static void test_sink_ends_all_up(void)
+{
+    static const uint8_t code[] = {
+        MACRO_OP_REPEAT, 2,
+        MACRO_OP_MODS, SHIFT,
+        MACRO_OP_TAP, A,
+        MACRO_OP_STRING, 2, 'x', 'Y', 0,
+        MACRO_OP_CONSUMER, 0xE9, 0x00,
+        MACRO_OP_DELAY, 10, 0,
+        MACRO_OP_MODS, 0,
+        MACRO_OP_LOOP,
+        MACRO_OP_END};
+    played_t p;
+    play(&p, code, sizeof(code));
+    CHECK_EQ(p.last, MACRO_STEP_DONE);
+    CHECK_EQ(p.consumer_steps, 4);
+    check_report(test_last(&p.sink), 0, 0, 0);
+}
+
+// A cancel between press and release still lets everything go
+static void test_cancel_releases(void)
+{
+    static const uint8_t code[] = {
+        MACRO_OP_MODS, SHIFT,
+        MACRO_OP_KEY_DOWN, A,
+        MACRO_OP_MOUSE, 1, 0, 0, 0,
+        MACRO_OP_CONSUMER, 0xE9, 0x00,
+        MACRO_OP_END};
+    static const uint8_t zero[8] = {0};
+    macro_vm_t vm;
+    macro_step_t step, steps[MACRO_CANCEL_STEPS];
+    macro_init(&vm, code, sizeof(code));
+    for (int i = 0; i < 4; i++)
+        macro_step(&vm, &step);
+    CHECK_EQ(step.kind, MACRO_STEP_CONSUMER);
+    CHECK_EQ(step.pressed, true);
+
+    CHECK_EQ(macro_cancel(&vm, steps), 3);
+    check_keyboard(&steps[0], 0, 0, 0);
+    CHECK_EQ(steps[1].kind, MACRO_STEP_REPORT);
+    CHECK_EQ(steps[1].report_id, MACRO_MOUSE_REPORT_ID);
+    CHECK_EQ(steps[1].len, MACRO_MOUSE_REPORT_LEN);
+    CHECK_MEM(steps[1].data, zero, MACRO_MOUSE_REPORT_LEN);
+    CHECK_EQ(steps[2].kind, MACRO_STEP_CONSUMER);
+    CHECK_EQ(steps[2].usage, 0xE9);
+    CHECK_EQ(steps[2].pressed, false);
+    macro_step(&vm, &step);
+    CHECK_EQ(step.kind, MACRO_STEP_DONE);
+
+    // Once the tap has completed there is no consumer usage to release
+    macro_init(&vm, code, sizeof(code));
+    for (int i = 0; i < 5; i++)
+        macro_step(&vm, &step);
+    CHECK_EQ(macro_cancel(&vm, steps), 2);
+}
+
+static void test_malformed_stops(void)
+{
+    static const uint8_t truncated[] = {MACRO_OP_TAP, A, MACRO_OP_DELAY, 1};
+    static const uint8_t unterminated[] = {MACRO_OP_STRING, 3, 'a', 'b', 'c', 'd'};
+    static const uint8_t stray_loop[] = {MACRO_OP_LOOP};
+    static const uint8_t bad_op[] = {0xFF};
+    static const uint8_t too_deep[] = {MACRO_OP_REPEAT, 2, MACRO_OP_REPEAT, 2, MACRO_OP_REPEAT, 2,
+                                       MACRO_OP_REPEAT, 2, MACRO_OP_REPEAT, 2};
+    trace_t t;
+    run(&t, truncated, sizeof(truncated));
+    CHECK_EQ(t.count, 3);
+    CHECK_EQ(t.steps[2].kind, MACRO_STEP_ERROR);
+    run(&t, unterminated, sizeof(unterminated));
+    CHECK_EQ(t.steps[t.count - 1].kind, MACRO_STEP_ERROR);
+    run(&t, stray_loop, sizeof(stray_loop));
+    CHECK_EQ(t.steps[t.count - 1].kind, MACRO_STEP_ERROR);
+    run(&t, bad_op, sizeof(bad_op));
+    CHECK_EQ(t.steps[t.count - 1].kind, MACRO_STEP_ERROR);
+    run(&t, too_deep, sizeof(too_deep));
+    CHECK_EQ(t.count, 1);
+    CHECK_EQ(t.steps[0].kind, MACRO_STEP_ERROR);
+}
+
+int main(void)
+{
+    keycodes_set_layout(&keyboard_layout_us);
+    TEST_RUN(test_tap_and_hold);
+    TEST_RUN(test_delay_consumer_mouse);
+    TEST_RUN(test_nested_repeat);
+    TEST_RUN(test_string);
+    TEST_RUN(test_string_restores_held_state);
+    TEST_RUN(test_sink_ends_all_up);
+    TEST_RUN(test_cancel_releases);
+    TEST_RUN(test_malformed_stops);
+    return TEST_EXIT();
+}
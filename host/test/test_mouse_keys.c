@@ -0,0 +1,207 @@
+// Mouse keys trajectories against the acceleration curve, tick rate
+// independence, sub-pixel carry and the report rate while a key is held
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "mouse_keys.h"
+
+#define INTERVAL_US 7500 // a typical connection interval
+
+typedef struct
+{
+    int64_t x;
+    int64_t y;
+    uint32_t reports;
+    uint32_t ticks;
+    int max_step; // largest |dx| or |dy| of one report
+} track_t;
+
+// Ticks every `period_us` from `from_us` up to `to_us`, summing the reports
+static void run(mouse_keys_t *mk, track_t *t, int64_t from_us, int64_t to_us, int64_t period_us)
+{
+    for (int64_t now = from_us + period_us; now <= to_us; now += period_us)
+    {
+        int8_t dx, dy;
+        t->ticks++;
+        if (!mouse_keys_tick(mk, now, &dx, &dy))
+            continue;
+        t->reports++;
+        t->x += dx;
+        t->y += dy;
+        if (abs(dx) > t->max_step)
+            t->max_step = abs(dx);
+        if (abs(dy) > t->max_step)
+            t->max_step = abs(dy);
+    }
+}
+
+// Pixels covered by one axis held for `us` under the default quadratic curve
+static double default_distance(double us)
+{
+    const double start = 150, max = 1500, delay = 150e3, accel = 1000e3;
+    double d = start * (us < delay ? us : delay) / 1e6;
+    double t = us - delay;
+    if (t <= 0)
+        return d;
+    double a = t < accel ? t : accel;
+    // speed = start + (max - start) * (s / accel)^2 over the ramp
+    d += (start * a + (max - start) * a * a * a / (3 * accel * accel)) / 1e6;
+    if (t > accel)
+        d += max * (t - accel) / 1e6;
+    return d;
+}
+
+static void hold(const mouse_keys_config_t *cfg, uint8_t dirs, int64_t hold_us, int64_t period_us, track_t *t)
+{
+    mouse_keys_t mk;
+    mouse_keys_init(&mk, cfg);
+    memset(t, 0, sizeof(*t));
+    mouse_keys_press(&mk, dirs, true, 0);
+    run(&mk, t, 0, hold_us, period_us);
+    mouse_keys_press(&mk, dirs, false, hold_us);
+    // Whole pixels still owed go out after the release
+    for (int64_t now = hold_us; mouse_keys_active(&mk); now += period_us)
+        run(&mk, t, now, now + period_us, period_us);
+}
+
+static void test_trajectory_follows_curve(void)
+{
+    const mouse_keys_config_t cfg = MOUSE_KEYS_DEFAULT_CONFIG;
+    track_t t;
+    for (int64_t us = 300000; us <= 2000000; us += 425000)
+    {
+        hold(&cfg, MOUSE_KEYS_RIGHT, us, INTERVAL_US, &t);
+        CHECK(fabs(t.x - default_distance(us)) <= 1.5);
+        CHECK_EQ(t.y, 0);
+    }
+    hold(&cfg, MOUSE_KEYS_UP, 2000000, INTERVAL_US, &t);
+    CHECK(fabs(-t.y - default_distance(2000000)) <= 1.5);
+    CHECK_EQ(t.x, 0);
+}
+
+static void test_linear_curve(void)
+{
+    const mouse_keys_config_t cfg = {.start_speed = 100, .max_speed = 1100, .delay_ms = 0, .accel_ms = 1000,
+                                     .curve = MOUSE_KEYS_CURVE_LINEAR};
+    track_t t;
+    // Mean speed over an even ramp is the midpoint: 600 px in the first second
+    hold(&cfg, MOUSE_KEYS_LEFT, 1000000, INTERVAL_US, &t);
+    CHECK(labs((long)(t.x + 600)) <= 1);
+    // Then flat at max_speed
+    hold(&cfg, MOUSE_KEYS_LEFT, 1500000, INTERVAL_US, &t);
+    CHECK(labs((long)(t.x + 1150)) <= 1);
+}
+
+// The same hold covers the same distance whatever the tick period
+static void test_tick_rate_independent(void)
+{
+    const mouse_keys_config_t cfg = MOUSE_KEYS_DEFAULT_CONFIG;
+    const int64_t periods[] = {7500, 11250, 15000, 30000, 50000};
+    track_t ref, t;
+    hold(&cfg, MOUSE_KEYS_DOWN, 1600000, 1000, &ref);
+    for (size_t i = 0; i < sizeof(periods) / sizeof(periods[0]); i++)
+    {
+        hold(&cfg, MOUSE_KEYS_DOWN, 1600000, periods[i], &t);
+        CHECK(llabs(t.y - ref.y) <= 1);
+    }
+}
+
+// Both axes get 1/sqrt(2) of the straight-line speed
+static void test_diagonal(void)
+{
+    const mouse_keys_config_t cfg = MOUSE_KEYS_DEFAULT_CONFIG;
+    track_t t;
+    hold(&cfg, MOUSE_KEYS_UP | MOUSE_KEYS_RIGHT, 1500000, INTERVAL_US, &t);
+    CHECK(t.x > 0 && t.y < 0);
+    CHECK(llabs(t.x + t.y) <= 1);
+    CHECK(fabs(sqrt((double)(t.x * t.x + t.y * t.y)) - default_distance(1500000)) <= 2.5);
+
+    // Keys pressed one after the other combine, opposite ones cancel
+    mouse_keys_t mk;
+    mouse_keys_init(&mk, &cfg);
+    memset(&t, 0, sizeof(t));
+    mouse_keys_press(&mk, MOUSE_KEYS_LEFT, true, 0);
+    mouse_keys_press(&mk, MOUSE_KEYS_RIGHT, true, 0);
+    run(&mk, &t, 0, 500000, INTERVAL_US);
+    CHECK_EQ(t.x, 0);
+    CHECK_EQ(t.reports, 0);
+    mouse_keys_press(&mk, MOUSE_KEYS_LEFT, false, 500000);
+    run(&mk, &t, 500000, 600000, INTERVAL_US);
+    CHECK(t.x > 0);
+    CHECK_EQ(t.y, 0);
+}
+
+// Below one pixel per tick the remainder carries: reports are sparser than
+// ticks but the distance is exact
+static void test_sub_pixel(void)
+{
+    const mouse_keys_config_t cfg = {.start_speed = 100, .max_speed = 100, .delay_ms = 0, .accel_ms = 1000,
+                                     .curve = MOUSE_KEYS_CURVE_LINEAR};
+    mouse_keys_t mk;
+    mouse_keys_init(&mk, &cfg);
+    track_t t = {0};
+    mouse_keys_press(&mk, MOUSE_KEYS_RIGHT, true, 0);
+    run(&mk, &t, 0, 1000000, 3000); // 0.3 px per tick
+    CHECK_EQ(t.ticks, 333);
+    CHECK(t.x >= 99 && t.x <= 100);
+    CHECK(t.reports >= 99 && t.reports <= 100);
+    CHECK_EQ(t.max_step, 1);
+
+    // A new motion drops the sub-pixel rest of the old one
+    mouse_keys_press(&mk, MOUSE_KEYS_RIGHT, false, 1000000);
+    mouse_keys_press(&mk, MOUSE_KEYS_LEFT, true, 2000000);
+    int8_t dx, dy;
+    CHECK(!mouse_keys_tick(&mk, 2005000, &dx, &dy));
+    CHECK(mouse_keys_tick(&mk, 2010000, &dx, &dy));
+    CHECK_EQ(dx, -1);
+}
+
+// Past 127 px per tick each report is clamped and the rest carries over,
+// so nothing is lost and the reports keep coming after the release
+static void test_clamp_carry(void)
+{
+    const mouse_keys_config_t cfg = {.start_speed = 3000, .max_speed = 3000, .delay_ms = 0, .accel_ms = 1000,
+                                     .curve = MOUSE_KEYS_CURVE_LINEAR};
+    track_t t;
+    hold(&cfg, MOUSE_KEYS_DOWN, 1000000, 50000, &t); // 150 px per tick
+    CHECK_EQ(t.y, 3000);
+    CHECK_EQ(t.max_step, 127);
+    CHECK_EQ(t.ticks, 24);
+    CHECK_EQ(t.reports, 24);
+}
+
+// One report per connection interval while a key is held, none once the
+// motion has been sent
+static void test_report_rate(void)
+{
+    const mouse_keys_config_t cfg = MOUSE_KEYS_DEFAULT_CONFIG;
+    const int64_t intervals[] = {7500, 15000, 30000};
+    for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++)
+    {
+        mouse_keys_t mk;
+        mouse_keys_init(&mk, &cfg);
+        track_t t = {0};
+        mouse_keys_press(&mk, MOUSE_KEYS_RIGHT, true, 0);
+        run(&mk, &t, 0, 1000000, intervals[i]);
+        CHECK_EQ(t.reports, 1000000 / intervals[i]);
+        CHECK_EQ(t.reports, t.ticks);
+
+        mouse_keys_press(&mk, MOUSE_KEYS_RIGHT, false, 1000000);
+        track_t after = {0};
+        run(&mk, &after, 1000000, 2000000, intervals[i]);
+        CHECK(after.reports <= 1);
+        CHECK(!mouse_keys_active(&mk));
+    }
+}
+
+int main(void)
+{
+    TEST_RUN(test_trajectory_follows_curve);
+    TEST_RUN(test_linear_curve);
+    TEST_RUN(test_tick_rate_independent);
+    TEST_RUN(test_diagonal);
+    TEST_RUN(test_sub_pixel);
+    TEST_RUN(test_clamp_carry);
+    TEST_RUN(test_report_rate);
+    return TEST_EXIT();
+}
@@ -0,0 +1,165 @@
+// Staged reconnect advertising against a mock ble_gap_adv_start: stage
+// order, stages the controller refuses, timeouts, and the metrics
+#include "test.h"
+#include "reconnect.h"
+
+#define MS 1000LL
+
+static const host_addr_t s_peer = {.type = 0, .val = {1, 2, 3, 4, 5, 6}};
+
+// Stands in for NimBLE: records every advertising start and refuses the
+// stages in `refuse` (bit per stage)
+typedef struct
+{
+    reconnect_stage_t started[16];
+    host_addr_t peers[16];
+    int count;
+    uint32_t refuse;
+} mock_stack_t;
+
+static int mock_adv_start(void *ctx, const reconnect_stage_params_t *stage, const host_addr_t *peer)
+{
+    mock_stack_t *m = ctx;
+    reconnect_stage_t s = (reconnect_stage_t)(stage - reconnect_stage_params);
+    if (m->count < 16)
+    {
+        m->started[m->count] = s;
+        m->peers[m->count] = *peer;
+        m->count++;
+    }
+    return (m->refuse >> s) & 1 ? 2 : 0; // BLE_HS_EINVAL
+}
+
+typedef struct
+{
+    reconnect_t r;
+    host_slots_t hs;
+    mock_stack_t stack;
+    hal_ble_t ble;
+} fixture_t;
+
+static void setup(fixture_t *f, bool bonded)
+{
+    memset(f, 0, sizeof(*f));
+    reconnect_init(&f->r);
+    host_slots_init(&f->hs);
+    if (bonded)
+        f->hs.slots[0] = (host_slot_t){.bonded = true, .addr = s_peer};
+    f->ble = (hal_ble_t){.adv_start = mock_adv_start, .ctx = &f->stack};
+}
+
+// What esp_hid_ble_gap_adv_start does
+static reconnect_stage_t start(fixture_t *f, int64_t now_us)
+{
+    host_action_t action = host_slots_start(&f->hs);
+    reconnect_begin(&f->r, action == HOST_ACTION_ADV_DIRECTED, now_us);
+    return reconnect_run(&f->r, &f->hs, &f->ble, &f->hs.slots[f->hs.active].addr);
+}
+
+// ADV_COMPLETE with BLE_HS_ETIMEOUT
+static reconnect_stage_t timeout(fixture_t *f)
+{
+    reconnect_advance(&f->r, &f->hs);
+    return reconnect_run(&f->r, &f->hs, &f->ble, &f->hs.slots[f->hs.active].addr);
+}
+
+static void test_stages_in_order(void)
+{
+    fixture_t f;
+    setup(&f, true);
+    CHECK_EQ(start(&f, 0), RECONNECT_DIRECTED_HIGH);
+    CHECK_EQ(f.hs.state, HOST_STATE_ADV_DIRECTED);
+    CHECK_MEM(&f.stack.peers[0], &s_peer, sizeof(s_peer));
+    CHECK(reconnect_stage_params[RECONNECT_DIRECTED_HIGH].high_duty);
+
+    CHECK_EQ(timeout(&f), RECONNECT_DIRECTED_LOW);
+    CHECK_EQ(f.hs.state, HOST_STATE_ADV_DIRECTED); // still aimed at the bonded host
+    CHECK_EQ(timeout(&f), RECONNECT_UNDIRECTED);
+    CHECK_EQ(f.hs.state, HOST_STATE_ADV_UNDIRECTED);
+    CHECK_EQ(timeout(&f), RECONNECT_IDLE);
+    CHECK_EQ(f.hs.state, HOST_STATE_IDLE);
+    CHECK_EQ(f.stack.count, 3);
+    CHECK_EQ(f.stack.started[1], RECONNECT_DIRECTED_LOW);
+    CHECK_EQ(f.stack.started[2], RECONNECT_UNDIRECTED);
+    CHECK_EQ(f.r.stats.exhausted, 1);
+
+    // A late timeout does nothing more
+    CHECK_EQ(timeout(&f), RECONNECT_IDLE);
+    CHECK_EQ(f.stack.count, 3);
+    CHECK_EQ(f.r.stats.exhausted, 1);
+}
+
+static void test_unbonded_goes_undirected(void)
+{
+    fixture_t f;
+    setup(&f, false);
+    CHECK_EQ(start(&f, 0), RECONNECT_UNDIRECTED);
+    CHECK_EQ(f.stack.count, 1);
+    CHECK_EQ(f.stack.started[0], RECONNECT_UNDIRECTED);
+    CHECK_EQ(f.hs.state, HOST_STATE_ADV_UNDIRECTED);
+}
+
+static void test_refused_stages_are_skipped(void)
+{
+    fixture_t f;
+    setup(&f, true);
+    // No high duty directed advertising on this controller
+    f.stack.refuse = 1u << RECONNECT_DIRECTED_HIGH;
+    CHECK_EQ(start(&f, 0), RECONNECT_DIRECTED_LOW);
+    CHECK_EQ(f.stack.count, 2);
+    CHECK_EQ(f.stack.started[0], RECONNECT_DIRECTED_HIGH);
+    CHECK_EQ(f.stack.started[1], RECONNECT_DIRECTED_LOW);
+    CHECK_EQ(f.hs.state, HOST_STATE_ADV_DIRECTED);
+
+    // Nothing starts at all
+    setup(&f, true);
+    f.stack.refuse = ~0u;
+    CHECK_EQ(start(&f, 0), RECONNECT_IDLE);
+    CHECK_EQ(f.stack.count, RECONNECT_STAGE_COUNT);
+    CHECK_EQ(f.hs.state, HOST_STATE_IDLE);
+    CHECK_EQ(f.r.stats.exhausted, 1);
+}
+
+static void test_reconnect_metrics(void)
+{
+    fixture_t f;
+    setup(&f, true);
+
+    // Back during high duty advertising
+    start(&f, 1000 * MS);
+    reconnect_connected(&f.r, 1300 * MS);
+    host_slots_connected(&f.hs);
+    CHECK_EQ(f.r.stage, RECONNECT_IDLE);
+    CHECK_EQ(f.r.stats.connects[RECONNECT_DIRECTED_HIGH], 1);
+    CHECK_EQ(f.r.stats.last_us, 300 * MS);
+    CHECK_EQ(f.hs.directed_connects, 1);
+
+    // Back in the low duty stage; the time counts from the first stage
+    host_slots_disconnected(&f.hs);
+    start(&f, 5000 * MS);
+    timeout(&f);
+    reconnect_connected(&f.r, 9000 * MS);
+    CHECK_EQ(f.r.stats.connects[RECONNECT_DIRECTED_LOW], 1);
+    CHECK_EQ(f.r.stats.last_us, 4000 * MS);
+    CHECK_EQ(f.r.stats.min_us, 300 * MS);
+    CHECK_EQ(f.r.stats.max_us, 4000 * MS);
+    CHECK_EQ(f.r.stats.total_us, 4300 * MS);
+    CHECK_EQ(f.r.stats.attempts, 2);
+
+    // A cancelled attempt (host switch) records nothing
+    start(&f, 20000 * MS);
+    reconnect_cancel(&f.r);
+    reconnect_connected(&f.r, 20100 * MS);
+    CHECK_EQ(f.r.stats.last_us, 4000 * MS);
+    CHECK_EQ(f.r.stats.connects[RECONNECT_DIRECTED_HIGH], 1);
+    CHECK_EQ(f.r.stats.attempts, 3);
+}
+
+int main(void)
+{
+    TEST_RUN(test_stages_in_order);
+    TEST_RUN(test_unbonded_goes_undirected);
+    TEST_RUN(test_refused_stages_are_skipped);
+    TEST_RUN(test_reconnect_metrics);
+    return TEST_EXIT();
+}
@@ -0,0 +1,121 @@
+// Scan engine over a simulated GPIO backend
+#include "test.h"
+#include "scan.h"
+
+typedef struct
+{
+    scan_mask_t pins;
+    int reads;
+} gpio_sim_t;
+
+typedef struct
+{
+    uint8_t key[SCAN_MAX_KEYS];
+    bool pressed[SCAN_MAX_KEYS];
+    int64_t time[SCAN_MAX_KEYS];
+    int count;
+} events_t;
+
+static scan_mask_t gpio_read(void *ctx)
+{
+    gpio_sim_t *g = ctx;
+    g->reads++;
+    return g->pins;
+}
+
+static void on_event(uint8_t key, bool pressed, int64_t now_us, void *ctx)
+{
+    events_t *e = ctx;
+    if (e->count == SCAN_MAX_KEYS)
+        return;
+    e->key[e->count] = key;
+    e->pressed[e->count] = pressed;
+    e->time[e->count] = now_us;
+    e->count++;
+}
+
+static void test_edges_in_key_order(void)
+{
+    gpio_sim_t g = {0};
+    events_t e = {0};
+    scan_t scan;
+    scan_init(&scan, 16, gpio_read, &g, on_event, &e);
+
+    g.pins = (1 << 9) | (1 << 2);
+    scan_tick(&scan, 1000);
+    CHECK_EQ(e.count, 2);
+    CHECK_EQ(e.key[0], 2);
+    CHECK_EQ(e.key[1], 9);
+    CHECK(e.pressed[0] && e.pressed[1]);
+    CHECK_EQ(e.time[1], 1000);
+    CHECK(scan_is_down(&scan, 9));
+
+    // No change, no events
+    scan_tick(&scan, 2000);
+    CHECK_EQ(e.count, 2);
+
+    g.pins = 1 << 2;
+    scan_tick(&scan, 3000);
+    CHECK_EQ(e.count, 3);
+    CHECK_EQ(e.key[2], 9);
+    CHECK_EQ(e.pressed[2], false);
+    CHECK(!scan_is_down(&scan, 9));
+}
+
+static void test_pins_outside_the_keys_are_ignored(void)
+{
+    gpio_sim_t g = {0};
+    events_t e = {0};
+    scan_t scan;
+    scan_init(&scan, 5, gpio_read, &g, on_event, &e);
+    g.pins = ~(scan_mask_t)0;
+    scan_tick(&scan, 0);
+    CHECK_EQ(e.count, 5);
+    CHECK_EQ(scan.state, 0x1F);
+
+    scan_init(&scan, 200, gpio_read, &g, on_event, &e);
+    CHECK_EQ(scan.num_keys, SCAN_MAX_KEYS);
+    CHECK_EQ(scan.key_mask, ~(scan_mask_t)0);
+}
+
+// Work per tick is one read plus one callback per changed key, whatever the
+// number of keys, and the state does not grow with it
+static void test_cost_is_flat_in_key_count(void)
+{
+    static const uint8_t sizes[] = {5, 16, 36, 64};
+    for (size_t i = 0; i < sizeof(sizes); i++)
+    {
+        gpio_sim_t g = {0};
+        events_t e = {0};
+        scan_t scan;
+        scan_init(&scan, sizes[i], gpio_read, &g, on_event, &e);
+        for (int tick = 0; tick < 100; tick++)
+        {
+            if (tick == 50)
+                g.pins = (scan_mask_t)1 << (sizes[i] - 1);
+            scan_tick(&scan, tick * SCAN_PERIOD_US);
+        }
+        CHECK_EQ(g.reads, 100);
+        CHECK_EQ(e.count, 1);
+        CHECK_EQ(e.key[0], sizes[i] - 1);
+    }
+    CHECK(sizeof(scan_t) <= 64);
+}
+
+static void test_no_callback(void)
+{
+    gpio_sim_t g = {.pins = 1};
+    scan_t scan;
+    scan_init(&scan, 4, gpio_read, &g, NULL, NULL);
+    scan_tick(&scan, 0);
+    CHECK(scan_is_down(&scan, 0));
+}
+
+int main(void)
+{
+    TEST_RUN(test_edges_in_key_order);
+    TEST_RUN(test_pins_outside_the_keys_are_ignored);
+    TEST_RUN(test_cost_is_flat_in_key_count);
+    TEST_RUN(test_no_callback);
+    return TEST_EXIT();
+}
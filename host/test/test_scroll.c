@@ -0,0 +1,258 @@
+// High-resolution wheel and pan: the descriptor as a host parses it, the
+// Resolution Multiplier feature report, and the mouse report stream the
+// scroll engine produces, decoded through the parsed descriptor
+#include <stdlib.h>
+#include "test.h"
+#include "hid_parse.h"
+#include "hid_report.h"
+#include "scroll.h"
+
+#define INTERVAL_US 15000
+#define WHEEL HID_PARSE_USAGE(HID_DESC_PAGE_GENERIC_DESKTOP, 0x38)
+#define AC_PAN HID_PARSE_USAGE(HID_DESC_PAGE_CONSUMER, 0x0238)
+#define RES_MULTIPLIER HID_PARSE_USAGE(HID_DESC_PAGE_GENERIC_DESKTOP, 0x48)
+
+static const uint8_t s_desc[] = {HID_REPORT_DESCRIPTOR};
+static hid_parse_t s_parse;
+
+// The Resolution Multiplier feature in the same logical collection as `f`
+static const hid_parse_field_t *multiplier_of(const hid_parse_field_t *f)
+{
+    const hid_parse_field_t *found = NULL;
+    for (int i = 0; i < s_parse.num_fields; i++)
+    {
+        const hid_parse_field_t *m = &s_parse.fields[i];
+        if (m->main == HID_PARSE_FEATURE && m->collection == f->collection &&
+            hid_parse_var_usage(m, 0) == RES_MULTIPLIER)
+        {
+            if (found)
+                return NULL; // one multiplier per collection
+            found = m;
+        }
+    }
+    return found;
+}
+
+// Physical value of a logical one, as the host scales it
+static int32_t physical(const hid_parse_field_t *f, int32_t logical)
+{
+    return f->physical_min + (logical - f->logical_min) * (f->physical_max - f->physical_min) /
+                                 (f->logical_max - f->logical_min);
+}
+
+static void test_descriptor_scroll_controls(void)
+{
+    CHECK(hid_parse(&s_parse, s_desc, sizeof(s_desc)));
+    CHECK_EQ(hid_parse_report_len(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_INPUT), HID_REPORT_MOUSE_LEN);
+    CHECK_EQ(hid_parse_report_len(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_FEATURE), HID_REPORT_MOUSE_FEATURE_LEN);
+    CHECK_EQ(s_parse.bits[HID_REPORT_ID_MOUSE][HID_PARSE_FEATURE] % 8, 0);
+
+    const uint32_t controls[] = {WHEEL, AC_PAN};
+    int collections[2];
+    for (int c = 0; c < 2; c++)
+    {
+        const hid_parse_field_t *f = hid_parse_find(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_INPUT, controls[c], NULL);
+        CHECK(f != NULL);
+        if (f == NULL)
+            continue;
+        CHECK_EQ(f->flags, HID_DESC_DATA | HID_DESC_VAR | HID_DESC_REL);
+        CHECK_EQ(f->size, 8);
+        CHECK_EQ(f->logical_min, -127);
+        CHECK_EQ(f->logical_max, 127);
+        // No physical range of its own, or the host would scale the units again
+        CHECK_EQ(f->physical_min, 0);
+        CHECK_EQ(f->physical_max, 0);
+        CHECK(f->collection >= 0 && s_parse.collections[f->collection].type == HID_DESC_LOGICAL);
+        collections[c] = f->collection;
+
+        const hid_parse_field_t *m = multiplier_of(f);
+        CHECK(m != NULL);
+        if (m == NULL)
+            continue;
+        CHECK_EQ(m->report_id, HID_REPORT_ID_MOUSE);
+        CHECK_EQ(m->logical_min, 0);
+        CHECK_EQ(m->logical_max, 1);
+        CHECK_EQ(physical(m, 0), 1);
+        CHECK_EQ(physical(m, 1), HID_REPORT_SCROLL_MULTIPLIER);
+    }
+    // Each control has its own multiplier
+    CHECK(collections[0] != collections[1]);
+}
+
+// The host writes the feature report from the descriptor; the firmware reads
+// it through hid_mouse_feature_t
+static void test_feature_report(void)
+{
+    const hid_parse_field_t *wheel = hid_parse_find(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_INPUT, WHEEL, NULL);
+    const hid_parse_field_t *pan = hid_parse_find(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_INPUT, AC_PAN, NULL);
+    if (wheel == NULL || pan == NULL || !multiplier_of(wheel) || !multiplier_of(pan))
+    {
+        CHECK(false);
+        return;
+    }
+    for (int v = 0; v <= 1; v++)
+    {
+        for (int h = 0; h <= 1; h++)
+        {
+            uint8_t data[HID_REPORT_MOUSE_FEATURE_LEN] = {0};
+            hid_parse_put(multiplier_of(wheel), 0, data, v);
+            hid_parse_put(multiplier_of(pan), 0, data, h);
+            hid_mouse_feature_t feature;
+            memcpy(&feature, data, sizeof(feature));
+            CHECK_EQ(HID_REPORT_MULTIPLIER(feature.wheel_multiplier), physical(multiplier_of(wheel), v));
+            CHECK_EQ(HID_REPORT_MULTIPLIER(feature.pan_multiplier), physical(multiplier_of(pan), h));
+        }
+    }
+}
+
+// === Report stream checker ===
+typedef struct
+{
+    const hid_parse_field_t *wheel;
+    const hid_parse_field_t *pan;
+    bool gliding; // keys released, magnitudes must not grow
+    uint32_t reports;
+    uint32_t bad;  // wrong ID or length, or a value outside the logical range
+    uint32_t reversals;
+    uint32_t glide_growth;
+    int64_t wheel_sum;
+    int64_t pan_sum;
+    int max_step;
+    int last_wheel;
+    int last_pan;
+} stream_t;
+
+static int sign(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+static void stream_value(stream_t *s, const hid_parse_field_t *f, int v, int *last, int64_t *sum)
+{
+    if (v < f->logical_min || v > f->logical_max)
+        s->bad++;
+    if (v && *last && sign(v) != sign(*last))
+        s->reversals++;
+    // One unit of rounding between reports is fine
+    if (s->gliding && *last && abs(v) > abs(*last) + 1)
+        s->glide_growth++;
+    if (abs(v) > s->max_step)
+        s->max_step = abs(v);
+    if (v)
+        *last = v;
+    *sum += v;
+}
+
+static bool stream_send(void *ctx, uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    stream_t *s = ctx;
+    s->reports++;
+    if (report_id != HID_REPORT_ID_MOUSE || len != hid_parse_report_len(&s_parse, report_id, HID_PARSE_INPUT))
+    {
+        s->bad++;
+        return true;
+    }
+    stream_value(s, s->wheel, hid_parse_get(s->wheel, 0, data), &s->last_wheel, &s->wheel_sum);
+    stream_value(s, s->pan, hid_parse_get(s->pan, 0, data), &s->last_pan, &s->pan_sum);
+    return true;
+}
+
+// Holds `dirs` for hold_us and lets the momentum run out, ticking once per
+// connection interval as the firmware's pointer timer does
+static void scroll_run(stream_t *s, const scroll_config_t *cfg, uint8_t mult_v, uint8_t mult_h, uint8_t dirs,
+                       int64_t hold_us)
+{
+    memset(s, 0, sizeof(*s));
+    s->wheel = hid_parse_find(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_INPUT, WHEEL, NULL);
+    s->pan = hid_parse_find(&s_parse, HID_REPORT_ID_MOUSE, HID_PARSE_INPUT, AC_PAN, NULL);
+    const hal_hid_sink_t sink = {.send = stream_send, .ctx = s};
+    hid_report_t r;
+    hid_report_init(&r, &sink);
+    scroll_t sc;
+    scroll_init(&sc, cfg);
+    scroll_set_resolution(&sc, mult_v, mult_h);
+
+    scroll_press(&sc, dirs, true, 0);
+    int64_t now = 0;
+    for (int ticks = 0; scroll_active(&sc) && ticks < 1000; ticks++)
+    {
+        now += INTERVAL_US;
+        if (now >= hold_us && !s->gliding)
+        {
+            scroll_press(&sc, dirs, false, hold_us);
+            s->gliding = true;
+        }
+        int8_t wheel, pan;
+        if (scroll_tick(&sc, now, &wheel, &pan))
+            hid_report_mouse_move(&r, 0, 0, wheel, pan);
+    }
+    CHECK(!scroll_active(&sc));
+}
+
+// Whole notches, one direction, then the glide runs down
+static void test_stream_low_res(void)
+{
+    const scroll_config_t cfg = SCROLL_DEFAULT_CONFIG;
+    stream_t s;
+    scroll_run(&s, &cfg, 1, 1, SCROLL_UP, 1000000);
+    CHECK_EQ(s.bad, 0);
+    CHECK_EQ(s.reversals, 0);
+    CHECK_EQ(s.glide_growth, 0);
+    CHECK_EQ(s.pan_sum, 0);
+    // 4 -> 30 detents/s over 0.8 s, 0.2 s at 30, then 30 * 0.25 s of glide
+    CHECK(s.wheel_sum >= 25 && s.wheel_sum <= 29);
+}
+
+// The same motion in 1/16 detents: sixteen times the units, more and smaller reports
+static void test_stream_high_res(void)
+{
+    const scroll_config_t cfg = SCROLL_DEFAULT_CONFIG;
+    stream_t lo, hi;
+    scroll_run(&lo, &cfg, 1, 1, SCROLL_DOWN | SCROLL_RIGHT, 1000000);
+    scroll_run(&hi, &cfg, HID_REPORT_SCROLL_MULTIPLIER, HID_REPORT_SCROLL_MULTIPLIER, SCROLL_DOWN | SCROLL_RIGHT,
+               1000000);
+    CHECK_EQ(hi.bad, 0);
+    CHECK_EQ(hi.reversals, 0);
+    CHECK_EQ(hi.glide_growth, 0);
+    CHECK(hi.wheel_sum < 0 && hi.pan_sum > 0);
+    CHECK_EQ(hi.wheel_sum, -hi.pan_sum);
+    CHECK(llabs(hi.wheel_sum - lo.wheel_sum * HID_REPORT_SCROLL_MULTIPLIER) <= HID_REPORT_SCROLL_MULTIPLIER);
+    CHECK(hi.reports > lo.reports);
+    // At most 30 detents/s * 15 ms, under half a notch per report
+    CHECK(hi.max_step <= HID_REPORT_SCROLL_MULTIPLIER / 2);
+}
+
+// The host may enable one multiplier only: each axis uses its own
+static void test_stream_mixed_resolution(void)
+{
+    const scroll_config_t cfg = SCROLL_DEFAULT_CONFIG;
+    stream_t s;
+    scroll_run(&s, &cfg, HID_REPORT_SCROLL_MULTIPLIER, 1, SCROLL_UP | SCROLL_LEFT, 600000);
+    CHECK_EQ(s.bad, 0);
+    CHECK(s.wheel_sum > 0 && s.pan_sum < 0);
+    CHECK(llabs(s.wheel_sum + s.pan_sum * HID_REPORT_SCROLL_MULTIPLIER) <= HID_REPORT_SCROLL_MULTIPLIER);
+}
+
+// Faster than 127 units per report: clamped to the logical range, the rest
+// follows in later reports
+static void test_stream_clamped(void)
+{
+    const scroll_config_t cfg = {.start_speed = 600, .max_speed = 600, .accel_ms = 0, .glide_ms = 0};
+    stream_t s;
+    scroll_run(&s, &cfg, HID_REPORT_SCROLL_MULTIPLIER, HID_REPORT_SCROLL_MULTIPLIER, SCROLL_UP, 300000);
+    CHECK_EQ(s.bad, 0);
+    CHECK_EQ(s.max_step, 127);
+    // 600 detents/s for 0.3 s
+    CHECK(llabs(s.wheel_sum - 180 * HID_REPORT_SCROLL_MULTIPLIER) <= 1);
+}
+
+int main(void)
+{
+    TEST_RUN(test_descriptor_scroll_controls);
+    TEST_RUN(test_feature_report);
+    TEST_RUN(test_stream_low_res);
+    TEST_RUN(test_stream_high_res);
+    TEST_RUN(test_stream_mixed_resolution);
+    TEST_RUN(test_stream_clamped);
+    return TEST_EXIT();
+}
@@ -0,0 +1,118 @@
+// SPSC ring semantics on a single thread
+#include <pthread.h>
+#include <sched.h>
+#include "test.h"
+#include "spsc_ring.h"
+
+#define STRESS_ITEMS 500000
+
+SPSC_RING_DEFINE(test_ring, uint32_t, 8)
+SPSC_RING_DEFINE(stress_ring, uint32_t, 64)
+
+static void test_fifo_and_full(void)
+{
+    test_ring_t r;
+    test_ring_init(&r);
+    uint32_t v = 0;
+    CHECK(!test_ring_pop(&r, &v));
+
+    for (uint32_t i = 0; i < 8; i++)
+        CHECK(test_ring_push(&r, &i));
+    uint32_t extra = 99;
+    CHECK(!test_ring_push(&r, &extra));
+    CHECK_EQ(test_ring_dropped(&r), 1);
+    CHECK_EQ(test_ring_size(&r), 8);
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        CHECK(test_ring_pop(&r, &v));
+        CHECK_EQ(v, i);
+    }
+    CHECK_EQ(test_ring_size(&r), 0);
+}
+
+static void test_pop_batch(void)
+{
+    test_ring_t r;
+    test_ring_init(&r);
+    for (uint32_t i = 0; i < 5; i++)
+        test_ring_push(&r, &i);
+
+    uint32_t out[8];
+    CHECK_EQ(test_ring_pop_batch(&r, out, 3), 3);
+    CHECK_EQ(out[0], 0);
+    CHECK_EQ(out[2], 2);
+    CHECK_EQ(test_ring_pop_batch(&r, out, 8), 2);
+    CHECK_EQ(out[1], 4);
+    CHECK_EQ(test_ring_pop_batch(&r, out, 8), 0);
+}
+
+// Indexes are free-running 32-bit counters: wrapping them must not lose or
+// reorder anything
+static void test_index_wrap(void)
+{
+    test_ring_t r;
+    test_ring_init(&r);
+    atomic_store(&r.head, UINT32_MAX - 3);
+    atomic_store(&r.tail, UINT32_MAX - 3);
+
+    uint32_t next = 0, expect = 0, v = 0;
+    for (int round = 0; round < 4; round++)
+    {
+        for (int i = 0; i < 6; i++, next++)
+            CHECK(test_ring_push(&r, &next));
+        CHECK_EQ(test_ring_size(&r), 6);
+        while (test_ring_pop(&r, &v))
+            CHECK_EQ(v, expect++);
+    }
+    CHECK_EQ(expect, next);
+    CHECK_EQ(test_ring_dropped(&r), 0);
+}
+
+// Producer and consumer on their own threads: every item arrives once and
+// in order, with the ring full and empty many times over. Both sides yield
+// when they cannot progress so the test also finishes on a single core.
+static stress_ring_t s_stress;
+
+static void *stress_producer(void *arg)
+{
+    for (uint32_t i = 0; i < STRESS_ITEMS; i++)
+    {
+        while (!stress_ring_push(&s_stress, &i))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void test_threaded_stress(void)
+{
+    stress_ring_init(&s_stress);
+    pthread_t producer;
+    CHECK(pthread_create(&producer, NULL, stress_producer, NULL) == 0);
+
+    uint32_t expect = 0, out[16];
+    bool in_order = true;
+    while (expect < STRESS_ITEMS)
+    {
+        uint32_t n = stress_ring_pop_batch(&s_stress, out, 1 + expect % 16);
+        if (n == 0)
+            sched_yield();
+        for (uint32_t i = 0; i < n; i++)
+            in_order &= out[i] == expect++;
+    }
+    pthread_join(producer, NULL);
+    CHECK(in_order);
+    CHECK_EQ(expect, STRESS_ITEMS);
+    CHECK_EQ(stress_ring_size(&s_stress), 0);
+    // Failed pushes while full are counted
+    CHECK(stress_ring_dropped(&s_stress) > 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_fifo_and_full);
+    TEST_RUN(test_pop_batch);
+    TEST_RUN(test_index_wrap);
+    TEST_RUN(test_threaded_stress);
+    return TEST_EXIT();
+}
@@ -0,0 +1,247 @@
+// Per-interval notification credits, completion counting, and the flush
+// cadence hid_tx.c builds from them and coalesce.c
+#include "test.h"
+#include "tx_flow.h"
+#include "coalesce.h"
+
+#define CONN 7
+#define INTERVAL_US 7500
+#define REPORT 0x2A // input report value handles
+#define REPORT_BOOT 0x31
+#define BATTERY 0x12 // battery level, notified by the battery service
+#define KBD 1
+#define MOUSE 2
+
+static void test_credits(void)
+{
+    tx_flow_t f;
+    tx_flow_init(&f);
+    tx_flow_connected(&f, CONN, 2);
+    CHECK(tx_flow_due(&f, CONN, 0, INTERVAL_US));
+    CHECK(tx_flow_acquire(&f, CONN));
+    CHECK(tx_flow_acquire(&f, CONN));
+    CHECK(!tx_flow_acquire(&f, CONN));
+
+    // Completions are counted but give nothing back: NimBLE reports them
+    // from inside the send
+    CHECK(tx_flow_complete(&f, CONN, REPORT, 0));
+    CHECK(tx_flow_complete(&f, CONN, REPORT, 5));
+    CHECK(!tx_flow_acquire(&f, CONN));
+
+    const tx_flow_conn_t *c = tx_flow_get(&f, CONN);
+    CHECK_EQ(c->sent, 2);
+    CHECK_EQ(c->completed, 1);
+    CHECK_EQ(c->failed, 1);
+    CHECK_EQ(c->stalls, 2);
+}
+
+// Credits come back once per interval, measured from the flush that opened it
+static void test_intervals(void)
+{
+    tx_flow_t f;
+    tx_flow_init(&f);
+    tx_flow_connected(&f, CONN, 1);
+    CHECK_EQ(tx_flow_next_us(&f, CONN), 0);
+    CHECK(tx_flow_due(&f, CONN, 1000, INTERVAL_US));
+    CHECK_EQ(tx_flow_next_us(&f, CONN), 1000 + INTERVAL_US);
+    CHECK(tx_flow_acquire(&f, CONN));
+    CHECK(!tx_flow_due(&f, CONN, 1000 + INTERVAL_US - 1, INTERVAL_US));
+    CHECK(!tx_flow_acquire(&f, CONN));
+    CHECK(tx_flow_due(&f, CONN, 1000 + INTERVAL_US, INTERVAL_US));
+    CHECK(tx_flow_acquire(&f, CONN));
+
+    // After idle the next flush is due at once, with a fresh interval
+    CHECK(tx_flow_due(&f, CONN, 1000000, INTERVAL_US));
+    CHECK_EQ(tx_flow_next_us(&f, CONN), 1000000 + INTERVAL_US);
+
+    // A new link starts due
+    tx_flow_connected(&f, CONN, 1);
+    CHECK(tx_flow_due(&f, CONN, 1000001, INTERVAL_US));
+}
+
+static void test_cancel(void)
+{
+    tx_flow_t f;
+    tx_flow_init(&f);
+    tx_flow_connected(&f, CONN, 1);
+    CHECK(tx_flow_acquire(&f, CONN));
+    tx_flow_cancel(&f, CONN);
+    CHECK_EQ(tx_flow_get(&f, CONN)->sent, 0);
+    CHECK(tx_flow_acquire(&f, CONN));
+    CHECK(!tx_flow_acquire(&f, CONN));
+}
+
+static void test_connections(void)
+{
+    tx_flow_t f;
+    tx_flow_init(&f);
+    // Unknown links are not limited, always due and never complete
+    CHECK(tx_flow_acquire(&f, CONN));
+    CHECK(tx_flow_due(&f, CONN, 0, INTERVAL_US));
+    CHECK(tx_flow_due(&f, CONN, 0, INTERVAL_US));
+    CHECK(!tx_flow_complete(&f, CONN, REPORT, 0));
+
+    // A zero limit still lets one notification through
+    tx_flow_connected(&f, CONN, 0);
+    CHECK(tx_flow_acquire(&f, CONN));
+    CHECK(!tx_flow_acquire(&f, CONN));
+
+    // One slot per link the stack allows
+    for (int i = 0; i < TX_FLOW_MAX_CONNS - 1; i++)
+        tx_flow_connected(&f, 100 + i, 1);
+    for (int i = 0; i < TX_FLOW_MAX_CONNS - 1; i++)
+        CHECK(tx_flow_get(&f, 100 + i) != NULL);
+    tx_flow_connected(&f, 200, 1);
+    CHECK(tx_flow_get(&f, 200) == NULL);
+
+    tx_flow_disconnected(&f, CONN);
+    CHECK(tx_flow_get(&f, CONN) == NULL);
+    tx_flow_connected(&f, CONN, 3);
+    CHECK_EQ(tx_flow_get(&f, CONN)->used, 0);
+}
+
+static void test_foreign_completions(void)
+{
+    tx_flow_t f;
+    tx_flow_init(&f);
+    CHECK(tx_flow_add_handle(&f, REPORT));
+    CHECK(tx_flow_add_handle(&f, REPORT_BOOT));
+    CHECK(tx_flow_add_handle(&f, REPORT)); // already known
+    CHECK_EQ(f.num_handles, 2);
+    tx_flow_connected(&f, CONN, 2);
+
+    CHECK(tx_flow_complete(&f, CONN, REPORT, 0));
+    CHECK(!tx_flow_complete(&f, CONN, BATTERY, 0));
+    CHECK(tx_flow_complete(&f, CONN, REPORT_BOOT, 0));
+    CHECK_EQ(f.foreign, 1);
+    CHECK_EQ(tx_flow_get(&f, CONN)->completed, 2);
+
+    // The table is bounded
+    for (int i = 0; i < TX_FLOW_MAX_HANDLES - 2; i++)
+        CHECK(tx_flow_add_handle(&f, 0x100 + i));
+    CHECK(!tx_flow_add_handle(&f, 0x200));
+}
+
+static void test_no_handles_counts_all(void)
+{
+    // Until GATT registration reports a handle every completion counts
+    tx_flow_t f;
+    tx_flow_init(&f);
+    tx_flow_connected(&f, CONN, 1);
+    CHECK(tx_flow_complete(&f, CONN, BATTERY, 0));
+    CHECK_EQ(f.foreign, 0);
+}
+
+// === hid_tx.c flush cadence ===
+typedef struct
+{
+    tx_flow_t flow;
+    coalesce_t coalesce;
+    struct
+    {
+        int64_t t_us;
+        uint8_t report_id;
+        uint8_t data[8];
+    } sent[16];
+    int count;
+    int64_t now_us;
+} link_t;
+
+static bool link_emit(uint8_t report_id, const uint8_t *data, uint8_t len, int64_t first_us, void *ctx)
+{
+    link_t *l = ctx;
+    if (!tx_flow_acquire(&l->flow, CONN))
+        return false;
+    l->sent[l->count].t_us = l->now_us;
+    l->sent[l->count].report_id = report_id;
+    memcpy(l->sent[l->count].data, data, len);
+    l->count++;
+    return true;
+}
+
+static void link_init(link_t *l, uint8_t credits)
+{
+    memset(l, 0, sizeof(*l));
+    tx_flow_init(&l->flow);
+    tx_flow_connected(&l->flow, CONN, credits);
+    coalesce_init(&l->coalesce);
+    coalesce_add(&l->coalesce, KBD, COALESCE_ABSOLUTE);
+    coalesce_add(&l->coalesce, MOUSE, COALESCE_RELATIVE);
+}
+
+// hid_tx_flush(): only when a new interval is due
+static void link_flush(link_t *l, int64_t now_us)
+{
+    l->now_us = now_us;
+    if (tx_flow_due(&l->flow, CONN, now_us, INTERVAL_US))
+        coalesce_flush(&l->coalesce, link_emit, l);
+}
+
+static void link_put(link_t *l, int64_t now_us, uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    CHECK(coalesce_put(&l->coalesce, report_id, data, len, now_us) != COALESCE_CONFLICT);
+    link_flush(l, now_us);
+}
+
+// Reports of the same ID inside one interval go out as one notification
+static void test_merge_per_interval(void)
+{
+    link_t l;
+    link_init(&l, TX_FLOW_DEFAULT_CREDITS);
+
+    // The first report after idle goes out at once
+    link_put(&l, 0, KBD, (const uint8_t[8]){0, 0, 4}, 8);
+    CHECK_EQ(l.count, 1);
+
+    link_put(&l, 1000, MOUSE, (const uint8_t[4]){0, 3, 0, 0}, 4);
+    link_put(&l, 2000, KBD, (const uint8_t[8]){0, 0, 4, 5}, 8);
+    link_put(&l, 3000, MOUSE, (const uint8_t[4]){0, 4, 0xFF, 0}, 4);
+    link_put(&l, 4000, KBD, (const uint8_t[8]){0, 0, 4, 5, 6}, 8);
+    link_put(&l, 6000, MOUSE, (const uint8_t[4]){0, 1, 0, 0}, 4);
+    CHECK_EQ(l.count, 1);
+    CHECK(coalesce_pending(&l.coalesce));
+
+    link_flush(&l, INTERVAL_US);
+    CHECK_EQ(l.count, 3);
+    CHECK_EQ(l.sent[1].t_us, INTERVAL_US);
+    CHECK_EQ(l.sent[1].report_id, KBD);
+    CHECK_MEM(l.sent[1].data, ((const uint8_t[8]){0, 0, 4, 5, 6}), 8);
+    CHECK_EQ(l.sent[2].report_id, MOUSE);
+    CHECK_MEM(l.sent[2].data, ((const uint8_t[4]){0, 8, 0xFF, 0}), 4);
+    CHECK_EQ(l.coalesce.merged, 3);
+    CHECK(!coalesce_pending(&l.coalesce));
+}
+
+// More pending IDs than credits: the rest waits a whole interval
+static void test_credits_per_interval(void)
+{
+    link_t l;
+    link_init(&l, 1);
+    link_put(&l, 0, KBD, (const uint8_t[8]){0, 0, 4}, 8);
+    link_put(&l, 100, KBD, (const uint8_t[8]){0, 0, 4, 5}, 8);
+    link_put(&l, 200, MOUSE, (const uint8_t[4]){0, 1, 0, 0}, 4);
+    CHECK_EQ(l.count, 1);
+
+    link_flush(&l, INTERVAL_US);
+    CHECK_EQ(l.count, 2);
+    CHECK_EQ(l.sent[1].report_id, KBD);
+    link_flush(&l, INTERVAL_US + 100);
+    CHECK_EQ(l.count, 2);
+    link_flush(&l, 2 * INTERVAL_US);
+    CHECK_EQ(l.count, 3);
+    CHECK_EQ(l.sent[2].report_id, MOUSE);
+    CHECK_EQ(l.sent[2].t_us, 2 * INTERVAL_US);
+}
+
+int main(void)
+{
+    TEST_RUN(test_credits);
+    TEST_RUN(test_intervals);
+    TEST_RUN(test_cancel);
+    TEST_RUN(test_connections);
+    TEST_RUN(test_foreign_completions);
+    TEST_RUN(test_no_handles_counts_all);
+    TEST_RUN(test_merge_per_interval);
+    TEST_RUN(test_credits_per_interval);
+    return TEST_EXIT();
+}
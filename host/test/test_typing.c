@@ -0,0 +1,100 @@
+// Boot keyboard report sequences produced for strings
+#include "test.h"
+#include "typing.h"
+#include "keycodes.h"
+
+#define SHIFT USB_HID_MODIFIER_LEFT_SHIFT
+#define KEY(c) (USB_HID_KEY_A + ((c) - 'a'))
+
+// Runs typing over `text` and compares every report against `want`
+static void expect_reports(const char *text, const uint8_t (*want)[TYPING_REPORT_LEN], int n)
+{
+    typing_t t;
+    typing_init(&t, text);
+    uint8_t report[TYPING_REPORT_LEN];
+    int i = 0;
+    while (typing_next_report(&t, report))
+    {
+        if (i < n)
+            CHECK_MEM(report, want[i], TYPING_REPORT_LEN);
+        i++;
+    }
+    CHECK_EQ(i, n);
+}
+
+static void test_distinct_keys_share_a_report(void)
+{
+    static const uint8_t want[][TYPING_REPORT_LEN] = {
+        {0, 0, KEY('a'), KEY('b'), KEY('c')},
+        {0},
+    };
+    expect_reports("abc", want, 2);
+}
+
+static void test_repeated_key_is_released_between(void)
+{
+    static const uint8_t want[][TYPING_REPORT_LEN] = {
+        {0, 0, KEY('a')},
+        {0},
+        {0, 0, KEY('a')},
+        {0},
+    };
+    expect_reports("aa", want, 4);
+}
+
+static void test_modifier_goes_down_first(void)
+{
+    static const uint8_t want[][TYPING_REPORT_LEN] = {
+        {0, 0, KEY('a')},
+        {SHIFT},
+        {SHIFT, 0, KEY('a'), KEY('b')},
+        {0},
+    };
+    expect_reports("aAB", want, 4);
+}
+
+static void test_report_holds_at_most_six_keys(void)
+{
+    static const uint8_t want[][TYPING_REPORT_LEN] = {
+        {0, 0, KEY('a'), KEY('b'), KEY('c'), KEY('d'), KEY('e'), KEY('f')},
+        {0, 0, KEY('g')},
+        {0},
+    };
+    expect_reports("abcdefg", want, 3);
+}
+
+static void test_unmapped_characters_are_skipped(void)
+{
+    static const uint8_t want[][TYPING_REPORT_LEN] = {
+        {0, 0, KEY('a'), KEY('b')},
+        {0},
+    };
+    expect_reports("\x01" "a\x80" "b", want, 2);
+    expect_reports("", want, 0);
+}
+
+// Batching is what makes typing fast: well under one report per character
+static void test_reports_per_character(void)
+{
+    static const char text[] = "The quick brown fox jumps over the lazy dog";
+    typing_t t;
+    uint8_t report[TYPING_REPORT_LEN];
+    int reports = 0;
+    typing_init(&t, text);
+    while (typing_next_report(&t, report))
+        reports++;
+    CHECK_EQ(reports, 19);
+    CHECK(reports * 2 < (int)sizeof(text) - 1);
+}
+
+int main(void)
+{
+    keycodes_set_layout(&keyboard_layout_us);
+    TEST_RUN(test_distinct_keys_share_a_report);
+    TEST_RUN(test_repeated_key_is_released_between);
+    TEST_RUN(test_modifier_goes_down_first);
+    TEST_RUN(test_report_holds_at_most_six_keys);
+    TEST_RUN(test_unmapped_characters_are_skipped);
+    TEST_RUN(test_reports_per_character);
+    return TEST_EXIT();
+}
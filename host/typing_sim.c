@@ -0,0 +1,117 @@
+// Reports per character and effective typing speed of typing.c:
+//
+//   build_host/hid_typing "Hello, world!" [-i US] [-n N]
+//   build_host/hid_typing -i 7500 -n 4 < text.txt
+//
+// Each string (an argument, or each line of stdin) is turned into keyboard
+// reports exactly as the macro VM types it. hid_tx.c hands reports to the
+// stack as fast as notification credits allow, so the link drains at most
+// -n reports per connection event of -i microseconds; the typing time is the
+// number of connection events needed. The "legacy" column is the previous
+// one-key-per-report scheme: press, 20 ms, release, 50 ms per character.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include "typing.h"
+#include "keycodes.h"
+#include "tx_flow.h"
+
+#define LEGACY_CHAR_US ((20 + 50) * 1000)
+
+static struct
+{
+    uint32_t conn_interval_us;
+    uint32_t per_event;
+} s_cfg = {
+    .conn_interval_us = 15000,
+    .per_event = TX_FLOW_DEFAULT_CREDITS,
+};
+
+static uint64_t s_total_chars;
+static uint64_t s_total_reports;
+static uint64_t s_total_us;
+
+static void simulate(const char *text)
+{
+    typing_t t;
+    uint8_t report[TYPING_REPORT_LEN];
+    uint32_t reports = 0, chars = 0;
+    for (const char *p = text; *p; p++)
+        chars += ascii_to_keycode(*p) != 0;
+
+    typing_init(&t, text);
+    while (typing_next_report(&t, report))
+        reports++;
+    if (chars == 0)
+        return;
+
+    uint64_t events = (reports + s_cfg.per_event - 1) / s_cfg.per_event;
+    uint64_t us = events * s_cfg.conn_interval_us;
+    printf("%6" PRIu32 " %8" PRIu32 " %8.2f %7" PRIu64 " %9.1f %9.1f  %.40s\n", chars, reports,
+           (double)reports / chars, events, chars * 1e6 / us, 1e6 / LEGACY_CHAR_US, text);
+    s_total_chars += chars;
+    s_total_reports += reports;
+    s_total_us += us;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: hid_typing [options] [text ...]   (lines of stdin without text)\n"
+            "  -i US   connection interval (%" PRIu32 ")\n"
+            "  -n N    notifications per connection event (%" PRIu32 ")\n"
+            "  -L uk   keyboard layout (us)\n",
+            s_cfg.conn_interval_us, s_cfg.per_event);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:L:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            s_cfg.conn_interval_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            s_cfg.per_event = strtoul(optarg, NULL, 0);
+            break;
+        case 'L':
+            keycodes_set_layout(strcmp(optarg, "uk") == 0 ? &keyboard_layout_uk : &keyboard_layout_us);
+            break;
+        default:
+            usage();
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (!s_cfg.conn_interval_us || !s_cfg.per_event)
+    {
+        usage();
+        return 2;
+    }
+
+    printf("# interval %" PRIu32 " us, %" PRIu32 " reports per connection event\n", s_cfg.conn_interval_us,
+           s_cfg.per_event);
+    printf("%6s %8s %8s %7s %9s %9s  %s\n", "chars", "reports", "rep/chr", "events", "chars/s", "legacy", "text");
+    if (optind < argc)
+    {
+        for (int i = optind; i < argc; i++)
+            simulate(argv[i]);
+    }
+    else
+    {
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin))
+        {
+            line[strcspn(line, "\r\n")] = 0;
+            simulate(line);
+        }
+    }
+    if (s_total_chars && s_total_us)
+        printf("# total %" PRIu64 " chars, %.2f reports/char, %.1f chars/s\n", s_total_chars,
+               (double)s_total_reports / s_total_chars, s_total_chars * 1e6 / s_total_us);
+    return 0;
+}
@@ -2,108 +2,240 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/timers.h"
 #include "global.h"
+#include "input.h"
 #include "driver/gpio.h"
+#include "hal/gpio_ll.h"
+#include "esp_attr.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "esp_rom_sys.h"
 #include "esp_timer.h"
 #include "esp_log.h"
+#include "power.h"
+#include "trace.h"
 
 #define NUM_BUTTONS 5
 #define TOTAL_BUTTONS 5
 #define LONG_PRESS_THRESHOLD 1000 * 500 // 0.5 second in microseconds
-#define DEBOUNCE_TIME_MS 50
+#define DEBOUNCE_TIME_MS 5
+#define DEBOUNCE_ALGO DEBOUNCE_EAGER
+
+// CONFIG_HID_KEY_MATRIX scans matrix_rows[] x matrix_cols[] instead of gpio_pins[]
+#if CONFIG_HID_KEY_MATRIX
+#define MATRIX_ROWS 3
+#define MATRIX_COLS 3
+#else
+#define MATRIX_ROWS 0
+#define MATRIX_COLS 0
+#endif
+#define MATRIX_SETTLE_US 2
+
+// With power management the scan timer parks once every key has been up this
+// long, so the chip can light sleep; a key going low wakes it and the scan
+#if CONFIG_PM_ENABLE
+#define SCAN_PARK_TICKS (CONFIG_HID_SCAN_PARK_MS * 1000 / SCAN_PERIOD_US)
+#endif
+
+#if MATRIX_ROWS > 0
+#define NUM_KEYS (MATRIX_ROWS * MATRIX_COLS)
+#else
+#define NUM_KEYS NUM_BUTTONS
+#endif
 
 static const char *BUTTON_TAG = "BUTTON";
-typedef struct
-{
-    gpio_num_t gpio;
-    char id_char;
-    int64_t press_time_us;
-    TaskHandle_t task_handle;
-} button_t;
 
 // === CONFIGURATION ===
+#if MATRIX_ROWS > 0
+const gpio_num_t matrix_rows[MATRIX_ROWS] = {GPIO_NUM_6, GPIO_NUM_7, GPIO_NUM_8};
+const gpio_num_t matrix_cols[MATRIX_COLS] = {GPIO_NUM_9, GPIO_NUM_10, GPIO_NUM_11};
+// Row major: key r * MATRIX_COLS + c
+const char button_chars[NUM_KEYS] = {'u', 'r', 'd', 'l', 'c', '1', '2', '3', '4'};
+#else
 const gpio_num_t gpio_pins[TOTAL_BUTTONS] = {GPIO_NUM_1, GPIO_NUM_2, GPIO_NUM_3, GPIO_NUM_4, GPIO_NUM_5};
-const char button_chars[TOTAL_BUTTONS] = {'u', 'r', 'd', 'l', 'c'};
-
-button_t buttons[NUM_BUTTONS];
+const char button_chars[NUM_KEYS] = {'u', 'r', 'd', 'l', 'c'};
+#endif
+
+static input_t button_input;
+static esp_timer_handle_t button_scan_timer;
+#if CONFIG_PM_ENABLE
+static uint64_t wake_pins;
+static uint32_t quiet_ticks;
+#if MATRIX_ROWS > 0
+static volatile bool scan_parked;
+#endif
+#endif
+
+// === GPIO backend: all inputs are latched with two register reads ===
+static inline uint64_t gpio_read_all(void)
+{
+    return (uint64_t)REG_READ(GPIO_IN_REG) | ((uint64_t)REG_READ(GPIO_IN1_REG) << 32);
+}
 
-// === ISR: Notify on both edges ===
-static void IRAM_ATTR button_isr_handler(void *arg)
+static scan_mask_t button_gpio_read(void *ctx)
 {
-    gpio_num_t gpio_num = (gpio_num_t)(int)arg;
-    for (int i = 0; i < NUM_BUTTONS; i++)
+    scan_mask_t down = 0;
+#if MATRIX_ROWS > 0
+#if CONFIG_PM_ENABLE
+    if (scan_parked)
+    {
+        // All rows were driven low so any key could wake us; release them first
+        scan_parked = false;
+        for (int r = 0; r < MATRIX_ROWS; r++)
+            gpio_set_level(matrix_rows[r], 1);
+        esp_rom_delay_us(MATRIX_SETTLE_US);
+    }
+#endif
+    for (int r = 0; r < MATRIX_ROWS; r++)
     {
-        if (buttons[i].gpio == gpio_num)
+        gpio_set_level(matrix_rows[r], 0);
+        esp_rom_delay_us(MATRIX_SETTLE_US);
+        uint64_t in = gpio_read_all();
+        gpio_set_level(matrix_rows[r], 1);
+        for (int c = 0; c < MATRIX_COLS; c++)
         {
-            int level = gpio_get_level(gpio_num);
-            int64_t now = esp_timer_get_time();
-
-            if (level == 0)
-            {
-                buttons[i].press_time_us = now;
-            }
-            else
-            {
-                BaseType_t hpTaskWoken = pdFALSE;
-                vTaskNotifyGiveFromISR(buttons[i].task_handle, &hpTaskWoken);
-                if (hpTaskWoken)
-                    portYIELD_FROM_ISR();
-            }
-            break;
+            // Active low: a pressed key pulls its column to the driven row
+            if (!((in >> matrix_cols[c]) & 1))
+                down |= (scan_mask_t)1 << (r * MATRIX_COLS + c);
         }
     }
+#else
+    uint64_t in = gpio_read_all();
+    for (int i = 0; i < NUM_BUTTONS; i++)
+    {
+        if (!((in >> gpio_pins[i]) & 1))
+            down |= (scan_mask_t)1 << i;
+    }
+#endif
+#if CONFIG_HID_TRACE
+    for (scan_mask_t changed = down ^ button_input.raw; changed; changed &= changed - 1)
+        TRACE_POINT(TRACE_RAW_EDGE, (uint8_t)__builtin_ctzll(changed));
+#endif
+    return down;
 }
 
-// === Button press handling task ===
-void button_task(void *arg)
+// === Clock and queue backends of the input pipeline ===
+static int64_t button_clock(void *ctx)
 {
-    button_t *btn = (button_t *)arg;
+    return esp_timer_get_time();
+}
 
-    while (1)
-    {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+static bool button_push(void *ctx, const button_event_t *evt)
+{
+    if (evt->kind != BUTTON_EVT_HOLD)
+        TRACE_POINT(TRACE_DEBOUNCED, evt->key);
+    return button_queue_send(evt);
+}
+
+#if CONFIG_PM_ENABLE
+// Runs in the timer service task; esp_timer cannot be started from an ISR
+static void button_scan_resume(void *arg, uint32_t unused)
+{
+    esp_timer_start_periodic(button_scan_timer, SCAN_PERIOD_US);
+}
 
-        // Debounce: wait and confirm release
-        vTaskDelay(pdMS_TO_TICKS(DEBOUNCE_TIME_MS));
-        if (gpio_get_level(btn->gpio) != 1)
-            continue;
+// A wake pin went low: the level interrupt is masked again and scanning resumes
+static void IRAM_ATTR button_wake_isr(void *arg)
+{
+    for (uint64_t pins = wake_pins; pins; pins &= pins - 1)
+        gpio_ll_intr_disable(&GPIO, __builtin_ctzll(pins));
+    BaseType_t woken = pdFALSE;
+    xTimerPendFunctionCallFromISR(button_scan_resume, NULL, 0, &woken);
+    if (woken)
+        portYIELD_FROM_ISR();
+}
 
-        int64_t release_time = esp_timer_get_time();
-        int64_t duration = release_time - btn->press_time_us;
+static void button_scan_park(void)
+{
+    esp_timer_stop(button_scan_timer);
+#if MATRIX_ROWS > 0
+    scan_parked = true;
+    for (int r = 0; r < MATRIX_ROWS; r++)
+        gpio_set_level(matrix_rows[r], 0);
+#endif
+    // Level triggered, so a key pressed while parking fires right away
+    for (uint64_t pins = wake_pins; pins; pins &= pins - 1)
+        gpio_intr_enable((gpio_num_t)__builtin_ctzll(pins));
+}
+#endif
 
-        button_event_t evt = {
-            .id_char = btn->id_char,
-            .long_press = (duration >= LONG_PRESS_THRESHOLD)};
+static void button_scan_cb(void *arg)
+{
+    input_tick(&button_input);
 
-        xQueueSend(button_queue, &evt, 0);
+#if CONFIG_PM_ENABLE
+    quiet_ticks = input_idle(&button_input) ? quiet_ticks + 1 : 0;
+    if (quiet_ticks >= SCAN_PARK_TICKS)
+    {
+        quiet_ticks = 0;
+        button_scan_park();
     }
+#endif
 }
 
 void button_main(void)
 {
-    gpio_install_isr_service(0);
-
-    // Init all buttons
-    for (int i = 0; i < NUM_BUTTONS; i++)
+#if MATRIX_ROWS > 0
+    for (int r = 0; r < MATRIX_ROWS; r++)
     {
-        buttons[i].gpio = gpio_pins[i];
-        buttons[i].id_char = button_chars[i];
-        buttons[i].press_time_us = 0;
-        // Configure button GPIO
-        gpio_config_t io_conf = {
-            .pin_bit_mask = (1ULL << buttons[i].gpio),
-            .mode = GPIO_MODE_INPUT,
-            .pull_up_en = GPIO_PULLUP_ENABLE,
+        gpio_config_t row_conf = {
+            .pin_bit_mask = (1ULL << matrix_rows[r]),
+            .mode = GPIO_MODE_OUTPUT_OD,
+            .pull_up_en = GPIO_PULLUP_DISABLE,
             .pull_down_en = GPIO_PULLDOWN_DISABLE,
-            .intr_type = GPIO_INTR_ANYEDGE // Detect press + release
-        };
-        gpio_config(&io_conf);
-
-        xTaskCreate(button_task, "button_task", 2048, &buttons[i], 10, &buttons[i].task_handle);
-
-        // Register ISR
-        gpio_isr_handler_add(buttons[i].gpio, button_isr_handler, (void *)(int)buttons[i].gpio);
+            .intr_type = GPIO_INTR_DISABLE};
+        gpio_config(&row_conf);
+        gpio_set_level(matrix_rows[r], 1);
+    }
+    uint64_t input_mask = 0;
+    for (int c = 0; c < MATRIX_COLS; c++)
+        input_mask |= 1ULL << matrix_cols[c];
+#else
+    uint64_t input_mask = 0;
+    for (int i = 0; i < NUM_BUTTONS; i++)
+        input_mask |= 1ULL << gpio_pins[i];
+#endif
+
+    // Configure all key inputs in one go, the scan timer polls them
+    gpio_config_t io_conf = {
+        .pin_bit_mask = input_mask,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE};
+    gpio_config(&io_conf);
+
+    const input_config_t input_cfg = {
+        .num_keys = NUM_KEYS,
+        .debounce_algo = DEBOUNCE_ALGO,
+        .debounce_ticks = DEBOUNCE_TIME_MS * 1000 / SCAN_PERIOD_US,
+        .long_press_us = LONG_PRESS_THRESHOLD,
+        .key_chars = button_chars,
+        .gpio = {.read = button_gpio_read},
+        .clock = {.now_us = button_clock},
+        .queue = {.push = button_push}};
+    input_init(&button_input, &input_cfg);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = button_scan_cb,
+        .name = "button_scan",
+        .skip_unhandled_events = true};
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &button_scan_timer));
+
+#if CONFIG_PM_ENABLE
+    // Matrix columns or the direct key pins, whichever the scan reads
+    wake_pins = input_mask;
+    ESP_ERROR_CHECK(power_enable_gpio_wakeup(wake_pins));
+    ESP_ERROR_CHECK(gpio_install_isr_service(ESP_INTR_FLAG_IRAM));
+    for (uint64_t pins = wake_pins; pins; pins &= pins - 1)
+    {
+        gpio_num_t pin = (gpio_num_t)__builtin_ctzll(pins);
+        gpio_intr_disable(pin);
+        gpio_isr_handler_add(pin, button_wake_isr, NULL);
     }
+#endif
+    ESP_ERROR_CHECK(esp_timer_start_periodic(button_scan_timer, SCAN_PERIOD_US));
 
-    ESP_LOGI(BUTTON_TAG, " Buttons with queue initialized");
+    ESP_LOGI(BUTTON_TAG, " Scan engine initialized for %d keys", NUM_KEYS);
 }
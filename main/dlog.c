@@ -0,0 +1,119 @@
+#include "dlog.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+
+static const char *TAG = "DLOG";
+
+#if CONFIG_HID_DLOG
+
+#define DLOG_RING_LEN CONFIG_HID_DLOG_RING_LEN
+#define DLOG_DRAIN_MS 20
+#define DLOG_LINE_LEN 192
+_Static_assert((DLOG_RING_LEN & (DLOG_RING_LEN - 1)) == 0, "dlog ring length must be a power of two");
+
+static dlog_slot_t s_slots[DLOG_RING_LEN];
+// Set up statically so entries written before dlog_start are kept
+static dlog_ring_t s_ring = {.slots = s_slots, .mask = DLOG_RING_LEN - 1};
+
+// Any task or ISR may write, see dlog_ring_write
+void dlog_write(uint8_t level, const char *tag, const char *fmt, int nargs, const uint32_t *args)
+{
+    dlog_ring_write(&s_ring, (uint32_t)esp_timer_get_time(), level, tag, fmt, nargs, args);
+}
+
+static void dlog_print(const dlog_entry_t *e)
+{
+    // Entries are at most a few drain periods old, so the high bits of the
+    // timestamp come from the current time
+    int64_t now = esp_timer_get_time();
+    int64_t t_us = now - (uint32_t)((uint32_t)now - e->t_us);
+#if CONFIG_HID_DLOG_HOST_FORMAT
+    printf("DLOG %" PRId64 " %u %08" PRIx32 " %08" PRIx32, t_us, e->level, (uint32_t)(uintptr_t)e->tag, (uint32_t)(uintptr_t)e->fmt);
+    for (int i = 0; i < e->nargs; i++)
+        printf(" %" PRIx32, e->args[i]);
+    printf("\n");
+#else
+    char line[DLOG_LINE_LEN];
+    dlog_format(e, line, sizeof(line));
+    esp_log_write(e->level, e->tag, "%c (%" PRIu32 ") %s: %s\n", "NEWIDV"[e->level],
+                  (uint32_t)(t_us / 1000), e->tag, line);
+#endif
+}
+
+static void dlog_task(void *arg)
+{
+    uint32_t reported = 0;
+    dlog_entry_t e;
+    while (1)
+    {
+        while (dlog_ring_pop(&s_ring, &e))
+            dlog_print(&e);
+        uint32_t dropped = atomic_load_explicit(&s_ring.dropped, memory_order_relaxed);
+        if (dropped != reported)
+        {
+            ESP_LOGW(TAG, "%" PRIu32 " entries dropped", dropped - reported);
+            reported = dropped;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+    }
+}
+
+void dlog_start(void)
+{
+    xTaskCreate(dlog_task, "dlog", 3072, NULL, tskIDLE_PRIORITY + 1, NULL);
+#if CONFIG_HID_DLOG_BENCHMARK
+    dlog_benchmark();
+#endif
+}
+
+dlog_stats_t dlog_get_stats(void)
+{
+    dlog_stats_t stats = {
+        .written = atomic_load_explicit(&s_ring.head, memory_order_relaxed),
+        .dropped = atomic_load_explicit(&s_ring.dropped, memory_order_relaxed),
+    };
+    return stats;
+}
+
+#define DLOG_BENCH_CALLS 16
+
+void dlog_benchmark(void)
+{
+    // Same message both ways, shaped like the GAP event logs
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < DLOG_BENCH_CALLS; i++)
+        DLOGI(TAG, "bench %d; conn_handle=%d status=%d", i, 1, 0);
+    uint32_t dlog_cycles = (esp_cpu_get_cycle_count() - start) / DLOG_BENCH_CALLS;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < DLOG_BENCH_CALLS; i++)
+        ESP_LOGI(TAG, "bench %d; conn_handle=%d status=%d", i, 1, 0);
+    uint32_t esp_log_cycles = (esp_cpu_get_cycle_count() - start) / DLOG_BENCH_CALLS;
+
+    ESP_LOGI(TAG, "cycles per call: DLOGI %" PRIu32 ", ESP_LOGI %" PRIu32, dlog_cycles, esp_log_cycles);
+}
+
+#else
+
+void dlog_start(void)
+{
+}
+
+dlog_stats_t dlog_get_stats(void)
+{
+    dlog_stats_t stats = {0};
+    return stats;
+}
+
+void dlog_benchmark(void)
+{
+    ESP_LOGW(TAG, "deferred logging is disabled (CONFIG_HID_DLOG)");
+}
+
+#endif
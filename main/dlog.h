@@ -0,0 +1,70 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "dlog_ring.h"
+
+// Deferred logging for hot paths (GAP events, the HID task, NOTIFY_TX).
+// A call stores the format string's address, the tag's address and up to
+// DLOG_MAX_ARGS raw 32 bit arguments into a lock-free ring (dlog_ring.h); a
+// low priority task formats and prints them later. Format strings and %s
+// arguments must point to static storage (literals, const tables); arguments
+// wider than 32 bits are not supported. Without CONFIG_HID_DLOG the macros
+// are plain ESP_LOG.
+
+typedef struct
+{
+    uint32_t written;
+    uint32_t dropped; // ring full, the drain task fell behind
+} dlog_stats_t;
+
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define DLOG_ARGS(...) DLOG_ARGS_N(DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+#define DLOG_ARGS_N(n, ...) DLOG_ARGS_CAT(DLOG_ARGS_, n)(__VA_ARGS__)
+#define DLOG_ARGS_CAT(a, b) a##b
+#define DLOG_U32(x) ((uint32_t)(uintptr_t)(x))
+#define DLOG_ARGS_0() 0
+#define DLOG_ARGS_1(a) DLOG_U32(a)
+#define DLOG_ARGS_2(a, b) DLOG_ARGS_1(a), DLOG_U32(b)
+#define DLOG_ARGS_3(a, b, c) DLOG_ARGS_2(a, b), DLOG_U32(c)
+#define DLOG_ARGS_4(a, b, c, d) DLOG_ARGS_3(a, b, c), DLOG_U32(d)
+#define DLOG_ARGS_5(a, b, c, d, e) DLOG_ARGS_4(a, b, c, d), DLOG_U32(e)
+#define DLOG_ARGS_6(a, b, c, d, e, f) DLOG_ARGS_5(a, b, c, d, e), DLOG_U32(f)
+#define DLOG_ARGS_7(a, b, c, d, e, f, g) DLOG_ARGS_6(a, b, c, d, e, f), DLOG_U32(g)
+#define DLOG_ARGS_8(a, b, c, d, e, f, g, h) DLOG_ARGS_7(a, b, c, d, e, f, g), DLOG_U32(h)
+
+#if CONFIG_HID_DLOG
+void dlog_write(uint8_t level, const char *tag, const char *fmt, int nargs, const uint32_t *args);
+
+// `if (0) printf` keeps the compiler's format checking without evaluating anything twice
+#define DLOG(level, tag, fmt, ...)                                                             \
+    do                                                                                         \
+    {                                                                                          \
+        if (LOG_LOCAL_LEVEL >= (level))                                                        \
+            dlog_write((level), (tag), (fmt), DLOG_NARGS(__VA_ARGS__),                         \
+                       (const uint32_t[]){DLOG_ARGS(__VA_ARGS__)});                            \
+        if (0)                                                                                 \
+            printf((fmt), ##__VA_ARGS__);                                                      \
+    } while (0)
+#else
+#define DLOG(level, tag, fmt, ...) ESP_LOG_LEVEL_LOCAL((level), (tag), fmt, ##__VA_ARGS__)
+#endif
+
+#define DLOGE(tag, fmt, ...) DLOG(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...) DLOG(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+// Starts the drain task; entries written before it runs wait in the ring
+void dlog_start(void);
+
+dlog_stats_t dlog_get_stats(void);
+
+// Times DLOGI against ESP_LOGI on the same message and logs cycles per call
+void dlog_benchmark(void);
+
+#endif
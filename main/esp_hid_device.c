@@ -17,6 +17,7 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
 #include "esp_bt.h"
 
 #include "host/ble_hs.h"
@@ -25,8 +26,20 @@
 
 #include "esp_hidd.h"
 #include "esp_hid_gap.h"
+#include "esp_hid_device.h"
 #include "store/config/ble_store_config.h"
 #include "global.h"
+#include "keycodes.h"
+#include "typing.h"
+#include "hid_tx.h"
+#include "macros.h"
+#include "keystore.h"
+#include "layer.h"
+#include "hid_report.h"
+#include "mouse_keys.h"
+#include "scroll.h"
+#include "trace.h"
+#include "dlog.h"
 
 static const char *TAG = "HID_DEV_DEMO";
 
@@ -41,15 +54,23 @@ int counter = 0;
 
 static local_param_t s_ble_hid_param = {0};
 
+// Reports built by the core library go out through the transmit task;
+// keyboard reports keep their order with text macros, the rest preempt them
+static bool hid_sink_send(void *ctx, uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    bool keyboard = report_id == HID_REPORT_ID_KEYBOARD || report_id == HID_REPORT_ID_NKRO;
+    hid_tx_prio_t prio = keyboard ? HID_TX_PRIO_NORMAL : HID_TX_PRIO_HIGH;
+    return hid_tx_send_report(report_id, data, len, prio);
+}
+
+static hid_report_t s_report;
+static volatile hid_mouse_feature_t s_scroll_feature; // Resolution Multipliers written by the host
+static volatile bool s_boot_protocol;                  // host switched to boot protocol, 6-key reports only
+
 // send the buttons, change in x, and change in y
 void send_mouse(uint8_t buttons, char dx, char dy, char wheel)
 {
-    static uint8_t buffer[4] = {0};
-    buffer[0] = buttons;
-    buffer[1] = dx;
-    buffer[2] = dy;
-    buffer[3] = wheel;
-    esp_hidd_dev_input_set(s_ble_hid_param.hid_dev, 0, 0, buffer, 4);
+    hid_report_mouse(&s_report, buttons, dx, dy, wheel, 0);
 }
 
 void ble_hid_demo_task_mouse(void *pvParameters)
@@ -100,236 +121,17 @@ void ble_hid_demo_task_mouse(void *pvParameters)
     }
 }
 
-#define CASE(a, b, c)  \
-    case a:            \
-        buffer[0] = b; \
-        buffer[2] = c; \
-        break;
-
-// USB keyboard codes
-#define USB_HID_MODIFIER_LEFT_CTRL 0x01
-#define USB_HID_MODIFIER_LEFT_SHIFT 0x02
-#define USB_HID_MODIFIER_LEFT_ALT 0x04
-#define USB_HID_MODIFIER_RIGHT_CTRL 0x10
-#define USB_HID_MODIFIER_RIGHT_SHIFT 0x20
-#define USB_HID_MODIFIER_RIGHT_ALT 0x40
-
-#define USB_HID_SPACE 0x2C
-#define USB_HID_DOT 0x37
-#define USB_HID_NEWLINE 0x28
-#define USB_HID_FSLASH 0x38
-#define USB_HID_BSLASH 0x31
-#define USB_HID_COMMA 0x36
-#define USB_HID_DOT 0x37
-
-const unsigned char keyboardReportMap[] = {
-    // -------------------------------------------------
-    // Keyboard (Report ID 1)
-    0x05, 0x01, // Usage Page (Generic Desktop)
-    0x09, 0x06, // Usage (Keyboard)
-    0xA1, 0x01, // Collection (Application)
-    0x85, 0x01, //   Report ID (1)
-    0x05, 0x07, //   Usage Page (Keyboard/Keypad)
-    0x19, 0xE0, //   Usage Minimum (224)
-    0x29, 0xE7, //   Usage Maximum (231)
-    0x15, 0x00, //   Logical Minimum (0)
-    0x25, 0x01, //   Logical Maximum (1)
-    0x75, 0x01, //   Report Size (1)
-    0x95, 0x08, //   Report Count (8)
-    0x81, 0x02, //   Input (Data, Variable, Absolute) ; Modifiers
-    0x75, 0x08,
-    0x95, 0x01,
-    0x81, 0x01, //   Input (Constant) ; Reserved
-    0x75, 0x08,
-    0x95, 0x06,
-    0x15, 0x00,
-    0x25, 0x65,
-    0x05, 0x07,
-    0x19, 0x00,
-    0x29, 0x65,
-    0x81, 0x00, //   Input (Data, Array) ; Keycodes
-    0xC0,       // End Collection
-
-    0x05, 0x01, // USAGE_PAGE (Generic Desktop)
-    0x09, 0x02, // USAGE (Mouse)
-    0xa1, 0x01, // COLLECTION (Application)
-
-    0x09, 0x01, //   USAGE (Pointer)
-    0xa1, 0x00, //   COLLECTION (Physical)
-
-    0x05, 0x09, //     USAGE_PAGE (Button)
-    0x19, 0x01, //     USAGE_MINIMUM (Button 1)
-    0x29, 0x03, //     USAGE_MAXIMUM (Button 3)
-    0x15, 0x00, //     LOGICAL_MINIMUM (0)
-    0x25, 0x01, //     LOGICAL_MAXIMUM (1)
-    0x95, 0x03, //     REPORT_COUNT (3)
-    0x75, 0x01, //     REPORT_SIZE (1)
-    0x81, 0x02, //     INPUT (Data,Var,Abs)
-    0x95, 0x01, //     REPORT_COUNT (1)
-    0x75, 0x05, //     REPORT_SIZE (5)
-    0x81, 0x03, //     INPUT (Cnst,Var,Abs)
-
-    0x05, 0x01, //     USAGE_PAGE (Generic Desktop)
-    0x09, 0x30, //     USAGE (X)
-    0x09, 0x31, //     USAGE (Y)
-    0x09, 0x38, //     USAGE (Wheel)
-    0x15, 0x81, //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f, //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08, //     REPORT_SIZE (8)
-    0x95, 0x03, //     REPORT_COUNT (3)
-    0x81, 0x06, //     INPUT (Data,Var,Rel)
-
-    0xc0, //   END_COLLECTION
-    0xc0, // END_COLLECTION
-
-    // -------------------------------------------------
-    // Media Control (Report ID 3) — as provided
-    0x05,
-    0x0C,       // Usage Page (Consumer)
-    0x09, 0x01, // Usage (Consumer Control)
-    0xA1, 0x01, // Collection (Application)
-    0x85, 0x03, //   Report ID (3)
-    0x09, 0x02, //   Usage (Numeric Key Pad)
-    0xA1, 0x02, //   Collection (Logical)
-    0x05, 0x09,
-    0x19, 0x01,
-    0x29, 0x0A,
-    0x15, 0x01,
-    0x25, 0x0A,
-    0x75, 0x04,
-    0x95, 0x01,
-    0x81, 0x00,
-    0xC0,
-    0x05, 0x0C,
-    0x09, 0x86,
-    0x15, 0xFF,
-    0x25, 0x01,
-    0x75, 0x02,
-    0x95, 0x01,
-    0x81, 0x46,
-    0x09, 0xE9,
-    0x09, 0xEA,
-    0x15, 0x00,
-    0x75, 0x01,
-    0x95, 0x02,
-    0x81, 0x02,
-    0x09, 0xE2,
-    0x09, 0x30,
-    0x09, 0x83,
-    0x09, 0x81,
-    0x09, 0xB0,
-    0x09, 0xB1,
-    0x09, 0xB2,
-    0x09, 0xB3,
-    0x09, 0xB4,
-    0x09, 0xB5,
-    0x09, 0xB6,
-    0x09, 0xB7,
-    0x15, 0x01,
-    0x25, 0x0C,
-    0x75, 0x04,
-    0x95, 0x01,
-    0x81, 0x00,
-    0x09, 0x80,
-    0xA1, 0x02,
-    0x05, 0x09,
-    0x19, 0x01,
-    0x29, 0x03,
-    0x15, 0x01,
-    0x25, 0x03,
-    0x75, 0x02,
-    0x81, 0x00,
-    0xC0,
-    0x81, 0x03,
-    0xC0};
-
-static void char_to_code(uint8_t *buffer, char ch)
-{
-    // Check if lower or upper case
-    if (ch >= 'a' && ch <= 'z')
-    {
-        buffer[0] = 0;
-        // convert ch to HID letter, starting at a = 4
-        buffer[2] = (uint8_t)(4 + (ch - 'a'));
-    }
-    else if (ch >= 'A' && ch <= 'Z')
-    {
-        // Add left shift
-        buffer[0] = USB_HID_MODIFIER_LEFT_SHIFT;
-        // convert ch to lower case
-        ch = ch - ('A' - 'a');
-        // convert ch to HID letter, starting at a = 4
-        buffer[2] = (uint8_t)(4 + (ch - 'a'));
-    }
-    else if (ch >= '0' && ch <= '9') // Check if number
-    {
-        buffer[0] = 0;
-        // convert ch to HID number, starting at 1 = 30, 0 = 39
-        if (ch == '0')
-        {
-            buffer[2] = 39;
-        }
-        else
-        {
-            buffer[2] = (uint8_t)(30 + (ch - '1'));
-        }
-    }
-    else // not a letter nor a number
-    {
-        switch (ch)
-        {
-            CASE(' ', 0, USB_HID_SPACE);
-            CASE('.', 0, USB_HID_DOT);
-            CASE('\n', 0, USB_HID_NEWLINE);
-            CASE('?', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_FSLASH);
-            CASE('/', 0, USB_HID_FSLASH);
-            CASE('\\', 0, USB_HID_BSLASH);
-            CASE('|', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_BSLASH);
-            CASE(',', 0, USB_HID_COMMA);
-            CASE('<', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_COMMA);
-            CASE('>', USB_HID_MODIFIER_LEFT_SHIFT, USB_HID_DOT);
-            CASE('@', USB_HID_MODIFIER_LEFT_SHIFT, 31);
-            CASE('!', USB_HID_MODIFIER_LEFT_SHIFT, 30);
-            CASE('#', USB_HID_MODIFIER_LEFT_SHIFT, 32);
-            CASE('$', USB_HID_MODIFIER_LEFT_SHIFT, 33);
-            CASE('%', USB_HID_MODIFIER_LEFT_SHIFT, 34);
-            CASE('^', USB_HID_MODIFIER_LEFT_SHIFT, 35);
-            CASE('&', USB_HID_MODIFIER_LEFT_SHIFT, 36);
-            CASE('*', USB_HID_MODIFIER_LEFT_SHIFT, 37);
-            CASE('(', USB_HID_MODIFIER_LEFT_SHIFT, 38);
-            CASE(')', USB_HID_MODIFIER_LEFT_SHIFT, 39);
-            CASE('-', 0, 0x2D);
-            CASE('_', USB_HID_MODIFIER_LEFT_SHIFT, 0x2D);
-            CASE('=', 0, 0x2E);
-            CASE('+', USB_HID_MODIFIER_LEFT_SHIFT, 39);
-            CASE(8, 0, 0x2A); // backspace
-            CASE('\t', 0, 0x2B);
-        default:
-            buffer[0] = 0;
-            buffer[2] = 0;
-        }
-    }
-}
+// Generated with the report structs from the definitions in hid_report.h
+const unsigned char keyboardReportMap[] = {HID_REPORT_DESCRIPTOR};
 
 void send_keyboard(char c)
 {
-    static uint8_t buffer[8] = {0};
-    char_to_code(buffer, c);
-    esp_hidd_dev_input_set(s_ble_hid_param.hid_dev, 0, 1, buffer, 8);
-    /* send the keyrelease event with sufficient delay */
-    vTaskDelay(20 / portTICK_PERIOD_MS);
-    memset(buffer, 0, sizeof(uint8_t) * 8);
-    esp_hidd_dev_input_set(s_ble_hid_param.hid_dev, 0, 1, buffer, 8);
+    hid_report_tap_char(&s_report, c);
 }
 
 void type_string(const char *text)
 {
-    while (*text)
-    {
-        send_keyboard(*text);
-        vTaskDelay(50 / portTICK_PERIOD_MS); // Delay between characters
-        text++;
-    }
+    hid_tx_type_text(text);
 }
 
 void ble_hid_demo_task_kbd(void *pvParameters)
@@ -371,176 +173,40 @@ static esp_hid_device_config_t ble_hid_config = {
     .report_maps = ble_report_maps,
     .report_maps_len = 1};
 
-#define HID_CC_RPT_MUTE 1
-#define HID_CC_RPT_POWER 2
-#define HID_CC_RPT_LAST 3
-#define HID_CC_RPT_ASSIGN_SEL 4
-#define HID_CC_RPT_PLAY 5
-#define HID_CC_RPT_PAUSE 6
-#define HID_CC_RPT_RECORD 7
-#define HID_CC_RPT_FAST_FWD 8
-#define HID_CC_RPT_REWIND 9
-#define HID_CC_RPT_SCAN_NEXT_TRK 10
-#define HID_CC_RPT_SCAN_PREV_TRK 11
-#define HID_CC_RPT_STOP 12
-
-#define HID_CC_RPT_CHANNEL_UP 0x10
-#define HID_CC_RPT_CHANNEL_DOWN 0x30
-#define HID_CC_RPT_VOLUME_UP 0x40
-#define HID_CC_RPT_VOLUME_DOWN 0x80
-
-// HID Consumer Control report bitmasks
-#define HID_CC_RPT_NUMERIC_BITS 0xF0
-#define HID_CC_RPT_CHANNEL_BITS 0xCF
-#define HID_CC_RPT_VOLUME_BITS 0x3F
-#define HID_CC_RPT_BUTTON_BITS 0xF0
-#define HID_CC_RPT_SELECTION_BITS 0xCF
-
-// Macros for the HID Consumer Control 2-byte report
-#define HID_CC_RPT_SET_NUMERIC(s, x)   \
-    (s)[0] &= HID_CC_RPT_NUMERIC_BITS; \
-    (s)[0] = (x)
-#define HID_CC_RPT_SET_CHANNEL(s, x)   \
-    (s)[0] &= HID_CC_RPT_CHANNEL_BITS; \
-    (s)[0] |= ((x) & 0x03) << 4
-#define HID_CC_RPT_SET_VOLUME_UP(s)   \
-    (s)[0] &= HID_CC_RPT_VOLUME_BITS; \
-    (s)[0] |= 0x40
-#define HID_CC_RPT_SET_VOLUME_DOWN(s) \
-    (s)[0] &= HID_CC_RPT_VOLUME_BITS; \
-    (s)[0] |= 0x80
-#define HID_CC_RPT_SET_BUTTON(s, x)   \
-    (s)[1] &= HID_CC_RPT_BUTTON_BITS; \
-    (s)[1] |= (x)
-#define HID_CC_RPT_SET_SELECTION(s, x)   \
-    (s)[1] &= HID_CC_RPT_SELECTION_BITS; \
-    (s)[1] |= ((x) & 0x03) << 4
-
-// HID Consumer Usage IDs (subset of the codes available in the USB HID Usage Tables spec)
-#define HID_CONSUMER_POWER 48 // Power
-#define HID_CONSUMER_RESET 49 // Reset
-#define HID_CONSUMER_SLEEP 50 // Sleep
-
-#define HID_CONSUMER_MENU 64          // Menu
-#define HID_CONSUMER_SELECTION 128    // Selection
-#define HID_CONSUMER_ASSIGN_SEL 129   // Assign Selection
-#define HID_CONSUMER_MODE_STEP 130    // Mode Step
-#define HID_CONSUMER_RECALL_LAST 131  // Recall Last
-#define HID_CONSUMER_QUIT 148         // Quit
-#define HID_CONSUMER_HELP 149         // Help
-#define HID_CONSUMER_CHANNEL_UP 156   // Channel Increment
-#define HID_CONSUMER_CHANNEL_DOWN 157 // Channel Decrement
-
-#define HID_CONSUMER_PLAY 176          // Play
-#define HID_CONSUMER_PAUSE 177         // Pause
-#define HID_CONSUMER_RECORD 178        // Record
-#define HID_CONSUMER_FAST_FORWARD 179  // Fast Forward
-#define HID_CONSUMER_REWIND 180        // Rewind
-#define HID_CONSUMER_SCAN_NEXT_TRK 181 // Scan Next Track
-#define HID_CONSUMER_SCAN_PREV_TRK 182 // Scan Previous Track
-#define HID_CONSUMER_STOP 183          // Stop
-#define HID_CONSUMER_EJECT 184         // Eject
-#define HID_CONSUMER_RANDOM_PLAY 185   // Random Play
-#define HID_CONSUMER_SELECT_DISC 186   // Select Disk
-#define HID_CONSUMER_ENTER_DISC 187    // Enter Disc
-#define HID_CONSUMER_REPEAT 188        // Repeat
-#define HID_CONSUMER_STOP_EJECT 204    // Stop/Eject
-#define HID_CONSUMER_PLAY_PAUSE 205    // Play/Pause
-#define HID_CONSUMER_PLAY_SKIP 206     // Play/Skip
-
-#define HID_CONSUMER_VOLUME 224      // Volume
-#define HID_CONSUMER_BALANCE 225     // Balance
-#define HID_CONSUMER_MUTE 226        // Mute
-#define HID_CONSUMER_BASS 227        // Bass
-#define HID_CONSUMER_VOLUME_UP 233   // Volume Increment
-#define HID_CONSUMER_VOLUME_DOWN 234 // Volume Decrement
-
-#define HID_RPT_ID_CC_IN 3  // Consumer Control input report ID
-#define HID_CC_IN_RPT_LEN 2 // Consumer Control input report Len
-void esp_hidd_send_consumer_value(uint8_t key_cmd, bool key_pressed)
-{
-    uint8_t buffer[HID_CC_IN_RPT_LEN] = {0, 0};
-    if (key_pressed)
-    {
-        switch (key_cmd)
-        {
-        case HID_CONSUMER_CHANNEL_UP:
-            HID_CC_RPT_SET_CHANNEL(buffer, HID_CC_RPT_CHANNEL_UP);
-            break;
-
-        case HID_CONSUMER_CHANNEL_DOWN:
-            HID_CC_RPT_SET_CHANNEL(buffer, HID_CC_RPT_CHANNEL_DOWN);
-            break;
-
-        case HID_CONSUMER_VOLUME_UP:
-            HID_CC_RPT_SET_VOLUME_UP(buffer);
-            break;
+// Consumer usages held in s_report belong to the button event task, which
+// also runs CONSUMER keymap actions: the transmit task posts macro steps
+// here instead of touching them, and the button task applies them in order
+#define CONSUMER_STEP_QUEUE_LEN 16
 
-        case HID_CONSUMER_VOLUME_DOWN:
-            HID_CC_RPT_SET_VOLUME_DOWN(buffer);
-            break;
-
-        case HID_CONSUMER_MUTE:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_MUTE);
-            break;
-
-        case HID_CONSUMER_POWER:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_POWER);
-            break;
-
-        case HID_CONSUMER_RECALL_LAST:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_LAST);
-            break;
-
-        case HID_CONSUMER_ASSIGN_SEL:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_ASSIGN_SEL);
-            break;
-
-        case HID_CONSUMER_PLAY:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_PLAY);
-            break;
-
-        case HID_CONSUMER_PAUSE:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_PAUSE);
-            break;
-
-        case HID_CONSUMER_RECORD:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_RECORD);
-            break;
-
-        case HID_CONSUMER_FAST_FORWARD:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_FAST_FWD);
-            break;
-
-        case HID_CONSUMER_REWIND:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_REWIND);
-            break;
-
-        case HID_CONSUMER_SCAN_NEXT_TRK:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_SCAN_NEXT_TRK);
-            break;
-
-        case HID_CONSUMER_SCAN_PREV_TRK:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_SCAN_PREV_TRK);
-            break;
+typedef struct
+{
+    uint16_t usage;
+    bool pressed;
+} consumer_step_t;
 
-        case HID_CONSUMER_STOP:
-            HID_CC_RPT_SET_BUTTON(buffer, HID_CC_RPT_STOP);
-            break;
+SPSC_RING_DEFINE(consumer_step_ring, consumer_step_t, CONSUMER_STEP_QUEUE_LEN)
+static consumer_step_ring_t s_consumer_steps;
 
-        default:
-            break;
-        }
-    }
-    esp_hidd_dev_input_set(s_ble_hid_param.hid_dev, 0, HID_RPT_ID_CC_IN, buffer, HID_CC_IN_RPT_LEN);
-    return;
+bool esp_hidd_send_consumer_value(uint16_t key_cmd, bool key_pressed)
+{
+    const consumer_step_t step = {.usage = key_cmd, .pressed = key_pressed};
+    if (!consumer_step_ring_push(&s_consumer_steps, &step))
+        return false;
+    TaskHandle_t handler = button_queue_consumer;
+    if (handler)
+        xTaskNotifyGive(handler);
+    return true;
 }
 
-void send_consumer_value(uint8_t key_cmd)
+static void consumer_steps_run(void)
 {
-    esp_hidd_send_consumer_value(key_cmd, true);
-    vTaskDelay(20 / portTICK_PERIOD_MS);
-    esp_hidd_send_consumer_value(key_cmd, false);
+    consumer_step_t step;
+    while (consumer_step_ring_pop(&s_consumer_steps, &step))
+    {
+        // A release whose press was refused fails as well; only report the press
+        if (!hid_report_consumer(&s_report, step.usage, step.pressed) && step.pressed)
+            DLOGW(TAG, "consumer usage 0x%x not sent: both slots held or queue full", step.usage);
+    }
 }
 
 void ble_hid_task_start_up(void)
@@ -563,24 +229,28 @@ static void ble_hidd_event_callback(void *handler_args, esp_event_base_t base, i
     {
     case ESP_HIDD_START_EVENT:
     {
-        ESP_LOGI(TAG, "START");
+        DLOGI(TAG, "START");
         esp_hid_ble_gap_adv_start();
         break;
     }
     case ESP_HIDD_CONNECT_EVENT:
     {
-        ESP_LOGI(TAG, "CONNECT");
+        DLOGI(TAG, "CONNECT");
         isDeviceConnected = true;
+        s_scroll_feature = (hid_mouse_feature_t){0}; // low resolution until the host sets the multipliers
+        s_boot_protocol = false;
         break;
     }
     case ESP_HIDD_PROTOCOL_MODE_EVENT:
     {
-        ESP_LOGI(TAG, "PROTOCOL MODE[%u]: %s", param->protocol_mode.map_index, param->protocol_mode.protocol_mode ? "REPORT" : "BOOT");
+        DLOGI(TAG, "PROTOCOL MODE[%u]: %s", param->protocol_mode.map_index, param->protocol_mode.protocol_mode ? "REPORT" : "BOOT");
+        // Picked up by the button event task before the next key
+        s_boot_protocol = param->protocol_mode.protocol_mode == ESP_HID_PROTOCOL_MODE_BOOT;
         break;
     }
     case ESP_HIDD_CONTROL_EVENT:
     {
-        ESP_LOGI(TAG, "CONTROL[%u]: %sSUSPEND", param->control.map_index, param->control.control ? "EXIT_" : "");
+        DLOGI(TAG, "CONTROL[%u]: %sSUSPEND", param->control.map_index, param->control.control ? "EXIT_" : "");
         if (param->control.control)
         {
             ble_hid_task_start_up();
@@ -593,27 +263,35 @@ static void ble_hidd_event_callback(void *handler_args, esp_event_base_t base, i
     }
     case ESP_HIDD_OUTPUT_EVENT:
     {
-        ESP_LOGI(TAG, "OUTPUT[%u]: %8s ID: %2u, Len: %d, Data:", param->output.map_index, esp_hid_usage_str(param->output.usage), param->output.report_id, param->output.length);
-        ESP_LOG_BUFFER_HEX(TAG, param->output.data, param->output.length);
+        DLOGI(TAG, "OUTPUT[%u]: %8s ID: %2u, Len: %u", (unsigned)param->output.map_index, esp_hid_usage_str(param->output.usage), param->output.report_id, (unsigned)param->output.length);
+        // The data buffer does not outlive the callback, so it cannot go through DLOG
+        ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->output.data, param->output.length, ESP_LOG_DEBUG);
         break;
     }
     case ESP_HIDD_FEATURE_EVENT:
     {
-        ESP_LOGI(TAG, "FEATURE[%u]: %8s ID: %2u, Len: %d, Data:", param->feature.map_index, esp_hid_usage_str(param->feature.usage), param->feature.report_id, param->feature.length);
-        ESP_LOG_BUFFER_HEX(TAG, param->feature.data, param->feature.length);
+        DLOGI(TAG, "FEATURE[%u]: %8s ID: %2u, Len: %u", (unsigned)param->feature.map_index, esp_hid_usage_str(param->feature.usage), param->feature.report_id, (unsigned)param->feature.length);
+        ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->feature.data, param->feature.length, ESP_LOG_DEBUG);
+        if (param->feature.report_id == HID_REPORT_ID_MOUSE && param->feature.length >= HID_REPORT_MOUSE_FEATURE_LEN)
+        {
+            // Picked up by the button event task on its next pointer tick
+            hid_mouse_feature_t feature;
+            memcpy(&feature, param->feature.data, sizeof(feature));
+            s_scroll_feature = feature;
+        }
         break;
     }
     case ESP_HIDD_DISCONNECT_EVENT:
     {
         isDeviceConnected = false;
-        ESP_LOGI(TAG, "DISCONNECT: %s", esp_hid_disconnect_reason_str(esp_hidd_dev_transport_get(param->disconnect.dev), param->disconnect.reason));
+        DLOGI(TAG, "DISCONNECT: %s", esp_hid_disconnect_reason_str(esp_hidd_dev_transport_get(param->disconnect.dev), param->disconnect.reason));
         ble_hid_task_shut_down();
         esp_hid_ble_gap_adv_start();
         break;
     }
     case ESP_HIDD_STOP_EVENT:
     {
-        ESP_LOGI(TAG, "STOP");
+        DLOGI(TAG, "STOP");
         break;
     }
     default:
@@ -632,31 +310,218 @@ void ble_hid_device_host_task(void *param)
 }
 
 // === Consumer task ===
+static keystore_t s_keystore;
+static layer_engine_t s_layers;
+
+// Mouse keys and scrolling: while either moves, a timer wakes the task once
+// per connection interval so each connection event carries one motion report
+#define POINTER_DEFAULT_INTERVAL_US 15000
+
+static mouse_keys_t s_mouse_keys;
+static scroll_t s_scroll;
+static esp_timer_handle_t s_pointer_timer;
+static uint32_t s_pointer_period_us; // 0 while the timer is stopped
+
+static void pointer_timer_cb(void *arg)
+{
+    xTaskNotifyGive(button_queue_consumer);
+}
+
+static bool pointer_active(void)
+{
+    return mouse_keys_active(&s_mouse_keys) || scroll_active(&s_scroll);
+}
+
+static void pointer_service(int64_t now)
+{
+    hid_mouse_feature_t feature = s_scroll_feature;
+    scroll_set_resolution(&s_scroll, HID_REPORT_MULTIPLIER(feature.wheel_multiplier), HID_REPORT_MULTIPLIER(feature.pan_multiplier));
+
+    int8_t dx, dy, wheel, pan;
+    bool moved = mouse_keys_tick(&s_mouse_keys, now, &dx, &dy);
+    bool scrolled = scroll_tick(&s_scroll, now, &wheel, &pan);
+    if (moved || scrolled)
+        hid_report_mouse_move(&s_report, dx, dy, wheel, pan);
+
+    uint32_t period = 0;
+    if (pointer_active())
+        period = conn_interval_us ? conn_interval_us : POINTER_DEFAULT_INTERVAL_US;
+    if (period == s_pointer_period_us)
+        return;
+    if (s_pointer_period_us)
+        esp_timer_stop(s_pointer_timer);
+    if (period)
+        esp_timer_start_periodic(s_pointer_timer, period);
+    s_pointer_period_us = period;
+}
+
+// Runs a keymap action on key-down (pressed) and key-up
+static void run_action(const keystore_action_t *action, bool pressed, void *ctx)
+{
+    if (hid_report_action(&s_report, action, pressed))
+        return;
+
+    switch (action->type)
+    {
+    case KEYSTORE_ACTION_MACRO:
+        if (pressed)
+        {
+            uint16_t len;
+            const uint8_t *code = keystore_macro(&s_keystore, action->arg1, &len);
+            if (code)
+                hid_tx_run_macro(code, len);
+        }
+        break;
+    case KEYSTORE_ACTION_MOUSE_MOVE:
+        mouse_keys_press(&s_mouse_keys, (uint8_t)action->arg1, pressed, esp_timer_get_time());
+        break;
+    case KEYSTORE_ACTION_SCROLL:
+        scroll_press(&s_scroll, (uint8_t)action->arg1, pressed, esp_timer_get_time());
+        break;
+    case KEYSTORE_ACTION_HOST:
+        if (pressed && action->arg0)
+            esp_hid_gap_forget_host((uint8_t)action->arg1);
+        else if (pressed)
+            esp_hid_gap_select_host((uint8_t)action->arg1);
+        break;
+    default:
+        break;
+    }
+}
+
+// Built-in actions when no keymap image is flashed: u/r/d/l move the pointer
+// and any other key clicks, with the long press macro on a long click
+static uint8_t builtin_direction(char id)
+{
+    switch (id)
+    {
+    case 'u':
+        return MOUSE_KEYS_UP;
+    case 'r':
+        return MOUSE_KEYS_RIGHT;
+    case 'd':
+        return MOUSE_KEYS_DOWN;
+    case 'l':
+        return MOUSE_KEYS_LEFT;
+    default:
+        return 0;
+    }
+}
+
+static uint64_t s_builtin_held; // built-in map keys whose long press has run
+
+static void handle_button_event(const button_event_t *evt)
+{
+    // Keymap keys still run while disconnected so a host switch key works;
+    // their reports are dropped by the transmit task
+    if (!isDeviceConnected && !s_keystore.base)
+    {
+        return;
+    }
+    esp_hid_gap_conn_activity();
+#if CONFIG_HID_NKRO
+    hid_report_set_nkro(&s_report, !s_boot_protocol);
+#endif
+    if (s_keystore.base)
+    {
+        if (evt->kind != BUTTON_EVT_HOLD)
+            layer_key(&s_layers, evt->key, evt->kind == BUTTON_EVT_DOWN, evt->time_us);
+        return;
+    }
+
+    // Other keys click on release, unless a hold ran the long-press macro
+    uint8_t dir = builtin_direction(evt->id_char);
+    uint64_t bit = 1ULL << evt->key;
+    switch (evt->kind)
+    {
+    case BUTTON_EVT_DOWN:
+        if (dir)
+            mouse_keys_press(&s_mouse_keys, dir, true, esp_timer_get_time());
+        s_builtin_held &= ~bit;
+        DLOGI(TAG, "Press on '%c'", evt->id_char);
+        break;
+    case BUTTON_EVT_HOLD:
+        if (dir)
+            break;
+        s_builtin_held |= bit;
+        hid_tx_run_macro(macro_long_press, sizeof(macro_long_press));
+        DLOGI(TAG, "Long press on '%c'", evt->id_char);
+        break;
+    case BUTTON_EVT_UP:
+        if (dir)
+        {
+            mouse_keys_press(&s_mouse_keys, dir, false, esp_timer_get_time());
+        }
+        else if (!(s_builtin_held & bit))
+        {
+            send_mouse(1, 0, 0, 0);
+            send_mouse(0, 0, 0, 0);
+        }
+        s_builtin_held &= ~bit;
+        break;
+    }
+}
+
+#define BUTTON_EVT_BATCH 8
+// Layers, mouse keys, the conn-param policy (ble_gap_update_params) and the
+// reconnect scheduler all run here; the high water mark is logged whenever it
+// drops so the size can be checked on hardware
+#define BUTTON_TASK_STACK 4096
+
 void button_event_handler_task(void *arg)
 {
-    button_event_t evt;
+    button_event_t evts[BUTTON_EVT_BATCH];
+    button_queue_consumer = xTaskGetCurrentTaskHandle();
+    layer_init(&s_layers, &s_keystore, run_action, NULL);
+    const mouse_keys_config_t mouse_cfg = MOUSE_KEYS_DEFAULT_CONFIG;
+    mouse_keys_init(&s_mouse_keys, &mouse_cfg);
+    const scroll_config_t scroll_cfg = SCROLL_DEFAULT_CONFIG;
+    scroll_init(&s_scroll, &scroll_cfg);
+    const esp_timer_create_args_t timer_args = {
+        .callback = pointer_timer_cb,
+        .name = "pointer"};
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_pointer_timer));
+    UBaseType_t stack_low = BUTTON_TASK_STACK;
     while (1)
     {
-        if (xQueueReceive(button_queue, &evt, portMAX_DELAY))
+        // Sleep until the next event, a pending tap-hold or a connection policy timer
+        TickType_t wait = portMAX_DELAY;
+        int64_t deadline = layer_next_deadline(&s_layers);
+        int64_t conn_deadline = esp_hid_gap_conn_tick();
+        if (conn_deadline < deadline)
+            deadline = conn_deadline;
+        if (deadline != INT64_MAX)
         {
-            UBaseType_t count = uxQueueMessagesWaiting(button_queue);
-            ESP_LOGI("QUEUE", "Items in queue: %u , event lpressed: %d on %c", count, evt.long_press, evt.id_char);
-            if (!isDeviceConnected)
-            {
-                continue;
-            }
-            if (evt.long_press)
-            {
-                type_string("Long Press!@#$%^&*()_+{}[]:;'\",.<>/?\n");
-                send_consumer_value(HID_CONSUMER_VOLUME_DOWN);
-                ESP_LOGI(TAG, "Long press on '%c'", evt.id_char);
-            }
-            else
+            int64_t remaining_us = deadline - esp_timer_get_time();
+            wait = remaining_us > 0 ? pdMS_TO_TICKS(remaining_us / 1000) + 1 : 0;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        uint32_t n;
+        while ((n = button_ring_pop_batch(&button_queue, evts, BUTTON_EVT_BATCH)) > 0)
+        {
+            DLOGD("QUEUE", "Items in queue: %" PRIu32 ", dropped: %" PRIu32,
+                  button_ring_size(&button_queue), button_ring_dropped(&button_queue));
+            for (uint32_t i = 0; i < n; i++)
             {
-                send_mouse(1, 20, 20, 0);
-                ESP_LOGI(TAG, "Short press on '%c'", evt.id_char);
+                if (evts[i].kind != BUTTON_EVT_HOLD)
+                    TRACE_POINT(TRACE_DEQUEUED, evts[i].key);
+                handle_button_event(&evts[i]);
             }
         }
+        consumer_steps_run();
+        // Queued edges carry their own timestamps, so timeouts are checked after them
+        int64_t now = esp_timer_get_time();
+        layer_tick(&s_layers, now);
+        if (s_pointer_period_us || pointer_active())
+            pointer_service(now);
+
+        UBaseType_t stack_free = uxTaskGetStackHighWaterMark(NULL);
+        if (stack_free < stack_low)
+        {
+            stack_low = stack_free;
+            DLOGI(TAG, "button task stack: %u of %u bytes never used", (unsigned)stack_free, BUTTON_TASK_STACK);
+        }
     }
 }
 
@@ -673,6 +538,8 @@ void esp_hid_device_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+    keystore_mount(&s_keystore);
+
     ESP_LOGI(TAG, "setting hid gap, mode:%d", HIDD_BLE_MODE);
     ret = esp_hid_gap_init(HIDD_BLE_MODE);
     ESP_ERROR_CHECK(ret);
@@ -683,6 +550,11 @@ void esp_hid_device_main(void)
     ESP_LOGI(TAG, "setting ble device");
     ESP_ERROR_CHECK(
         esp_hidd_dev_init(&ble_hid_config, ESP_HID_TRANSPORT_BLE, ble_hidd_event_callback, &s_ble_hid_param.hid_dev));
+    hid_tx_start(s_ble_hid_param.hid_dev);
+    const hal_hid_sink_t sink = {.send = hid_sink_send};
+    hid_report_init(&s_report, &sink);
+    consumer_step_ring_init(&s_consumer_steps);
+    trace_console_start();
     /* XXX Need to have template for store */
     ble_store_config_init();
 
@@ -694,5 +566,5 @@ void esp_hid_device_main(void)
         ESP_LOGE(TAG, "esp_nimble_enable failed: %d", ret);
     }
 
-    xTaskCreate(button_event_handler_task, "button_evt_handler", 2048, NULL, 10, NULL);
+    xTaskCreate(button_event_handler_task, "button_evt_handler", BUTTON_TASK_STACK, NULL, 10, NULL);
 }
@@ -0,0 +1,12 @@
+#ifndef ESP_HID_DEVICE_H
+#define ESP_HID_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Presses or releases a consumer control usage (HID_CONSUMER_* in hid_report.h).
+// Queued for the button event task, which owns the held usages; call it from
+// the transmit task only. Returns false when the queue is full.
+bool esp_hidd_send_consumer_value(uint16_t key_cmd, bool key_pressed);
+
+#endif
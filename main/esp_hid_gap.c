@@ -11,7 +11,15 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
-#include "util.h"
+#include "global.h"
+#include "conn_params.h"
+#include "hid_tx.h"
+#include "host_slots.h"
+#include "reconnect.h"
+#include "trace.h"
+#include "dlog.h"
+#include "esp_timer.h"
+#include "nvs.h"
 
 #include "esp_hid_gap.h"
 
@@ -39,10 +47,31 @@ static SemaphoreHandle_t ble_hidh_cb_semaphore = NULL;
 #define SIZEOF_ARRAY(a) (sizeof(a) / sizeof(*a))
 
 #define GATT_SVR_SVC_HID_UUID 0x1812
+#define HOSTS_NVS_NAMESPACE "hid_hosts"
 
 extern void ble_hid_task_start_up(void);
 static struct ble_hs_adv_fields fields;
 
+// GATT characteristic UUIDs of the HID input reports
+#define GATT_UUID_HID_REPORT 0x2A4D
+#define GATT_UUID_HID_BOOT_KB_INPUT 0x2A22
+#define GATT_UUID_HID_BOOT_MOUSE_INPUT 0x2A33
+
+// Hands the value handles of the notifying HID report characteristics to
+// hid_tx, so NOTIFY_TX for anything else (battery level) returns no credit
+static void gap_gatts_register(struct ble_gatt_register_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op != BLE_GATT_REGISTER_OP_CHR || !(ctxt->chr.chr_def->flags & BLE_GATT_CHR_F_NOTIFY))
+    {
+        return;
+    }
+    uint16_t uuid = ble_uuid_u16(ctxt->chr.chr_def->uuid);
+    if (uuid == GATT_UUID_HID_REPORT || uuid == GATT_UUID_HID_BOOT_KB_INPUT || uuid == GATT_UUID_HID_BOOT_MOUSE_INPUT)
+    {
+        hid_tx_add_report_handle(ctxt->chr.val_handle);
+    }
+}
+
 esp_err_t esp_hid_ble_gap_adv_init(uint16_t appearance, const char *device_name)
 {
     ble_uuid16_t *uuid16, *uuid16_1;
@@ -95,10 +124,271 @@ esp_err_t esp_hid_ble_gap_adv_init(uint16_t appearance, const char *device_name)
     ble_hs_cfg.sm_sc = 1;
     ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ID | BLE_SM_PAIR_KEY_DIST_ENC;
     ble_hs_cfg.sm_their_key_dist |= BLE_SM_PAIR_KEY_DIST_ID | BLE_SM_PAIR_KEY_DIST_ENC;
+    // Set before esp_hidd_dev_init() adds the HID service
+    ble_hs_cfg.gatts_register_cb = gap_gatts_register;
 
     return ESP_OK;
 }
 
+static conn_params_mgr_t s_conn_params;
+static SemaphoreHandle_t s_conn_params_lock = NULL;
+
+static int gap_request_conn_params(void *ctx, uint16_t conn_handle, const conn_params_t *p)
+{
+    struct ble_gap_upd_params params = {
+        .itvl_min = p->itvl_min,
+        .itvl_max = p->itvl_max,
+        .latency = p->latency,
+        .supervision_timeout = p->supervision_timeout,
+        .min_ce_len = 0,
+        .max_ce_len = 0,
+    };
+    int rc = ble_gap_update_params(conn_handle, &params);
+    DLOGI(TAG, "request conn params itvl %u-%u latency %u; rc=%d",
+          p->itvl_min, p->itvl_max, p->latency, rc);
+    return rc;
+}
+
+// Cache the negotiated interval so the send path can pace reports to it
+static bool gap_read_conn_params(uint16_t conn_handle, conn_params_t *granted)
+{
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(conn_handle, &desc) != 0)
+    {
+        return false;
+    }
+    conn_interval_us = (uint32_t)desc.conn_itvl * BLE_HCI_CONN_ITVL;
+    granted->itvl_min = desc.conn_itvl;
+    granted->itvl_max = desc.conn_itvl;
+    granted->latency = desc.conn_latency;
+    granted->supervision_timeout = desc.supervision_timeout;
+    DLOGI(TAG, "conn interval %" PRIu32 " us, latency %d", conn_interval_us, desc.conn_latency);
+    return true;
+}
+
+void esp_hid_gap_conn_activity(void)
+{
+    if (s_conn_params_lock == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(s_conn_params_lock, portMAX_DELAY);
+    conn_params_activity(&s_conn_params, esp_timer_get_time());
+    xSemaphoreGive(s_conn_params_lock);
+}
+
+int64_t esp_hid_gap_conn_tick(void)
+{
+    if (s_conn_params_lock == NULL)
+    {
+        return CONN_PARAMS_NO_DEADLINE;
+    }
+    xSemaphoreTake(s_conn_params_lock, portMAX_DELAY);
+    conn_params_tick(&s_conn_params, esp_timer_get_time());
+    int64_t deadline = conn_params_next_deadline(&s_conn_params);
+    xSemaphoreGive(s_conn_params_lock);
+    return deadline;
+}
+
+static host_slots_t s_hosts;
+static SemaphoreHandle_t s_hosts_lock = NULL;
+static uint16_t s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+
+static void gap_hosts_load(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(HOSTS_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return;
+    }
+    size_t len = sizeof(s_hosts.slots);
+    if (nvs_get_blob(nvs, "slots", s_hosts.slots, &len) != ESP_OK || len != sizeof(s_hosts.slots))
+    {
+        memset(s_hosts.slots, 0, sizeof(s_hosts.slots));
+    }
+    uint8_t active = 0;
+    if (nvs_get_u8(nvs, "active", &active) == ESP_OK && active < HOST_SLOTS_MAX)
+    {
+        s_hosts.active = active;
+    }
+    nvs_close(nvs);
+}
+
+static void gap_hosts_save(const host_slots_t *hosts)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(HOSTS_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK)
+    {
+        nvs_set_blob(nvs, "slots", hosts->slots, sizeof(hosts->slots));
+        nvs_set_u8(nvs, "active", hosts->active);
+        err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "saving host slots failed: %s", esp_err_to_name(err));
+    }
+}
+
+static int nimble_hid_gap_event(struct ble_gap_event *event, void *arg);
+
+static reconnect_t s_reconnect; // guarded by s_hosts_lock, like the slots
+static host_addr_t s_reconnect_peer;
+
+// True while NimBLE's bond store still holds keys for `peer`
+static bool gap_peer_bonded(const host_addr_t *peer)
+{
+    struct ble_store_key_sec key;
+    struct ble_store_value_sec value;
+
+    memset(&key, 0, sizeof key);
+    key.peer_addr.type = peer->type;
+    memcpy(key.peer_addr.val, peer->val, sizeof(key.peer_addr.val));
+    return ble_store_read_peer_sec(&key, &value) == 0;
+}
+
+// Bonds made before host slots existed take the free slots
+static void gap_hosts_adopt_bonds(void)
+{
+    ble_addr_t peers[HOST_SLOTS_MAX];
+    int num_peers = 0;
+    if (ble_store_util_bonded_peers(peers, &num_peers, HOST_SLOTS_MAX) != 0)
+    {
+        return;
+    }
+
+    bool changed = false;
+    xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+    for (int i = 0; i < num_peers; i++)
+    {
+        host_addr_t peer = {.type = peers[i].type};
+        memcpy(peer.val, peers[i].val, sizeof(peer.val));
+        changed |= host_slots_adopt(&s_hosts, &peer);
+    }
+    host_slots_t snapshot = s_hosts;
+    xSemaphoreGive(s_hosts_lock);
+    if (changed)
+    {
+        gap_hosts_save(&snapshot);
+    }
+}
+
+// hal_ble_t.adv_start: one reconnect stage through ble_gap_adv_start
+static int gap_adv_stage(void *ctx, const reconnect_stage_params_t *p, const host_addr_t *peer)
+{
+    int stage = (int)(p - reconnect_stage_params);
+    struct ble_gap_adv_params adv_params;
+    ble_addr_t addr;
+    int rc;
+
+    DLOGI(TAG, "reconnect stage %d", stage);
+    memset(&adv_params, 0, sizeof adv_params);
+    if (p->directed)
+    {
+        addr.type = peer->type;
+        memcpy(addr.val, peer->val, sizeof(addr.val));
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_NON;
+        adv_params.high_duty_cycle = p->high_duty;
+    }
+    else
+    {
+        rc = ble_gap_adv_set_fields(&fields);
+        if (rc != 0)
+        {
+            MODLOG_DFLT(ERROR, "error setting advertisement data; rc=%d\n", rc);
+            return rc;
+        }
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    }
+    if (!p->high_duty)
+    {
+        adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(p->itvl_min_ms);
+        adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(p->itvl_max_ms);
+    }
+    rc = ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, p->directed ? &addr : NULL, p->duration_ms,
+                           &adv_params, nimble_hid_gap_event, NULL);
+    if (rc != 0)
+    {
+        MODLOG_DFLT(ERROR, "error enabling advertisement (stage %d); rc=%d\n", stage, rc);
+    }
+    return rc;
+}
+
+static const hal_ble_t s_ble = {
+    .update_params = gap_request_conn_params,
+    .adv_start = gap_adv_stage,
+};
+
+void esp_hid_gap_get_reconnect_stats(reconnect_stats_t *stats)
+{
+    xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+    *stats = s_reconnect.stats;
+    xSemaphoreGive(s_hosts_lock);
+}
+
+static void gap_hosts_apply(host_action_t action)
+{
+    switch (action)
+    {
+    case HOST_ACTION_DISCONNECT:
+        ble_gap_terminate(s_conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+        break;
+    case HOST_ACTION_RESTART_ADV:
+        ble_gap_adv_stop();
+        xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+        reconnect_cancel(&s_reconnect);
+        xSemaphoreGive(s_hosts_lock);
+        esp_hid_ble_gap_adv_start();
+        break;
+    case HOST_ACTION_ADV_DIRECTED:
+    case HOST_ACTION_ADV_UNDIRECTED:
+        esp_hid_ble_gap_adv_start();
+        break;
+    case HOST_ACTION_NONE:
+    default:
+        break;
+    }
+}
+
+void esp_hid_gap_select_host(uint8_t slot)
+{
+    xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+    host_action_t action = host_slots_select(&s_hosts, slot);
+    host_slots_t snapshot = s_hosts;
+    xSemaphoreGive(s_hosts_lock);
+
+    DLOGI(TAG, "output host -> slot %u (%s)", slot, snapshot.slots[snapshot.active].bonded ? "bonded" : "empty");
+    if (action != HOST_ACTION_NONE)
+    {
+        gap_hosts_save(&snapshot);
+    }
+    gap_hosts_apply(action);
+}
+
+void esp_hid_gap_forget_host(uint8_t slot)
+{
+    host_addr_t peer;
+    host_action_t action;
+    xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+    bool forgotten = host_slots_forget(&s_hosts, slot, &peer, &action);
+    host_slots_t snapshot = s_hosts;
+    xSemaphoreGive(s_hosts_lock);
+
+    if (!forgotten)
+    {
+        return;
+    }
+    ble_addr_t addr = {.type = peer.type};
+    memcpy(addr.val, peer.val, sizeof(addr.val));
+    ble_store_util_delete_peer(&addr);
+    gap_hosts_save(&snapshot);
+    DLOGI(TAG, "host slot %u forgotten", slot);
+    gap_hosts_apply(action);
+}
+
 static int
 nimble_hid_gap_event(struct ble_gap_event *event, void *arg)
 {
@@ -108,78 +398,140 @@ nimble_hid_gap_event(struct ble_gap_event *event, void *arg)
     switch (event->type)
     {
     case BLE_GAP_EVENT_CONNECT:
-        printDebugLog("", "BLE_GAP_EVENT_CONNECT");
         /* A new connection was established or a connection attempt failed. */
-        ESP_LOGI(TAG, "connection %s; status=%d",
-                 event->connect.status == 0 ? "established" : "failed",
-                 event->connect.status);
+        DLOGI(TAG, "connection %s; status=%d",
+              event->connect.status == 0 ? "established" : "failed",
+              event->connect.status);
+        if (event->connect.status == 0)
+        {
+            conn_params_t granted;
+            if (gap_read_conn_params(event->connect.conn_handle, &granted))
+            {
+                xSemaphoreTake(s_conn_params_lock, portMAX_DELAY);
+                conn_params_connected(&s_conn_params, event->connect.conn_handle, &granted, esp_timer_get_time());
+                xSemaphoreGive(s_conn_params_lock);
+            }
+            hid_tx_link_up(event->connect.conn_handle);
+            s_conn_handle = event->connect.conn_handle;
+            xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+            reconnect_stage_t stage = s_reconnect.stage;
+            reconnect_connected(&s_reconnect, esp_timer_get_time());
+            int64_t reconnect_us = s_reconnect.stats.last_us;
+            host_slots_connected(&s_hosts);
+            xSemaphoreGive(s_hosts_lock);
+            if (stage != RECONNECT_IDLE)
+            {
+                DLOGI(TAG, "host connected after %" PRIu32 " ms in stage %d", (uint32_t)(reconnect_us / 1000), stage);
+            }
+        }
 
         return 0;
         break;
     case BLE_GAP_EVENT_DISCONNECT:
-        printDebugLog("", "BLE_GAP_EVENT_DISCONNECT");
-        ESP_LOGI(TAG, "disconnect; reason=%d", event->disconnect.reason);
+        DLOGI(TAG, "disconnect; reason=%d", event->disconnect.reason);
+        xSemaphoreTake(s_conn_params_lock, portMAX_DELAY);
+        conn_params_disconnected(&s_conn_params);
+        xSemaphoreGive(s_conn_params_lock);
+        hid_tx_link_down(event->disconnect.conn.conn_handle);
+        s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        // esp_hidd restarts advertising for the active slot on its DISCONNECT event
+        xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+        host_slots_disconnected(&s_hosts);
+        xSemaphoreGive(s_hosts_lock);
 
         return 0;
     case BLE_GAP_EVENT_CONN_UPDATE:
-        printDebugLog("", "BLE_GAP_EVENT_CONN_UPDATE");
         /* The central has updated the connection parameters. */
-        ESP_LOGI(TAG, "connection updated; status=%d",
-                 event->conn_update.status);
-        return 0;
-
-    case BLE_GAP_EVENT_ADV_COMPLETE:
-        printDebugLog("", "BLE_GAP_EVENT_ADV_COMPLETE");
-        ESP_LOGI(TAG, "advertise complete; reason=%d",
-                 event->adv_complete.reason);
+        DLOGI(TAG, "connection updated; status=%d",
+              event->conn_update.status);
+        {
+            conn_params_t granted = {0};
+            gap_read_conn_params(event->conn_update.conn_handle, &granted);
+            xSemaphoreTake(s_conn_params_lock, portMAX_DELAY);
+            conn_params_updated(&s_conn_params, event->conn_update.status, &granted, esp_timer_get_time());
+            DLOGI(TAG, "conn params granted itvl %u latency %u (requests %" PRIu32 ", rejected %" PRIu32 ")",
+                  granted.itvl_min, granted.latency, s_conn_params.requests, s_conn_params.rejections);
+            xSemaphoreGive(s_conn_params_lock);
+        }
         return 0;
 
     case BLE_GAP_EVENT_SUBSCRIBE:
-        printDebugLog("", "BLE_GAP_EVENT_SUBSCRIBE");
-        ESP_LOGI(TAG, "subscribe event; conn_handle=%d attr_handle=%d "
-                      "reason=%d prevn=%d curn=%d previ=%d curi=%d\n",
-                 event->subscribe.conn_handle,
-                 event->subscribe.attr_handle,
-                 event->subscribe.reason,
-                 event->subscribe.prev_notify,
-                 event->subscribe.cur_notify,
-                 event->subscribe.prev_indicate,
-                 event->subscribe.cur_indicate);
+        DLOGI(TAG, "subscribe event; conn_handle=%d attr_handle=%d "
+                   "reason=%d prevn=%d curn=%d previ=%d curi=%d",
+              event->subscribe.conn_handle,
+              event->subscribe.attr_handle,
+              event->subscribe.reason,
+              event->subscribe.prev_notify,
+              event->subscribe.cur_notify,
+              event->subscribe.prev_indicate,
+              event->subscribe.cur_indicate);
         return 0;
 
     case BLE_GAP_EVENT_MTU:
-        printDebugLog("", "BLE_GAP_EVENT_MTU");
-        ESP_LOGI(TAG, "mtu update event; conn_handle=%d cid=%d mtu=%d",
-                 event->mtu.conn_handle,
-                 event->mtu.channel_id,
-                 event->mtu.value);
+        DLOGI(TAG, "mtu update event; conn_handle=%d cid=%d mtu=%d",
+              event->mtu.conn_handle,
+              event->mtu.channel_id,
+              event->mtu.value);
         return 0;
 
     case BLE_GAP_EVENT_ENC_CHANGE:
-        printDebugLog("", "BLE_GAP_EVENT_ENC_CHANGE");
         /* Encryption has been enabled or disabled for this connection. */
-        MODLOG_DFLT(INFO, "encryption change event; status=%d ",
-                    event->enc_change.status);
-        ESP_LOGI(TAG, "ENC_CHANGE: encrypted=%d bonded=%d",
-                 desc.sec_state.encrypted,
-                 desc.sec_state.bonded);
+        DLOGI(TAG, "encryption change event; status=%d",
+              event->enc_change.status);
         rc = ble_gap_conn_find(event->enc_change.conn_handle, &desc);
         assert(rc == 0);
+        DLOGI(TAG, "ENC_CHANGE: encrypted=%d bonded=%d",
+              desc.sec_state.encrypted,
+              desc.sec_state.bonded);
+        if (event->enc_change.status == 0)
+        {
+            host_addr_t peer = {.type = desc.peer_id_addr.type};
+            memcpy(peer.val, desc.peer_id_addr.val, sizeof(peer.val));
+            bool changed;
+            xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+            host_action_t action = host_slots_encrypted(&s_hosts, &peer, desc.sec_state.bonded, &changed);
+            host_slots_t snapshot = s_hosts;
+            xSemaphoreGive(s_hosts_lock);
+            if (changed)
+            {
+                DLOGI(TAG, "host bonded to slot %u", snapshot.active);
+                gap_hosts_save(&snapshot);
+            }
+            if (action == HOST_ACTION_DISCONNECT)
+            {
+                DLOGI(TAG, "host belongs to another slot, disconnecting");
+                gap_hosts_apply(action);
+                return 0;
+            }
+        }
         ble_hid_task_start_up();
         return 0;
 
+    case BLE_GAP_EVENT_ADV_COMPLETE:
+        DLOGI(TAG, "advertise complete; reason=%d", event->adv_complete.reason);
+        if (event->adv_complete.reason == BLE_HS_ETIMEOUT)
+        {
+            // ble_gap_adv_start never calls back into this handler, so the
+            // lock can be held across the stages
+            xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+            reconnect_advance(&s_reconnect, &s_hosts);
+            reconnect_run(&s_reconnect, &s_hosts, &s_ble, &s_reconnect_peer);
+            xSemaphoreGive(s_hosts_lock);
+        }
+        return 0;
+
     case BLE_GAP_EVENT_NOTIFY_TX:
-        printDebugLog("", "BLE_GAP_EVENT_NOTIFY_TX");
-        MODLOG_DFLT(INFO, "notify_tx event; conn_handle=%d attr_handle=%d "
-                          "status=%d is_indication=%d",
-                    event->notify_tx.conn_handle,
-                    event->notify_tx.attr_handle,
-                    event->notify_tx.status,
-                    event->notify_tx.indication);
+        DLOGD(TAG, "notify_tx event; conn_handle=%d attr_handle=%d "
+                   "status=%d is_indication=%d",
+              event->notify_tx.conn_handle,
+              event->notify_tx.attr_handle,
+              event->notify_tx.status,
+              event->notify_tx.indication);
+        TRACE_POINT(TRACE_NOTIFY_TX, (uint8_t)event->notify_tx.status);
+        hid_tx_notify_complete(event->notify_tx.conn_handle, event->notify_tx.attr_handle, event->notify_tx.status);
         return 0;
 
     case BLE_GAP_EVENT_REPEAT_PAIRING:
-        printDebugLog("", "BLE_GAP_EVENT_REPEAT_PAIRING");
         /* We already have a bond with the peer, but it is attempting to
          * establish a new secure link.  This app sacrifices security for
          * convenience: just throw away the old bond and accept the new link.
@@ -197,8 +549,7 @@ nimble_hid_gap_event(struct ble_gap_event *event, void *arg)
         return BLE_GAP_REPEAT_PAIRING_IGNORE;
 
     case BLE_GAP_EVENT_PASSKEY_ACTION:
-        printDebugLog("", "BLE_GAP_EVENT_PASSKEY_ACTION");
-        ESP_LOGI(TAG, "PASSKEY_ACTION_EVENT started");
+        DLOGI(TAG, "PASSKEY_ACTION_EVENT started");
         struct ble_sm_io pkey = {0};
         int key = 0;
         const int keycode = 999999;
@@ -207,17 +558,17 @@ nimble_hid_gap_event(struct ble_gap_event *event, void *arg)
         {
             pkey.action = event->passkey.params.action;
             pkey.passkey = keycode; // This is the passkey to be entered on peer
-            ESP_LOGI(TAG, "Enter passkey %" PRIu32 " on the peer side", pkey.passkey);
+            DLOGI(TAG, "Enter passkey %" PRIu32 " on the peer side", pkey.passkey);
             rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
-            ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
+            DLOGI(TAG, "ble_sm_inject_io result: %d", rc);
         }
         else if (event->passkey.params.action == BLE_SM_IOACT_NUMCMP)
         {
-            ESP_LOGI(TAG, "Accepting passkey..");
+            DLOGI(TAG, "Accepting passkey..");
             pkey.action = event->passkey.params.action;
             pkey.numcmp_accept = key;
             rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
-            ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
+            DLOGI(TAG, "ble_sm_inject_io result: %d", rc);
         }
         else if (event->passkey.params.action == BLE_SM_IOACT_OOB)
         {
@@ -228,15 +579,15 @@ nimble_hid_gap_event(struct ble_gap_event *event, void *arg)
                 pkey.oob[i] = tem_oob[i];
             }
             rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
-            ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
+            DLOGI(TAG, "ble_sm_inject_io result: %d", rc);
         }
         else if (event->passkey.params.action == BLE_SM_IOACT_INPUT)
         {
-            ESP_LOGI(TAG, "Input not supported passing keycode");
+            DLOGI(TAG, "Input not supported passing keycode");
             pkey.action = event->passkey.params.action;
             pkey.passkey = keycode;
             rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
-            ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
+            DLOGI(TAG, "ble_sm_inject_io result: %d", rc);
         }
         return 0;
     }
@@ -244,31 +595,22 @@ nimble_hid_gap_event(struct ble_gap_event *event, void *arg)
 }
 esp_err_t esp_hid_ble_gap_adv_start(void)
 {
-    int rc;
-    struct ble_gap_adv_params adv_params;
-    /* maximum possible duration for hid device(180s) */
-    int32_t adv_duration_ms = 180000;
-
-    rc = ble_gap_adv_set_fields(&fields);
-    if (rc != 0)
-    {
-        MODLOG_DFLT(ERROR, "error setting advertisement data; rc=%d\n", rc);
-        return rc;
-    }
-    /* Begin advertising. */
-    memset(&adv_params, 0, sizeof adv_params);
-    adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
-    adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
-    adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(30); /* Recommended interval 30ms to 50ms */
-    adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(50);
-    rc = ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, adv_duration_ms,
-                           &adv_params, nimble_hid_gap_event, NULL);
-    if (rc != 0)
+    gap_hosts_adopt_bonds();
+
+    xSemaphoreTake(s_hosts_lock, portMAX_DELAY);
+    host_action_t action = host_slots_start(&s_hosts);
+    s_reconnect_peer = s_hosts.slots[s_hosts.active].addr;
+    // The slot may outlive its keys, e.g. after a repeat pairing deleted them
+    bool bonded = action == HOST_ACTION_ADV_DIRECTED && gap_peer_bonded(&s_reconnect_peer);
+    if (action == HOST_ACTION_ADV_DIRECTED && !bonded)
     {
-        MODLOG_DFLT(ERROR, "error enabling advertisement; rc=%d\n", rc);
-        return rc;
+        host_slots_adv_timeout(&s_hosts);
     }
-    return rc;
+    reconnect_begin(&s_reconnect, bonded, esp_timer_get_time());
+    reconnect_stage_t stage = reconnect_run(&s_reconnect, &s_hosts, &s_ble, &s_reconnect_peer);
+    xSemaphoreGive(s_hosts_lock);
+
+    return stage != RECONNECT_IDLE ? ESP_OK : ESP_FAIL;
 }
 
 /*
@@ -343,6 +685,32 @@ esp_err_t esp_hid_gap_init(uint8_t mode)
         return ESP_FAIL;
     }
 
+    s_conn_params_lock = xSemaphoreCreateMutex();
+    if (s_conn_params_lock == NULL)
+    {
+        ESP_LOGE(TAG, "xSemaphoreCreateMutex failed!");
+        vSemaphoreDelete(bt_hidh_cb_semaphore);
+        bt_hidh_cb_semaphore = NULL;
+        vSemaphoreDelete(ble_hidh_cb_semaphore);
+        ble_hidh_cb_semaphore = NULL;
+        return ESP_FAIL;
+    }
+    conn_params_init(&s_conn_params, &s_ble);
+
+    s_hosts_lock = xSemaphoreCreateMutex();
+    if (s_hosts_lock == NULL)
+    {
+        ESP_LOGE(TAG, "xSemaphoreCreateMutex failed!");
+        vSemaphoreDelete(bt_hidh_cb_semaphore);
+        bt_hidh_cb_semaphore = NULL;
+        vSemaphoreDelete(ble_hidh_cb_semaphore);
+        ble_hidh_cb_semaphore = NULL;
+        return ESP_FAIL;
+    }
+    host_slots_init(&s_hosts);
+    reconnect_init(&s_reconnect);
+    gap_hosts_load();
+
     ret = init_low_level(mode);
     if (ret != ESP_OK)
     {
@@ -14,6 +14,7 @@
 
 #include "esp_bt.h"
 #include "esp_hid_common.h"
+#include "reconnect.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -25,6 +26,19 @@ extern "C"
     esp_err_t esp_hid_ble_gap_adv_init(uint16_t appearance, const char *device_name);
     esp_err_t esp_hid_ble_gap_adv_start(void);
 
+    // Connection parameter policy: report input activity, and run the policy
+    // timers; the tick returns the esp_timer time it next needs to run
+    void esp_hid_gap_conn_activity(void);
+    int64_t esp_hid_gap_conn_tick(void);
+
+    // Host slots: switch output to the host bonded in `slot` (directed
+    // advertising reconnects it), or forget that host so a new one can pair
+    void esp_hid_gap_select_host(uint8_t slot);
+    void esp_hid_gap_forget_host(uint8_t slot);
+
+    // Advertising restarts in stages (see reconnect.h); how long hosts took to return
+    void esp_hid_gap_get_reconnect_stats(reconnect_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,10 +1,34 @@
 #include "global.h"
 
-QueueHandle_t button_queue;
+button_ring_t button_queue;
+TaskHandle_t button_queue_consumer = NULL;
 bool isDeviceConnected = false;
 bool canSendHIDInput = false;
+uint32_t conn_interval_us = 0;
 
 void init_queue()
 {
-    button_queue = xQueueCreate(10, sizeof(button_event_t));
+    button_ring_init(&button_queue);
+}
+
+// Push an event and wake the consumer; usable from tasks and ISRs
+bool button_queue_send(const button_event_t *evt)
+{
+    bool ok = button_ring_push(&button_queue, evt);
+    TaskHandle_t consumer = button_queue_consumer;
+    if (consumer == NULL)
+        return ok;
+
+    if (xPortInIsrContext())
+    {
+        BaseType_t hpTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(consumer, &hpTaskWoken);
+        if (hpTaskWoken)
+            portYIELD_FROM_ISR();
+    }
+    else
+    {
+        xTaskNotifyGive(consumer);
+    }
+    return ok;
 }
\ No newline at end of file
@@ -2,21 +2,24 @@
 #define GLOBAL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "spsc_ring.h"
+#include "input.h"
 
-typedef struct
-{
-    char id_char;
-    bool long_press;
-} button_event_t;
+#define BUTTON_QUEUE_LEN 64
+SPSC_RING_DEFINE(button_ring, button_event_t, BUTTON_QUEUE_LEN)
 
-extern QueueHandle_t button_queue;
+extern button_ring_t button_queue;
+extern TaskHandle_t button_queue_consumer;
 
 extern bool isDeviceConnected;
 extern bool canSendHIDInput;
+extern uint32_t conn_interval_us; // negotiated BLE connection interval, 0 until connected
 
 void init_queue();
+bool button_queue_send(const button_event_t *evt);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include "hid_tx.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "global.h"
+#include "typing.h"
+#include "macro.h"
+#include "coalesce.h"
+#include "tx_flow.h"
+#include "hid_report.h"
+#include "trace.h"
+#include "dlog.h"
+#include "esp_hid_device.h"
+
+#define HID_TX_MAX_RETRIES 5
+#define DEFAULT_CONN_INTERVAL_US 15000
+
+static const char *TAG = "HID_TX";
+
+_Static_assert(HID_TX_REPORT_MAX >= HID_REPORT_MAX_LEN, "transmit jobs hold every report");
+_Static_assert(TX_FLOW_MAX_CONNS >= CONFIG_BT_NIMBLE_MAX_CONNECTIONS, "a credit slot for every link");
+
+typedef enum
+{
+    HID_TX_JOB_REPORT,
+    HID_TX_JOB_TEXT,
+    HID_TX_JOB_MACRO,
+} hid_tx_job_kind_t;
+
+typedef struct
+{
+    hid_tx_job_kind_t kind;
+    uint32_t id;
+    int64_t enqueue_us;
+    union
+    {
+        struct
+        {
+            uint8_t report_id;
+            uint8_t len;
+            uint8_t data[HID_TX_REPORT_MAX];
+        } report;
+        const char *text;
+        struct
+        {
+            const uint8_t *code;
+            uint16_t len;
+        } macro;
+    };
+} hid_tx_job_t;
+
+static esp_hidd_dev_t *s_dev;
+static TaskHandle_t s_task;
+static QueueHandle_t s_queues[HID_TX_PRIO_COUNT];
+static uint32_t s_next_id = 1;
+static volatile uint32_t s_cancel_below; // text jobs with an id below this are dropped
+static hid_tx_stats_t s_stats; // dropped is shared with producers and counted under s_lock
+static coalesce_t s_coalesce; // only touched by the transmit task
+static tx_flow_t s_flow;      // guarded by s_lock, completions come from the NimBLE host task
+static uint16_t s_conn_handle;
+static bool s_link_up;
+static volatile uint32_t s_link_epoch; // bumped on connect and disconnect
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t hid_tx_interval_us(void)
+{
+    return conn_interval_us ? conn_interval_us : DEFAULT_CONN_INTERVAL_US;
+}
+
+// Whole ticks covering `us`, at least one
+static TickType_t hid_tx_ticks(int64_t us)
+{
+    TickType_t ticks = (us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+    return ticks ? ticks : 1;
+}
+
+// One connection interval, used to back off when the stack is out of buffers
+static TickType_t hid_tx_pace_ticks(void)
+{
+    return hid_tx_ticks(hid_tx_interval_us());
+}
+
+static void hid_tx_count_drop(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_stats.dropped++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static bool hid_tx_enqueue(hid_tx_job_t *job, hid_tx_prio_t prio)
+{
+    if (s_task == NULL)
+        return false;
+
+    portENTER_CRITICAL(&s_lock);
+    job->id = s_next_id++;
+    portEXIT_CRITICAL(&s_lock);
+    job->enqueue_us = esp_timer_get_time();
+
+    if (xQueueSend(s_queues[prio], job, 0) != pdTRUE)
+    {
+        hid_tx_count_drop();
+        return false;
+    }
+    xTaskNotifyGive(s_task);
+    return true;
+}
+
+bool hid_tx_send_report(uint8_t report_id, const uint8_t *data, uint8_t len, hid_tx_prio_t prio)
+{
+    if (len > HID_TX_REPORT_MAX)
+        return false;
+
+    hid_tx_job_t job = {.kind = HID_TX_JOB_REPORT};
+    job.report.report_id = report_id;
+    job.report.len = len;
+    memcpy(job.report.data, data, len);
+    return hid_tx_enqueue(&job, prio);
+}
+
+bool hid_tx_type_text(const char *text)
+{
+    hid_tx_job_t job = {.kind = HID_TX_JOB_TEXT, .text = text};
+    return hid_tx_enqueue(&job, HID_TX_PRIO_NORMAL);
+}
+
+bool hid_tx_run_macro(const uint8_t *code, uint16_t len)
+{
+    hid_tx_job_t job = {.kind = HID_TX_JOB_MACRO, .macro = {.code = code, .len = len}};
+    return hid_tx_enqueue(&job, HID_TX_PRIO_NORMAL);
+}
+
+void hid_tx_cancel_macros(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_cancel_below = s_next_id;
+    portEXIT_CRITICAL(&s_lock);
+    if (s_task)
+        xTaskNotifyGive(s_task);
+}
+
+void hid_tx_get_stats(hid_tx_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    stats->coalesced = s_coalesce.merged;
+    stats->duplicates = s_coalesce.duplicates;
+}
+
+void hid_tx_link_up(uint16_t conn_handle)
+{
+    portENTER_CRITICAL(&s_lock);
+    tx_flow_connected(&s_flow, conn_handle, TX_FLOW_DEFAULT_CREDITS);
+    s_conn_handle = conn_handle;
+    s_link_up = true;
+    s_link_epoch++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void hid_tx_link_down(uint16_t conn_handle)
+{
+    portENTER_CRITICAL(&s_lock);
+    tx_flow_disconnected(&s_flow, conn_handle);
+    bool ours = s_conn_handle == conn_handle;
+    if (ours)
+        s_link_up = false;
+    s_link_epoch++;
+    portEXIT_CRITICAL(&s_lock);
+    // Text still being typed must not go to whichever host connects next
+    if (ours)
+        hid_tx_cancel_macros();
+    else if (s_task)
+        xTaskNotifyGive(s_task);
+}
+
+void hid_tx_add_report_handle(uint16_t attr_handle)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool added = tx_flow_add_handle(&s_flow, attr_handle);
+    portEXIT_CRITICAL(&s_lock);
+    if (!added)
+        DLOGW(TAG, "no room for report handle %u, its completions are ignored", attr_handle);
+}
+
+void hid_tx_notify_complete(uint16_t conn_handle, uint16_t attr_handle, int status)
+{
+    portENTER_CRITICAL(&s_lock);
+    tx_flow_complete(&s_flow, conn_handle, attr_handle, status);
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Sends one report if the link has a credit left this interval; returns false to keep it pending
+static bool hid_tx_emit(uint8_t report_id, const uint8_t *data, uint8_t len, int64_t enqueue_us, void *ctx)
+{
+    if (!isDeviceConnected)
+    {
+        hid_tx_count_drop();
+        return true;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    uint16_t conn_handle = s_conn_handle;
+    bool credit = !s_link_up || tx_flow_acquire(&s_flow, conn_handle);
+    portEXIT_CRITICAL(&s_lock);
+    if (!credit)
+        return false;
+
+    int64_t latency = esp_timer_get_time() - enqueue_us;
+    s_stats.last_latency_us = latency;
+    if (latency > s_stats.max_latency_us)
+        s_stats.max_latency_us = latency;
+
+    for (int attempt = 0; attempt <= HID_TX_MAX_RETRIES; attempt++)
+    {
+        // NimBLE reports NOTIFY_TX from inside this call, so it is traced
+        // first and the lock is not held. A full mbuf pool fails the call,
+        // and waiting an interval here is the only back-off it gets.
+        TRACE_POINT(TRACE_INPUT_SET, report_id);
+        if (esp_hidd_dev_input_set(s_dev, 0, report_id, (uint8_t *)data, len) == ESP_OK)
+        {
+            s_stats.sent++;
+            return true;
+        }
+        s_stats.retries++;
+        vTaskDelay(hid_tx_pace_ticks());
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    tx_flow_cancel(&s_flow, conn_handle);
+    portEXIT_CRITICAL(&s_lock);
+
+    hid_tx_count_drop();
+    DLOGW(TAG, "report %u dropped after %d retries", report_id, HID_TX_MAX_RETRIES);
+    return true;
+}
+
+// Once per connection interval, sends the latest state of every report ID the
+// credits allow; reports put in between are merged into the pending ones.
+// True if some are still pending.
+static bool hid_tx_flush(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool due = tx_flow_due(&s_flow, s_conn_handle, esp_timer_get_time(), hid_tx_interval_us());
+    portEXIT_CRITICAL(&s_lock);
+    if (due)
+        coalesce_flush(&s_coalesce, hid_tx_emit, NULL);
+    return coalesce_pending(&s_coalesce);
+}
+
+// Sleeps until the next connection interval or a new job
+static void hid_tx_wait_interval(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    int64_t next_us = tx_flow_next_us(&s_flow, s_conn_handle);
+    portEXIT_CRITICAL(&s_lock);
+    int64_t wait_us = next_us - esp_timer_get_time();
+    ulTaskNotifyTake(pdTRUE, hid_tx_ticks(wait_us > 0 ? wait_us : 0));
+}
+
+// Folds a report into the pending state, flushing first when that would lose an edge
+static void hid_tx_output(uint8_t report_id, const uint8_t *data, uint8_t len, int64_t enqueue_us)
+{
+    coalesce_result_t result;
+    while ((result = coalesce_put(&s_coalesce, report_id, data, len, enqueue_us)) == COALESCE_CONFLICT)
+    {
+        if (hid_tx_flush())
+            hid_tx_wait_interval();
+    }
+    if (result == COALESCE_NO_SLOT)
+    {
+        // Not coalesced, it still waits for a credit of a later interval
+        while (!hid_tx_emit(report_id, data, len, enqueue_us, NULL))
+        {
+            hid_tx_wait_interval();
+            hid_tx_flush();
+        }
+    }
+}
+
+// Runs one step of the active macro; returns false once it has finished
+static bool hid_tx_macro_step(const hid_tx_job_t *job, macro_vm_t *vm, TickType_t *resume)
+{
+    macro_step_t step;
+    if (job->kind == HID_TX_JOB_TEXT)
+    {
+        if (!typing_next_report(&vm->typing, step.data))
+            return false;
+        hid_tx_output(HID_REPORT_ID_KEYBOARD, step.data, TYPING_REPORT_LEN, job->enqueue_us);
+        return true;
+    }
+
+    macro_step(vm, &step);
+    switch (step.kind)
+    {
+    case MACRO_STEP_REPORT:
+        hid_tx_output(step.report_id, step.data, step.len, job->enqueue_us);
+        return true;
+    case MACRO_STEP_CONSUMER:
+        // Applied by the button event task, whose report then takes the high priority queue
+        if (!esp_hidd_send_consumer_value(step.usage, step.pressed))
+            DLOGW(TAG, "macro %" PRIu32 ": consumer step 0x%x dropped", job->id, step.usage);
+        return true;
+    case MACRO_STEP_DELAY:
+        *resume = xTaskGetTickCount() + pdMS_TO_TICKS(step.delay_ms);
+        return true;
+    case MACRO_STEP_ERROR:
+        ESP_LOGE(TAG, "macro %" PRIu32 ": malformed bytecode", job->id);
+        return false;
+    case MACRO_STEP_DONE:
+    default:
+        return false;
+    }
+}
+
+// Sends one step of macro_cancel()
+static void hid_tx_macro_release(const macro_step_t *step)
+{
+    if (step->kind == MACRO_STEP_REPORT)
+        hid_tx_output(step->report_id, step->data, step->len, esp_timer_get_time());
+    else if (!esp_hidd_send_consumer_value(step->usage, false))
+        DLOGW(TAG, "consumer release 0x%x dropped", step->usage);
+}
+
+static void hid_tx_task(void *arg)
+{
+    hid_tx_job_t job;
+    hid_tx_job_t active_job;
+    bool active = false;
+    static macro_vm_t vm;
+    TickType_t resume = 0;
+    uint8_t buffer[TYPING_REPORT_LEN];
+    uint32_t link_epoch = 0;
+
+    while (1)
+    {
+        // A new host (or the same one after a drop) starts from all keys up
+        if (link_epoch != s_link_epoch)
+        {
+            link_epoch = s_link_epoch;
+            coalesce_reset(&s_coalesce);
+        }
+
+        // High priority reports always go first, even in the middle of a macro
+        while (xQueueReceive(s_queues[HID_TX_PRIO_HIGH], &job, 0) == pdTRUE)
+        {
+            hid_tx_output(job.report.report_id, job.report.data, job.report.len, job.enqueue_us);
+        }
+
+        if (active)
+        {
+            if (active_job.id < s_cancel_below)
+            {
+                // Leave no key, button or consumer usage stuck down on the host
+                if (active_job.kind == HID_TX_JOB_TEXT)
+                {
+                    memset(buffer, 0, sizeof(buffer));
+                    hid_tx_output(HID_REPORT_ID_KEYBOARD, buffer, TYPING_REPORT_LEN, esp_timer_get_time());
+                }
+                else
+                {
+                    macro_step_t release[MACRO_CANCEL_STEPS];
+                    int n = macro_cancel(&vm, release);
+                    for (int i = 0; i < n; i++)
+                        hid_tx_macro_release(&release[i]);
+                }
+                s_stats.cancelled++;
+                active = false;
+            }
+            else if ((int32_t)(resume - xTaskGetTickCount()) <= 0)
+            {
+                active = hid_tx_macro_step(&active_job, &vm, &resume);
+            }
+        }
+
+        // Plain reports queued so far are absorbed until a macro starts
+        while (!active && xQueueReceive(s_queues[HID_TX_PRIO_NORMAL], &job, 0) == pdTRUE)
+        {
+            if (job.kind == HID_TX_JOB_REPORT)
+            {
+                hid_tx_output(job.report.report_id, job.report.data, job.report.len, job.enqueue_us);
+                continue;
+            }
+            if (job.id < s_cancel_below)
+            {
+                s_stats.cancelled++;
+                continue;
+            }
+            active_job = job;
+            active = true;
+            resume = xTaskGetTickCount();
+            if (job.kind == HID_TX_JOB_TEXT)
+            {
+                typing_init(&vm.typing, job.text);
+            }
+            else
+            {
+                macro_init(&vm, job.macro.code, job.macro.len);
+            }
+        }
+
+        // Everything gathered above goes out together at the next interval; whatever
+        // the credits do not cover stays pending and keeps coalescing
+        if (coalesce_pending(&s_coalesce))
+        {
+            if (hid_tx_flush())
+                hid_tx_wait_interval();
+            continue;
+        }
+
+        if (active)
+        {
+            // A macro delay only parks the macro, queued reports keep flowing
+            TickType_t now = xTaskGetTickCount();
+            if ((int32_t)(resume - now) > 0)
+                ulTaskNotifyTake(pdTRUE, resume - now);
+            continue;
+        }
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+void hid_tx_start(esp_hidd_dev_t *dev)
+{
+    s_dev = dev;
+    coalesce_init(&s_coalesce);
+    tx_flow_init(&s_flow);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_MOUSE, COALESCE_RELATIVE);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_KEYBOARD, COALESCE_ABSOLUTE);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_NKRO, COALESCE_ABSOLUTE);
+    coalesce_add(&s_coalesce, HID_REPORT_ID_CONSUMER, COALESCE_ABSOLUTE);
+    for (int i = 0; i < HID_TX_PRIO_COUNT; i++)
+    {
+        s_queues[i] = xQueueCreate(HID_TX_QUEUE_LEN, sizeof(hid_tx_job_t));
+    }
+    xTaskCreate(hid_tx_task, "hid_tx", 3072, NULL, 11, &s_task);
+}
@@ -0,0 +1,57 @@
+#ifndef HID_TX_H
+#define HID_TX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_hidd.h"
+
+#define HID_TX_REPORT_MAX 16
+#define HID_TX_QUEUE_LEN 32
+
+typedef enum
+{
+    HID_TX_PRIO_HIGH,   // consumer and mouse reports, preempt text macros
+    HID_TX_PRIO_NORMAL, // keyboard reports and text macros
+    HID_TX_PRIO_COUNT,
+} hid_tx_prio_t;
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t retries;
+    uint32_t dropped;   // queue full, cancelled or not connected
+    uint32_t cancelled; // macros aborted by hid_tx_cancel_macros
+    uint32_t coalesced;  // reports folded into a pending one instead of sent
+    uint32_t duplicates; // reports that changed nothing and were skipped
+    int64_t max_latency_us;
+    int64_t last_latency_us; // enqueue to esp_hidd_dev_input_set
+} hid_tx_stats_t;
+
+// Starts the transmit task; all HID output goes through it from then on
+void hid_tx_start(esp_hidd_dev_t *dev);
+
+// Producers only enqueue; these never block and return false when the queue is full
+bool hid_tx_send_report(uint8_t report_id, const uint8_t *data, uint8_t len, hid_tx_prio_t prio);
+bool hid_tx_type_text(const char *text); // text must stay valid until typed (e.g. a literal)
+bool hid_tx_run_macro(const uint8_t *code, uint16_t len); // bytecode is read in place, see macro.h
+
+// Aborts the text or bytecode macro in flight and every macro queued so far;
+// keys, mouse buttons and consumer usages it held are released first.
+// Also done when the active link goes down.
+void hid_tx_cancel_macros(void);
+
+void hid_tx_get_stats(hid_tx_stats_t *stats);
+
+// Link events from the GAP handler. Reports are paced, not flow controlled:
+// NimBLE sends NOTIFY_TX from inside the notify call, so the link gets
+// TX_FLOW_DEFAULT_CREDITS notifications per connection interval (tx_flow.h)
+// and completions are only counted.
+void hid_tx_link_up(uint16_t conn_handle);
+void hid_tx_link_down(uint16_t conn_handle);
+void hid_tx_notify_complete(uint16_t conn_handle, uint16_t attr_handle, int status);
+
+// Value handle of an input report characteristic, from GATT registration.
+// Only NOTIFY_TX events for these handles are counted.
+void hid_tx_add_report_handle(uint16_t attr_handle);
+
+#endif
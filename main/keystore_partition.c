@@ -0,0 +1,41 @@
+#include "keystore.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+
+static const char *TAG = "KEYSTORE";
+
+esp_err_t keystore_mount(keystore_t *ks)
+{
+    static esp_partition_mmap_handle_t map_handle;
+    static const void *map_ptr;
+
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           KEYSTORE_PARTITION_SUBTYPE,
+                                                           KEYSTORE_PARTITION_LABEL);
+    if (part == NULL)
+    {
+        ESP_LOGW(TAG, "no '%s' partition", KEYSTORE_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (map_ptr == NULL)
+    {
+        esp_err_t ret = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &map_ptr, &map_handle);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "mmap failed: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    esp_err_t ret = keystore_open(ks, map_ptr, part->size);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "no valid keymap image (%s), using built-in actions", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "keymap v%u: %u layers x %u keys, %u macros",
+             ks->header->version, ks->header->num_layers, ks->header->num_keys, ks->header->num_macros);
+    return ESP_OK;
+}
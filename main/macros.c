@@ -0,0 +1,13 @@
+// Generated by tools/macroc.py from main/macros/default.macro, do not edit
+#include "macros.h"
+
+const uint8_t macro_long_press[44] = {
+    0x0A, 0x25, 0x4C, 0x6F, 0x6E, 0x67, 0x20, 0x50, 0x72, 0x65, 0x73, 0x73,
+    0x21, 0x40, 0x23, 0x24, 0x25, 0x5E, 0x26, 0x2A, 0x28, 0x29, 0x5F, 0x2B,
+    0x7B, 0x7D, 0x5B, 0x5D, 0x3A, 0x3B, 0x27, 0x22, 0x2C, 0x2E, 0x3C, 0x3E,
+    0x2F, 0x3F, 0x0A, 0x00, 0x06, 0xEA, 0x00, 0x00,
+};
+
+const uint8_t macro_select_all_copy[12] = {
+    0x04, 0x01, 0x03, 0x04, 0x05, 0x14, 0x00, 0x03, 0x06, 0x04, 0x00, 0x00,
+};
@@ -0,0 +1,10 @@
+// Generated by tools/macroc.py from main/macros/default.macro, do not edit
+#ifndef MACROS_H
+#define MACROS_H
+
+#include <stdint.h>
+
+extern const uint8_t macro_long_press[44];
+extern const uint8_t macro_select_all_copy[12];
+
+#endif
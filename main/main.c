@@ -3,10 +3,14 @@
 #include "global.h"
 #include "button.c"
 #include "dip.c"
+#include "power.h"
+#include "dlog.h"
 
 void app_main(void)
 {
+    dlog_start();
     init_queue();
+    power_init();
     dip_main();
     button_main();
     esp_hid_device_main();
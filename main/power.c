@@ -0,0 +1,51 @@
+#include "power.h"
+#include "sdkconfig.h"
+#include "driver/gpio.h"
+#include "esp_sleep.h"
+#include "esp_log.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+static const char *TAG = "POWER";
+
+esp_err_t power_init(void)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_HID_POWER_MIN_CPU_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_pm_configure failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "DFS %d-%d MHz, light sleep %s", pm_config.min_freq_mhz, pm_config.max_freq_mhz,
+             pm_config.light_sleep_enable ? "on" : "off");
+#else
+    ESP_LOGI(TAG, "power management disabled (CONFIG_PM_ENABLE)");
+#endif
+    return ESP_OK;
+}
+
+esp_err_t power_enable_gpio_wakeup(uint64_t pin_mask)
+{
+#if CONFIG_PM_ENABLE
+    for (int pin = 0; pin_mask; pin++, pin_mask >>= 1)
+    {
+        if (!(pin_mask & 1))
+            continue;
+        esp_err_t err = gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_LOW_LEVEL);
+        if (err != ESP_OK)
+            return err;
+    }
+    return esp_sleep_enable_gpio_wakeup();
+#else
+    return ESP_OK;
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Enables dynamic frequency scaling and, with tickless idle, automatic light
+// sleep. Does nothing unless the build has CONFIG_PM_ENABLE (see
+// sdkconfig.defaults.battery).
+esp_err_t power_init(void);
+
+// Lets any of the given GPIOs going low wake the chip from light sleep
+esp_err_t power_enable_gpio_wakeup(uint64_t pin_mask);
+
+#endif
@@ -0,0 +1,141 @@
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "TRACE";
+
+#if CONFIG_HID_TRACE
+
+#define TRACE_RING_LEN CONFIG_HID_TRACE_RING_LEN
+_Static_assert((TRACE_RING_LEN & (TRACE_RING_LEN - 1)) == 0, "trace ring length must be a power of two");
+
+static trace_entry_t s_ring[TRACE_RING_LEN];
+static _Atomic uint32_t s_head;
+static trace_hist_t s_hist[TRACE_POINT_COUNT];
+static int64_t s_open[TRACE_POINT_COUNT]; // oldest time at each point not yet matched by the next one
+static int64_t s_edge_us;                 // raw edge that started the path in flight
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void trace_hist_add(trace_hist_t *h, uint32_t us)
+{
+    int bucket = us ? 32 - __builtin_clz(us) : 0;
+    if (bucket >= TRACE_HIST_BUCKETS)
+        bucket = TRACE_HIST_BUCKETS - 1;
+    h->buckets[bucket]++;
+    h->count++;
+    if (us > h->max_us)
+        h->max_us = us;
+}
+
+// Producers on several tasks share the ring; a slot is claimed with one atomic add
+void trace_record(trace_point_t point, uint8_t arg)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t seq = atomic_fetch_add_explicit(&s_head, 1, memory_order_relaxed);
+    trace_entry_t *e = &s_ring[seq & (TRACE_RING_LEN - 1)];
+    e->t_us = (uint32_t)now;
+    e->point = point;
+    e->arg = arg;
+    e->seq = (uint16_t)seq;
+
+    // Input is sparse, so each point is paired with the oldest unmatched
+    // time at the point before it; coalesced reports count from the oldest edge
+    portENTER_CRITICAL_SAFE(&s_lock);
+    if (point == TRACE_RAW_EDGE)
+    {
+        if (!s_open[point])
+            s_open[point] = now;
+        if (!s_edge_us)
+            s_edge_us = now;
+    }
+    else if (s_open[point - 1])
+    {
+        trace_hist_add(&s_hist[point], (uint32_t)(now - s_open[point - 1]));
+        s_open[point - 1] = 0;
+        if (point != TRACE_NOTIFY_TX && !s_open[point])
+            s_open[point] = now;
+        if (point == TRACE_NOTIFY_TX && s_edge_us)
+        {
+            trace_hist_add(&s_hist[0], (uint32_t)(now - s_edge_us));
+            s_edge_us = 0;
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+void trace_reset(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(s_hist, 0, sizeof(s_hist));
+    memset(s_open, 0, sizeof(s_open));
+    s_edge_us = 0;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void trace_dump(void)
+{
+    trace_hist_t hist[TRACE_POINT_COUNT];
+    portENTER_CRITICAL(&s_lock);
+    memcpy(hist, s_hist, sizeof(hist));
+    portEXIT_CRITICAL(&s_lock);
+
+    for (int i = 0; i < TRACE_POINT_COUNT; i++)
+    {
+        printf("TRACE H %d %" PRIu32 " %" PRIu32, i, hist[i].count, hist[i].max_us);
+        for (int b = 0; b < TRACE_HIST_BUCKETS; b++)
+            printf(" %" PRIu32, hist[i].buckets[b]);
+        printf("\n");
+    }
+
+    uint32_t head = atomic_load_explicit(&s_head, memory_order_relaxed);
+    uint32_t n = head < TRACE_RING_LEN ? head : TRACE_RING_LEN;
+    for (uint32_t i = head - n; i != head; i++)
+    {
+        trace_entry_t e = s_ring[i & (TRACE_RING_LEN - 1)];
+        printf("TRACE E %u %" PRIu32 " %u %u\n", e.seq, e.t_us, e.point, e.arg);
+    }
+    printf("TRACE END\n");
+}
+
+static void trace_console_task(void *arg)
+{
+    while (1)
+    {
+        int c = getchar();
+        if (c == 't')
+            trace_dump();
+        else if (c == 'r')
+            trace_reset();
+        else if (c == EOF)
+            vTaskDelay(pdMS_TO_TICKS(100));
+    }
+}
+
+void trace_console_start(void)
+{
+    xTaskCreate(trace_console_task, "trace_console", 3072, NULL, 2, NULL);
+    ESP_LOGI(TAG, "latency trace on, 't' dumps, 'r' resets");
+}
+
+#else
+
+void trace_dump(void)
+{
+    ESP_LOGW(TAG, "tracing is disabled (CONFIG_HID_TRACE)");
+}
+
+void trace_reset(void)
+{
+}
+
+void trace_console_start(void)
+{
+}
+
+#endif
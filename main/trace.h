@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Points along the path of a key edge, in the order an edge passes them
+typedef enum
+{
+    TRACE_RAW_EDGE,  // scan saw the raw input change, arg = key
+    TRACE_DEBOUNCED, // debounced edge queued for the HID task, arg = key
+    TRACE_DEQUEUED,  // HID task took the event off the queue, arg = key
+    TRACE_INPUT_SET, // report handed to esp_hidd_dev_input_set, arg = report id
+    // BLE_GAP_EVENT_NOTIFY_TX, arg = status. NimBLE raises it from inside
+    // esp_hidd_dev_input_set() once the notification is queued for the
+    // controller, so INPUT_SET -> NOTIFY_TX only measures the NimBLE enqueue,
+    // not the wait for the connection event or the air time
+    TRACE_NOTIFY_TX,
+    TRACE_POINT_COUNT,
+} trace_point_t;
+
+typedef struct
+{
+    uint32_t t_us; // low 32 bits of esp_timer time
+    uint8_t point;
+    uint8_t arg;
+    uint16_t seq;
+} trace_entry_t;
+
+// log2 buckets: bucket i counts latencies in [2^(i-1), 2^i) us, the last one everything above
+#define TRACE_HIST_BUCKETS 20
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t buckets[TRACE_HIST_BUCKETS];
+} trace_hist_t;
+
+// Histogram i (1..TRACE_POINT_COUNT-1) holds the time from point i-1 to point i;
+// histogram 0 holds the whole path, raw edge to NOTIFY_TX
+#if CONFIG_HID_TRACE
+void trace_record(trace_point_t point, uint8_t arg);
+#define TRACE_POINT(point, arg) trace_record((point), (arg))
+#else
+#define TRACE_POINT(point, arg) ((void)0)
+#endif
+
+// Prints the histograms and the ring as "TRACE" lines for tools/trace_decode.py
+void trace_dump(void);
+void trace_reset(void);
+
+// Console task: 't' dumps, 'r' resets
+void trace_console_start(void);
+
+#endif
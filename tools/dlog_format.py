@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Rebuild deferred log messages printed by a CONFIG_HID_DLOG_HOST_FORMAT build.
+
+Such builds print each DLOG entry as a raw line instead of text:
+
+    DLOG <t_us> <level> <tag addr> <format addr> <argument words in hex>...
+
+The tag, the format string and %s arguments are looked up in the application
+ELF (build/<project>.elf); other lines are passed through unchanged.
+
+Usage:
+    dlog_format.py build/esp_hid_device.elf monitor.log
+    idf.py monitor | dlog_format.py build/esp_hid_device.elf -
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+LEVELS = 'NEWIDV'
+CONVERSION = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d+))?(?:hh|h|ll|l|z|j|t)?([diouxXcsp%])')
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 1 or self.data[5] != 1:
+            sys.exit('%s: not a little endian ELF32 file' % path)
+        shoff, = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.data, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            _name, sh_type, flags, addr, offset, size = struct.unpack_from('<IIIIII', self.data, shoff + i * shentsize)
+            if flags & SHF_ALLOC and sh_type != SHT_NOBITS and size:
+                self.sections.append((addr, size, offset))
+
+    def string(self, addr):
+        for start, size, offset in self.sections:
+            if start <= addr < start + size:
+                pos = offset + addr - start
+                end = self.data.find(b'\0', pos, offset + size)
+                return self.data[pos:end if end >= 0 else offset + size].decode('utf-8', 'replace')
+        return None
+
+
+def format_message(elf, fmt, args):
+    words = iter(args)
+
+    def convert(m):
+        flags, width, prec, conv = m.groups()
+        if conv == '%':
+            return '%'
+        word = next(words, 0)
+        if conv == 's':
+            value = elf.string(word)
+            return ('%' + flags + width + ('.' + prec if prec else '') + 's') % (value if value is not None else '<0x%08x>' % word)
+        if conv == 'p':
+            return '0x%08x' % word
+        if conv == 'c':
+            return ('%' + flags + width + 'c') % chr(word & 0xff)
+        if conv in 'di' and word & 0x80000000:
+            word -= 1 << 32
+        spec = '%' + flags + width + ('.' + prec if prec else '') + ('d' if conv in 'diu' else conv)
+        return spec % word
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def format_line(elf, line):
+    fields = line.split()
+    if len(fields) < 5 or fields[0] != 'DLOG':
+        return line
+    try:
+        t_us, level = int(fields[1]), int(fields[2])
+        tag_addr, fmt_addr = int(fields[3], 16), int(fields[4], 16)
+        args = [int(a, 16) for a in fields[5:]]
+    except ValueError:
+        return line
+    tag = elf.string(tag_addr) or '<0x%08x>' % tag_addr
+    fmt = elf.string(fmt_addr)
+    if fmt is None:
+        return '%s (%d) %s: <format 0x%08x not in ELF> %s' % (LEVELS[level % 6], t_us // 1000, tag, fmt_addr, ' '.join(fields[5:]))
+    return '%s (%d) %s: %s' % (LEVELS[level % 6], t_us // 1000, tag, format_message(elf, fmt, args))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf', help='application ELF the log came from')
+    parser.add_argument('log', help="console log, '-' for stdin")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    f = sys.stdin if args.log == '-' else open(args.log, errors='replace')
+    with f:
+        for line in f:
+            print(format_line(elf, line.rstrip('\r\n')), flush=True)
+
+
+if __name__ == '__main__':
+    main()
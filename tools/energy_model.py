@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Estimate average current of a build from a key event trace.
+
+The trace is a text file with one key event per line, the time in
+milliseconds first; anything after it (event kind, key) is ignored and
+'#' starts a comment:
+
+    0 down u
+    85 up u
+    4200 down c
+
+Power settings come from the build's sdkconfig (CONFIG_PM_ENABLE,
+CONFIG_FREERTOS_USE_TICKLESS_IDLE, CONFIG_BT_CTRL_MODEM_SLEEP, CPU
+frequencies, CONFIG_HID_SCAN_PARK_MS). Connection intervals follow the
+fast/idle policies in main/conn_params.c. The current figures are rough
+ESP32-S3 datasheet values; override them with --param NAME=VALUE.
+
+Usage:
+    energy_model.py trace.txt --sdkconfig sdkconfig
+    energy_model.py trace.txt --sdkconfig build/sdkconfig --battery-mah 500 --duration 3600
+"""
+
+import argparse
+import sys
+
+PARAMS = {
+    'cpu_idle_ma_240': 32.0,  # CPU idle (WAITI) with the radio in modem sleep
+    'cpu_idle_ma_160': 27.0,
+    'cpu_idle_ma_80': 22.0,
+    'cpu_idle_ma_40': 13.0,
+    'light_sleep_ma': 0.24,
+    'xtal_pu_ma': 0.8,  # main crystal kept running in light sleep as BLE sleep clock
+    'conn_event_uc': 25.0,  # radio charge of one empty connection event
+    'report_uc': 10.0,  # extra charge for a notification carrying a report
+    'wake_ms': 1.0,  # CPU awake around each connection event under light sleep
+    'fast_itvl_ms': 15.0,  # CONN_POLICY_FAST, upper end of the interval
+    'idle_itvl_ms': 50.0,  # CONN_POLICY_IDLE
+    'idle_latency': 4,
+    'idle_timeout_ms': 10000.0,  # CONN_PARAMS_IDLE_TIMEOUT_US
+}
+
+
+def read_sdkconfig(path):
+    config = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('CONFIG_') and '=' in line:
+                name, _, value = line.partition('=')
+                config[name] = value.strip('"')
+    return config
+
+
+def read_trace(path):
+    times = []
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].replace(',', ' ').split()
+            if not line:
+                continue
+            try:
+                times.append(float(line[0]))
+            except ValueError:
+                sys.exit('%s:%d: expected a time in ms' % (path, n))
+    return sorted(times)
+
+
+def cpu_idle_ma(params, mhz):
+    key = 'cpu_idle_ma_%d' % mhz
+    if key not in params:
+        sys.exit('no CPU current for %d MHz, pass --param %s=...' % (mhz, key))
+    return params[key]
+
+
+def estimate(times, duration_ms, config, params):
+    pm = config.get('CONFIG_PM_ENABLE') == 'y'
+    modem_sleep = config.get('CONFIG_BT_CTRL_MODEM_SLEEP') == 'y'
+    # BLE only lets the chip light sleep with controller modem sleep
+    light_sleep = pm and modem_sleep and config.get('CONFIG_FREERTOS_USE_TICKLESS_IDLE') == 'y'
+    max_mhz = int(config.get('CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ', 160))
+    min_mhz = int(config.get('CONFIG_HID_POWER_MIN_CPU_FREQ_MHZ', 40)) if pm else max_mhz
+    park_ms = float(config.get('CONFIG_HID_SCAN_PARK_MS', 50)) if pm else duration_ms
+
+    # Split the trace into time on the fast connection policy, time on the
+    # idle one and time the 1 ms key scan is running
+    fast_ms = scan_ms = 0.0
+    for i, t in enumerate(times):
+        gap = (times[i + 1] if i + 1 < len(times) else duration_ms) - t
+        fast_ms += min(gap, params['idle_timeout_ms'])
+        scan_ms += min(gap, park_ms)
+    if times:
+        fast_ms += min(times[0], params['idle_timeout_ms'])  # connected and fast at start
+        scan_ms += min(times[0], park_ms)
+    idle_ms = duration_ms - fast_ms
+
+    events = fast_ms / params['fast_itvl_ms'] + idle_ms / (params['idle_itvl_ms'] * (1 + params['idle_latency']))
+    radio_uc = events * params['conn_event_uc'] + len(times) * params['report_uc']
+
+    if light_sleep:
+        awake_ms = min(duration_ms, scan_ms + events * params['wake_ms'])
+        sleep_ma = params['light_sleep_ma']
+        if config.get('CONFIG_BT_CTRL_MAIN_XTAL_PU_DURING_LIGHT_SLEEP') == 'y':
+            sleep_ma += params['xtal_pu_ma']
+        cpu_uc = awake_ms * cpu_idle_ma(params, min_mhz) + (duration_ms - awake_ms) * sleep_ma
+    else:
+        awake_ms = duration_ms
+        cpu_uc = duration_ms * cpu_idle_ma(params, min_mhz)
+
+    return {
+        'pm': pm,
+        'light_sleep': light_sleep,
+        'cpu_mhz': '%d-%d' % (min_mhz, max_mhz) if pm else '%d' % max_mhz,
+        'awake_pct': 100.0 * awake_ms / duration_ms,
+        'conn_events': events,
+        'cpu_ma': cpu_uc / duration_ms,
+        'radio_ma': radio_uc / duration_ms,
+        'total_ma': (cpu_uc + radio_uc) / duration_ms,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('trace')
+    parser.add_argument('--sdkconfig', default='sdkconfig')
+    parser.add_argument('--duration', type=float, help='seconds to model, default: trace length + idle timeout')
+    parser.add_argument('--battery-mah', type=float)
+    parser.add_argument('--param', action='append', default=[], metavar='NAME=VALUE')
+    args = parser.parse_args()
+
+    params = dict(PARAMS)
+    for p in args.param:
+        name, _, value = p.partition('=')
+        if name not in params and not name.startswith('cpu_idle_ma_'):
+            sys.exit('unknown parameter %r' % name)
+        params[name] = float(value)
+
+    times = read_trace(args.trace)
+    duration_ms = args.duration * 1000 if args.duration else (times[-1] if times else 0) + params['idle_timeout_ms']
+    if duration_ms <= 0:
+        sys.exit('nothing to model')
+    times = [t for t in times if t < duration_ms]
+
+    r = estimate(times, duration_ms, read_sdkconfig(args.sdkconfig), params)
+    print('%d key events over %.1f s' % (len(times), duration_ms / 1000))
+    print('power management %s, light sleep %s, CPU %s MHz' % (
+        'on' if r['pm'] else 'off', 'on' if r['light_sleep'] else 'off', r['cpu_mhz']))
+    print('awake %.1f%%, %.0f connection events' % (r['awake_pct'], r['conn_events']))
+    print('average current %.2f mA (CPU %.2f mA, radio %.2f mA)' % (r['total_ma'], r['cpu_ma'], r['radio_ma']))
+    if args.battery_mah:
+        print('battery life %.1f h on %.0f mAh' % (args.battery_mah / r['total_ma'], args.battery_mah))
+
+
+if __name__ == '__main__':
+    main()
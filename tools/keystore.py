@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""Build and validate keymap/macro images for the 'keymap' flash partition.
+
+The layout matches components/hid_core/keystore.h. A spec is a JSON file:
+
+    {
+        "macros": "../macros/default.macro",     (optional, relative to the spec)
+        "layers": [
+            ["KEY:UP", "KEY:LCTRL+C", "CONSUMER:VOLUME_UP", "MACRO:long_press", "MO:1"],
+            ["TRNS", "TAPHOLD:LSHIFT,ESC", "MOUSE:1,20,20", "TG:2", "TRNS"],
+            ...
+        ]
+    }
+
+Every layer lists one action per key. 'NONE' leaves a key unmapped and
+'TRNS' falls through to the next active layer below. 'MO:n' activates
+layer n while held, 'TG:n' toggles it, and 'TAPHOLD:MODS,KEY' sends KEY
+when tapped and holds MODS otherwise. 'HOST:n' switches output to the host
+bonded in slot n and 'UNPAIR:n' forgets that host so a new one can pair.
+'MOVE:DIRS' moves the pointer with acceleration while held, DIRS being
+UP, DOWN, LEFT or RIGHT joined with '+' (e.g. 'MOVE:UP+LEFT'), and
+'SCROLL:DIRS' scrolls that way with momentum after release.
+
+Usage:
+    keystore.py build main/keymaps/default.json -o build/keymap.bin
+    keystore.py validate build/keymap.bin
+    parttool.py write_partition --partition-name keymap --input build/keymap.bin
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import zlib
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import macroc  # noqa: E402
+
+MAGIC = 0x534B504D
+VERSION = 1
+HEADER = struct.Struct('<IHHBBHIIII')
+ACTION = struct.Struct('<BBH')
+MACRO = struct.Struct('<IHH')
+PARTITION_SIZE = 64 * 1024
+
+ACTION_NONE = 0
+ACTION_KEY = 1
+ACTION_CONSUMER = 2
+ACTION_MACRO = 3
+ACTION_MOUSE = 4
+ACTION_TRANSPARENT = 5
+ACTION_LAYER_MOMENTARY = 6
+ACTION_LAYER_TOGGLE = 7
+ACTION_TAP_HOLD = 8
+ACTION_HOST = 9
+ACTION_MOUSE_MOVE = 10
+ACTION_SCROLL = 11
+MAX_LAYERS = 32
+MAX_HOSTS = 3  # HOST_SLOTS_MAX in main/host_slots.h
+MOVE_DIRS = {'UP': 0x01, 'DOWN': 0x02, 'LEFT': 0x04, 'RIGHT': 0x08}  # MOUSE_KEYS_* and SCROLL_*
+
+
+class SpecError(Exception):
+    pass
+
+
+def align4(n):
+    return (n + 3) & ~3
+
+
+def parse_action(text, macro_index):
+    kind, _, arg = text.partition(':')
+    kind = kind.upper()
+    try:
+        if kind == 'NONE':
+            return (ACTION_NONE, 0, 0)
+        if kind == 'KEY':
+            *mods, key = arg.split('+')
+            return (ACTION_KEY, macroc.parse_mods('+'.join(mods)) if mods else 0, macroc.parse_key(key))
+        if kind == 'CONSUMER':
+            return (ACTION_CONSUMER, 0, macroc.parse_consumer(arg))
+        if kind == 'MACRO':
+            if arg not in macro_index:
+                raise SpecError('unknown macro %r' % arg)
+            return (ACTION_MACRO, 0, macro_index[arg])
+        if kind == 'MOUSE':
+            buttons, dx, dy = arg.split(',')
+            dx = macroc.parse_int(dx, -127, 127, 'dx') & 0xFF
+            dy = macroc.parse_int(dy, -127, 127, 'dy') & 0xFF
+            return (ACTION_MOUSE, macroc.parse_int(buttons, 0, 0xFF, 'buttons'), dx | dy << 8)
+        if kind in ('MOVE', 'SCROLL'):
+            dirs = 0
+            for d in arg.upper().split('+'):
+                if d not in MOVE_DIRS:
+                    raise SpecError('%s: unknown direction %r' % (text, d))
+                dirs |= MOVE_DIRS[d]
+            return (ACTION_MOUSE_MOVE if kind == 'MOVE' else ACTION_SCROLL, 0, dirs)
+        if kind in ('TRNS', 'TRANSPARENT'):
+            return (ACTION_TRANSPARENT, 0, 0)
+        if kind == 'MO':
+            return (ACTION_LAYER_MOMENTARY, 0, macroc.parse_int(arg, 0, MAX_LAYERS - 1, 'layer'))
+        if kind == 'TG':
+            return (ACTION_LAYER_TOGGLE, 0, macroc.parse_int(arg, 0, MAX_LAYERS - 1, 'layer'))
+        if kind == 'TAPHOLD':
+            mods, key = arg.split(',')
+            return (ACTION_TAP_HOLD, macroc.parse_mods(mods), macroc.parse_key(key))
+        if kind == 'HOST':
+            return (ACTION_HOST, 0, macroc.parse_int(arg, 0, MAX_HOSTS - 1, 'host slot'))
+        if kind == 'UNPAIR':
+            return (ACTION_HOST, 1, macroc.parse_int(arg, 0, MAX_HOSTS - 1, 'host slot'))
+    except (ValueError, macroc.MacroError) as e:
+        raise SpecError('%s: %s' % (text, e))
+    raise SpecError('unknown action %r' % text)
+
+
+def build(spec, spec_dir):
+    macros = []
+    if 'macros' in spec:
+        with open(os.path.join(spec_dir, spec['macros'])) as f:
+            macros = macroc.compile_source(f.read().split('\n'))
+    macro_index = {name: i for i, (name, _) in enumerate(macros)}
+
+    layers = spec['layers']
+    if not layers or not 1 <= len(layers) <= MAX_LAYERS:
+        raise SpecError('need 1-%d layers' % MAX_LAYERS)
+    num_keys = len(layers[0])
+    if not 1 <= num_keys <= 255 or any(len(layer) != num_keys for layer in layers):
+        raise SpecError('every layer needs the same number of keys (1-255)')
+
+    keymap = b''.join(ACTION.pack(*parse_action(a, macro_index)) for layer in layers for a in layer)
+    keymap_offset = HEADER.size
+    macros_offset = align4(keymap_offset + len(keymap))
+    data_offset = macros_offset + MACRO.size * len(macros)
+
+    directory = b''
+    blobs = b''
+    for _, code in macros:
+        directory += MACRO.pack(data_offset + len(blobs), len(code), 0)
+        blobs += code
+
+    body = keymap.ljust(macros_offset - keymap_offset, b'\0') + directory + blobs
+    total = HEADER.size + len(body)
+    if total > PARTITION_SIZE:
+        raise SpecError('image is %d bytes, partition holds %d' % (total, PARTITION_SIZE))
+    header = HEADER.pack(MAGIC, VERSION, HEADER.size, len(layers), num_keys, len(macros),
+                         keymap_offset, macros_offset, total, zlib.crc32(body))
+    return header + body
+
+
+def validate(image):
+    """Mirrors keystore_open(); returns a short description or raises SpecError."""
+    if len(image) < HEADER.size:
+        raise SpecError('image too small')
+    (magic, version, header_size, num_layers, num_keys, num_macros,
+     keymap_offset, macros_offset, total, crc) = HEADER.unpack_from(image)
+    if magic != MAGIC:
+        raise SpecError('bad magic 0x%08X' % magic)
+    if version != VERSION or header_size < HEADER.size:
+        raise SpecError('unsupported version %d' % version)
+    if total > len(image) or header_size > total:
+        raise SpecError('total size %d exceeds image' % total)
+    if keymap_offset % 4 or macros_offset % 4:
+        raise SpecError('misaligned tables')
+    if keymap_offset < header_size or keymap_offset + num_layers * num_keys * ACTION.size > total:
+        raise SpecError('keymap out of bounds')
+    if macros_offset < header_size or macros_offset + num_macros * MACRO.size > total:
+        raise SpecError('macro table out of bounds')
+    for i in range(num_macros):
+        offset, length, _ = MACRO.unpack_from(image, macros_offset + i * MACRO.size)
+        if offset < header_size or offset + length > total:
+            raise SpecError('macro %d out of bounds' % i)
+    if zlib.crc32(image[header_size:total]) != crc:
+        raise SpecError('crc mismatch')
+    for i in range(num_layers * num_keys):
+        kind, _, arg1 = ACTION.unpack_from(image, keymap_offset + i * ACTION.size)
+        if kind > ACTION_SCROLL:
+            raise SpecError('key %d: unknown action type %d' % (i, kind))
+        if kind in (ACTION_LAYER_MOMENTARY, ACTION_LAYER_TOGGLE) and arg1 >= num_layers:
+            raise SpecError('key %d: layer %d does not exist' % (i, arg1))
+        if kind == ACTION_MACRO and arg1 >= num_macros:
+            raise SpecError('key %d: macro %d does not exist' % (i, arg1))
+        if kind in (ACTION_KEY, ACTION_TAP_HOLD) and arg1 > macroc.MAX_KEY:
+            raise SpecError('key %d: usage 0x%X past the keyboard reports' % (i, arg1))
+    return 'v%d: %d layers x %d keys, %d macros, %d bytes' % (version, num_layers, num_keys, num_macros, total)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='cmd', required=True)
+    p_build = sub.add_parser('build', help='build an image from a JSON spec')
+    p_build.add_argument('spec')
+    p_build.add_argument('-o', '--output', required=True)
+    p_validate = sub.add_parser('validate', help='check an existing image')
+    p_validate.add_argument('image')
+    args = parser.parse_args()
+
+    try:
+        if args.cmd == 'build':
+            with open(args.spec) as f:
+                spec = json.load(f)
+            image = build(spec, os.path.dirname(os.path.abspath(args.spec)))
+            print(validate(image))
+            with open(args.output, 'wb') as f:
+                f.write(image)
+        else:
+            with open(args.image, 'rb') as f:
+                print(validate(f.read()))
+    except (SpecError, macroc.MacroError, KeyError) as e:
+        sys.exit('error: %s' % e)
+
+
+if __name__ == '__main__':
+    main()
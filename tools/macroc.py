@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+"""Compile the macro DSL into bytecode for main/macro.c.
+
+Source format, one statement per line, '#' starts a comment:
+
+    macro NAME          start a macro, closed by 'end'
+    tap KEY             press and release a key
+    down KEY / up KEY   press or release a key
+    mods LCTRL+LSHIFT   modifiers held from now on ('mods NONE' releases them)
+    delay MS            wait MS milliseconds (0-65535)
+    consumer USAGE      tap a consumer usage (name or number)
+    mouse B DX DY W     one mouse report, B = button mask, deltas -127..127
+    repeat N ... loop   run the body N times (1-255), nests up to 4 deep; the
+                        body must send something (the VM does not yield on loop)
+    type "text"         type an ASCII string, escapes: \\n \\t \\" \\\\
+                        held keys and mods are released for the string and
+                        pressed again after it
+
+Usage:
+    macroc.py main/macros/default.macro -o main/macros.c --header main/macros.h
+    macroc.py main/macros/default.macro --bin out_dir   (one .bin per macro)
+"""
+
+import argparse
+import os
+import re
+import shlex
+import sys
+
+OP_END = 0x00
+OP_KEY_DOWN = 0x01
+OP_KEY_UP = 0x02
+OP_TAP = 0x03
+OP_MODS = 0x04
+OP_DELAY = 0x05
+OP_CONSUMER = 0x06
+OP_MOUSE = 0x07
+OP_REPEAT = 0x08
+OP_LOOP = 0x09
+OP_STRING = 0x0A
+
+MAX_DEPTH = 4
+MAX_KEY = 0x77  # HID_REPORT_NKRO_USAGES - 1 in components/hid_core/hid_report.h
+
+MODS = {
+    'NONE': 0x00,
+    'LCTRL': 0x01, 'LSHIFT': 0x02, 'LALT': 0x04, 'LGUI': 0x08,
+    'RCTRL': 0x10, 'RSHIFT': 0x20, 'RALT': 0x40, 'RGUI': 0x80,
+}
+
+KEYS = {
+    'ENTER': 0x28, 'ESC': 0x29, 'BACKSPACE': 0x2A, 'TAB': 0x2B, 'SPACE': 0x2C,
+    'MINUS': 0x2D, 'EQUAL': 0x2E, 'LBRACKET': 0x2F, 'RBRACKET': 0x30,
+    'BSLASH': 0x31, 'SEMICOLON': 0x33, 'QUOTE': 0x34, 'GRAVE': 0x35,
+    'COMMA': 0x36, 'DOT': 0x37, 'SLASH': 0x38, 'CAPSLOCK': 0x39,
+    'PRINTSCREEN': 0x46, 'SCROLLLOCK': 0x47, 'PAUSE': 0x48, 'INSERT': 0x49,
+    'HOME': 0x4A, 'PAGEUP': 0x4B, 'DELETE': 0x4C, 'END': 0x4D,
+    'PAGEDOWN': 0x4E, 'RIGHT': 0x4F, 'LEFT': 0x50, 'DOWN': 0x51, 'UP': 0x52,
+}
+KEYS.update({chr(ord('A') + i): 0x04 + i for i in range(26)})
+KEYS.update({str(i): 0x1E + i - 1 for i in range(1, 10)})
+KEYS['0'] = 0x27
+KEYS.update({'F%d' % i: 0x3A + i - 1 for i in range(1, 13)})
+
+# Usage IDs from the Consumer page, same names as HID_CONSUMER_* in components/hid_core/hid_report.h
+CONSUMER = {
+    'POWER': 48, 'RESET': 49, 'SLEEP': 50, 'MENU': 64,
+    'SELECTION': 128, 'ASSIGN_SEL': 129, 'MODE_STEP': 130, 'RECALL_LAST': 131,
+    'QUIT': 148, 'HELP': 149, 'CHANNEL_UP': 156, 'CHANNEL_DOWN': 157,
+    'PLAY': 176, 'PAUSE': 177, 'RECORD': 178, 'FAST_FORWARD': 179,
+    'REWIND': 180, 'SCAN_NEXT_TRK': 181, 'SCAN_PREV_TRK': 182, 'STOP': 183,
+    'EJECT': 184, 'RANDOM_PLAY': 185, 'SELECT_DISC': 186, 'ENTER_DISC': 187,
+    'REPEAT': 188, 'STOP_EJECT': 204, 'PLAY_PAUSE': 205, 'PLAY_SKIP': 206,
+    'VOLUME': 224, 'BALANCE': 225, 'MUTE': 226, 'BASS': 227,
+    'VOLUME_UP': 233, 'VOLUME_DOWN': 234,
+}
+
+
+class MacroError(Exception):
+    pass
+
+
+def parse_int(text, lo, hi, what):
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise MacroError('bad %s %r' % (what, text))
+    if not lo <= value <= hi:
+        raise MacroError('%s %d out of range %d..%d' % (what, value, lo, hi))
+    return value
+
+
+def parse_key(text):
+    name = text.upper()
+    if name in KEYS:
+        return KEYS[name]
+    return parse_int(text, 0, MAX_KEY, 'key')
+
+
+def parse_mods(text):
+    mask = 0
+    for part in text.upper().split('+'):
+        if part not in MODS:
+            raise MacroError('unknown modifier %r' % part)
+        mask |= MODS[part]
+    return mask
+
+
+def parse_consumer(text):
+    name = text.upper()
+    if name in CONSUMER:
+        return CONSUMER[name]
+    return parse_int(text, 1, 0x0FFF, 'consumer usage')
+
+
+def compile_source(lines):
+    """Returns an ordered list of (name, bytecode)."""
+    macros = []
+    name = None
+    code = None
+    bodies = []  # per open repeat: has its body produced a step yet
+    for lineno, raw in enumerate(lines, 1):
+        try:
+            args = shlex.split(raw, comments=True, posix=True)
+        except ValueError as e:
+            raise MacroError('line %d: %s' % (lineno, e))
+        if not args:
+            continue
+        cmd, rest = args[0].lower(), args[1:]
+        try:
+            if cmd == 'macro':
+                if name is not None:
+                    raise MacroError('macro %s is not closed' % name)
+                if len(rest) != 1 or not re.match(r'^[A-Za-z_][A-Za-z0-9_]*$', rest[0]):
+                    raise MacroError('macro needs a C identifier name')
+                name, code, bodies = rest[0], bytearray(), []
+                continue
+            if name is None:
+                raise MacroError('statement outside a macro')
+            size = len(code)
+            if cmd == 'end':
+                if bodies:
+                    raise MacroError('repeat without loop')
+                code.append(OP_END)
+                macros.append((name, bytes(code)))
+                name = None
+            elif cmd in ('tap', 'down', 'up'):
+                op = {'tap': OP_TAP, 'down': OP_KEY_DOWN, 'up': OP_KEY_UP}[cmd]
+                for key in rest:
+                    code += bytes([op, parse_key(key)])
+            elif cmd == 'mods':
+                code += bytes([OP_MODS, parse_mods(rest[0])])
+            elif cmd == 'delay':
+                ms = parse_int(rest[0], 0, 0xFFFF, 'delay')
+                code += bytes([OP_DELAY, ms & 0xFF, ms >> 8])
+            elif cmd == 'consumer':
+                usage = parse_consumer(rest[0])
+                code += bytes([OP_CONSUMER, usage & 0xFF, usage >> 8])
+            elif cmd == 'mouse':
+                if len(rest) != 4:
+                    raise MacroError('mouse takes buttons dx dy wheel')
+                buttons = parse_int(rest[0], 0, 0xFF, 'buttons')
+                deltas = [parse_int(v, -127, 127, 'delta') & 0xFF for v in rest[1:]]
+                code += bytes([OP_MOUSE, buttons] + deltas)
+            elif cmd == 'repeat':
+                if len(bodies) == MAX_DEPTH:
+                    raise MacroError('repeat nested deeper than %d' % MAX_DEPTH)
+                code += bytes([OP_REPEAT, parse_int(rest[0], 1, 255, 'repeat count')])
+                bodies.append(False)
+                continue
+            elif cmd == 'loop':
+                if not bodies:
+                    raise MacroError('loop without repeat')
+                # An empty body would spin in the VM without ever yielding
+                if not bodies.pop():
+                    raise MacroError('empty repeat body')
+                code.append(OP_LOOP)
+                continue
+            elif cmd == 'type':
+                text = ' '.join(rest).replace('\\n', '\n').replace('\\t', '\t').encode('ascii')
+                # Long strings are split into runs of at most 255 bytes
+                for i in range(0, len(text), 255):
+                    run = text[i:i + 255]
+                    code += bytes([OP_STRING, len(run)]) + run + b'\0'
+            else:
+                raise MacroError('unknown statement %r' % cmd)
+            if name is not None and len(code) > size:
+                bodies = [True] * len(bodies)
+        except (MacroError, IndexError, UnicodeEncodeError) as e:
+            raise MacroError('line %d: %s' % (lineno, e or 'missing argument'))
+    if name is not None:
+        raise MacroError('macro %s is not closed' % name)
+    return macros
+
+
+def emit_c(macros, source):
+    out = ['// Generated by tools/macroc.py from %s, do not edit' % source,
+           '#include "macros.h"', '']
+    for name, code in macros:
+        out.append('const uint8_t macro_%s[%d] = {' % (name, len(code)))
+        for i in range(0, len(code), 12):
+            out.append('    ' + ' '.join('0x%02X,' % b for b in code[i:i + 12]))
+        out.append('};')
+        out.append('')
+    return '\n'.join(out)
+
+
+def emit_header(macros, source):
+    out = ['// Generated by tools/macroc.py from %s, do not edit' % source,
+           '#ifndef MACROS_H', '#define MACROS_H', '', '#include <stdint.h>', '']
+    for name, code in macros:
+        out.append('extern const uint8_t macro_%s[%d];' % (name, len(code)))
+    out += ['', '#endif', '']
+    return '\n'.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('source')
+    parser.add_argument('-o', '--output', help='C file to write')
+    parser.add_argument('--header', help='header declaring the macros')
+    parser.add_argument('--bin', help='directory for raw .bin bytecode files')
+    args = parser.parse_args()
+
+    with open(args.source) as f:
+        lines = f.read().split('\n')
+    try:
+        macros = compile_source(lines)
+    except MacroError as e:
+        sys.exit('%s: %s' % (args.source, e))
+
+    if args.bin:
+        os.makedirs(args.bin, exist_ok=True)
+        for name, code in macros:
+            with open(os.path.join(args.bin, name + '.bin'), 'wb') as f:
+                f.write(code)
+    if args.header:
+        with open(args.header, 'w') as f:
+            f.write(emit_header(macros, os.path.relpath(args.source)))
+    text = emit_c(macros, os.path.relpath(args.source))
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text)
+    elif not args.bin:
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()
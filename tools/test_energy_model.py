@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Tests for energy_model.py: trace parsing, the connection event count and
+how the power settings move the estimate. Run by ctest from host/ or directly."""
+
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import energy_model  # noqa: E402
+
+PARAMS = energy_model.PARAMS
+NO_PM = {'CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ': '160'}
+LIGHT_SLEEP = {
+    'CONFIG_PM_ENABLE': 'y',
+    'CONFIG_BT_CTRL_MODEM_SLEEP': 'y',
+    'CONFIG_FREERTOS_USE_TICKLESS_IDLE': 'y',
+    'CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ': '160',
+    'CONFIG_HID_POWER_MIN_CPU_FREQ_MHZ': '40',
+    'CONFIG_HID_SCAN_PARK_MS': '50',
+}
+
+
+def write_temp(text):
+    f = tempfile.NamedTemporaryFile('w', suffix='.txt', delete=False)
+    f.write(text)
+    f.close()
+    return f.name
+
+
+class TraceTest(unittest.TestCase):
+    def test_read_trace(self):
+        path = write_temp('# typing\n4200 down c\n\n0 down u   # first\n85,up,u\n')
+        try:
+            self.assertEqual(energy_model.read_trace(path), [0.0, 85.0, 4200.0])
+        finally:
+            os.unlink(path)
+
+    def test_bad_time(self):
+        path = write_temp('0 down u\nsoon up u\n')
+        try:
+            with self.assertRaises(SystemExit) as e:
+                energy_model.read_trace(path)
+            self.assertIn(':2:', str(e.exception))
+        finally:
+            os.unlink(path)
+
+
+class EstimateTest(unittest.TestCase):
+    def test_connection_events(self):
+        # One key at the start: idle_timeout_ms on the fast interval, the rest idle
+        r = energy_model.estimate([0.0], 20000.0, NO_PM, PARAMS)
+        fast = PARAMS['idle_timeout_ms'] / PARAMS['fast_itvl_ms']
+        idle = (20000.0 - PARAMS['idle_timeout_ms']) / (PARAMS['idle_itvl_ms'] * (1 + PARAMS['idle_latency']))
+        self.assertAlmostEqual(r['conn_events'], fast + idle)
+        self.assertAlmostEqual(r['radio_ma'], ((fast + idle) * PARAMS['conn_event_uc'] + PARAMS['report_uc']) / 20000.0)
+
+    def test_no_pm_stays_awake(self):
+        r = energy_model.estimate([0.0, 100.0], 20000.0, NO_PM, PARAMS)
+        self.assertFalse(r['light_sleep'])
+        self.assertEqual(r['cpu_mhz'], '160')
+        self.assertAlmostEqual(r['awake_pct'], 100.0)
+        self.assertAlmostEqual(r['cpu_ma'], PARAMS['cpu_idle_ma_160'])
+
+    def test_light_sleep(self):
+        times = [0.0, 100.0, 5000.0]
+        awake = energy_model.estimate(times, 20000.0, NO_PM, PARAMS)
+        r = energy_model.estimate(times, 20000.0, LIGHT_SLEEP, PARAMS)
+        self.assertTrue(r['light_sleep'])
+        self.assertEqual(r['cpu_mhz'], '40-160')
+        # The scan parks 50 ms after each key; the CPU also wakes for connection events
+        awake_ms = 3 * 50.0 + r['conn_events'] * PARAMS['wake_ms']
+        self.assertAlmostEqual(r['awake_pct'], 100.0 * awake_ms / 20000.0)
+        self.assertLess(r['total_ma'], awake['total_ma'] / 10)
+
+        xtal = dict(LIGHT_SLEEP, CONFIG_BT_CTRL_MAIN_XTAL_PU_DURING_LIGHT_SLEEP='y')
+        r_xtal = energy_model.estimate(times, 20000.0, xtal, PARAMS)
+        sleep_ms = 20000.0 - awake_ms
+        self.assertAlmostEqual(r_xtal['cpu_ma'] - r['cpu_ma'], PARAMS['xtal_pu_ma'] * sleep_ms / 20000.0)
+
+    def test_light_sleep_needs_modem_sleep(self):
+        config = dict(LIGHT_SLEEP, CONFIG_BT_CTRL_MODEM_SLEEP='n')
+        r = energy_model.estimate([0.0], 20000.0, config, PARAMS)
+        self.assertFalse(r['light_sleep'])
+        self.assertAlmostEqual(r['cpu_ma'], PARAMS['cpu_idle_ma_40'])
+
+    def test_unknown_frequency(self):
+        config = dict(LIGHT_SLEEP, CONFIG_HID_POWER_MIN_CPU_FREQ_MHZ='10')
+        with self.assertRaises(SystemExit):
+            energy_model.estimate([0.0], 20000.0, config, PARAMS)
+
+
+class CommandLineTest(unittest.TestCase):
+    def test_repo_sdkconfig(self):
+        here = os.path.dirname(os.path.abspath(__file__))
+        trace = write_temp('0 down u\n85 up u\n4200 down c\n4300 up c\n')
+        try:
+            out = subprocess.run([sys.executable, os.path.join(here, 'energy_model.py'), trace,
+                                  '--sdkconfig', os.path.join(here, '..', 'sdkconfig'),
+                                  '--battery-mah', '500'],
+                                 capture_output=True, text=True, check=True).stdout
+        finally:
+            os.unlink(trace)
+        self.assertIn('4 key events over 14.3 s', out)
+        self.assertIn('average current', out)
+        self.assertIn('battery life', out)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Unit tests for macroc.py, run by ctest from host/ or directly."""
+
+import os
+import re
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import macroc  # noqa: E402
+
+
+def compile_one(body):
+    return macroc.compile_source(['macro m'] + body + ['end'])[0][1]
+
+
+class CompileTest(unittest.TestCase):
+    def test_statements(self):
+        code = compile_one(['mods LCTRL+LSHIFT', 'tap A', 'delay 300', 'consumer VOLUME_UP',
+                            'mouse 1 -2 3 0', 'type "ab"'])
+        self.assertEqual(code, bytes([
+            macroc.OP_MODS, 0x03,
+            macroc.OP_TAP, 0x04,
+            macroc.OP_DELAY, 0x2C, 0x01,
+            macroc.OP_CONSUMER, 233, 0,
+            macroc.OP_MOUSE, 1, 0xFE, 3, 0,
+            macroc.OP_STRING, 2, ord('a'), ord('b'), 0,
+            macroc.OP_END]))
+
+    def test_long_string_is_split(self):
+        code = compile_one(['type "%s"' % ('x' * 300)])
+        self.assertEqual(code[:2], bytes([macroc.OP_STRING, 255]))
+        self.assertEqual(code[258:260], bytes([macroc.OP_STRING, 45]))
+
+    def test_nested_repeat(self):
+        code = compile_one(['repeat 3', 'repeat 2', 'tap A', 'loop', 'loop'])
+        self.assertEqual(code, bytes([macroc.OP_REPEAT, 3, macroc.OP_REPEAT, 2, macroc.OP_TAP, 4,
+                                      macroc.OP_LOOP, macroc.OP_LOOP, macroc.OP_END]))
+
+    def test_empty_repeat_body_is_rejected(self):
+        for body in (['repeat 2', 'loop'],
+                     ['repeat 2', 'repeat 3', 'loop', 'tap A', 'loop'],
+                     ['repeat 2', 'type ""', 'loop']):
+            with self.assertRaisesRegex(macroc.MacroError, 'empty repeat body'):
+                compile_one(body)
+
+    def test_structure_errors(self):
+        for body, message in ((['repeat 2', 'tap A'], 'repeat without loop'),
+                              (['loop'], 'loop without repeat'),
+                              (['repeat 1'] * 5, 'nested deeper'),
+                              (['repeat 0', 'tap A', 'loop'], 'out of range'),
+                              (['bogus'], 'unknown statement'),
+                              (['tap 0x78'], 'key 120 out of range'),
+                              (['down 0xE0'], 'key 224 out of range')):
+            with self.assertRaisesRegex(macroc.MacroError, message):
+                compile_one(body)
+
+    def test_consumer_names_match_header(self):
+        path = os.path.join(os.path.dirname(__file__), '..', 'components', 'hid_core', 'hid_report.h')
+        with open(path) as f:
+            header = dict(re.findall(r'#define HID_CONSUMER_(\w+) (\d+)', f.read()))
+        self.assertEqual(macroc.CONSUMER, {name: int(value) for name, value in header.items()})
+
+    def test_default_macros_compile(self):
+        path = os.path.join(os.path.dirname(__file__), '..', 'main', 'macros', 'default.macro')
+        with open(path) as f:
+            self.assertTrue(macroc.compile_source(f.readlines()))
+
+
+if __name__ == '__main__':
+    unittest.main()
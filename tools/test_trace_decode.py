@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""Round-trip tests for trace_decode.py: dumps are encoded the way main/trace.c
+prints them and decoded again. Run by ctest from host/ or directly."""
+
+import io
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import trace_decode  # noqa: E402
+
+HIST_BUCKETS = 20  # TRACE_HIST_BUCKETS
+
+
+def encode_hist(latencies):
+    """trace_hist_add() over `latencies`: (count, max_us, buckets)."""
+    buckets = [0] * HIST_BUCKETS
+    for us in latencies:
+        buckets[min(us.bit_length(), HIST_BUCKETS - 1)] += 1
+    return len(latencies), max(latencies, default=0), buckets
+
+
+def encode_dump(hists, entries, prefix='I (4242) TRACE: '):
+    """trace_dump() output; hists maps stage to a latency list, entries are (seq, t_us, point, arg)."""
+    lines = []
+    for stage in range(len(trace_decode.STAGES)):
+        count, max_us, buckets = encode_hist(hists.get(stage, []))
+        lines.append('%sTRACE H %d %d %d %s' % (prefix, stage, count, max_us, ' '.join(map(str, buckets))))
+    for seq, t, point, arg in entries:
+        lines.append('%sTRACE E %d %d %d %d' % (prefix, seq, t & 0xFFFFFFFF, point, arg))
+    lines.append('%sTRACE END' % prefix)
+    return lines
+
+
+def key_presses(starts, stage_us):
+    """Ring entries for one key press per start time, each stage taking stage_us[i] us."""
+    entries = []
+    for t in starts:
+        entries.append((len(entries), t, 0, 0))
+        for point, dt in enumerate(stage_us, 1):
+            t += dt
+            entries.append((len(entries), t, point, 0))
+    return entries
+
+
+class HistogramTest(unittest.TestCase):
+    def test_round_trip(self):
+        rng = random.Random(7)
+        latencies = [rng.randint(1, 40000) for _ in range(1000)]
+        hists, _ = trace_decode.parse(encode_dump({0: latencies, 2: [5, 6, 7]}, []))
+        count, max_us, buckets = hists[0]
+        self.assertEqual(count, len(latencies))
+        self.assertEqual(max_us, max(latencies))
+        self.assertEqual(sum(buckets), len(latencies))
+        self.assertEqual(hists[2][0], 3)
+        self.assertEqual(hists[1][0], 0)
+
+        # A bucket percentile is the upper bound of the bucket holding the
+        # exact one: never below it, and less than twice it
+        exact = sorted(latencies)
+        for pct in (50, 90, 99):
+            got = trace_decode.hist_percentile(count, max_us, buckets, pct)
+            want = exact[int(len(exact) * pct / 100.0 + 0.5) - 1]
+            self.assertGreaterEqual(got, want, pct)
+            self.assertLess(got, 2 * want, pct)
+        self.assertEqual(trace_decode.hist_percentile(count, max_us, buckets, 100), max_us)
+
+    def test_bucket_edges(self):
+        # Powers of two open a new bucket, as 32 - __builtin_clz() does
+        for us, bucket in ((0, 0), (1, 1), (2, 2), (3, 2), (4, 3), (1023, 10), (1024, 11)):
+            self.assertEqual(encode_hist([us])[2].index(1), bucket, us)
+        # The last bucket takes everything above its lower bound
+        count, max_us, buckets = encode_hist([1 << 25])
+        self.assertEqual(buckets[-1], 1)
+        self.assertEqual(trace_decode.hist_percentile(count, max_us, buckets, 50), 1 << 25)
+
+    def test_last_complete_dump_wins(self):
+        first = encode_dump({0: [100] * 10}, [])
+        second = encode_dump({0: [3000] * 4}, [])
+        cut = encode_dump({0: [9] * 99}, [])[:-1]  # no END: still being printed
+        noise = ['I (10) HID_TX: unrelated', 'TRACE H 0 5', 'TRACE E x y z w']
+        hists, _ = trace_decode.parse(first + noise + second + cut)
+        self.assertEqual(hists[0][0], 4)
+        self.assertEqual(hists[0][1], 3000)
+
+
+class RingTest(unittest.TestCase):
+    STAGE_US = [5000, 120, 800, 7500]  # debounce, queue, task, stack
+
+    def test_pairing_matches_device(self):
+        entries = key_presses([0, 100000, 250000], self.STAGE_US)
+        _, parsed = trace_decode.parse(encode_dump({}, entries))
+        samples = trace_decode.pair_entries(parsed)
+        self.assertEqual(samples[0], [sum(self.STAGE_US)] * 3)
+        for i, dt in enumerate(self.STAGE_US, 1):
+            self.assertEqual(samples[i], [dt] * 3)
+
+    def test_timer_wrap(self):
+        # t_us keeps the low 32 bits; a press across the wrap still pairs
+        start = (1 << 32) - 6000
+        entries = key_presses([start], self.STAGE_US)
+        _, parsed = trace_decode.parse(encode_dump({}, entries))
+        self.assertLess(parsed[4][1], parsed[3][1])
+        samples = trace_decode.pair_entries(parsed)
+        self.assertEqual(samples[0], [sum(self.STAGE_US)])
+        self.assertEqual(samples[4], [self.STAGE_US[3]])
+
+    def test_report_table(self):
+        entries = key_presses([i * 50000 for i in range(20)], self.STAGE_US)
+        hists = {0: [sum(self.STAGE_US)] * 20}
+        for i, dt in enumerate(self.STAGE_US, 1):
+            hists[i] = [dt] * 20
+        with tempfile.NamedTemporaryFile('w', suffix='.log', delete=False) as f:
+            f.write('\n'.join(encode_dump(hists, entries)) + '\n')
+        try:
+            out = subprocess.run([sys.executable, trace_decode.__file__, f.name], check=True,
+                                 stdout=subprocess.PIPE, universal_newlines=True).stdout
+        finally:
+            os.unlink(f.name)
+        rows = {line[:28].strip(): line[28:].split() for line in out.splitlines()[1:]}
+        total = rows[trace_decode.STAGES[0]]
+        # count, p50 (bucket bound of 13420 is 16384, capped at max), p99, max
+        self.assertEqual(total[:4], ['20', '13420', '13420', '13420'])
+        self.assertEqual(total[4], '13420/13420')
+        stack = rows[trace_decode.STAGES[4]]
+        self.assertEqual(stack[:4], ['20', '7500', '7500', '7500'])
+
+    def test_empty_log(self):
+        hists, entries = trace_decode.parse(io.StringIO('no trace here\n'))
+        self.assertEqual((hists, entries), ({}, []))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""Decode key latency traces dumped by main/trace.c.
+
+Build with CONFIG_HID_TRACE, press 't' on the console and save the output
+(idf.py monitor | tee trace.log). The last dump in the log is decoded:
+per-stage p50/p99 are taken from the device histograms (bucket upper
+bounds, so they round up to a power of two) and, where the ring still holds
+the trace points, computed exactly by pairing points the way the device does.
+
+Usage:
+    trace_decode.py trace.log
+    idf.py monitor | trace_decode.py -
+"""
+
+import argparse
+import sys
+
+# notify_tx fires inside input_set, so the last stage is the NimBLE enqueue (main/trace.h)
+POINTS = ['raw_edge', 'debounced', 'dequeued', 'input_set', 'notify_tx']
+STAGES = ['total (edge -> notify)'] + ['%s -> %s' % (POINTS[i - 1], POINTS[i]) for i in range(1, len(POINTS))]
+
+
+def parse(lines):
+    hists, entries = {}, []
+    cur_hists, cur_entries = {}, []
+    for line in lines:
+        if 'TRACE ' not in line:
+            continue
+        fields = line[line.index('TRACE ') + 6:].split()
+        if not fields:
+            continue
+        try:
+            if fields[0] == 'H':
+                stage, count, max_us = int(fields[1]), int(fields[2]), int(fields[3])
+                cur_hists[stage] = (count, max_us, [int(b) for b in fields[4:]])
+            elif fields[0] == 'E':
+                cur_entries.append([int(f) for f in fields[1:5]])
+            elif fields[0] == 'END':
+                hists, entries = cur_hists, cur_entries
+                cur_hists, cur_entries = {}, []
+        except (IndexError, ValueError):
+            continue  # a line cut short by other console output
+    return hists, entries
+
+
+def hist_percentile(count, max_us, buckets, pct):
+    target = count * pct / 100.0
+    seen = 0
+    for i, n in enumerate(buckets):
+        seen += n
+        if n and seen >= target:
+            return min(1 << i, max_us) if i < len(buckets) - 1 else max_us
+    return max_us
+
+
+def pair_entries(entries):
+    """Same pairing as trace_record(): each point closes the oldest open time of the point before it."""
+    samples = [[] for _ in STAGES]
+    opened = [None] * len(POINTS)
+    edge = None
+    last_t = None
+    wrap = 0
+    for _seq, t, point, _arg in entries:
+        if last_t is not None and t < last_t:
+            wrap += 1 << 32  # t_us holds the low 32 bits of esp_timer time
+        last_t = t
+        t += wrap
+        if point >= len(POINTS):
+            continue
+        if point == 0:
+            opened[0] = opened[0] if opened[0] is not None else t
+            edge = edge if edge is not None else t
+        elif opened[point - 1] is not None:
+            samples[point].append(t - opened[point - 1])
+            opened[point - 1] = None
+            if point == len(POINTS) - 1:
+                if edge is not None:
+                    samples[0].append(t - edge)
+                    edge = None
+            elif opened[point] is None:
+                opened[point] = t
+    return samples
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    k = max(0, min(len(values) - 1, int(round(pct / 100.0 * len(values) + 0.5)) - 1))
+    return values[k]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('log', help="console log, '-' for stdin")
+    args = parser.parse_args()
+
+    f = sys.stdin if args.log == '-' else open(args.log, errors='replace')
+    with f:
+        hists, entries = parse(f)
+    if not hists and not entries:
+        sys.exit('no complete TRACE dump found')
+
+    samples = pair_entries(entries)
+    print('%-28s %8s %9s %9s %9s   %s' % ('stage', 'count', 'p50 us', 'p99 us', 'max us', 'from ring (p50/p99)'))
+    for i, name in enumerate(STAGES):
+        count, max_us, buckets = hists.get(i, (0, 0, []))
+        if count:
+            p50 = hist_percentile(count, max_us, buckets, 50)
+            p99 = hist_percentile(count, max_us, buckets, 99)
+            row = '%-28s %8d %9d %9d %9d' % (name, count, p50, p99, max_us)
+        else:
+            row = '%-28s %8d %9s %9s %9s' % (name, 0, '-', '-', '-')
+        if samples[i]:
+            row += '   %d/%d (%d samples)' % (percentile(samples[i], 50), percentile(samples[i], 99), len(samples[i]))
+        print(row)
+
+
+if __name__ == '__main__':
+    main()